@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include "components/TransformManager.h"
+
+#include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
+
+#include <vector>
+#include <random>
+
+using namespace filament;
+using namespace filament::math;
+using namespace utils;
+
+// state.range(0): number of nodes
+// state.range(1): 0 = single threaded, 1 = uses the JobSystem
+// parentOf(i) returns the index of the parent of node i (which must be < i), or -1
+template<typename P, typename U>
+static void runTransformManager(benchmark::State& state, P parentOf, U update) {
+    JobSystem js;
+    js.adopt();
+
+    {
+        FTransformManager tcm;
+        if (state.range(1)) {
+            tcm.init(js);
+        }
+
+        std::vector<Entity> entities(size_t(state.range(0)));
+        EntityManager::get().create(entities.size(), entities.data());
+        for (size_t i = 0, c = entities.size(); i < c; i++) {
+            const ssize_t p = parentOf(i);
+            tcm.create(entities[i], p < 0 ? TransformManager::Instance{} :
+                    tcm.getInstance(entities[p]), mat4f::translation(float3{ 0, 1, 0 }));
+        }
+
+        // the first commit sorts the hierarchy by depth
+        tcm.openLocalTransformTransaction();
+        tcm.commitLocalTransformTransaction();
+
+        {
+            PerformanceCounters pc(state);
+            for (auto _ : state) {
+                tcm.openLocalTransformTransaction();
+                update(tcm, entities);
+                tcm.commitLocalTransformTransaction();
+            }
+            benchmark::ClobberMemory();
+            pc.stop();
+            state.SetItemsProcessed(state.iterations() * entities.size());
+        }
+
+        EntityManager::get().destroy(entities.size(), entities.data());
+    }
+
+    js.emancipate();
+}
+
+static void updateAll(FTransformManager& tcm, std::vector<Entity> const& entities) {
+    for (Entity e : entities) {
+        tcm.setTransform(tcm.getInstance(e), mat4f::translation(float3{ 0, 1, 0 }));
+    }
+}
+
+static void BM_TransformManagerDeepChains(benchmark::State& state) {
+    // chains of 300 nodes
+    runTransformManager(state, [](size_t i) { return (i % 300) ? ssize_t(i - 1) : -1; },
+            updateAll);
+}
+
+static void BM_TransformManagerWideTree(benchmark::State& state) {
+    // a single root with all other nodes as its children
+    runTransformManager(state, [](size_t i) { return i ? 0 : -1; },
+            updateAll);
+}
+
+static void BM_TransformManagerRandomUpdates(benchmark::State& state) {
+    // random hierarchy with about one root per 64 nodes, and 1/8th of the nodes updated
+    std::default_random_engine gen; // NOLINT
+    runTransformManager(state,
+            [&gen](size_t i) { return (i && (gen() % 64)) ? ssize_t(gen() % i) : -1; },
+            [&gen](FTransformManager& tcm, std::vector<Entity> const& entities) {
+                for (size_t i = 0, c = entities.size() / 8; i < c; i++) {
+                    tcm.setTransform(tcm.getInstance(entities[gen() % entities.size()]),
+                            mat4f::translation(float3{ 0, 1, 0 }));
+                }
+            });
+}
+
+BENCHMARK(BM_TransformManagerDeepChains)->Args({ 30000, 0 })->Args({ 30000, 1 });
+BENCHMARK(BM_TransformManagerWideTree)->Args({ 30000, 0 })->Args({ 30000, 1 });
+BENCHMARK(BM_TransformManagerRandomUpdates)->Args({ 30000, 0 })->Args({ 30000, 1 });
@@ -24,6 +24,9 @@
 namespace utils {
 class Entity;
 class JobSystem;
+namespace io {
+class ostream;
+} // namespace io
 } // namespace utils
 
 namespace filament {
@@ -489,6 +492,30 @@ public:
 
     DebugRegistry& getDebugRegistry() noexcept;
 
+    /**
+     * Enables or disables the trace recorder, which records the SYSTRACE scopes of all threads
+     * (except on Android, where they go to atrace) as well as the JobSystem activity: jobs,
+     * steals and waits. Recording is disabled by default and costs almost nothing when
+     * disabled.
+     *
+     * @note The trace recorder is shared by all Engine instances of the process.
+     */
+    void setTraceRecordingEnabled(bool enabled) noexcept;
+
+    /**
+     * @return Whether the trace recorder is enabled.
+     */
+    bool isTraceRecordingEnabled() const noexcept;
+
+    /**
+     * Writes the events held by the trace recorder as Chrome trace-event JSON, which can be
+     * loaded in chrome://tracing or ui.perfetto.dev. Only the most recent events of each
+     * thread are kept. This can be called while recording is enabled.
+     *
+     * @param out stream the JSON is written to, e.g. a utils::io::sstream.
+     */
+    void dumpTrace(utils::io::ostream& out) const noexcept;
+
 protected:
     //! \privatesection
     Engine() noexcept = default;
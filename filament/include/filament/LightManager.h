@@ -309,6 +309,16 @@ public:
          */
         float maxShadowDistance = 0.3;
 
+        /**
+         * Whether the shadow map of a spot light is sized from how much of the screen the
+         * light's influence covers. mapSize is then the largest size used, and the shadow map
+         * can shrink down to 32x32 texels when the light is far away, which saves memory and
+         * rendering time at the expense of resolution.
+         * This parameter is ignored for directional lights.
+         * (off by default)
+         */
+        bool screenSizedShadowMap = false;
+
         /**
          * Options available when the View's ShadowType is set to VSM.
          *
@@ -224,6 +224,26 @@ public:
      */
     void render(View const* view);
 
+    /**
+     * Render several Views into this renderer's window, in order.
+     *
+     * This is equivalent to calling render() for each View, except that the Scenes are
+     * prepared once for all the Views that share them, rather than once per View, and that
+     * several Scenes are prepared in parallel. This is more efficient when many Views of the
+     * same Scene are rendered each frame, for instance when capturing a cubemap. The Views
+     * themselves are still culled and recorded one after the other.
+     *
+     * @param views An array of pointers to the views to render.
+     * @param count Number of views in the array.
+     *
+     * @attention
+     * render() must be called *after* beginFrame() and *before* endFrame().
+     *
+     * @see
+     * render(View const*)
+     */
+    void render(View const* const* views, size_t count);
+
     /**
      * Flags used to configure the behavior of copyFrame().
      *
@@ -487,7 +487,8 @@ public:
      * The reflections cubemap's dimension must be a power-of-two.
      *
      * @warning This operation is computationally intensive, especially with large environments and
-     *          is currently synchronous. Expect about 1ms for a 16x16 cubemap.
+     *          is synchronous. Expect about 1ms for a 16x16 cubemap.
+     *          See generatePrefilterMipmapAsync() for an asynchronous version.
      *
      * @param engine        Reference to the filament::Engine to associate this IndirectLight with.
      * @param buffer        Client-side buffer containing the images to set.
@@ -501,6 +502,43 @@ public:
     void generatePrefilterMipmap(Engine& engine,
             PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
             PrefilterOptions const* options = nullptr);
+
+    /**
+     * Callback used with generatePrefilterMipmapAsync(), it's called from the thread calling
+     * Renderer::beginFrame(), once all the levels of the reflections cubemap have been uploaded.
+     */
+    using PrefilterCallback = void(*)(Texture* texture, void* user);
+
+    /**
+     * Same as generatePrefilterMipmap(), but the processing is done by low-priority jobs and
+     * this call doesn't block while it happens.
+     *
+     * The source data is copied before this call returns. All the levels of the texture are
+     * first set with an approximation of the reflections, so that the texture is usable right
+     * away at a reduced quality. The levels are then replaced with their prefiltered content as
+     * it becomes available, starting with the lowest roughness. Uploads happen during
+     * Renderer::beginFrame().
+     *
+     * Calling this function again, or destroying the texture, cancels a prefiltering that is
+     * still in flight, and its callback isn't called. This doesn't wait for the prefiltering
+     * to stop, which happens in the background once the level being filtered is done.
+     *
+     * @param engine        Reference to the filament::Engine to associate this IndirectLight with.
+     * @param buffer        Client-side buffer containing the images to set.
+     * @param faceOffsets   Offsets in bytes into \p buffer for all six images. The offsets
+     *                      are specified in the following order: +x, -x, +y, -y, +z, -z
+     * @param options       Optional parameter to controlling user-specified quality and options.
+     * @param callback      Optional callback called once all levels have been uploaded.
+     * @param user          A user provided pointer that is given back to callback unmodified.
+     *
+     * @exception utils::PreConditionPanic if the source data constraints are not respected.
+     *
+     * @see generatePrefilterMipmap()
+     */
+    void generatePrefilterMipmapAsync(Engine& engine,
+            PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
+            PrefilterOptions const* options = nullptr,
+            PrefilterCallback callback = nullptr, void* user = nullptr);
 };
 
 } // namespace filament
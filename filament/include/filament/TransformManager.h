@@ -202,6 +202,36 @@ public:
      */
     void setTransform(Instance ci, const math::mat4f& localTransform) noexcept;
 
+    /**
+     * Sets the local transforms of several transform components at once.
+     *
+     * Unlike setTransform(), this doesn't update the world transforms of the given components
+     * and their descendants immediately. Instead, they're updated lazily, once per frame, before
+     * the scene is prepared for rendering or when updateWorldTransforms() is called.
+     * Each component is visited only once, regardless of how many of its ancestors changed.
+     *
+     * @param instances         Array of instances of the transform components to update.
+     * @param localTransforms   Array of local transforms (i.e. relative to the parent), one for
+     *                          each instance.
+     * @param count             Number of elements in both arrays.
+     * @see setTransform(), updateWorldTransforms()
+     */
+    void setTransforms(Instance const* instances,
+            const math::mat4f* localTransforms, size_t count) noexcept;
+
+    /**
+     * Updates the world transforms that are out of date because of setTransforms().
+     * When this returns, calls to getWorldTransform() will return the proper value.
+     *
+     * This is called automatically by the Renderer, so it only needs to be called when
+     * world transforms are needed before the next frame is rendered.
+     *
+     * @note This is a no-op if there are no pending transforms, or during a local transform
+     *       transaction (see commitLocalTransformTransaction()).
+     * @see setTransforms()
+     */
+    void updateWorldTransforms() noexcept;
+
     /**
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
@@ -295,6 +295,15 @@ public:
         uint8_t anisotropy = 0;
     };
 
+    /**
+     * Shadow map cache statistics of the last frame.
+     * @see setShadowMapCachingEnabled()
+     */
+    struct ShadowMapCacheStats {
+        uint32_t hits = 0;      //!< number of shadow maps reused from a previous frame
+        uint32_t misses = 0;    //!< number of shadow maps rendered
+    };
+
     /**
      * Sets the View's name. Only useful for debugging.
      * @param name Pointer to the View's name. The string is copied.
@@ -740,6 +749,40 @@ public:
      */
     VsmShadowOptions getVsmShadowOptions() const noexcept;
 
+    /**
+     * Enables or disables shadow map caching. Disabled by default.
+     *
+     * When enabled, a shadow map is only rendered again when its light, its light-space
+     * transform, or the set, world transforms or morph weights of its shadow casters changed.
+     * Otherwise the shadow map rendered during a previous frame is reused. Shadow maps with
+     * skinned casters are always rendered.
+     *
+     * Other changes to the shadow casters, such as their geometry or their materials, are not
+     * detected. Disable caching for the frames during which such changes happen.
+     *
+     * @param enabled true to enable shadow map caching, false otherwise.
+     *
+     * @see getShadowMapCacheStats
+     *
+     * @warning This API is still experimental and subject to change.
+     */
+    void setShadowMapCachingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether shadow map caching is enabled.
+     * See setShadowMapCachingEnabled() for more information.
+     */
+    bool isShadowMapCachingEnabled() const noexcept;
+
+    /**
+     * Returns how many shadow maps were reused or rendered during the last frame.
+     *
+     * @return the shadow map cache statistics of the last time this View was rendered.
+     *
+     * @see setShadowMapCachingEnabled
+     */
+    ShadowMapCacheStats getShadowMapCacheStats() const noexcept;
+
     /**
      * Enables or disables post processing. Enabled by default.
      *
@@ -784,6 +827,29 @@ public:
      */
     bool isFrontFaceWindingInverted() const noexcept;
 
+    /**
+     * Enables or disables pipelined frame preparation. Disabled by default.
+     *
+     * When enabled, the renderables and lights of the Scene (world transforms, bounding boxes,
+     * visibility, light positions and directions) are gathered for the next frame on the
+     * JobSystem while the passes of the current frame are being recorded, which takes that
+     * work off the critical path.
+     *
+     * This adds one frame of latency: changes made to transforms, renderables or lights
+     * between two frames are rendered one frame later. Adding or removing entities or
+     * components, and moving the camera, still take effect immediately. What was gathered is
+     * discarded if this View isn't rendered during the next frame.
+     *
+     * @param enabled true to enable pipelined frame preparation, false otherwise.
+     */
+    void setFramePipeliningEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether pipelined frame preparation is enabled.
+     * See setFramePipeliningEnabled() for more information.
+     */
+    bool isFramePipeliningEnabled() const noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable frustum culling. (culling enabled by default).
@@ -44,8 +44,13 @@
 #include <utils/Log.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
+#include <utils/TraceRecorder.h>
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #include "generated/resources/materials.h"
 
@@ -160,6 +165,27 @@ static constexpr float4 sFullScreenTriangleVertices[3] = {
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
+// The EntityManager is shared by all engines. While at least one engine exists, its listeners
+// are notified in batches, from FEngine::gc(), rather than from each destroy() call.
+static std::mutex sEntityNotificationsLock;
+static uint32_t sEntityNotificationsEngineCount = 0;
+
+static void deferEntityNotifications(EntityManager& em, bool defer) noexcept {
+    std::lock_guard<std::mutex> lock(sEntityNotificationsLock);
+    if (defer) {
+        if (sEntityNotificationsEngineCount++ == 0) {
+            em.setDeferredListenerNotifications(true);
+        }
+    } else {
+        if (--sEntityNotificationsEngineCount == 0) {
+            // this also notifies the listeners of the pending entities
+            em.setDeferredListenerNotifications(false);
+        } else {
+            em.notifyListeners();
+        }
+    }
+}
+
 FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
         mBackend(backend),
         mPlatform(platform),
@@ -180,6 +206,8 @@ FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
     // (it may not be the case)
     mJobSystem.adopt();
 
+    deferEntityNotifications(mEntityManager, true);
+
     slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << this << " "
            << "(threading is " << (UTILS_HAS_THREADING ? "enabled)" : "disabled)") << io::endl;
 }
@@ -249,6 +277,7 @@ void FEngine::init() {
                     .build(*const_cast<FEngine*>(this)));
 
     mPostProcessManager.init();
+    mTransformManager.init(mJobSystem);
     mLightManager.init(*this);
     mDFG = std::make_unique<DFG>(*this);
 }
@@ -328,6 +357,11 @@ void FEngine::shutdown() {
     }
     cleanupResourceList(mFences);
 
+    // the textures have canceled their prefiltering, wait for the jobs still finishing a level
+    if (mPrefilterParentJob) {
+        mJobSystem.runAndWait(mPrefilterParentJob);
+    }
+
     /*
      * Shutdown the backend...
      */
@@ -358,6 +392,9 @@ void FEngine::shutdown() {
     // detach this thread from the jobsystem
     mJobSystem.emancipate();
 
+    // don't leave entities destroyed since the last gc() without notifications
+    deferEntityNotifications(mEntityManager, false);
+
     mTerminated = true;
 }
 
@@ -377,11 +414,52 @@ void FEngine::prepare() {
     for (const auto& material : mMaterials) {
         material->getDefaultInstance()->commit(driver);
     }
+
+    // Upload the environments prefiltered in the background. Callbacks are called last, since
+    // they're allowed to destroy textures.
+    if (UTILS_UNLIKELY(!mPrefilteringTextures.empty())) {
+        auto pos = std::partition(mPrefilteringTextures.begin(), mPrefilteringTextures.end(),
+                [this](FTexture* texture) { return !texture->updatePrefilter(*this); });
+        std::vector<std::pair<FTexture*, std::pair<Texture::PrefilterCallback, void*>>> done;
+        for (auto it = pos; it != mPrefilteringTextures.end(); ++it) {
+            done.emplace_back(*it, (*it)->finishPrefilter(*this));
+        }
+        mPrefilteringTextures.erase(pos, mPrefilteringTextures.end());
+        for (auto const& [texture, callback] : done) {
+            if (callback.first) {
+                callback.first(texture, callback.second);
+            }
+        }
+    }
+}
+
+void FEngine::addPrefilteringTexture(FTexture* texture) {
+    mPrefilteringTextures.push_back(texture);
+}
+
+void FEngine::removePrefilteringTexture(FTexture* texture) noexcept {
+    auto pos = std::find(mPrefilteringTextures.begin(), mPrefilteringTextures.end(), texture);
+    if (pos != mPrefilteringTextures.end()) {
+        mPrefilteringTextures.erase(pos);
+    }
+}
+
+JobSystem::Job* FEngine::getPrefilterParentJob() noexcept {
+    if (!mPrefilterParentJob) {
+        // This is only called outside of FRenderer::render(), so there is no root job and
+        // this job doesn't have a parent. It's only run when the engine shuts down.
+        mPrefilterParentJob = mJobSystem.createJob();
+    }
+    return mPrefilterParentJob;
 }
 
 void FEngine::gc() {
     // Note: this runs in a Job
 
+    // let the EntityManager listeners know about the entities destroyed since the last time
+    // (see deferEntityNotifications())
+    mEntityManager.notifyListeners();
+
     JobSystem& js = mJobSystem;
     auto *parent = js.createJob();
     auto em = std::ref(mEntityManager);
@@ -1025,6 +1103,18 @@ DebugRegistry& Engine::getDebugRegistry() noexcept {
     return upcast(this)->getDebugRegistry();
 }
 
+void Engine::setTraceRecordingEnabled(bool enabled) noexcept {
+    TraceRecorder::setEnabled(enabled);
+}
+
+bool Engine::isTraceRecordingEnabled() const noexcept {
+    return TraceRecorder::isEnabled();
+}
+
+void Engine::dumpTrace(utils::io::ostream& out) const noexcept {
+    TraceRecorder::dump(out);
+}
+
 Camera* Engine::createCamera() noexcept {
     return createCamera(upcast(this)->getEntityManager().create());
 }
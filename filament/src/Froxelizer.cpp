@@ -85,10 +85,24 @@ static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
         "RecordBuffer cannot be larger than 65536 entries");
 
 Froxelizer::Froxelizer(FEngine& engine)
-        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
+        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE +
+                sizeof(FroxelThreadData) * GROUP_COUNT + CACHELINE_SIZE +
+                sizeof(LightParams) * CONFIG_MAX_LIGHT_COUNT) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
+    // Froxel thread data and light parameters are kept across frames (~256 KiB), they're
+    // allocated first so they're not affected by rewinding the arena in update().
+    mFroxelShardedData = {
+            mArena.alloc<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
+            uint32_t(GROUP_COUNT) };
+    mLightParams = {
+            mArena.alloc<LightParams>(CONFIG_MAX_LIGHT_COUNT),
+            uint32_t(CONFIG_MAX_LIGHT_COUNT) };
+
+    assert(mFroxelShardedData.begin());
+    assert(mLightParams.begin());
+
     // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
@@ -105,6 +119,8 @@ void Froxelizer::terminate(DriverApi& driverApi) noexcept {
     // call reset() on our LinearAllocator arenas
     mArena.reset();
 
+    mLightParams.clear();
+    mFroxelShardedData.clear();
     mBoundingSpheres = nullptr;
     mPlanesY = nullptr;
     mPlanesX = nullptr;
@@ -140,15 +156,22 @@ void Froxelizer::setProjection(const mat4f& projection, float near, float far) n
 
 bool Froxelizer::prepare(
         FEngine::DriverApi& driverApi, ArenaScope& arena, filament::Viewport const& viewport,
-        const mat4f& projection, float projectionNear, float projectionFar) noexcept {
+        CameraInfo const& camera, FLightManager const& lcm,
+        const FScene::LightSoa& lightData) noexcept {
     setViewport(viewport);
-    setProjection(projection, projectionNear, projectionFar);
+    setProjection(camera.projection, camera.zn, camera.zf);
 
     bool uniformsNeedUpdating = false;
     if (UTILS_UNLIKELY(mDirtyFlags)) {
         uniformsNeedUpdating = update();
     }
 
+    // nothing else to do if the froxel data on the GPU is still valid
+    mCommitNeeded = findDirtyLights(lcm, camera, lightData);
+    if (!mCommitNeeded) {
+        return uniformsNeedUpdating;
+    }
+
     /*
      * Allocations that need to persists until the driver consumes them are done from
      * the command stream.
@@ -173,16 +196,9 @@ bool Froxelizer::prepare(
             arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
             FROXEL_BUFFER_ENTRY_COUNT_MAX };
 
-    // froxel thread data (~256 KiB)
-    mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
-    };
-
     assert(mFroxelBufferUser.begin());
     assert(mRecordBufferUser.begin());
     assert(mLightRecords.begin());
-    assert(mFroxelShardedData.begin());
 
     // initialize buffers that need to be
     memset(mLightRecords.data(), 0, mLightRecords.sizeInBytes());
@@ -460,6 +476,9 @@ bool Froxelizer::update() noexcept {
             mParamsZ[2] = mLinearizer;
         }
         uniformsNeedUpdating = true;
+
+        // froxels changed, previous froxelization results are not valid anymore
+        mFroxelsInvalid = true;
     }
     assert(mZLightNear >= mNear);
     mDirtyFlags = 0;
@@ -511,21 +530,26 @@ std::pair<size_t, size_t> Froxelizer::clipToIndices(float2 const& clip) const no
 
 
 void Froxelizer::commit(backend::DriverApi& driverApi) {
-    // send data to GPU
-    mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
-    mRecordsBuffer.commit(driverApi, mRecordBufferUser);
-#ifndef NDEBUG
+    // send data to GPU, unless it's the same as what we sent last time
+    if (mCommitNeeded) {
+        mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
+        mRecordsBuffer.commit(driverApi, mRecordBufferUser);
+        mCommitNeeded = false;
+    }
+    // the buffers belong to the command stream now
     mFroxelBufferUser.clear();
     mRecordBufferUser.clear();
-    mFroxelShardedData.clear();
-#endif
 }
 
 void Froxelizer::froxelizeLights(FEngine& engine,
-        CameraInfo const& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
-    froxelizeLoop(engine, camera, lightData);
+    if (!mCommitNeeded) {
+        // nothing changed since last time, the data on the GPU side is still valid
+        return;
+    }
+
+    froxelizeLoop(engine);
     froxelizeAssignRecordsCompress();
 
 #ifndef NDEBUG
@@ -552,43 +576,97 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
-void Froxelizer::froxelizeLoop(FEngine& engine,
-        const CameraInfo& UTILS_RESTRICT camera,
+bool Froxelizer::findDirtyLights(FLightManager const& lcm, CameraInfo const& camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+
+    /*
+     * Find which lights changed since the last froxelization. The light parameters are
+     * compared in view-space, so this catches changes coming from the LightManager (e.g.
+     * falloff or spot cone), the TransformManager and the camera, as well as lights
+     * being reordered in the LightSoa.
+     */
+
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
+    const size_t previousLightCount = mLightParamsCount;
+    assert(lightCount <= CONFIG_MAX_LIGHT_COUNT);
+
+    // if the previous froxelization wasn't committed, the dirty lights accumulate
+    const bool froxelsInvalid = mFroxelsInvalid;
+    LightParams* const UTILS_RESTRICT lightParams = mLightParams.data();
+    LightRecord::bitset& dirtyLights = mDirtyLights;
+    const mat3f& vn = camera.view.upperLeft();
+    for (size_t i = 0; i < lightCount; i++) {
+        const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
+        FLightManager::Instance li = instances[j];
+        LightParams const light = {
+                .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
+                .cosSqr = lcm.getCosOuterSquared(li),   // spot only
+                .axis = vn * directions[j],             // spot only
+                .invSin = lcm.getSinInverse(li),        // spot only
+                .radius = spheres[j].w,
+        };
+        if (froxelsInvalid || i >= previousLightCount || light != lightParams[i]) {
+            lightParams[i] = light;
+            dirtyLights.set(i);
+        }
+    }
+    // lights that went away must be removed from the froxels
+    for (size_t i = lightCount; i < previousLightCount; i++) {
+        dirtyLights.set(i);
+    }
+    mLightParamsCount = lightCount;
+    return froxelsInvalid || dirtyLights.any();
+}
+
+void Froxelizer::froxelizeLoop(FEngine& engine) noexcept {
     SYSTRACE_CALL();
 
     Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
-    memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
 
-    auto& lcm = engine.getLightManager();
-    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
-    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
-    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    const size_t lightCount = mLightParamsCount;
+    const bool froxelsInvalid = mFroxelsInvalid;
+    LightParams const* const UTILS_RESTRICT lightParams = mLightParams.data();
+    LightRecord::bitset const& dirtyLights = mDirtyLights;
+
+    if (froxelsInvalid) {
+        memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    } else {
+        // remove the lights that changed from all froxels, they'll be re-added below.
+        LightGroupType clearMasks[GROUP_COUNT] = {};
+        dirtyLights.forEachSetBit([&clearMasks](size_t i) {
+            clearMasks[i % GROUP_COUNT] |= LightGroupType(1) << (i / GROUP_COUNT);
+        });
+        for (size_t group = 0; group < GROUP_COUNT; group++) {
+            const LightGroupType mask = ~clearMasks[group];
+            if (mask != std::numeric_limits<LightGroupType>::max()) {
+                // this loop gets vectorized
+                FroxelThreadData& threadData = froxelThreadData[group];
+                for (size_t fi = 0, c = getFroxelCount(); fi < c; fi++) {
+                    threadData[fi] &= mask;
+                }
+            }
+        }
+    }
 
-    auto process = [ this, &froxelThreadData,
-                     spheres, directions, instances, &camera, &lcm ]
+    auto process = [ this, &froxelThreadData, &dirtyLights, lightParams ]
             (size_t count, size_t offset, size_t stride) {
 
         const mat4f& projection = mProjection;
-        const mat3f& vn = camera.view.upperLeft();
 
         for (size_t i = offset; i < count; i += stride) {
-            const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
-            FLightManager::Instance li = instances[j];
-            LightParams light = {
-                    .position = (camera.view * float4{ spheres[j].xyz, 1 }).xyz, // to view-space
-                    .cosSqr = lcm.getCosOuterSquared(li),   // spot only
-                    .axis = vn * directions[j],             // spot only
-                    .invSin = lcm.getSinInverse(li),        // spot only
-                    .radius = spheres[j].w,
-            };
+            if (!dirtyLights[i]) {
+                continue;
+            }
 
             const size_t group = i % GROUP_COUNT;
             const size_t bit   = i / GROUP_COUNT;
             assert(bit < LIGHT_PER_GROUP);
 
             FroxelThreadData& threadData = froxelThreadData[group];
-            froxelizePointAndSpotLight(threadData, bit, projection, light);
+            froxelizePointAndSpotLight(threadData, bit, projection, lightParams[i]);
         }
     };
 
@@ -599,15 +677,15 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
     if (!SINGLE_THREADED) {
         auto *parent = js.createJob();
         for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+            js.run(jobs::createJob(js, parent, std::cref(process), lightCount, i, GROUP_COUNT));
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process), lightCount, 0, 1));
     }
+
+    mDirtyLights.reset();
+    mFroxelsInvalid = false;
 }
 
 void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
@@ -159,7 +159,14 @@ RenderPass::Command* RenderPass::sortCommands() noexcept {
 
     GrowingSlice<Command>& commands = mCommands;
 
-    std::sort(commands.begin(), commands.end());
+    // only large command buffers are worth sorting in parallel, because of the merge passes
+    constexpr size_t PARALLEL_SORT_THRESHOLD = 4096;
+    if (commands.size() < PARALLEL_SORT_THRESHOLD) {
+        std::sort(commands.begin(), commands.end());
+    } else {
+        jobs::parallel_sort(mEngine.getJobSystem(), commands.begin(), uint32_t(commands.size()),
+                std::less<Command>(), jobs::CountSplitter<1024>());
+    }
 
     // find the last command
     Command const* const last = std::partition_point(commands.begin(), commands.end(),
@@ -40,6 +40,10 @@
 #include <utils/Systrace.h>
 #include <utils/vector.h>
 
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include <assert.h>
 
 // this helps visualize what dynamic-scaling is doing
@@ -182,11 +186,58 @@ void FRenderer::render(FView const* view) {
         // make sure to flush the command buffer
         engine.flush();
 
+        // the scene can be modified as soon as we return, it must not be gathered anymore
+        const_cast<FView&>(*view).finishPrepareNextFrame();
+
         // and wait for all jobs to finish as a safety (this should be a no-op)
         js.runAndWait(rootJob);
     }
 }
 
+void FRenderer::render(View const* const* views, size_t count) {
+    SYSTRACE_CALL();
+
+    assert(mSwapChain);
+
+    if (mBeginFrameInternal) {
+        mBeginFrameInternal();
+        mBeginFrameInternal = {};
+    }
+
+    FEngine& engine = mEngine;
+    JobSystem& js = engine.getJobSystem();
+
+    // the world origins depend on the cameras' transforms
+    engine.getTransformManager().updateWorldTransforms();
+
+    // Prepare each scene once, with the world origin of its first view. The other views of
+    // the same scene only offset that data, which is much cheaper.
+    std::vector<std::pair<FScene*, mat4f>> scenes;
+    scenes.reserve(count); // the jobs below keep pointers to the elements
+    auto *rootJob = js.setRootJob(js.createJob());
+    for (size_t i = 0; i < count; i++) {
+        FView const* const view = upcast(views[i]);
+        FScene* const scene = view ? const_cast<FView*>(view)->getScene() : nullptr;
+        if (scene && std::none_of(scenes.begin(), scenes.end(),
+                [scene](auto const& entry) { return entry.first == scene; })) {
+            scenes.emplace_back(scene, view->getWorldOrigin(engine));
+            js.run(js.createJob(nullptr, [&entry = scenes.back(), frameId = mFrameId](
+                    JobSystem&, JobSystem::Job*) {
+                entry.first->prepareShared(entry.second, frameId);
+            }));
+        }
+    }
+    js.runAndWait(rootJob);
+
+    for (size_t i = 0; i < count; i++) {
+        render(upcast(views[i]));
+    }
+
+    for (auto const& entry : scenes) {
+        entry.first->endShared();
+    }
+}
+
 void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     FEngine& engine = getEngine();
     JobSystem& js = engine.getJobSystem();
@@ -234,7 +285,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
         initializeClearFlags();
     }
 
-    view.prepare(engine, driver, arena, svp, getShaderUserTime());
+    view.prepare(engine, driver, arena, svp, getShaderUserTime(), mFrameId);
 
     // start froxelization immediately, it has no dependencies
     JobSystem::Job* jobFroxelize = js.runAndRetain(js.createJob(nullptr,
@@ -1125,6 +1176,10 @@ void Renderer::render(View const* view) {
     upcast(this)->render(upcast(view));
 }
 
+void Renderer::render(View const* const* views, size_t count) {
+    upcast(this)->render(views, count);
+}
+
 bool Renderer::beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano) {
     return upcast(this)->beginFrame(upcast(swapChain), vsyncSteadyClockTimeNano, nullptr, nullptr);
 }
@@ -31,6 +31,7 @@
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <utility>
 
 using namespace filament::math;
 using namespace utils;
@@ -46,20 +47,158 @@ FScene::FScene(FEngine& engine) :
 FScene::~FScene() noexcept = default;
 
 
+namespace {
+
+// copies all the elements of src into dst, which is given at least the same capacity
+template<typename SoA, size_t ... Indices>
+void copyElements(SoA& dst, SoA const& src, std::index_sequence<Indices...>) {
+    dst.clear();
+    if (dst.capacity() < src.capacity()) {
+        dst.setCapacity(src.capacity());
+    }
+    dst.resize(src.size());
+    int UTILS_UNUSED dummy[] = {
+            (std::copy(src.template begin<Indices>(), src.template end<Indices>(),
+                    dst.template begin<Indices>()), 0)... };
+}
+
+template<typename SoA>
+void copyElements(SoA& dst, SoA const& src) {
+    copyElements(dst, src, std::make_index_sequence<SoA::getArrayCount()>());
+}
+
+} // anonymous namespace
+
 void FScene::prepare(const mat4f& worldOriginTransform) {
     // TODO: can we skip this in most cases? Since we rely on indices staying the same,
     //       we could only skip, if nothing changed in the RCM.
+    gather(mRenderableData, mLightData, worldOriginTransform);
+}
+
+void FScene::prepareNextFrame(PreparedData& next,
+        const mat4f& worldOriginTransform, uint32_t frameId) {
+    assert(!next.job);
+    if (mHasShared) {
+        // the scene is gathered once for all its views anyway
+        next.scene = nullptr;
+        return;
+    }
+    JobSystem& js = mEngine.getJobSystem();
+    next.worldOrigin = worldOriginTransform;
+    next.scene = this;
+    next.structureVersion = getStructureVersion();
+    next.frameId = frameId;
+    next.job = js.runAndRetain(js.createJob(nullptr, [this, &next](JobSystem&, JobSystem::Job*) {
+        gather(next.renderableData, next.lightData, next.worldOrigin);
+    }));
+}
+
+void FScene::finishPrepareNextFrame(PreparedData& next) noexcept {
+    if (next.job) {
+        mEngine.getJobSystem().waitAndRelease(next.job);
+        next.job = nullptr;
+    }
+}
+
+void FScene::prepareShared(const mat4f& worldOriginTransform, uint32_t frameId) {
+    // The renderables are gathered straight into the scene's data. Each view only reorders it
+    // and recomputes the visibility, so the next view can use it in place. Light culling drops
+    // the invisible lights however, so the lights are kept aside and copied for each view.
+    mShared.worldOrigin = worldOriginTransform;
+    mShared.scene = this;
+    mShared.structureVersion = getStructureVersion();
+    mShared.frameId = frameId;
+    gather(mRenderableData, mShared.lightData, mShared.worldOrigin);
+    mHasShared = true;
+}
+
+void FScene::endShared() noexcept {
+    mHasShared = false;
+    mShared.scene = nullptr;
+}
+
+bool FScene::usePrepared(PreparedData& next,
+        const mat4f& worldOriginTransform, uint32_t frameId) noexcept {
+    finishPrepareNextFrame(next);
+
+    if (mHasShared) {
+        if (!isPreparedValid(mShared, worldOriginTransform, frameId)) {
+            // prepare() is about to overwrite the shared renderables
+            endShared();
+            return false;
+        }
+        const float3 offset = worldOriginTransform[3].xyz - mShared.worldOrigin[3].xyz;
+        offsetPrepared(mRenderableData, mShared.lightData, offset);
+        mShared.worldOrigin = worldOriginTransform;
+        copyElements(mLightData, mShared.lightData);
+        padLightData(mLightData);
+        return true;
+    }
+
+    if (!isPreparedValid(next, worldOriginTransform, frameId)) {
+        next.scene = nullptr;
+        return false;
+    }
+    std::swap(mRenderableData, next.renderableData);
+    std::swap(mLightData, next.lightData);
+    next.scene = nullptr;
+    offsetPrepared(mRenderableData, mLightData,
+            worldOriginTransform[3].xyz - next.worldOrigin[3].xyz);
+    return true;
+}
+
+bool FScene::isPreparedValid(PreparedData const& prepared,
+        const mat4f& worldOriginTransform, uint32_t frameId) const noexcept {
+    // The data must have been gathered from this scene, for this very frame: anything older
+    // (e.g. the view wasn't rendered during the last frame) could be stale.
+    if (prepared.scene != this || prepared.frameId != frameId ||
+            prepared.structureVersion != getStructureVersion()) {
+        return false;
+    }
+
+    // The world origin is a rigid transform, which typically only differs by its translation
+    // from one frame or view to the next (the camera is kept at the origin). In that case the
+    // gathered data can simply be offset, otherwise it has to be gathered again.
+    mat4f const& prev = prepared.worldOrigin;
+    mat4f const& next = worldOriginTransform;
+    return prev[0] == next[0] && prev[1] == next[1] && prev[2] == next[2];
+}
+
+void FScene::offsetPrepared(RenderableSoa& sceneData, LightSoa& lightData,
+        float3 offset) noexcept {
+    if (any(offset)) {
+        for (size_t i = 0, c = sceneData.size(); i < c; i++) {
+            mat34f& worldTransform = sceneData.elementAt<WORLD_TRANSFORM>(i);
+            worldTransform[0][3] += offset.x;
+            worldTransform[1][3] += offset.y;
+            worldTransform[2][3] += offset.z;
+            sceneData.elementAt<WORLD_AABB_CENTER>(i) += offset;
+        }
+        for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+            lightData.elementAt<POSITION_RADIUS>(i).xyz += offset;
+        }
+    }
+}
+
+uint32_t FScene::getStructureVersion() const noexcept {
+    // all three versions only ever increase, so does their sum
+    FEngine& engine = mEngine;
+    return mEntitiesVersion +
+            engine.getRenderableManager().getVersion() + engine.getLightManager().getVersion();
+}
 
+void FScene::gather(RenderableSoa& sceneData, LightSoa& lightData,
+        const mat4f& worldOriginTransform) {
     FEngine& engine = mEngine;
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     FTransformManager& tcm = engine.getTransformManager();
     FLightManager& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
-    auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
     auto const& entities = mEntities;
 
+    // the world origin is a rigid transform
+    const mat34f worldOrigin(worldOriginTransform);
 
     // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
     // component can be added after the entity is added to the scene.
@@ -107,14 +246,17 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
 
         // get the world transform
         auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
-        const bool reversedWindingOrder = det(worldTransform.upperLeft()) < 0;
+        // The renderer only handles affine world transforms (culling already ignores the last
+        // row), so they're packed as 3x4 matrices from here on.
+        const mat34f worldTransform = worldOrigin * mat34f(tcm.getWorldTransform(ti));
+        const bool reversedWindingOrder = det(worldTransform) < 0;
 
         // don't even draw this object if it doesn't have a transform (which shouldn't happen
         // because one is always created when creating a Renderable component).
         if (ri && ti) {
             // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+            Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform.upperLeft());
+            worldAABB.center += worldTransform.translation();
 
             // we know there is enough space in the array
             sceneData.push_back_unsafe(
@@ -161,6 +303,10 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
         }
     }
 
+    padLightData(lightData);
+}
+
+void FScene::padLightData(LightSoa& lightData) noexcept {
     // some elements past the end of the array will be accessed by SIMD code, we need to make
     // sure the data is valid enough as not to produce errors such as divide-by-zero
     // (e.g. in computeLightRanges())
@@ -179,11 +325,12 @@ void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Hand
     bool hasContactShadows = false;
     auto& sceneData = mRenderableData;
     for (uint32_t i : visibleRenderables) {
-        mat4f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
+        mat34f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
         const size_t offset = i * sizeof(PerRenderableUib);
 
+        // the UBO still expects a full 4x4 matrix
         UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelMatrix), model);
+                offset + offsetof(PerRenderableUib, worldFromModelMatrix), model.toMat4());
 
         // Using mat3f::getTransformForNormals handles non-uniform scaling, but DOESN'T guarantee that
         // the transformed normals will have unit-length, therefore they need to be normalized
@@ -360,14 +507,17 @@ inline void FScene::computeLightRanges(
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mEntitiesVersion++;
 }
 
 void FScene::addEntities(const Entity* entities, size_t count) {
     mEntities.insert(entities, entities + count);
+    mEntitiesVersion++;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    mEntitiesVersion++;
 }
 
 void FScene::removeEntities(const Entity* entities, size_t count) {
@@ -600,12 +600,12 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
             0.0f, 0.0f, 0.0f, 1.0f
     });
 
-    // apply the 1-texel border viewport transform
-    const float o = 1.0f / mShadowMapLayout.atlasDimension;
+    // apply the 1-texel border viewport transform, and move to the shadow map's place in the atlas
+    const float2 o = (float2(mShadowMapLayout.offset) + 1.0f) / mShadowMapLayout.atlasDimension;
     const float s = 1.0f - 2.0f * (1.0f / mShadowMapLayout.textureDimension);
     const mat4f Mb(mat4f::row_major_init{
-             s,    0.0f, 0.0f, o,
-             0.0f, s,    0.0f, o,
+             s,    0.0f, 0.0f, o.x,
+             0.0f, s,    0.0f, o.y,
              0.0f, 0.0f, 1.0f, 0.0f,
              0.0f, 0.0f, 0.0f, 1.0f
     });
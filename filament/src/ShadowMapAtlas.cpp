@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowMapAtlas.h"
+
+#include <utils/algorithm.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <assert.h>
+
+namespace filament {
+
+namespace {
+
+constexpr uint32_t MAX_SIZE = 1u << 15u;
+
+uint32_t nextPowerOfTwo(uint32_t x) noexcept {
+    return x <= 1u ? 1u : 1u << (utils::log2i(x - 1u) + 1u);
+}
+
+} // anonymous namespace
+
+uint16_t ShadowMapAtlas::computeDimension(uint32_t largestSize) noexcept {
+    return uint16_t(std::clamp(nextPowerOfTwo(largestSize), uint32_t(MIN_SIZE), MAX_SIZE));
+}
+
+uint16_t ShadowMapAtlas::computeSize(uint32_t requestedSize, float coverage,
+        uint16_t currentSize) noexcept {
+    const uint32_t maxSize = computeDimension(requestedSize);
+    const float target = std::ceil(float(requestedSize) * std::clamp(coverage, 0.0f, 1.0f));
+    uint32_t size = std::clamp(nextPowerOfTwo(uint32_t(target)), uint32_t(MIN_SIZE), maxSize);
+    if (currentSize > size && currentSize <= maxSize && size * 4u > currentSize) {
+        // don't shrink until the map is at least 4 times too large
+        size = currentSize;
+    }
+    return uint16_t(size);
+}
+
+size_t ShadowMapAtlas::getLevel(uint16_t size) const noexcept {
+    assert(size >= MIN_SIZE && size <= mDimension);
+    return utils::log2i(uint32_t(mDimension)) - utils::log2i(uint32_t(size));
+}
+
+uint16_t ShadowMapAtlas::getSize(uint32_t key) const noexcept {
+    auto pos = std::find_if(mEntries.begin(), mEntries.end(), [key](Entry const& entry) {
+        return !entry.exclusive && entry.key == key;
+    });
+    return pos != mEntries.end() ? pos->allocation.size : 0;
+}
+
+void ShadowMapAtlas::reset(uint16_t dimension) noexcept {
+    mDimension = dimension;
+    mLayerCount = 0;
+    mEntries.clear();
+    for (auto& blocks : mFreeBlocks) {
+        blocks.clear();
+    }
+}
+
+bool ShadowMapAtlas::allocate(uint16_t size, Allocation* allocation) {
+    const size_t level = getLevel(size);
+
+    // find the smallest free block that fits
+    size_t l = level + 1;
+    while (l > 0 && mFreeBlocks[l - 1].empty()) {
+        l--;
+    }
+    if (l == 0) {
+        return false;
+    }
+    l--;
+
+    // use the lowest one, so that the last layers empty out first
+    std::vector<Allocation>& blocks = mFreeBlocks[l];
+    auto pos = std::min_element(blocks.begin(), blocks.end(),
+            [](Allocation const& lhs, Allocation const& rhs) {
+                if (lhs.layer != rhs.layer) return lhs.layer < rhs.layer;
+                if (lhs.y != rhs.y) return lhs.y < rhs.y;
+                return lhs.x < rhs.x;
+            });
+    Allocation block = *pos;
+    *pos = blocks.back();
+    blocks.pop_back();
+
+    // split it until it's the right size, we keep the first quadrant each time
+    for (; l < level; l++) {
+        const uint16_t half = block.size / 2u;
+        block.size = half;
+        std::vector<Allocation>& children = mFreeBlocks[l + 1];
+        children.push_back({ uint16_t(block.x + half), block.y, half, block.layer });
+        children.push_back({ block.x, uint16_t(block.y + half), half, block.layer });
+        children.push_back({ uint16_t(block.x + half), uint16_t(block.y + half), half, block.layer });
+    }
+
+    *allocation = block;
+    return true;
+}
+
+void ShadowMapAtlas::free(Allocation const& allocation) {
+    Allocation block = allocation;
+    size_t level = getLevel(block.size);
+    while (level > 0) {
+        // merge the block with its 3 buddies if they're all free
+        std::vector<Allocation>& blocks = mFreeBlocks[level];
+        const uint16_t parentSize = block.size * 2u;
+        const uint16_t px = block.x & ~(parentSize - 1u);
+        const uint16_t py = block.y & ~(parentSize - 1u);
+        auto isBuddy = [&](Allocation const& other) {
+            return other.layer == block.layer &&
+                   (other.x & ~(parentSize - 1u)) == px &&
+                   (other.y & ~(parentSize - 1u)) == py;
+        };
+        if (std::count_if(blocks.begin(), blocks.end(), isBuddy) != 3) {
+            break;
+        }
+        blocks.erase(std::remove_if(blocks.begin(), blocks.end(), isBuddy), blocks.end());
+        block = { px, py, parentSize, block.layer };
+        level--;
+    }
+    mFreeBlocks[level].push_back(block);
+}
+
+size_t ShadowMapAtlas::update(uint16_t dimension, Request const* requests, size_t count,
+        Allocation* allocations) {
+    assert(dimension >= MIN_SIZE && !(dimension & (dimension - 1u)));
+
+    auto blockSize = [dimension](Request const& request) {
+        return uint16_t(std::clamp(nextPowerOfTwo(request.size),
+                uint32_t(MIN_SIZE), uint32_t(dimension)));
+    };
+
+    auto findEntry = [this](uint32_t key, bool exclusive) {
+        return std::find_if(mEntries.begin(), mEntries.end(), [=](Entry const& entry) {
+            return entry.exclusive == exclusive && entry.key == key;
+        });
+    };
+
+    // The exclusive layers come first, if they changed, all the layers after them move too.
+    const size_t exclusiveCount = size_t(std::count_if(requests, requests + count,
+            [](Request const& request) { return request.exclusive; }));
+    bool repack = dimension != mDimension || exclusiveCount != size_t(std::count_if(
+            mEntries.begin(), mEntries.end(), [](Entry const& entry) { return entry.exclusive; }));
+    for (size_t i = 0, layer = 0; i < count && !repack; i++) {
+        if (requests[i].exclusive) {
+            auto pos = findEntry(requests[i].key, true);
+            repack = pos == mEntries.end() || pos->allocation.layer != layer++;
+        }
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (repack) {
+            reset(dimension);
+            for (size_t i = 0; i < count; i++) {
+                if (requests[i].exclusive) {
+                    mEntries.push_back({ requests[i].key,
+                            { 0, 0, dimension, uint8_t(mLayerCount++) }, true });
+                }
+            }
+        }
+
+        // Release the maps that are gone or changed size, the others stay where they are.
+        mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(), [&](Entry const& entry) {
+            if (entry.exclusive) {
+                return false;
+            }
+            Request const* const end = requests + count;
+            Request const* request = std::find_if(requests, end, [&](Request const& r) {
+                return !r.exclusive && r.key == entry.key;
+            });
+            if (request != end && blockSize(*request) == entry.allocation.size) {
+                return false;
+            }
+            free(entry.allocation);
+            return true;
+        }), mEntries.end());
+
+        // Place the new maps, largest first, which guarantees they're packed tightly.
+        std::vector<Request const*> pending;
+        uint64_t area = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!requests[i].exclusive) {
+                const uint64_t size = blockSize(requests[i]);
+                area += size * size;
+                if (findEntry(requests[i].key, false) == mEntries.end()) {
+                    pending.push_back(requests + i);
+                }
+            }
+        }
+        std::sort(pending.begin(), pending.end(), [&](Request const* lhs, Request const* rhs) {
+            const uint16_t ls = blockSize(*lhs);
+            const uint16_t rs = blockSize(*rhs);
+            if (ls != rs) return ls > rs;
+            if (lhs->importance != rhs->importance) return lhs->importance > rhs->importance;
+            return lhs->key < rhs->key;
+        });
+        for (Request const* request : pending) {
+            Allocation allocation;
+            const uint16_t size = blockSize(*request);
+            while (!allocate(size, &allocation)) {
+                mFreeBlocks[0].push_back({ 0, 0, dimension, uint8_t(mLayerCount++) });
+            }
+            mEntries.push_back({ request->key, allocation, false });
+        }
+
+        // If holes left by previous maps cost us a layer, start over.
+        const uint64_t layerArea = uint64_t(dimension) * dimension;
+        const size_t layersNeeded = exclusiveCount + size_t((area + layerArea - 1) / layerArea);
+        if (mLayerCount <= layersNeeded) {
+            break;
+        }
+        repack = true;
+    }
+
+    size_t exclusiveIndex = 0;
+    for (size_t i = 0; i < count; i++) {
+        Request const& request = requests[i];
+        if (request.exclusive) {
+            allocations[i] = { 0, 0, dimension, uint8_t(exclusiveIndex++) };
+        } else {
+            allocations[i] = findEntry(request.key, false)->allocation;
+        }
+    }
+    return mLayerCount;
+}
+
+} // namespace filament
@@ -20,9 +20,16 @@
 #include "details/View.h"
 
 #include "RenderPass.h"
+#include "ResourceAllocator.h"
 
 #include <private/filament/SibGenerator.h>
 
+#include <utils/Hash.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <limits>
+
 namespace filament {
 
 using namespace backend;
@@ -40,10 +47,17 @@ ShadowMapManager::ShadowMapManager(FEngine& engine) {
             &engine.debug.shadowmap.visualize_cascades);
     debugRegistry.registerProperty("d.shadowmap.tightly_bound_scene",
             &engine.debug.shadowmap.tightly_bound_scene);
+    debugRegistry.registerProperty("d.shadowmap.cache",
+            &engine.debug.shadowmap.cache);
 }
 
 ShadowMapManager::~ShadowMapManager() = default;
 
+void ShadowMapManager::terminate(FEngine& engine) noexcept {
+    mShadowTexture.destroy(engine.getResourceAllocator());
+    mShadowTexture = {};
+}
+
 ShadowMapManager::ShadowTechnique ShadowMapManager::update(
         FEngine& engine, FView& view, UniformBuffer& perViewUb,
         UniformBuffer& shadowUb, FScene::RenderableSoa& renderableData,
@@ -90,10 +104,104 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
 
     assert(mTextureRequirements.layers <= MAX_SHADOW_LAYERS);
 
+    const bool fillWithCheckerboard = engine.debug.shadowmap.checkerboard && !view.hasVsm();
+
+    FrameGraphTexture::Descriptor shadowTextureDesc {
+        .width = mTextureRequirements.size, .height = mTextureRequirements.size,
+        .depth = mTextureRequirements.layers,
+        .levels = mTextureRequirements.levels,
+        .type = SamplerType::SAMPLER_2D_ARRAY,
+        .format = mTextureFormat,
+        .usage = TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE
+            | (fillWithCheckerboard ? TextureUsage::UPLOADABLE : (TextureUsage) 0)
+    };
+
+    if (view.hasVsm()) {
+        // TODO: support 16-bit VSM depth textures.
+        shadowTextureDesc.format = TextureFormat::RG32F;
+        shadowTextureDesc.usage = TextureUsage::COLOR_ATTACHMENT |
+                TextureUsage::SAMPLEABLE;
+    }
+
+    FrameGraphTexture::Descriptor const& cachedDesc = mShadowTextureDesc;
+    if (!mShadowTexture.texture ||
+            cachedDesc.width != shadowTextureDesc.width ||
+            cachedDesc.height != shadowTextureDesc.height ||
+            cachedDesc.depth != shadowTextureDesc.depth ||
+            cachedDesc.levels != shadowTextureDesc.levels ||
+            cachedDesc.format != shadowTextureDesc.format ||
+            cachedDesc.usage != shadowTextureDesc.usage) {
+        // the shadow maps rendered so far are lost
+        ResourceAllocatorInterface& allocator = engine.getResourceAllocator();
+        mShadowTexture.destroy(allocator);
+        mShadowTexture.create(allocator, "Shadow Texture", shadowTextureDesc);
+        mShadowTextureDesc = shadowTextureDesc;
+        for (auto& rendered : mRenderedCascadeShadowMaps) { rendered.valid = false; }
+        for (auto& rendered : mRenderedSpotShadowMaps) { rendered.valid = false; }
+    }
+
+    // Caching is opt-in, see View::setShadowMapCachingEnabled(). With the debug pattern, the
+    // shadow maps are always rendered.
+    const bool useCache = view.isShadowMapCachingEnabled() &&
+            engine.debug.shadowmap.cache && !fillWithCheckerboard;
+    if (!useCache) {
+        // whatever is rendered now isn't recorded, don't reuse older maps once enabled again
+        for (auto& rendered : mRenderedCascadeShadowMaps) { rendered.valid = false; }
+        for (auto& rendered : mRenderedSpotShadowMaps) { rendered.valid = false; }
+    }
+
+    FScene::RenderableSoa const& renderableData = view.getScene()->getRenderableData();
+    FScene::LightSoa const& lightData = view.getScene()->getLightData();
+    mat4f const& worldOrigin = view.getCameraInfo().worldOrigin;
+
+    auto shouldRender = [&](ShadowMapEntry const& map, RenderedShadowMap& rendered,
+            uint32_t castersHash) -> bool {
+        if (!useCache) {
+            return true;
+        }
+        ShadowMap const& shadowMap = *map.getShadowMap();
+        return needsRendering(rendered, {
+                .lightFromWorld = shadowMap.getLightSpaceMatrix() * worldOrigin,
+                .light = lightData.elementAt<FScene::LIGHT_INSTANCE>(map.getLightIndex()),
+                .layout = map.getLayout(),
+                .polygonOffset = shadowMap.getPolygonOffset(),
+                .castersHash = castersHash });
+    };
+
+    // Find the layers that need to be rendered again. Shadow maps sharing a layer are always
+    // rendered together, since the layer is cleared first.
+    // All cascades share the same shadow casters.
+    const uint32_t cascadeCastersHash = useCache && !mCascadeShadowMaps.empty() ?
+            hashShadowCasters(engine, renderableData, view.getVisibleDirectionalShadowCasters(),
+                    std::numeric_limits<FScene::VisibleMaskType>::max()) : 0;
+    bool renderedLayers[MAX_SHADOW_LAYERS] = {};
+    for (size_t i = 0; i < mCascadeShadowMaps.size(); i++) {
+        const auto& map = mCascadeShadowMaps[i];
+        if (!map.hasVisibleShadows()) {
+            mRenderedCascadeShadowMaps[i].valid = false;
+            continue;
+        }
+        if (shouldRender(map, mRenderedCascadeShadowMaps[i], cascadeCastersHash)) {
+            renderedLayers[map.getLayout().layer] = true;
+        }
+    }
+    for (size_t i = 0; i < mSpotShadowMaps.size(); i++) {
+        const auto& map = mSpotShadowMaps[i];
+        if (!map.hasVisibleShadows()) {
+            mRenderedSpotShadowMaps[i].valid = false;
+            continue;
+        }
+        const uint32_t castersHash = useCache ? hashShadowCasters(engine, renderableData,
+                view.getVisibleSpotShadowCasters(), VISIBLE_SPOT_SHADOW_RENDERABLE_N(i)) : 0;
+        if (shouldRender(map, mRenderedSpotShadowMaps[i], castersHash)) {
+            renderedLayers[map.getLayout().layer] = true;
+        }
+    }
+
     // These loops fill render passes with appropriate rendering commands for each shadow map.
     // The actual render pass execution is deferred to the frame graph.
     for (const auto& map : mCascadeShadowMaps) {
-        if (!map.hasVisibleShadows()) {
+        if (!map.hasVisibleShadows() || !renderedLayers[map.getLayout().layer]) {
             continue;
         }
 
@@ -108,7 +216,7 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
     }
     for (size_t i = 0; i < mSpotShadowMaps.size(); i++) {
         const auto& map = mSpotShadowMaps[i];
-        if (!map.hasVisibleShadows()) {
+        if (!map.hasVisibleShadows() || !renderedLayers[map.getLayout().layer]) {
             continue;
         }
 
@@ -123,31 +231,28 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
         assert(layer < MAX_SHADOW_LAYERS);
         layerSampleCount[layer] = map.getLayout().vsmSamples;
     }
-    assert(passes.size() <= mTextureRequirements.layers);
 
-    const bool fillWithCheckerboard = engine.debug.shadowmap.checkerboard && !view.hasVsm();
+    const size_t visibleShadowMapCount =
+            std::count_if(mCascadeShadowMaps.begin(), mCascadeShadowMaps.end(),
+                    [](auto const& map) { return map.hasVisibleShadows(); }) +
+            std::count_if(mSpotShadowMaps.begin(), mSpotShadowMaps.end(),
+                    [](auto const& map) { return map.hasVisibleShadows(); });
+    mCacheStats.misses = uint32_t(passes.size());
+    mCacheStats.hits = uint32_t(visibleShadowMapCount - passes.size());
+    SYSTRACE_VALUE32("shadowMapsRendered", passes.size());
+
+    FrameGraphId<FrameGraphTexture> shadows =
+            fg.import("Shadow Texture", shadowTextureDesc, mShadowTexture);
+
+    if (UTILS_UNLIKELY(passes.empty())) {
+        // all the shadow maps are up to date
+        fg.getBlackboard().put("shadows", shadows);
+        return;
+    }
 
     auto& shadowPass = fg.addPass<ShadowPassData>("Shadow Pass",
             [&](FrameGraph::Builder& builder, auto& data) {
-                FrameGraphTexture::Descriptor shadowTextureDesc {
-                    .width = mTextureRequirements.size, .height = mTextureRequirements.size,
-                    .depth = mTextureRequirements.layers,
-                    .levels = mTextureRequirements.levels,
-                    .type = SamplerType::SAMPLER_2D_ARRAY,
-                    .format = mTextureFormat,
-                    .usage = TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE
-                        | (fillWithCheckerboard ? TextureUsage::UPLOADABLE : (TextureUsage) 0)
-                };
-
-                if (view.hasVsm()) {
-                    // TODO: support 16-bit VSM depth textures.
-                    shadowTextureDesc.format = TextureFormat::RG32F;
-                    shadowTextureDesc.usage = TextureUsage::COLOR_ATTACHMENT |
-                            TextureUsage::SAMPLEABLE;
-                }
-
-                data.shadows = builder.createTexture("Shadow Texture", shadowTextureDesc);
-                data.shadows = builder.write(data.shadows);
+                data.shadows = builder.write(shadows);
 
                 if (view.hasVsm()) {
                     // When rendering VSM shadow maps, we still need a depth texture for correct
@@ -168,8 +273,12 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
                     data.tempDepth = builder.write(builder.read(data.tempDepth));
                 }
 
-                // Create a render target for each layer of the texture array.
+                // Create a render target for each layer of the texture array we render into,
+                // the other layers are left untouched.
                 for (uint8_t i = 0u; i < mTextureRequirements.layers; i++) {
+                    if (!renderedLayers[i]) {
+                        continue;
+                    }
                     FrameGraphRenderTarget::Descriptor renderTargetDesc {};
                     if (view.hasVsm()) {
                         renderTargetDesc.attachments = { { data.shadows, 0u, i }, { data.tempDepth } };
@@ -187,6 +296,10 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
             },
             [=, passes = std::move(passes), &view, &engine](FrameGraphPassResources const& resources,
                     auto const& data, DriverApi& driver) mutable {
+                // only the first shadow map rendered in a layer clears it
+                bool layerCleared[MAX_SHADOW_LAYERS] = {};
+                const TargetBufferFlags shadowFlags = view.hasVsm() ?
+                        TargetBufferFlags::COLOR : TargetBufferFlags::DEPTH;
                 for (auto& [map, pass] : passes) {
                     FCamera const& camera = map->getShadowMap()->getCamera();
                     filament::CameraInfo cameraInfo(camera);
@@ -201,15 +314,22 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
                     // shadowing.fs). Unfortunately, the APIs don't seem let us clear depth
                     // attachments to anything greater than 1.0, so we'd need a way to do this other
                     // than clearing.
-                    const uint32_t dim = map->getLayout().size;
-                    filament::Viewport viewport { 1, 1, dim - 2, dim - 2 };
+                    const ShadowLayout& layout = map->getLayout();
+                    const uint32_t dim = layout.size;
+                    filament::Viewport viewport {
+                            int32_t(layout.x + 1u), int32_t(layout.y + 1u), dim - 2, dim - 2 };
                     view.prepareViewport(viewport);
 
                     view.commitUniforms(driver);
 
-                    const auto layer = map->getLayout().layer;
+                    const auto layer = layout.layer;
                     auto rt = resources.get(data.rt[layer]);
                     rt.params.viewport = viewport;
+                    if (layerCleared[layer]) {
+                        rt.params.flags.clear &= ~shadowFlags;
+                        rt.params.flags.discardStart &= ~shadowFlags;
+                    }
+                    layerCleared[layer] = true;
 
                     auto polygonOffset = map->getShadowMap()->getPolygonOffset();
                     pass.overridePolygonOffset(&polygonOffset);
@@ -220,7 +340,7 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
                 engine.flush(); // Wake-up the driver thread
             });
 
-    auto shadows = shadowPass.getData().shadows;
+    shadows = shadowPass.getData().shadows;
 
     if (UTILS_UNLIKELY(fillWithCheckerboard)) {
         struct DebugPatternData {
@@ -246,6 +366,9 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
     if (mTextureRequirements.levels > 1) {
         auto& ppm = engine.getPostProcessManager();
         for (uint8_t layer = 0; layer < mTextureRequirements.layers; layer++) {
+            if (!renderedLayers[layer]) {
+                continue;
+            }
             for (size_t level = 0; level < mTextureRequirements.levels - 1; level++) {
                 shadows = ppm.vsmMipmapPass(fg, shadows, layer, level);
             }
@@ -298,12 +421,14 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
         // Even if we have more than one cascade, we cull directional shadow casters against the
         // entire camera frustum, as if we only had a single cascade.
         ShadowMap& map = *mCascadeShadowMaps[0].getShadowMap();
-        const size_t textureDimension = mCascadeShadowMaps[0].getLayout().size;
+        const ShadowLayout& shadowLayout = mCascadeShadowMaps[0].getLayout();
+        const size_t textureDimension = shadowLayout.size;
         const ShadowMap::ShadowMapLayout layout {
                 .zResolution = mTextureZResolution,
                 .atlasDimension = textureSize,
                 .textureDimension = textureDimension,
-                .shadowDimension = textureDimension - 2
+                .shadowDimension = textureDimension - 2,
+                .offset = { shadowLayout.x, shadowLayout.y }
         };
         map.update(lightData, 0, scene, viewingCameraInfo, visibleLayers,
                 layout, cascadeParams);
@@ -381,12 +506,14 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
         UTILS_UNUSED_IN_RELEASE size_t l = entry.getLightIndex();
         assert(l == 0);
 
-        const size_t textureDimension = entry.getLayout().size;
+        const ShadowLayout& shadowLayout = entry.getLayout();
+        const size_t textureDimension = shadowLayout.size;
         const ShadowMap::ShadowMapLayout layout{
                 .zResolution = mTextureZResolution,
                 .atlasDimension = textureSize,
                 .textureDimension = textureDimension,
-                .shadowDimension = textureDimension - 2
+                .shadowDimension = textureDimension - 2,
+                .offset = { shadowLayout.x, shadowLayout.y }
         };
         cascadeParams.csNearFar = { csSplitPosition[i], csSplitPosition[i + 1] };
         shadowMap.update(lightData, 0, scene, viewingCameraInfo, visibleLayers, layout, cascadeParams);
@@ -451,12 +578,14 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateSpotShadowMaps(
         ShadowMap& shadowMap = *entry.getShadowMap();
         size_t l = entry.getLightIndex();
 
-        const size_t textureDimension = entry.getLayout().size;
+        const ShadowLayout& shadowLayout = entry.getLayout();
+        const size_t textureDimension = shadowLayout.size;
         const ShadowMap::ShadowMapLayout layout{
                 .zResolution = mTextureZResolution,
                 .atlasDimension = textureSize,
                 .textureDimension = textureDimension,
-                .shadowDimension = textureDimension - 2
+                .shadowDimension = textureDimension - 2,
+                .offset = { shadowLayout.x, shadowLayout.y }
         };
         shadowMap.update(lightData, l, scene, viewingCameraInfo, visibleLayers, layout, {});
 
@@ -504,6 +633,80 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateSpotShadowMaps(
     return shadowTechnique;
 }
 
+bool ShadowMapManager::needsRendering(RenderedShadowMap& rendered,
+        RenderedShadowMap const& current) noexcept {
+    // The light-space matrix is recomputed each frame relative to the world origin, which
+    // moves with the camera, so it's only compared up to rounding errors.
+    auto nearlyEqual = [](mat4f const& lhs, mat4f const& rhs) {
+        for (size_t i = 0; i < 4; i++) {
+            const float4 d = abs(lhs[i] - rhs[i]);
+            const float4 m = max(abs(lhs[i]), abs(rhs[i]));
+            if (any(greaterThan(d, m * 1e-5f + 1e-7f))) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    if (rendered.valid &&
+            rendered.light == current.light &&
+            rendered.layout.layer == current.layout.layer &&
+            rendered.layout.x == current.layout.x &&
+            rendered.layout.y == current.layout.y &&
+            rendered.layout.size == current.layout.size &&
+            rendered.layout.vsmSamples == current.layout.vsmSamples &&
+            rendered.polygonOffset.slope == current.polygonOffset.slope &&
+            rendered.polygonOffset.constant == current.polygonOffset.constant &&
+            rendered.castersHash == current.castersHash &&
+            nearlyEqual(rendered.lightFromWorld, current.lightFromWorld)) {
+        // keep the matrix the map was rendered with, so small changes can't accumulate
+        return false;
+    }
+    rendered = current;
+    rendered.valid = true;
+    return true;
+}
+
+uint32_t ShadowMapManager::hashShadowCasters(FEngine& engine, FScene::RenderableSoa const& soa,
+        utils::Range<uint32_t> range, FScene::VisibleMaskType mask) noexcept {
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+
+    // Everything we can observe about a caster. World transforms come from the
+    // TransformManager, as they're independent of the world origin.
+    struct Caster {
+        uint32_t entity;
+        mat4f worldTransform;
+        float4 morphWeights;
+    };
+    static_assert(sizeof(Caster) % 4 == 0, "Caster must be hashable as 32-bit words");
+
+    auto const* const UTILS_RESTRICT instances = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT visibleMasks = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT visibilities = soa.data<FScene::VISIBILITY_STATE>();
+    auto const* const UTILS_RESTRICT morphWeights = soa.data<FScene::MORPH_WEIGHTS>();
+
+    uint32_t hash = range.size();
+    for (uint32_t i : range) {
+        if (!(visibleMasks[i] & mask)) {
+            continue;
+        }
+        FRenderableManager::Visibility const visibility = visibilities[i];
+        if (visibility.skinning) {
+            // bones can change without us knowing, assume they did
+            return hash ^ 0xffffffffu;
+        }
+        Caster caster{};
+        const utils::Entity e = rcm.getEntity(instances[i]);
+        caster.entity = e.getId();
+        caster.worldTransform = tcm.getWorldTransform(tcm.getInstance(e));
+        caster.morphWeights = visibility.morphing ? morphWeights[i] : float4{};
+        hash = utils::hash::murmur3(reinterpret_cast<uint32_t const*>(&caster),
+                sizeof(Caster) / 4, hash);
+    }
+    return hash;
+}
+
 UTILS_NOINLINE
 void ShadowMapManager::fillWithDebugPattern(backend::DriverApi& driverApi,
         Handle<HwTexture> texture, size_t dim) noexcept {
@@ -537,50 +740,104 @@ void ShadowMapManager::calculateTextureRequirements(FEngine& engine, FView& view
         return std::max((uint8_t) 1u, options.vsm.msaaSamples);
     };
 
-    // Lay out the shadow maps. For now, we take the largest requested dimension and allocate a
-    // texture of that size. Each cascade / shadow map gets its own layer in the array texture.
-    // The directional shadow cascades start on layer 0, followed by spot lights.
-    uint8_t layer = 0;
+    // How much of the screen a spot light's sphere of influence covers, from 0 to 1. This is
+    // also how important its shadow map is.
+    const CameraInfo& camera = view.getCameraInfo();
+    const float projectionScale = std::max(camera.projection[0][0], camera.projection[1][1]);
+    auto getScreenCoverage = [&](size_t lightIndex) {
+        const float4 sphere = lightData.elementAt<FScene::POSITION_RADIUS>(lightIndex);
+        const float z = -(camera.view * float4{ sphere.xyz, 1.0f }).z;
+        const float r = sphere.w;
+        if (z <= -r) {
+            return 0.0f;    // behind the camera
+        }
+        if (z <= r) {
+            return 1.0f;    // the camera might be inside the light's influence
+        }
+        return std::min(1.0f, projectionScale * r / std::sqrt(z * z - r * r));
+    };
+
+    // Only generate mipmaps for VSM when anisotropy is enabled.
+    const bool useMipmapping = view.hasVsm() && view.getVsmShadowOptions().anisotropy > 0;
+
+    // Lay out the shadow maps in an atlas, the size of which is the largest requested dimension.
+    // The directional shadow cascades each get their own layer, starting at layer 0, which is
+    // what the shaders expect. Spot lights are packed in the following layers, and can get a
+    // resolution depending on their screen coverage.
     uint16_t maxDimension = 0;
     for (auto& cascade : mCascadeShadowMaps) {
-        // Shadow map size should be the same for all cascades.
-        const size_t lightIndex = cascade.getLightIndex();
-        const uint16_t dim = getShadowMapSize(lightIndex);
-        const uint8_t vsmSamples = getShadowMapVsmSamples(lightIndex);
-        maxDimension = std::max(maxDimension, dim);
-        cascade.setLayout({
-            .layer = layer++,
-            .size = dim,
-            .vsmSamples = vsmSamples
-        });
+        maxDimension = std::max(maxDimension, uint16_t(getShadowMapSize(cascade.getLightIndex())));
+    }
+    for (auto& spotShadowMap : mSpotShadowMaps) {
+        maxDimension = std::max(maxDimension,
+                uint16_t(getShadowMapSize(spotShadowMap.getLightIndex())));
+    }
+    const uint16_t atlasDimension = ShadowMapAtlas::computeDimension(maxDimension);
+
+    ShadowMapAtlas::Request requests[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOW_CASTING_SPOTS];
+    ShadowMapAtlas::Allocation allocations[CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOW_CASTING_SPOTS];
+    size_t requestCount = 0;
+    for (size_t i = 0; i < mCascadeShadowMaps.size(); i++) {
+        requests[requestCount++] = {
+                .key = uint32_t(i),
+                .size = atlasDimension,
+                .importance = 1.0f,
+                .exclusive = true };
     }
     for (auto& spotShadowMap : mSpotShadowMaps) {
         const size_t lightIndex = spotShadowMap.getLightIndex();
-        const uint16_t dim = getShadowMapSize(lightIndex);
-        const uint8_t vsmSamples = getShadowMapVsmSamples(lightIndex);
-        maxDimension = std::max(maxDimension, dim);
-        spotShadowMap.setLayout({
-            .layer = layer++,
-            .size = dim,
-            .vsmSamples = vsmSamples
+        const FLightManager::Instance light = lightData.elementAt<FScene::LIGHT_INSTANCE>(lightIndex);
+        const float coverage = getScreenCoverage(lightIndex);
+        // VSM shadow maps with MSAA can't share a layer, its content is lost when rendering
+        // another shadow map in it. Mipmaps would blend neighbouring maps.
+        const bool exclusive = view.hasVsm() &&
+                (useMipmapping || getShadowMapVsmSamples(lightIndex) > 1);
+        // only shrink the maps of the lights that allow it
+        const bool screenSized = lcm.getShadowOptions(light).screenSizedShadowMap;
+        requests[requestCount++] = {
+                .key = light,
+                .size = exclusive ? atlasDimension : ShadowMapAtlas::computeSize(
+                        getShadowMapSize(lightIndex), screenSized ? coverage : 1.0f,
+                        mAtlas.getSize(light)),
+                .importance = coverage,
+                .exclusive = exclusive };
+    }
+    const uint8_t layer = uint8_t(mAtlas.update(atlasDimension, requests, requestCount,
+            allocations));
+
+    auto setLayout = [&](ShadowMapEntry& entry, ShadowMapAtlas::Allocation const& allocation) {
+        const size_t lightIndex = entry.getLightIndex();
+        // the shadow map might be smaller than its block, when the requested size isn't a
+        // power-of-two
+        entry.setLayout({
+            .layer = allocation.layer,
+            .size = std::min(uint32_t(allocation.size), getShadowMapSize(lightIndex)),
+            .vsmSamples = getShadowMapVsmSamples(lightIndex),
+            .x = allocation.x,
+            .y = allocation.y
         });
+    };
+    size_t allocationIndex = 0;
+    for (auto& cascade : mCascadeShadowMaps) {
+        setLayout(cascade, allocations[allocationIndex++]);
+    }
+    for (auto& spotShadowMap : mSpotShadowMaps) {
+        setLayout(spotShadowMap, allocations[allocationIndex++]);
     }
 
     const uint8_t layersNeeded = layer;
 
-    // Only generate mipmaps for VSM when anisotropy is enabled.
-    const bool useMipmapping = view.hasVsm() && view.getVsmShadowOptions().anisotropy > 0;
 
     uint8_t mipLevels = 1u;
     if (useMipmapping) {
         // Limit the lowest mipmap level to 256x256.
         // This avoids artifacts on high derivative tangent surfaces.
         int lowMipmapLevel = 7;    // log2(256) - 1
-        mipLevels = std::max(1, FTexture::maxLevelCount(maxDimension) - lowMipmapLevel);
+        mipLevels = std::max(1, FTexture::maxLevelCount(atlasDimension) - lowMipmapLevel);
     }
 
     mTextureRequirements = {
-        maxDimension,
+        atlasDimension,
         layersNeeded,
         mipLevels
     };
@@ -28,9 +28,15 @@
 #include <ibl/CubemapUtils.h>
 #include <ibl/Image.h>
 
+#include <utils/JobSystem.h>
+#include <utils/Mutex.h>
 #include <utils/Panic.h>
 #include <filament/Texture.h>
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 using namespace utils;
 
 namespace filament {
@@ -161,6 +167,7 @@ FTexture::FTexture(FEngine& engine, const Builder& builder) {
 
 // frees driver resources, object becomes invalid
 void FTexture::terminate(FEngine& engine) {
+    cancelPrefilter(engine);
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.destroyTexture(mHandle);
 }
@@ -463,14 +470,16 @@ auto make_copyable_function(F&& f) {
     };
 }
 
-void FTexture::generatePrefilterMipmap(FEngine& engine,
-        PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
-        PrefilterOptions const* options) {
+// Validates the source environment and copies it into a seamless cubemap, which becomes the
+// first level of the mipmap chain.
+static bool loadEnvironment(FTexture const& texture,
+        Texture::PixelBufferDescriptor const& buffer, const Texture::FaceOffsets& faceOffsets,
+        std::vector<ibl::Image>& images, std::vector<ibl::Cubemap>& levels) {
     using namespace ibl;
     using namespace backend;
     using namespace math;
 
-    const size_t size = getWidth();
+    const size_t size = texture.getWidth();
     const size_t stride = buffer.stride ? buffer.stride : size;
 
     /* validate input data */
@@ -478,7 +487,7 @@ void FTexture::generatePrefilterMipmap(FEngine& engine,
     if (!ASSERT_PRECONDITION_NON_FATAL(buffer.format == PixelDataFormat::RGB ||
                                        buffer.format == PixelDataFormat::RGBA,
             "input data format must be RGB or RGBA")) {
-        return;
+        return false;
     }
 
     if (!ASSERT_PRECONDITION_NON_FATAL(
@@ -486,46 +495,21 @@ void FTexture::generatePrefilterMipmap(FEngine& engine,
             buffer.type == PixelDataType::HALF ||
             buffer.type == PixelDataType::UINT_10F_11F_11F_REV,
             "input data type must be FLOAT, HALF or UINT_10F_11F_11F_REV")) {
-        return;
+        return false;
     }
 
     /* validate texture */
 
     if (!ASSERT_PRECONDITION_NON_FATAL(!(size & (size-1)),
             "input data cubemap dimensions must be a power-of-two")) {
-        return;
+        return false;
     }
 
-    if (!ASSERT_PRECONDITION_NON_FATAL(!isCompressed(),
+    if (!ASSERT_PRECONDITION_NON_FATAL(!texture.isCompressed(),
             "reflections texture cannot be compressed")) {
-        return;
+        return false;
     }
 
-
-    PrefilterOptions defaultOptions;
-    options = options ? options : &defaultOptions;
-
-    JobSystem& js = engine.getJobSystem();
-    FEngine::DriverApi& driver = engine.getDriverApi();
-
-    auto generateMipmaps = [](JobSystem& js,
-            std::vector<Cubemap>& levels, std::vector<Image>& images) {
-        Image temp;
-        const Cubemap& base(levels[0]);
-        size_t dim = base.getDimensions();
-        size_t mipLevel = 0;
-        while (dim > 1) {
-            dim >>= 1u;
-            Cubemap dst = CubemapUtils::create(temp, dim);
-            const Cubemap& src(levels[mipLevel++]);
-            CubemapUtils::downsampleCubemapLevelBoxFilter(js, dst, src);
-            dst.makeSeamless();
-            images.push_back(std::move(temp));
-            levels.push_back(std::move(dst));
-        }
-    };
-
-
     /*
      * Create a Cubemap data structure
      */
@@ -596,27 +580,81 @@ void FTexture::generatePrefilterMipmap(FEngine& engine,
         }
     }
 
-    /*
-     * Create the mipmap chain
-     */
-
-    std::vector<Image> images;
-    std::vector<Cubemap> levels;
-    images.reserve(getLevels());
-    levels.reserve(getLevels());
+    images.reserve(texture.getLevelCount());
+    levels.reserve(texture.getLevelCount());
 
     images.push_back(std::move(temp));
     levels.push_back(std::move(cml));
 
-    const float3 mirror = options->mirror ? float3{ -1, 1, 1 } : float3{ 1, 1, 1 };
-
     // make the cubemap seamless
     levels[0].makeSeamless();
+    return true;
+}
+
+static void generateCubemapMipmaps(JobSystem& js,
+        std::vector<ibl::Cubemap>& levels, std::vector<ibl::Image>& images) {
+    using namespace ibl;
+    Image temp;
+    const Cubemap& base(levels[0]);
+    size_t dim = base.getDimensions();
+    size_t mipLevel = 0;
+    while (dim > 1) {
+        dim >>= 1u;
+        Cubemap dst = CubemapUtils::create(temp, dim);
+        const Cubemap& src(levels[mipLevel++]);
+        CubemapUtils::downsampleCubemapLevelBoxFilter(js, dst, src);
+        dst.makeSeamless();
+        images.push_back(std::move(temp));
+        levels.push_back(std::move(dst));
+    }
+}
+
+// uploads all 6 faces of a cubemap into the given level, the driver takes ownership of image
+static void uploadCubemap(FEngine::DriverApi& driver, Handle<HwTexture> handle, size_t level,
+        ibl::Image& image, ibl::Cubemap const& cm) {
+    using namespace ibl;
+
+    Texture::PixelBufferDescriptor pbd(image.getData(), image.getSize(),
+            Texture::PixelBufferDescriptor::PixelDataFormat::RGB,
+            Texture::PixelBufferDescriptor::PixelDataType::FLOAT, 1, 0, 0, image.getStride());
+
+    uintptr_t base = uintptr_t(image.getData());
+    backend::FaceOffsets offsets{};
+    for (size_t j = 0; j < 6; j++) {
+        Image const& faceImage = cm.getImageForFace((Cubemap::Face)j);
+        offsets[j] = uintptr_t(faceImage.getData()) - base;
+    }
+    driver.updateCubeImage(handle, level, std::move(pbd), offsets);
+
+    // enqueue a commands that holds the image data until it's executed
+    driver.queueCommand(make_copyable_function([data = image.detach()]() {}));
+}
+
+void FTexture::generatePrefilterMipmap(FEngine& engine,
+        PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
+        PrefilterOptions const* options) {
+    using namespace ibl;
+    using namespace math;
+
+    std::vector<Image> images;
+    std::vector<Cubemap> levels;
+    if (!loadEnvironment(*this, buffer, faceOffsets, images, levels)) {
+        return;
+    }
+
+    PrefilterOptions defaultOptions;
+    options = options ? options : &defaultOptions;
+
+    JobSystem& js = engine.getJobSystem();
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    const float3 mirror = options->mirror ? float3{ -1, 1, 1 } : float3{ 1, 1, 1 };
 
     // Now generate all the mipmap levels
-    generateMipmaps(js, levels, images);
+    generateCubemapMipmaps(js, levels, images);
 
     // Finally generate each pre-filtered mipmap level
+    const size_t size = getWidth();
     const size_t baseExp = ctz(size);
     size_t numSamples = options->sampleCount;
     const size_t numLevels = baseExp + 1;
@@ -629,28 +667,168 @@ void FTexture::generatePrefilterMipmap(FEngine& engine,
         Image image;
         Cubemap dst = CubemapUtils::create(image, dim);
         CubemapIBL::roughnessFilter(js, dst, levels, linearRoughness, numSamples, mirror, true);
+        uploadCubemap(driver, mHandle, level, image, dst);
+    }
+
+    // no need to call the user callback because buffer is a reference and it'll be destroyed
+    // by the caller (without being move()d here).
+}
+
+/*
+ * Asynchronous prefiltering
+ *
+ * The environment is copied on the calling thread, everything else happens in a BACKGROUND job,
+ * which hands over the levels as they're ready. They're uploaded from FEngine::prepare(), since
+ * only the engine's thread can use the driver.
+ */
+
+struct FTexture::PrefilterTask {
+    struct Level {
+        size_t level;
+        ibl::Image image;
+        ibl::Cubemap cubemap;
+        bool prefiltered;       // false for the approximation uploaded first
+    };
+
+    std::vector<ibl::Image> images;         // the environment and its mipmaps
+    std::vector<ibl::Cubemap> levels;
+    math::float3 mirror;
+    size_t numSamples;
+    size_t levelCount;
+    size_t prefilteredCount = 0;            // levels uploaded with their final content
+    PrefilterCallback callback;
+    void* user;
+    std::atomic<bool> canceled = { false };
+
+    utils::Mutex lock;
+    std::vector<Level> ready;               // levels waiting to be uploaded, guarded by lock
+
+    void push(size_t level, ibl::Image&& image, ibl::Cubemap&& cubemap, bool prefiltered) {
+        std::lock_guard<utils::Mutex> guard(lock);
+        ready.push_back({ level, std::move(image), std::move(cubemap), prefiltered });
+    }
+
+    void run(JobSystem& js, JobSystem::Job* job);
+};
+
+void FTexture::PrefilterTask::run(JobSystem& js, JobSystem::Job* job) {
+    using namespace ibl;
 
-        Texture::PixelBufferDescriptor pbd(image.getData(), image.getSize(),
-                Texture::PixelBufferDescriptor::PixelDataFormat::RGB,
-                Texture::PixelBufferDescriptor::PixelDataType::FLOAT, 1, 0, 0, image.getStride());
+    generateCubemapMipmaps(js, levels, images);
 
-        uintptr_t base = uintptr_t(image.getData());
-        backend::FaceOffsets offsets{};
-        for (size_t j = 0; j < 6; j++) {
-            Image const& faceImage = dst.getImageForFace((Cubemap::Face)j);
-            offsets[j] = uintptr_t(faceImage.getData()) - base;
+    // Start with the (mirrored) mipmaps, which approximate the prefiltered levels well enough
+    // to render with. For level 0 this is the final content already, since its roughness is 0.
+    for (size_t level = 0; level < levelCount; level++) {
+        if (canceled.load(std::memory_order_relaxed)) {
+            return;
         }
-        // upload all 6 faces into the texture
-        driver.updateCubeImage(mHandle, level, std::move(pbd), offsets);
+        Cubemap const& src = levels[level];
+        const size_t dim = src.getDimensions();
+        Image image;
+        Cubemap dst = CubemapUtils::create(image, dim);
+        if (mirror.x < 0) {
+            CubemapUtils::mirrorCubemap(js, dst, src);
+        } else {
+            for (size_t j = 0; j < 6; j++) {
+                const Cubemap::Face face = (Cubemap::Face)j;
+                for (size_t y = 0; y < dim; y++) {
+                    memcpy(dst.getImageForFace(face).getPixelRef(0, y),
+                            src.getImageForFace(face).getPixelRef(0, y),
+                            dim * sizeof(Cubemap::Texel));
+                }
+            }
+        }
+        push(level, std::move(image), std::move(dst), level == 0);
+    }
+
+    // Then prefilter each level, lowest roughness first.
+    for (size_t level = 1; level < levelCount; level++) {
+        if (canceled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        const size_t dim = levels[level].getDimensions();
+        const float lod = math::saturate(level / (levelCount - 1.0f));
+        const float linearRoughness = lod * lod;
+        Image image;
+        Cubemap dst = CubemapUtils::create(image, dim);
+        // the filter's jobs are children of this one, and BACKGROUND as well since they're run
+        // from a BACKGROUND job
+        CubemapIBL::roughnessFilter(js, job, dst, levels, linearRoughness, numSamples, mirror,
+                true);
+        push(level, std::move(image), std::move(dst), true);
+    }
+}
+
+void FTexture::generatePrefilterMipmapAsync(FEngine& engine,
+        PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
+        PrefilterOptions const* options, PrefilterCallback callback, void* user) {
+    using namespace math;
+
+    cancelPrefilter(engine);
 
-        // enqueue a commands that holds the image data until it's executed
-        driver.queueCommand(make_copyable_function([data = image.detach()]() {}));
+    auto task = std::make_shared<PrefilterTask>();
+    if (!loadEnvironment(*this, buffer, faceOffsets, task->images, task->levels)) {
+        return;
     }
 
+    PrefilterOptions defaultOptions;
+    options = options ? options : &defaultOptions;
+
+    task->mirror = options->mirror ? float3{ -1, 1, 1 } : float3{ 1, 1, 1 };
+    task->numSamples = options->sampleCount;
+    task->levelCount = ctz(getWidth()) + 1;
+    task->callback = callback;
+    task->user = user;
+
+    // The job keeps its own reference to the task, so that it can be canceled without waiting
+    // for the level being filtered. Its parent isn't the root job of the frame being rendered,
+    // which must not wait for it.
+    JobSystem& js = engine.getJobSystem();
+    js.run(js.createJob(engine.getPrefilterParentJob(),
+            [task](JobSystem& js, JobSystem::Job* job) {
+                task->run(js, job);
+            }), JobSystem::BACKGROUND);
+
+    mPrefilterTask = task;
+    engine.addPrefilteringTexture(this);
+
     // no need to call the user callback because buffer is a reference and it'll be destroyed
     // by the caller (without being move()d here).
 }
 
+bool FTexture::updatePrefilter(FEngine& engine) {
+    PrefilterTask& task = *mPrefilterTask;
+
+    std::vector<PrefilterTask::Level> ready;
+    {
+        std::lock_guard<utils::Mutex> guard(task.lock);
+        std::swap(ready, task.ready);
+    }
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    for (PrefilterTask::Level& level : ready) {
+        uploadCubemap(driver, mHandle, level.level, level.image, level.cubemap);
+        task.prefilteredCount += level.prefiltered ? 1 : 0;
+    }
+    return task.prefilteredCount == task.levelCount;
+}
+
+std::pair<Texture::PrefilterCallback, void*> FTexture::finishPrefilter(FEngine& engine) noexcept {
+    // all the levels are uploaded, so the job is finished or about to be
+    std::pair<PrefilterCallback, void*> callback{ mPrefilterTask->callback, mPrefilterTask->user };
+    mPrefilterTask.reset();
+    return callback;
+}
+
+void FTexture::cancelPrefilter(FEngine& engine) noexcept {
+    if (mPrefilterTask) {
+        // the job stops after the level it's working on, and releases the task then
+        mPrefilterTask->canceled.store(true, std::memory_order_relaxed);
+        engine.removePrefilteringTexture(this);
+        mPrefilterTask.reset();
+    }
+}
+
 bool FTexture::validatePixelFormatAndType(TextureFormat internalFormat,
         PixelDataFormat format, PixelDataType type) noexcept {
 
@@ -1100,4 +1278,11 @@ void Texture::generatePrefilterMipmap(Engine& engine, Texture::PixelBufferDescri
     upcast(this)->generatePrefilterMipmap(upcast(engine), std::move(buffer), faceOffsets, options);
 }
 
+void Texture::generatePrefilterMipmapAsync(Engine& engine,
+        Texture::PixelBufferDescriptor&& buffer, const Texture::FaceOffsets& faceOffsets,
+        PrefilterOptions const* options, PrefilterCallback callback, void* user) {
+    upcast(this)->generatePrefilterMipmapAsync(upcast(engine), std::move(buffer), faceOffsets,
+            options, callback, user);
+}
+
 } // namespace filament
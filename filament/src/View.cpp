@@ -98,6 +98,7 @@ void FView::terminate(FEngine& engine) {
     driver.destroySamplerGroup(mPerViewSbh);
     driver.destroyUniformBuffer(mRenderableUbh);
     drainFrameHistory(engine);
+    mShadowMapManager.terminate(engine);
     mFroxelizer.terminate(driver);
 }
 
@@ -349,49 +350,62 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     mHasDynamicLighting = scene->getLightData().size() > FScene::DIRECTIONAL_LIGHTS_COUNT;
     if (mHasDynamicLighting) {
         Froxelizer& froxelizer = mFroxelizer;
-        if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf)) {
+        if (froxelizer.prepare(driver, arena, viewport, camera, engine.getLightManager(),
+                lightData)) {
             froxelizer.updateUniforms(u); // update our uniform buffer if needed
         }
     }
 }
 
-void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& arena,
-        filament::Viewport const& viewport, float4 const& userTime) noexcept {
-    JobSystem& js = engine.getJobSystem();
-
-    /*
-     * Prepare the scene -- this is where we gather all the objects added to the scene,
-     * and in particular their world-space AABB.
-     */
-
-    FScene* const scene = getScene();
-
+mat4f FView::getWorldOrigin(FEngine const& engine) const noexcept {
     /*
      * We apply a "world origin" to "everything" in order to implement the IBL rotation.
      * The "world origin" could also be useful for other things, like keeping the origin
      * close to the camera position to improve fp precision in the shader for large scenes.
      */
-    mat4f worldOriginScene;
-    FIndirectLight const* const ibl = scene->getIndirectLight();
+    mat4f worldOrigin;
+    FIndirectLight const* const ibl = mScene->getIndirectLight();
     if (ibl) {
         // the IBL transformation must be a rigid transform
-        mat3f rotation{ scene->getIndirectLight()->getRotation() };
+        mat3f rotation{ ibl->getRotation() };
         // for a rigid-body transform, the inverse is the transpose
-        worldOriginScene = mat4f{ transpose(rotation) };
+        worldOrigin = mat4f{ transpose(rotation) };
     }
 
-    /*
-     * Calculate all camera parameters needed to render this View for this frame.
-     */
-    FCamera const* const camera = mViewingCamera ? mViewingCamera : mCullingCamera;
-
     if (engine.debug.view.camera_at_origin) {
         // this moves the camera to the origin, effectively doing all shader computations in
         // view-space, which improves floating point precision in the shader by staying around
         // zero, where fp precision is highest. This also ensures that when the camera is placed
         // very far from the origin, objects are still rendered and lit properly.
-        worldOriginScene[3].xyz -= camera->getPosition();
+        FCamera const* const camera = mViewingCamera ? mViewingCamera : mCullingCamera;
+        worldOrigin[3].xyz -= camera->getPosition();
     }
+    return worldOrigin;
+}
+
+void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& arena,
+        filament::Viewport const& viewport, float4 const& userTime, uint32_t frameId) noexcept {
+    JobSystem& js = engine.getJobSystem();
+
+    /*
+     * Update the world transforms that were deferred by TransformManager::setTransforms(),
+     * they're needed for both the cameras and the scene.
+     */
+    engine.getTransformManager().updateWorldTransforms();
+
+    /*
+     * Prepare the scene -- this is where we gather all the objects added to the scene,
+     * and in particular their world-space AABB.
+     */
+
+    FScene* const scene = getScene();
+
+    mat4f const worldOriginScene = getWorldOrigin(engine);
+
+    /*
+     * Calculate all camera parameters needed to render this View for this frame.
+     */
+    FCamera const* const camera = mViewingCamera ? mViewingCamera : mCullingCamera;
 
     // Note: for debugging (i.e. visualize what the camera / objects are doing, using
     // the viewing camera), we can set worldOriginScene to identity when mViewingCamera
@@ -404,9 +418,12 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
-     * objects in the scene.
+     * objects in the scene. This might have been done already, during the previous frame
+     * when pipelining, or for all the views of this scene rendered together.
      */
-    scene->prepare(worldOriginScene);
+    if (!scene->usePrepared(mNextFrame, worldOriginScene, frameId)) {
+        scene->prepare(worldOriginScene);
+    }
 
     /*
      * Light culling: runs in parallel with Renderable culling (below)
@@ -552,6 +569,20 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
+
+    /*
+     * Gather the scene for the next frame while this one is being recorded. This reflects the
+     * current state of the scene, which can't change until FRenderer::render() returns.
+     */
+    if (mFramePipelining) {
+        scene->prepareNextFrame(mNextFrame, worldOriginScene, frameId + 1);
+    }
+}
+
+void FView::finishPrepareNextFrame() noexcept {
+    if (mScene) {
+        mScene->finishPrepareNextFrame(mNextFrame);
+    }
 }
 
 void FView::computeVisibilityMasks(
@@ -695,7 +726,7 @@ void FView::froxelize(FEngine& engine) const noexcept {
 
     if (mHasDynamicLighting) {
         // froxelize lights
-        mFroxelizer.froxelizeLights(engine, mViewingCameraInfo, mScene->getLightData());
+        mFroxelizer.froxelizeLights(engine, mScene->getLightData());
     }
 }
 
@@ -754,7 +785,7 @@ void FView::cullRenderables(JobSystem& js,
     js.runAndWait(job);
 }
 
-void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
+void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem& js,
         Frustum const& frustum, FScene::LightSoa& lightData) noexcept {
     SYSTRACE_CALL();
 
@@ -766,49 +797,92 @@ void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
     Culler::intersects(visibleArray, frustum, sphereArray, lightData.size());
 
     const float4* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
-    // the directional light is considered visible
-    size_t visibleLightCount = FScene::DIRECTIONAL_LIGHTS_COUNT;
-    // skip directional light
-    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT; i < lightData.size(); i++) {
-        FLightManager::Instance li = instanceArray[i];
-        if (visibleArray[i]) {
-            if (!lcm.isLightCaster(li)) {
-                visibleArray[i] = 0;
-                continue;
-            }
-            if (lcm.getIntensity(li) <= 0.0f) {
-                visibleArray[i] = 0;
-                continue;
-            }
-            // cull spotlights that cannot possibly intersect the view frustum
-            if (lcm.isSpotLight(li)) {
-                const float3 position = sphereArray[i].xyz;
-                const float3 axis = directions[i];
-                const float cosSqr = lcm.getCosOuterSquared(li);
-                bool invisible = false;
-                for (size_t j = 0; j < 6; ++j) {
-                    const float p = dot(position + planes[j].xyz * planes[j].w, planes[j].xyz);
-                    const float c = dot(planes[j].xyz, axis);
-                    invisible |= ((1.0f - c * c) < cosSqr && c > 0 && p > 0);
+
+    auto cullLights = [=, &lcm](uint32_t start, uint32_t count) {
+        uint32_t visibleLightCount = 0;
+        for (size_t i = start; i < start + count; i++) {
+            FLightManager::Instance li = instanceArray[i];
+            if (visibleArray[i]) {
+                if (!lcm.isLightCaster(li)) {
+                    visibleArray[i] = 0;
+                    continue;
                 }
-                if (invisible) {
+                if (lcm.getIntensity(li) <= 0.0f) {
                     visibleArray[i] = 0;
                     continue;
                 }
+                // cull spotlights that cannot possibly intersect the view frustum
+                if (lcm.isSpotLight(li)) {
+                    const float3 position = sphereArray[i].xyz;
+                    const float3 axis = directions[i];
+                    const float cosSqr = lcm.getCosOuterSquared(li);
+                    bool invisible = false;
+                    for (size_t j = 0; j < 6; ++j) {
+                        const float p = dot(position + planes[j].xyz * planes[j].w, planes[j].xyz);
+                        const float c = dot(planes[j].xyz, axis);
+                        invisible |= ((1.0f - c * c) < cosSqr && c > 0 && p > 0);
+                    }
+                    if (invisible) {
+                        visibleArray[i] = 0;
+                        continue;
+                    }
+                }
+                visibleLightCount++;
             }
-            visibleLightCount++;
         }
-    }
+        return visibleLightCount;
+    };
 
-    // Partition array such that all visible lights appear first
-    UTILS_UNUSED_IN_RELEASE auto last =
-            std::partition(lightData.begin() + FScene::DIRECTIONAL_LIGHTS_COUNT, lightData.end(),
-                    [](auto const& it) {
-                        return it.template get<FScene::VISIBILITY>() != 0;
-                    });
-    assert(visibleLightCount == size_t(last - lightData.begin()));
+    // the directional light is considered visible, skip it
+    const uint32_t first = FScene::DIRECTIONAL_LIGHTS_COUNT;
+    const uint32_t end = uint32_t(lightData.size());
+    const uint32_t visibleEnd = first + jobs::parallel_reduce(js, first, end - first, 0u,
+            cullLights, std::plus<uint32_t>(), jobs::CountSplitter<64>());
+
+    // Partition the array such that all visible lights appear first. Each visible light past
+    // visibleEnd is moved into the slot of an invisible light before it, the k-th light into
+    // the k-th slot: a scan of each side gives the lights and the slots their rank.
+    if (first < visibleEnd && visibleEnd < end) {
+        auto countLights = [visibleArray](bool visible) {
+            return [visibleArray, visible](uint32_t start, uint32_t count) {
+                uint32_t n = 0;
+                for (uint32_t i = start; i < start + count; i++) {
+                    n += uint32_t(bool(visibleArray[i]) == visible);
+                }
+                return n;
+            };
+        };
+
+        std::unique_ptr<uint32_t[]> slots(new uint32_t[visibleEnd - first]);
+
+        UTILS_UNUSED_IN_RELEASE const uint32_t slotCount = jobs::parallel_scan(js,
+                first, visibleEnd - first, 0u, countLights(false), std::plus<uint32_t>(),
+                [visibleArray, slots = slots.get()](uint32_t start, uint32_t count, uint32_t k) {
+                    for (uint32_t i = start; i < start + count; i++) {
+                        if (!visibleArray[i]) {
+                            slots[k++] = i;
+                        }
+                    }
+                    return k;
+                }, jobs::CountSplitter<64>());
+
+        UTILS_UNUSED_IN_RELEASE const uint32_t movedCount = jobs::parallel_scan(js,
+                visibleEnd, end - visibleEnd, 0u, countLights(true), std::plus<uint32_t>(),
+                [&lightData, visibleArray, slots = slots.get()](
+                        uint32_t start, uint32_t count, uint32_t k) {
+                    auto const begin = lightData.begin();
+                    for (uint32_t i = start; i < start + count; i++) {
+                        if (visibleArray[i]) {
+                            *(begin + slots[k++]) = *(begin + i);
+                        }
+                    }
+                    return k;
+                }, jobs::CountSplitter<64>());
+
+        assert(slotCount == movedCount);
+    }
 
-    lightData.resize(visibleLightCount);
+    lightData.resize(visibleEnd);
 }
 
 void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
@@ -880,6 +954,14 @@ bool View::isFrustumCullingEnabled() const noexcept {
     return upcast(this)->isFrustumCullingEnabled();
 }
 
+void View::setFramePipeliningEnabled(bool enabled) noexcept {
+    upcast(this)->setFramePipeliningEnabled(enabled);
+}
+
+bool View::isFramePipeliningEnabled() const noexcept {
+    return upcast(this)->isFramePipeliningEnabled();
+}
+
 void View::setDebugCamera(Camera* camera) noexcept {
     upcast(this)->setViewingCamera(upcast(camera));
 }
@@ -1008,6 +1090,18 @@ View::VsmShadowOptions View::getVsmShadowOptions() const noexcept {
     return upcast(this)->getVsmShadowOptions();
 }
 
+void View::setShadowMapCachingEnabled(bool enabled) noexcept {
+    upcast(this)->setShadowMapCachingEnabled(enabled);
+}
+
+bool View::isShadowMapCachingEnabled() const noexcept {
+    return upcast(this)->isShadowMapCachingEnabled();
+}
+
+View::ShadowMapCacheStats View::getShadowMapCacheStats() const noexcept {
+    return upcast(this)->getShadowMapCacheStats();
+}
+
 void View::setAmbientOcclusion(View::AmbientOcclusion ambientOcclusion) noexcept {
     upcast(this)->setAmbientOcclusion(ambientOcclusion);
 }
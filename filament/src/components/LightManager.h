@@ -60,6 +60,11 @@ public:
         return mManager.getInstance(e);
     }
 
+    // changes whenever Instances are invalidated
+    uint32_t getVersion() const noexcept {
+        return mManager.getVersion();
+    }
+
     void create(const FLightManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
@@ -80,6 +80,15 @@ public:
         return mManager.getInstance(e);
     }
 
+    utils::Entity getEntity(Instance i) const noexcept {
+        return mManager.getEntity(i);
+    }
+
+    // changes whenever Instances are invalidated
+    uint32_t getVersion() const noexcept {
+        return mManager.getVersion();
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
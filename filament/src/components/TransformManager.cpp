@@ -16,6 +16,9 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
 #include <math/mat4.h>
 
 using namespace utils;
@@ -27,6 +30,10 @@ FTransformManager::FTransformManager() noexcept = default;
 
 FTransformManager::~FTransformManager() noexcept = default;
 
+void FTransformManager::init(JobSystem& js) noexcept {
+    mJobSystem = &js;
+}
+
 void FTransformManager::terminate() noexcept {
 }
 
@@ -141,6 +148,80 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     }
 }
 
+void FTransformManager::setTransforms(Instance const* instances, mat4f const* models,
+        size_t count) noexcept {
+    auto& manager = mManager;
+    for (size_t k = 0; k < count; k++) {
+        Instance const ci = instances[k];
+        validateNode(ci);
+        if (ci) {
+            // world transforms are updated later, in updateWorldTransforms()
+            manager[ci].local = models[k];
+            manager[ci].dirty = true;
+            mHasDirtyTransforms = true;
+        }
+    }
+}
+
+void FTransformManager::updateWorldTransforms() noexcept {
+    if (UTILS_LIKELY(!mHasDirtyTransforms) || UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
+        // nothing to do, or commitLocalTransformTransaction() will take care of it
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    mHasDirtyTransforms = false;
+    auto& manager = mManager;
+    auto& soa = manager.getSoA();
+    bool* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+    mat4f const* const UTILS_RESTRICT world = soa.data<WORLD>();
+
+    // Nodes are not necessarily sorted by depth here. We update each dirty subtree from its
+    // root, which is a dirty node without dirty ancestors, this way each node is visited once.
+    // Dirty flags must stay set until we're done, so we can identify these roots.
+    auto& roots = mDirtyRoots;
+    roots.clear();
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (UTILS_LIKELY(!dirty[i])) {
+            continue;
+        }
+        Instance p = parents[i];
+        while (p && !dirty[p]) {
+            p = parents[p];
+        }
+        if (!p) {
+            // none of our ancestors is dirty, otherwise we'd be updated with it
+            roots.push_back(i);
+        }
+    }
+
+    // subtrees are disjoint, so they can be updated concurrently
+    auto work = [&manager, world, parents, roots = roots.data()](uint32_t start, uint32_t count) {
+        for (uint32_t k = start, e = start + count; k != e; ++k) {
+            const Instance i = roots[k];
+            manager[i].world = world[parents[i]] * static_cast<mat4f const&>(manager[i].local);
+            Instance child = manager[i].firstChild;
+            if (UTILS_UNLIKELY(child)) {
+                transformChildren(manager, child);
+            }
+        }
+    };
+
+    constexpr size_t PARALLEL_THRESHOLD = 512;
+    JobSystem* const js = mJobSystem;
+    if (js && roots.size() >= PARALLEL_THRESHOLD) {
+        auto* job = jobs::parallel_for(*js, nullptr, 0, uint32_t(roots.size()), std::cref(work),
+                jobs::CountSplitter<PARALLEL_THRESHOLD / 4>());
+        js->runAndWait(job);
+    } else {
+        work(0, uint32_t(roots.size()));
+    }
+
+    std::fill_n(dirty, soa.size(), false);
+}
+
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
         return;
@@ -172,21 +253,137 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
+        sortByDepth();
+        computeAllWorldTransforms();
+
+        // all world transforms are up-to-date now
+        if (mHasDirtyTransforms) {
+            mHasDirtyTransforms = false;
+            auto& soa = mManager.getSoA();
+            std::fill_n(soa.data<DIRTY>(), soa.size(), false);
+        }
+    }
+}
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+// Reorders the nodes so they're sorted by their depth in the hierarchy, i.e. all roots first,
+// then all their children, etc... This guarantees that parents are always before their children
+// and allows each level to be processed in parallel. The order is stable, so in the common case
+// where the hierarchy didn't change, no node is moved.
+void FTransformManager::sortByDepth() noexcept {
+    SYSTRACE_CALL();
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            while (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
-            }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+    auto& manager = mManager;
+    const Instance first = manager.begin();
+    const Instance last = manager.end();
+    const size_t size = last;
+
+    // compute the depth of each node, walking up the hierarchy only until we find a node
+    // of known depth.
+    constexpr uint32_t UNKNOWN = std::numeric_limits<uint32_t>::max();
+    auto& depths = mDepths;
+    depths.assign(size, UNKNOWN);
+    uint32_t maxDepth = 0;
+    bool sorted = true;
+    for (Instance i = first; i != last; ++i) {
+        size_t d = 0;
+        Instance p = i;
+        while (p && depths[p] == UNKNOWN) {
+            p = manager[p].parent;
+            d++;
+        }
+        d += p ? depths[p] : size_t(-1);
+        for (Instance c = i; c != p; c = manager[c].parent) {
+            depths[c] = uint32_t(d--);
+        }
+        maxDepth = std::max(maxDepth, depths[i]);
+        sorted = sorted && (i == first || depths[i - 1] <= depths[i]);
+    }
+
+    // counting sort: compute the first instance of each level
+    auto& levels = mLevels;
+    levels.assign(maxDepth + 2u, 0);
+    for (Instance i = first; i != last; ++i) {
+        levels[depths[i] + 1u]++;
+    }
+    levels[0] = first;
+    for (size_t d = 1; d < levels.size(); d++) {
+        levels[d] += levels[d - 1];
+    }
+
+    if (UTILS_LIKELY(sorted)) {
+        return;
+    }
+
+    // compute the new order of all nodes
+    auto& order = mSortedOrder;
+    order.resize(size);
+    auto& cursor = mCursors;
+    cursor = levels;
+    for (Instance i = first; i != last; ++i) {
+        order[cursor[depths[i]]++] = i;
+    }
+
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    // and apply the permutation, keeping track of where each node went.
+    auto& positions = mPositions;   // original instance -> current position
+    auto& occupants = mOccupants;   // current position -> original instance
+    positions.resize(size);
+    occupants.resize(size);
+    for (Instance i = first; i != last; ++i) {
+        positions[i] = i;
+        occupants[i] = i;
+    }
+    for (Instance k = first; k != last; ++k) {
+        const Instance wanted = order[k];
+        const Instance from = positions[wanted];
+        if (from != k) {
+            swapNode(k, from);
+            const Instance displaced = occupants[k];
+            occupants[from] = displaced;
+            positions[displaced] = from;
+            occupants[k] = wanted;
+            positions[wanted] = k;
+        }
+    }
+}
+
+// Computes the world transforms of all nodes, one level at a time. This assumes sortByDepth()
+// has been called.
+void FTransformManager::computeAllWorldTransforms() noexcept {
+    SYSTRACE_CALL();
+
+    auto& manager = mManager;
+    auto& soa = manager.getSoA();
+    mat4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+    mat4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+
+    auto work = [world, local, parents](uint32_t start, uint32_t count) {
+        for (uint32_t i = start, e = start + count; i != e; ++i) {
+            // note: the root nodes have the null instance as parent, whose world transform
+            // is the identity.
+            assert(parents[i] < Instance(i));
+            world[i] = world[parents[i]] * local[i];
+        }
+    };
+
+    // A level can only be processed once the level above it is done. Small levels are not
+    // worth the overhead of the JobSystem.
+    constexpr size_t PARALLEL_THRESHOLD = 512;
+    JobSystem* const js = mJobSystem;
+    auto const& levels = mLevels;
+    for (size_t d = 0, c = levels.size() - 1; d < c; d++) {
+        const uint32_t start = levels[d];
+        const uint32_t count = levels[d + 1] - start;
+        if (js && count >= PARALLEL_THRESHOLD) {
+            auto* job = jobs::parallel_for(*js, nullptr, start, count, std::cref(work),
+                    jobs::CountSplitter<PARALLEL_THRESHOLD / 2>());
+            js->runAndWait(job);
+        } else {
+            work(start, count);
         }
     }
 }
@@ -225,6 +422,7 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -413,6 +611,15 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
+void TransformManager::setTransforms(Instance const* instances,
+        const mat4f* localTransforms, size_t count) noexcept {
+    upcast(this)->setTransforms(instances, localTransforms, count);
+}
+
+void TransformManager::updateWorldTransforms() noexcept {
+    upcast(this)->updateWorldTransforms();
+}
+
 const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
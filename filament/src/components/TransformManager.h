@@ -28,6 +28,12 @@
 
 #include <math/mat4.h>
 
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class UTILS_PRIVATE FTransformManager : public TransformManager {
@@ -37,6 +43,9 @@ public:
     FTransformManager() noexcept;
     ~FTransformManager() noexcept;
 
+    // world transforms are computed in parallel when a JobSystem is provided
+    void init(utils::JobSystem& js) noexcept;
+
     // free-up all resources
     void terminate() noexcept;
 
@@ -81,8 +90,17 @@ public:
         return mManager.slice<WORLD>();
     }
 
+    // outside of a transaction, this updates the world transforms of the node's subtree
+    // immediately, on the calling thread.
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
+    void setTransforms(Instance const* instances, math::mat4f const* models,
+            size_t count) noexcept;
+
+    // computes the world transform of nodes set with setTransforms(), if any. Independent
+    // subtrees are updated in parallel when there are many of them.
+    void updateWorldTransforms() noexcept;
+
     const math::mat4f& getTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
@@ -101,6 +119,8 @@ private:
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
     static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    void sortByDepth() noexcept;
+    void computeAllWorldTransforms() noexcept;
 
     friend class TransformManager::children_iterator;
 
@@ -111,6 +131,7 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        DIRTY,          // local transform changed, world transform of the subtree is stale
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -119,7 +140,8 @@ private:
             Instance,
             Instance,
             Instance,
-            Instance
+            Instance,
+            bool
     >;
 
     struct Sim : public Base {
@@ -142,6 +164,7 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<DIRTY>        dirty;
             };
         };
 
@@ -155,6 +178,22 @@ private:
 
     Sim mManager;
     bool mLocalTransformTransactionOpen = false;
+    bool mHasDirtyTransforms = false;
+    utils::JobSystem* mJobSystem = nullptr;
+
+    // scratch storage for sortByDepth(), kept around to avoid allocations
+    std::vector<uint32_t> mDepths;
+    std::vector<uint32_t> mCursors;
+    std::vector<Instance> mSortedOrder;
+    std::vector<Instance> mPositions;
+    std::vector<Instance> mOccupants;
+
+    // first instance of each depth level (plus one past the last instance), valid after
+    // sortByDepth()
+    std::vector<uint32_t> mLevels;
+
+    // scratch storage for updateWorldTransforms()
+    std::vector<Instance> mDirtyRoots;
 };
 
 FILAMENT_UPCAST(TransformManager)
@@ -284,6 +284,13 @@ public:
     void prepare();
     void gc();
 
+    // textures with a prefiltering in flight, see FTexture::generatePrefilterMipmapAsync()
+    void addPrefilteringTexture(FTexture* texture);
+    void removePrefilteringTexture(FTexture* texture) noexcept;
+
+    // parent of all the prefiltering jobs, which can outlive their texture
+    utils::JobSystem::Job* getPrefilterParentJob() noexcept;
+
     filaflat::ShaderBuilder& getVertexShaderBuilder() const noexcept {
         return mVertexShaderBuilder;
     }
@@ -355,6 +362,9 @@ private:
     ResourceList<FColorGrading> mColorGradings{ "ColorGrading" };
     ResourceList<FRenderTarget> mRenderTargets{ "RenderTarget" };
 
+    std::vector<FTexture*> mPrefilteringTextures;
+    utils::JobSystem::Job* mPrefilterParentJob = nullptr;
+
     mutable uint32_t mMaterialId = 0;
 
     // FMaterialInstance are handled directly by FMaterial
@@ -401,6 +411,7 @@ public:
             bool lispsm = true;
             bool visualize_cascades = false;
             bool tightly_bound_scene = true;
+            bool cache = true;
             float dzn = -1.0f;
             float dzf =  1.0f;
         } shadowmap;
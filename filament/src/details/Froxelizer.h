@@ -107,14 +107,18 @@ public:
      * driverApi         used to allocate memory in the stream
      * arena             use to allocate per-frame memory
      * viewport          viewport used to calculate froxel dimensions
-     * projection        camera projection matrix
-     * projectionNear    near plane
-     * projectionFar     far plane
+     * camera            camera projection, near and far planes and view matrix
+     * lcm               light manager, for the spot lights parameters
+     * lightData         lights to froxelize
+     *
+     * This finds the lights that changed since the last froxelization. Nothing is allocated
+     * if none did, froxelizeLights() and commit() are no-ops in that case.
      *
      * return true if updateUniforms() needs to be called
      */
     bool prepare(backend::DriverApi& driverApi, ArenaScope& arena, Viewport const& viewport,
-            const math::mat4f& projection, float projectionNear, float projectionFar) noexcept;
+            CameraInfo const& camera, FLightManager const& lcm,
+            const FScene::LightSoa& lightData) noexcept;
 
     Froxel getFroxelAt(size_t x, size_t y, size_t z) const noexcept;
     size_t getFroxelCountX() const noexcept { return mFroxelCountX; }
@@ -123,8 +127,10 @@ public:
     size_t getFroxelCount() const noexcept { return mFroxelCount; }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
-    void froxelizeLights(FEngine& engine, CameraInfo const& camera,
-            const FScene::LightSoa& lightData) noexcept;
+    // Only the lights that prepare() found changed are re-froxelized, and nothing at all
+    // is done if neither the lights nor the projection or viewport changed.
+    // lightData must be the same as the one given to prepare().
+    void froxelizeLights(FEngine& engine, const FScene::LightSoa& lightData) noexcept;
 
     void updateUniforms(UniformBuffer& u) {
         u.setUniform(offsetof(PerViewUib, zParams), mParamsZ);
@@ -134,7 +140,7 @@ public:
         u.setUniform(offsetof(PerViewUib, oneOverFroxelDimensionY), mOneOverDimension.y);
     }
 
-    // send froxel data to GPU
+    // send froxel data to GPU, this is a no-op if froxelizeLights() didn't change anything.
     void commit(backend::DriverApi& driverApi);
 
 
@@ -157,6 +163,7 @@ public:
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_INDEX <= std::numeric_limits<uint8_t>::max(), uint8_t, uint16_t>;
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
+    bool isCommitNeeded() const noexcept { return mCommitNeeded; }
 
     // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
     // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
@@ -176,6 +183,11 @@ private:
         float invSin = std::numeric_limits<float>::infinity();
         // radius is not used in the hot loop, so leave it at the end
         float radius;
+
+        bool operator!=(LightParams const& rhs) const noexcept {
+            return position != rhs.position || axis != rhs.axis ||
+                   cosSqr != rhs.cosSqr || invSin != rhs.invSin || radius != rhs.radius;
+        }
     };
 
     struct LightTreeNode {
@@ -196,8 +208,11 @@ private:
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
 
-    void froxelizeLoop(FEngine& engine,
-            const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
+    // updates mLightParams and mDirtyLights, returns false if no light needs to be froxelized
+    bool findDirtyLights(FLightManager const& lcm, CameraInfo const& camera,
+            const FScene::LightSoa& lightData) noexcept;
+
+    void froxelizeLoop(FEngine& engine) noexcept;
 
     void froxelizeAssignRecordsCompress() noexcept;
 
@@ -228,7 +243,11 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
+    // these persist across frames so that only lights that changed need to be re-froxelized
     utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
+    utils::Slice<LightParams> mLightParams;             //   9 KiB w/  256 lights
+    size_t mLightParamsCount = 0;
+    LightRecord::bitset mDirtyLights;                   // lights to re-froxelize
     utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
 
     // max 32 KiB  (actual: resolution dependant)
@@ -258,6 +277,12 @@ private:
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
 
+    // set when all lights must be re-froxelized (i.e. the froxels themselves changed)
+    bool mFroxelsInvalid = true;
+
+    // set by prepare() when froxelizeLights() will produce new data that must be sent to the GPU
+    bool mCommitNeeded = false;
+
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
     enum {
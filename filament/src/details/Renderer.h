@@ -73,6 +73,7 @@ public:
 
     // do all the work here!
     void render(FView const* view);
+    void render(View const* const* views, size_t count);
     void renderJob(ArenaScope& arena, FView& view);
 
     void copyFrame(FSwapChain* dstSwapChain, Viewport const& dstViewport,
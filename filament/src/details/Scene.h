@@ -31,10 +31,13 @@
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
+#include <utils/JobSystem.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <math/mat34.h>
+
 #include <cstddef>
 #include <tsl/robin_set.h>
 
@@ -84,6 +87,7 @@ public:
     void terminate(FEngine& engine);
 
     void prepare(const math::mat4f& worldOriginTransform);
+
     void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept;
 
 
@@ -99,7 +103,7 @@ public:
 
     enum {
         RENDERABLE_INSTANCE,    //  4 | instance of the Renderable component
-        WORLD_TRANSFORM,        // 16 | instance of the Transform component
+        WORLD_TRANSFORM,        // 48 | affine world transform, as a 3x4 matrix
         REVERSED_WINDING_ORDER, //  1 | det(WORLD_TRANSFORM)<0
         VISIBILITY_STATE,       //  1 | visibility data of the component
         BONES_UBH,              //  4 | bones uniform buffer handle
@@ -118,7 +122,7 @@ public:
 
     using RenderableSoa = utils::StructureOfArrays<
             utils::EntityInstance<RenderableManager>,   // RENDERABLE_INSTANCE
-            math::mat4f,                                // WORLD_TRANSFORM
+            math::mat34f,                               // WORLD_TRANSFORM
             bool,                                       // REVERSED_WINDING_ORDER
             FRenderableManager::Visibility,             // VISIBILITY_STATE
             backend::Handle<backend::HwUniformBuffer>,  // BONES_UBH
@@ -200,7 +204,54 @@ public:
 
     bool hasContactShadows() const noexcept;
 
+    /*
+     * Data gathered ahead of time, instead of by prepare().
+     *
+     * Pipelining, see View::setFramePipeliningEnabled(): each view keeps its own PreparedData,
+     * prepareNextFrame() gathers the scene into it on the JobSystem for the next frame,
+     * finishPrepareNextFrame() waits for that to complete and must be called before the scene
+     * or any of its components can be modified.
+     *
+     * Sharing, when several views of this scene are rendered together: prepareShared() gathers
+     * the scene once for all of them, until endShared(). Views don't pipeline in the meantime.
+     * The renderables are used in place by each view, only the lights are copied.
+     *
+     * usePrepared() makes the gathered data current if it's still valid for this frame,
+     * prepare() must be called otherwise.
+     */
+    struct PreparedData {
+        RenderableSoa renderableData;
+        LightSoa lightData;
+        math::mat4f worldOrigin;
+        utils::JobSystem::Job* job = nullptr;
+        FScene const* scene = nullptr;      // the scene this was gathered from, if any
+        uint32_t structureVersion = 0;
+        uint32_t frameId = 0;               // the frame this was gathered for
+    };
+
+    void prepareNextFrame(PreparedData& next,
+            const math::mat4f& worldOriginTransform, uint32_t frameId);
+    void finishPrepareNextFrame(PreparedData& next) noexcept;
+    void prepareShared(const math::mat4f& worldOriginTransform, uint32_t frameId);
+    void endShared() noexcept;
+    bool usePrepared(PreparedData& next,
+            const math::mat4f& worldOriginTransform, uint32_t frameId) noexcept;
+
 private:
+    void gather(RenderableSoa& sceneData, LightSoa& lightData,
+            const math::mat4f& worldOriginTransform);
+
+    static void padLightData(LightSoa& lightData) noexcept;
+
+    bool isPreparedValid(PreparedData const& prepared,
+            const math::mat4f& worldOriginTransform, uint32_t frameId) const noexcept;
+
+    static void offsetPrepared(RenderableSoa& sceneData, LightSoa& lightData,
+            math::float3 offset) noexcept;
+
+    // changes whenever the entities of the scene or the renderable and light instances change
+    uint32_t getStructureVersion() const noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -229,6 +280,15 @@ private:
     LightSoa mLightData;
     backend::Handle<backend::HwUniformBuffer> mRenderableViewUbh; // This is actually owned by the view.
     bool mHasContactShadows = false;
+
+    /*
+     * Data gathered for all the views sharing this scene, only its lights are used, the
+     * renderables are gathered into mRenderableData. It's only valid as long as the instances
+     * it refers to are, and is discarded otherwise.
+     */
+    PreparedData mShared;
+    uint32_t mEntitiesVersion = 0;
+    bool mHasShared = false;
 };
 
 FILAMENT_UPCAST(Scene)
@@ -55,6 +55,9 @@ public:
         // the dimension of the actual shadow map, taking into account the 1 texel border
         // e.g., for a texture dimension of 512, shadowDimension would be 510
         size_t shadowDimension = 0;
+
+        // the position of the shadow map texture within the atlas, in texels
+        math::uint2 offset = {};
     };
 
     struct CascadeParameters {
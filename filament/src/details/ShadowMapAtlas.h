@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWMAPATLAS_H
+#define TNT_FILAMENT_DETAILS_SHADOWMAPATLAS_H
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace filament {
+
+/*
+ * ShadowMapAtlas packs square shadow maps into the layers of a texture array.
+ *
+ * Shadow maps are allocated power-of-two blocks, and each layer is split like a quadtree (i.e.
+ * it's a 2D buddy allocator), so packing is exact for as long as there is space left.
+ * Allocations are kept from one update() to the next, so that a shadow map doesn't move
+ * (and its cached content stays valid) unless its size changes.
+ *
+ * This is purely CPU-side book-keeping, it doesn't know anything about textures.
+ */
+class ShadowMapAtlas {
+public:
+    // smallest block handed out, in texels
+    static constexpr uint16_t MIN_SIZE = 32;
+
+    struct Request {
+        uint32_t key = 0;           // identifies a shadow map from one update to the next
+        uint16_t size = 0;          // in texels, rounded up to a power-of-two block
+        float importance = 0.0f;    // amongst maps of the same size, most important go first
+        bool exclusive = false;     // the map gets a layer to itself
+    };
+
+    struct Allocation {
+        uint16_t x = 0;             // position of the block within its layer, in texels
+        uint16_t y = 0;
+        uint16_t size = 0;          // size of the block, in texels
+        uint8_t layer = 0;
+    };
+
+    // Returns the dimension of an atlas that can hold a shadow map of the given size.
+    static uint16_t computeDimension(uint32_t largestSize) noexcept;
+
+    // Chooses the block size of a shadow map from its requested size and how much of the screen
+    // it covers, between 0 and 1. Maps only shrink when they're much larger than needed, so
+    // that small camera moves don't cause them to be reallocated. currentSize is the size
+    // returned by getSize().
+    static uint16_t computeSize(uint32_t requestedSize, float coverage,
+            uint16_t currentSize) noexcept;
+
+    // Lays out the requests in layers of dimension x dimension texels, dimension must be a
+    // power-of-two. Exclusive requests are assigned layers 0 to N-1 in order, the other requests
+    // are packed in the following layers. Allocations are returned in the order of the requests.
+    // Returns the number of layers needed.
+    size_t update(uint16_t dimension, Request const* requests, size_t count,
+            Allocation* allocations);
+
+    // current block size for the given key, or 0
+    uint16_t getSize(uint32_t key) const noexcept;
+
+    size_t getLayerCount() const noexcept { return mLayerCount; }
+
+private:
+    static constexpr size_t MAX_LEVELS = 16;
+
+    struct Entry {
+        uint32_t key;
+        Allocation allocation;
+        bool exclusive;
+    };
+
+    void reset(uint16_t dimension) noexcept;
+    bool allocate(uint16_t size, Allocation* allocation);
+    void free(Allocation const& allocation);
+    size_t getLevel(uint16_t size) const noexcept;
+
+    uint16_t mDimension = 0;
+    size_t mLayerCount = 0;
+    std::vector<Entry> mEntries;
+    // free blocks of each level, level 0 is a whole layer
+    std::vector<Allocation> mFreeBlocks[MAX_LEVELS];
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWMAPATLAS_H
@@ -17,6 +17,7 @@
 #ifndef TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
 #define TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
 
+#include <filament/View.h>
 #include <filament/Viewport.h>
 
 #include <private/backend/DriverApi.h>
@@ -29,11 +30,16 @@
 #include <backend/DriverEnums.h>
 #include <backend/Handle.h>
 
+#include "details/ShadowMapAtlas.h"
+
 #include "fg/FrameGraph.h"
 #include "fg/FrameGraphPassResources.h"
 
+#include <math/mat4.h>
 #include <math/vec3.h>
 
+#include <utils/Range.h>
+
 #include <array>
 #include <memory>
 #include <vector>
@@ -58,6 +64,9 @@ public:
     explicit ShadowMapManager(FEngine& engine);
     ~ShadowMapManager();
 
+    // Releases the shadow map texture kept from one frame to the next.
+    void terminate(FEngine& engine) noexcept;
+
     // Reset shadow map layout.
     void reset() noexcept;
 
@@ -81,12 +90,20 @@ public:
         return mCascadeShadowMapCache[c].get();
     }
 
+    // Shadow maps rendered (misses) and reused (hits) by the last call to render().
+    View::ShadowMapCacheStats getCacheStats() const noexcept {
+        return mCacheStats;
+    }
+
 private:
 
     struct ShadowLayout {
         uint8_t layer = 0;
         uint32_t size = 0;
         uint8_t vsmSamples = 1;
+        // position of the shadow map within its layer, in texels
+        uint16_t x = 0;
+        uint16_t y = 0;
     };
 
     struct TextureRequirements {
@@ -104,6 +121,25 @@ private:
 
     void calculateTextureRequirements(FEngine& engine, FView& view, FScene::LightSoa& lightData) noexcept;
 
+    // What a shadow map was last rendered with. A map is only rendered again when any of
+    // this changes, otherwise its layer of the shadow texture is reused as is.
+    struct RenderedShadowMap {
+        math::mat4f lightFromWorld;     // from world space, i.e. without the world origin
+        FLightManager::Instance light;
+        ShadowLayout layout;
+        backend::PolygonOffset polygonOffset;
+        uint32_t castersHash = 0;
+        bool valid = false;
+    };
+
+    // Returns true if the shadow map needs to be rendered, and records it as rendered.
+    static bool needsRendering(RenderedShadowMap& rendered,
+            RenderedShadowMap const& current) noexcept;
+
+    // Hashes everything that affects the shadow casters in the range that pass the mask.
+    static uint32_t hashShadowCasters(FEngine& engine, FScene::RenderableSoa const& soa,
+            utils::Range<uint32_t> range, FScene::VisibleMaskType mask) noexcept;
+
     class ShadowMapEntry {
     public:
         ShadowMapEntry() = default;
@@ -180,6 +216,17 @@ private:
 
     std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASCADES> mCascadeShadowMapCache;
     std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASTING_SPOTS> mSpotShadowMapCache;
+
+    // Where each shadow map lives in the shadow texture, kept from one frame to the next.
+    ShadowMapAtlas mAtlas;
+
+    // The shadow texture outlives the frame, so that unchanged shadow maps don't need to be
+    // rendered again.
+    FrameGraphTexture mShadowTexture;
+    FrameGraphTexture::Descriptor mShadowTextureDesc;
+    std::array<RenderedShadowMap, CONFIG_MAX_SHADOW_CASCADES> mRenderedCascadeShadowMaps;
+    std::array<RenderedShadowMap, CONFIG_MAX_SHADOW_CASTING_SPOTS> mRenderedSpotShadowMaps;
+    View::ShadowMapCacheStats mCacheStats{};
 };
 
 } // namespace filament
@@ -25,6 +25,9 @@
 
 #include <utils/compiler.h>
 
+#include <memory>
+#include <utility>
+
 namespace filament {
 
 class FEngine;
@@ -64,6 +67,17 @@ public:
             PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
             PrefilterOptions const* options);
 
+    void generatePrefilterMipmapAsync(FEngine& engine,
+            PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets,
+            PrefilterOptions const* options, PrefilterCallback callback, void* user);
+
+    // Uploads the levels prefiltered in the background since the last call, returns true once
+    // they're all uploaded, finishPrefilter() must then be called.
+    bool updatePrefilter(FEngine& engine);
+
+    // Releases the background prefiltering and returns its callback.
+    std::pair<PrefilterCallback, void*> finishPrefilter(FEngine& engine) noexcept;
+
     void setExternalImage(FEngine& engine, void* image) noexcept;
     void setExternalImage(FEngine& engine, void* image, size_t plane) noexcept;
     void setExternalStream(FEngine& engine, FStream* stream) noexcept;
@@ -113,7 +127,12 @@ public:
 
 private:
     friend class Texture;
+    struct PrefilterTask;
+
+    void cancelPrefilter(FEngine& engine) noexcept;
+
     FStream* mStream = nullptr;
+    std::shared_ptr<PrefilterTask> mPrefilterTask;     // shared with its job
     backend::Handle<backend::HwTexture> mHandle;
     uint32_t mWidth = 1;
     uint32_t mHeight = 1;
@@ -114,7 +114,13 @@ public:
     void terminate(FEngine& engine);
 
     void prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& arena,
-            Viewport const& viewport, math::float4 const& userTime) noexcept;
+            Viewport const& viewport, math::float4 const& userTime, uint32_t frameId) noexcept;
+
+    // waits for the scene data gathered for the next frame, see setFramePipeliningEnabled()
+    void finishPrepareNextFrame() noexcept;
+
+    // the rigid transform applied to the scene when rendering this view
+    math::mat4f getWorldOrigin(FEngine const& engine) const noexcept;
 
     void setScene(FScene* scene) { mScene = scene; }
     FScene const* getScene() const noexcept { return mScene; }
@@ -142,6 +148,9 @@ public:
     void setFrontFaceWindingInverted(bool inverted) noexcept { mFrontFaceWindingInverted = inverted; }
     bool isFrontFaceWindingInverted() const noexcept { return mFrontFaceWindingInverted; }
 
+    void setFramePipeliningEnabled(bool enabled) noexcept { mFramePipelining = enabled; }
+    bool isFramePipeliningEnabled() const noexcept { return mFramePipelining; }
+
 
     void setVisibleLayers(uint8_t select, uint8_t values) noexcept;
     uint8_t getVisibleLayers() const noexcept {
@@ -327,6 +336,18 @@ public:
         return mVsmShadowOptions;
     }
 
+    void setShadowMapCachingEnabled(bool enabled) noexcept {
+        mShadowMapCaching = enabled;
+    }
+
+    bool isShadowMapCachingEnabled() const noexcept {
+        return mShadowMapCaching;
+    }
+
+    ShadowMapCacheStats getShadowMapCacheStats() const noexcept {
+        return mShadowMapManager.getCacheStats();
+    }
+
     AmbientOcclusionOptions const& getAmbientOcclusionOptions() const noexcept {
         return mAmbientOcclusionOptions;
     }
@@ -474,6 +495,8 @@ private:
     Viewport mViewport;
     bool mCulling = true;
     bool mFrontFaceWindingInverted = false;
+    bool mFramePipelining = false;
+    FScene::PreparedData mNextFrame;    // the scene gathered for the next frame, if pipelining
 
     FRenderTarget* mRenderTarget = nullptr;
 
@@ -488,6 +511,7 @@ private:
     AmbientOcclusionOptions mAmbientOcclusionOptions{};
     ShadowType mShadowType = ShadowType::PCF;
     VsmShadowOptions mVsmShadowOptions = {};
+    bool mShadowMapCaching = false;
     BloomOptions mBloomOptions;
     FogOptions mFogOptions;
     DepthOfFieldOptions mDepthOfFieldOptions;
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <random>
 
 #include <gtest/gtest.h>
@@ -40,6 +42,7 @@
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/ShadowMapAtlas.h"
 #include "details/Engine.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
@@ -277,6 +280,36 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(c, tcm.getChildCount(newParent));
 }
 
+TEST(FilamentTest, TransformManagerSetTransforms) {
+    filament::FTransformManager tcm;
+    EntityManager& em = EntityManager::get();
+    std::array<Entity, 3> entities;
+    em.create(entities.size(), entities.data());
+
+    // a chain: entities[0] <- entities[1] <- entities[2]
+    tcm.create(entities[0]);
+    tcm.create(entities[1], tcm.getInstance(entities[0]), mat4f{});
+    tcm.create(entities[2], tcm.getInstance(entities[1]), mat4f{});
+
+    std::array<TransformManager::Instance, 2> instances = {
+            tcm.getInstance(entities[2]), tcm.getInstance(entities[0]) };
+    std::array<mat4f, 2> transforms = { mat4f::scaling(float3{ 3 }), mat4f::scaling(float3{ 2 })};
+    tcm.setTransforms(instances.data(), transforms.data(), instances.size());
+
+    // local transforms are set immediately, but world transforms are deferred
+    EXPECT_EQ(tcm.getTransform(instances[0]), mat4f::scaling(float3{ 3 }));
+    EXPECT_EQ(tcm.getTransform(instances[1]), mat4f::scaling(float3{ 2 }));
+    EXPECT_EQ(tcm.getWorldTransform(instances[0]), mat4f{});
+    EXPECT_EQ(tcm.getWorldTransform(instances[1]), mat4f{});
+
+    tcm.updateWorldTransforms();
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[0])), mat4f::scaling(float3{ 2 }));
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[1])), mat4f::scaling(float3{ 2 }));
+    EXPECT_EQ(tcm.getWorldTransform(tcm.getInstance(entities[2])), mat4f::scaling(float3{ 6 }));
+
+    em.destroy(entities.size(), entities.data());
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -637,11 +670,24 @@ TEST(FilamentTest, FroxelData) {
     // used by the engine). We do this to infer the value of the left and right most planes
     // to check if they're computed correctly.
     Viewport vp(0, 0, 1280, 640);
-    mat4f p = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+    CameraInfo camera;
+    camera.projection = mat4f::perspective(90, 1.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+    camera.zn = 0.1;
+    camera.zf = 100;
+
+    // create a dummy point light that can be referenced in LightSoa
+    Entity e = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
+    LightManager::Instance instance = engine->getLightManager().getInstance(e);
+
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, {});
 
     Froxelizer froxelData(*engine);
     froxelData.setOptions(5, 100);
-    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+    froxelData.prepare(engine->getDriverApi(), scope, vp, camera, engine->getLightManager(),
+            lights);
 
     Froxel f = froxelData.getFroxelAt(0,0,0);
 
@@ -682,17 +728,9 @@ TEST(FilamentTest, FroxelData) {
     // farthest froxel far plane distance always zLightFar
     EXPECT_FLOAT_EQ(        100,-l.planes[Froxel::FAR].w);
 
-    // create a dummy point light that can be referenced in LightSoa
-    Entity e = engine->getEntityManager().create();
-    LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
-    LightManager::Instance instance = engine->getLightManager().getInstance(e);
-
-    FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, {}, {});
-
     {
-        froxelData.froxelizeLights(*engine, {}, lights);
+        EXPECT_TRUE(froxelData.isCommitNeeded());
+        froxelData.froxelizeLights(*engine, lights);
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
         // light straddles the "light near" plane
@@ -711,7 +749,11 @@ TEST(FilamentTest, FroxelData) {
         auto pos = lights.elementAt<FScene::POSITION_RADIUS>(1);
         EXPECT_TRUE(pos == float4( 0, 0, -3, 1 ));
 
-        froxelData.froxelizeLights(*engine, {}, lights);
+        froxelData.commit(engine->getDriverApi());
+        froxelData.prepare(engine->getDriverApi(), scope, vp, camera, engine->getLightManager(),
+                lights);
+        EXPECT_TRUE(froxelData.isCommitNeeded());
+        froxelData.froxelizeLights(*engine, lights);
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
         size_t pointCount = 0;
@@ -722,11 +764,118 @@ TEST(FilamentTest, FroxelData) {
         EXPECT_GT(pointCount, 0);
     }
 
+    {
+        // nothing changed: no buffer is allocated, froxelized or uploaded
+        froxelData.commit(engine->getDriverApi());
+        froxelData.prepare(engine->getDriverApi(), scope, vp, camera, engine->getLightManager(),
+                lights);
+        EXPECT_FALSE(froxelData.isCommitNeeded());
+        EXPECT_TRUE(froxelData.getFroxelBufferUser().empty());
+        EXPECT_TRUE(froxelData.getRecordBufferUser().empty());
+        froxelData.froxelizeLights(*engine, lights);
+        EXPECT_TRUE(froxelData.getFroxelBufferUser().empty());
+        EXPECT_TRUE(froxelData.getRecordBufferUser().empty());
+        froxelData.commit(engine->getDriverApi());
+    }
+
+    {
+        // changing the viewport invalidates all the froxels
+        froxelData.prepare(engine->getDriverApi(), scope, Viewport(0, 0, 640, 640), camera,
+                engine->getLightManager(), lights);
+        EXPECT_TRUE(froxelData.isCommitNeeded());
+        froxelData.froxelizeLights(*engine, lights);
+        froxelData.commit(engine->getDriverApi());
+        EXPECT_FALSE(froxelData.isCommitNeeded());
+    }
+
     froxelData.terminate(engine->getDriverApi());
 
     Engine::destroy((Engine **)&engine);
 }
 
+static bool overlaps(ShadowMapAtlas::Allocation const& a, ShadowMapAtlas::Allocation const& b) {
+    return a.layer == b.layer &&
+           a.x < b.x + b.size && b.x < a.x + a.size &&
+           a.y < b.y + b.size && b.y < a.y + a.size;
+}
+
+TEST(FilamentTest, ShadowMapAtlasSize) {
+    // full coverage gets the requested size, rounded up to a power-of-two
+    EXPECT_EQ(1024, ShadowMapAtlas::computeSize(1024, 1.0f, 0));
+    EXPECT_EQ(1024, ShadowMapAtlas::computeSize(1000, 1.0f, 0));
+    EXPECT_EQ(256, ShadowMapAtlas::computeSize(1024, 0.2f, 0));
+    EXPECT_EQ(ShadowMapAtlas::MIN_SIZE, ShadowMapAtlas::computeSize(1024, 0.0f, 0));
+
+    // maps grow right away, but only shrink when 4 times too large
+    EXPECT_EQ(1024, ShadowMapAtlas::computeSize(1024, 0.9f, 256));
+    EXPECT_EQ(512, ShadowMapAtlas::computeSize(1024, 0.2f, 512));
+    EXPECT_EQ(256, ShadowMapAtlas::computeSize(1024, 0.2f, 1024));
+    // but never beyond what's requested
+    EXPECT_EQ(512, ShadowMapAtlas::computeSize(512, 0.9f, 1024));
+
+    EXPECT_EQ(1024, ShadowMapAtlas::computeDimension(1000));
+    EXPECT_EQ(ShadowMapAtlas::MIN_SIZE, ShadowMapAtlas::computeDimension(3));
+}
+
+TEST(FilamentTest, ShadowMapAtlasPacking) {
+    ShadowMapAtlas atlas;
+    ShadowMapAtlas::Allocation allocations[8];
+
+    // 2 cascades, then a 512 map and four 256 maps, which fit in a single layer
+    ShadowMapAtlas::Request requests[] = {
+            { .key = 0, .size = 1024, .exclusive = true },
+            { .key = 1, .size = 1024, .exclusive = true },
+            { .key = 10, .size = 256, .importance = 0.5f },
+            { .key = 11, .size = 512, .importance = 0.5f },
+            { .key = 12, .size = 256, .importance = 0.5f },
+            { .key = 13, .size = 256, .importance = 0.5f },
+            { .key = 14, .size = 256, .importance = 0.5f },
+    };
+    constexpr size_t count = sizeof(requests) / sizeof(requests[0]);
+
+    EXPECT_EQ(3, atlas.update(1024, requests, count, allocations));
+    EXPECT_EQ(0, allocations[0].layer);
+    EXPECT_EQ(1, allocations[1].layer);
+    EXPECT_EQ(1024, allocations[0].size);
+    for (size_t i = 2; i < count; i++) {
+        EXPECT_EQ(2, allocations[i].layer);
+        EXPECT_EQ(requests[i].size, allocations[i].size);
+        EXPECT_LE(allocations[i].x + allocations[i].size, 1024);
+        EXPECT_LE(allocations[i].y + allocations[i].size, 1024);
+        for (size_t j = 2; j < i; j++) {
+            EXPECT_FALSE(overlaps(allocations[i], allocations[j]));
+        }
+    }
+    EXPECT_EQ(512, atlas.getSize(11));
+    EXPECT_EQ(0, atlas.getSize(42));
+
+    // maps that don't change stay where they are
+    ShadowMapAtlas::Allocation previous[8];
+    std::copy(std::begin(allocations), std::end(allocations), std::begin(previous));
+    requests[6].size = 128;
+    EXPECT_EQ(3, atlas.update(1024, requests, count, allocations));
+    for (size_t i = 0; i < count - 1; i++) {
+        EXPECT_EQ(previous[i].layer, allocations[i].layer);
+        EXPECT_EQ(previous[i].x, allocations[i].x);
+        EXPECT_EQ(previous[i].y, allocations[i].y);
+    }
+    EXPECT_EQ(128, allocations[6].size);
+
+    // a map too large for what's left opens a new layer
+    requests[6].size = 1024;
+    EXPECT_EQ(4, atlas.update(1024, requests, count, allocations));
+    EXPECT_EQ(3, allocations[6].layer);
+
+    // without the cascades, everything moves down
+    EXPECT_EQ(2, atlas.update(1024, requests + 2, count - 2, allocations));
+    for (size_t i = 0; i < count - 2; i++) {
+        EXPECT_LT(allocations[i].layer, 2);
+        for (size_t j = 0; j < i; j++) {
+            EXPECT_FALSE(overlaps(allocations[i], allocations[j]));
+        }
+    }
+}
+
 TEST(FilamentTest, Bones) {
 
     struct Shader {
@@ -61,23 +61,25 @@ bool IBL::loadFromKtx(const std::string& prefix) {
         return false;
     }
 
-    auto createKtx = [] (Path path) {
-        using namespace std;
-        ifstream file(path.getPath(), ios::binary);
-        vector<uint8_t> contents((istreambuf_iterator<char>(file)), {});
-        return new image::KtxBundle(contents.data(), contents.size());
-    };
-
-    KtxBundle* iblKtx = createKtx(iblPath);
-    KtxBundle* skyKtx = createKtx(skyPath);
-
-    mSkyboxTexture = ktx::createTexture(&mEngine, skyKtx, false);
-    mTexture = ktx::createTexture(&mEngine, iblKtx, false);
+    // The files are mapped rather than read, and unmapped once the textures are uploaded.
+    KtxBundle* iblKtx = KtxBundle::map(iblPath.c_str());
+    KtxBundle* skyKtx = KtxBundle::map(skyPath.c_str());
+    if (!iblKtx || !skyKtx) {
+        delete iblKtx;
+        delete skyKtx;
+        return false;
+    }
 
+    // the bundles are destroyed asynchronously by createTexture(), so this must happen first
     if (!iblKtx->getSphericalHarmonics(mBands)) {
+        delete iblKtx;
+        delete skyKtx;
         return false;
     }
 
+    mSkyboxTexture = ktx::createTexture(&mEngine, skyKtx, false);
+    mTexture = ktx::createTexture(&mEngine, iblKtx, false);
+
     mIndirectLight = IndirectLight::Builder()
             .reflections(mTexture)
             .intensity(IBL_INTENSITY)
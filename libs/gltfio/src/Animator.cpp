@@ -33,6 +33,8 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <tsl/robin_map.h>
+
 #include <map>
 #include <string>
 #include <vector>
@@ -57,6 +59,7 @@ struct Sampler {
 struct Channel {
     const Sampler* sourceData;
     utils::Entity targetEntity;
+    uint32_t targetIndex;   // index in Animation::targets, unused for WEIGHTS
     enum { TRANSLATION, ROTATION, SCALE, WEIGHTS } transformType;
 };
 
@@ -65,6 +68,7 @@ struct Animation {
     std::string name;
     vector<Sampler> samplers;
     vector<Channel> channels;
+    vector<Entity> targets;     // entities whose transform is animated, without duplicates
 };
 
 struct AnimatorImpl {
@@ -74,6 +78,10 @@ struct AnimatorImpl {
     FFilamentInstance* instance = nullptr;
     RenderableManager* renderableManager;
     TransformManager* transformManager;
+
+    // scratch storage for applyAnimation()
+    vector<TransformManager::Instance> instances;
+    vector<mat4f> transforms;
 };
 
 static void createSampler(const cgltf_animation_sampler& src, Sampler& dst) {
@@ -168,6 +176,10 @@ static void addChannels(const NodeMap& nodeMap, const cgltf_animation& srcAnim,
     cgltf_animation_channel* srcChannels = srcAnim.channels;
     cgltf_animation_sampler* srcSamplers = srcAnim.samplers;
     const Sampler* samplers = dst.samplers.data();
+    tsl::robin_map<Entity, uint32_t> targetIndices;
+    for (uint32_t i = 0; i < dst.targets.size(); ++i) {
+        targetIndices[dst.targets[i]] = i;
+    }
     for (cgltf_size j = 0, nchans = srcAnim.channels_count; j < nchans; ++j) {
         const cgltf_animation_channel& srcChannel = srcChannels[j];
         auto iter = nodeMap.find(srcChannel.target_node);
@@ -187,7 +199,15 @@ static void addChannels(const NodeMap& nodeMap, const cgltf_animation& srcAnim,
         Channel dstChannel;
         dstChannel.sourceData = samplers + (srcChannel.sampler - srcSamplers);
         dstChannel.targetEntity = targetEntity;
+        dstChannel.targetIndex = 0;
         setTransformType(srcChannel, dstChannel);
+        if (dstChannel.transformType != Channel::WEIGHTS) {
+            auto pos = targetIndices.emplace(targetEntity, uint32_t(dst.targets.size()));
+            if (pos.second) {
+                dst.targets.push_back(targetEntity);
+            }
+            dstChannel.targetIndex = pos.first->second;
+        }
         dst.channels.push_back(dstChannel);
     }
 }
@@ -269,13 +289,25 @@ void Animator::applyAnimation(size_t animationIndex, float time) const {
     TransformManager* transformManager = mImpl->transformManager;
     RenderableManager* renderableManager = mImpl->renderableManager;
     time = fmod(time, anim.duration);
+
+    // The transforms of all the animated nodes are computed here and set all at once at the
+    // end, so that nodes with several animated channels or animated ancestors are only
+    // visited once.
+    auto& instances = mImpl->instances;
+    auto& transforms = mImpl->transforms;
+    instances.resize(anim.targets.size());
+    transforms.resize(anim.targets.size());
+    for (size_t i = 0; i < anim.targets.size(); ++i) {
+        instances[i] = transformManager->getInstance(anim.targets[i]);
+        transforms[i] = transformManager->getTransform(instances[i]);
+    }
+
     for (const auto& channel : anim.channels) {
         const Sampler* sampler = channel.sourceData;
         if (sampler->times.size() < 2) {
             continue;
         }
 
-        TransformManager::Instance node = transformManager->getInstance(channel.targetEntity);
         const TimeValues& times = sampler->times;
 
         // Find the first keyframe after the given time, or the keyframe that matches it exactly.
@@ -307,7 +339,7 @@ void Animator::applyAnimation(size_t animationIndex, float time) const {
         // Perform the interpolation. This is a simple but inefficient implementation; Filament
         // stores transforms as mat4's but glTF animation is based on TRS (translation rotation
         // scale).
-        mat4f xform = transformManager->getTransform(node);
+        mat4f& xform = transforms[channel.targetIndex];
         float3 scale;
         quatf rotation;
         float3 translation;
@@ -398,8 +430,10 @@ void Animator::applyAnimation(size_t animationIndex, float time) const {
         }
 
         xform = composeMatrix(translation, rotation, scale);
-        transformManager->setTransform(node, xform);
     }
+
+    transformManager->setTransforms(instances.data(), transforms.data(), instances.size());
+    transformManager->updateWorldTransforms();
 }
 
 void Animator::updateBoneMatrices() {
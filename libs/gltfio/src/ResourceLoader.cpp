@@ -687,6 +687,9 @@ bool ResourceLoader::Impl::createTextures(bool async) {
 
     JobSystem::Job* parent = js->createJob();
 
+    // When decoding asynchronously, decoding jobs must not delay the rendering of frames.
+    const uint32_t runFlags = async ? JobSystem::BACKGROUND : 0;
+
     // Create a copy of the shared_ptr to the source data to prevent it from being freed during
     // the texture decoding process.
     FFilamentAsset::SourceHandle retainSourceAsset = asset->mSourceAsset;
@@ -700,7 +703,7 @@ bool ResourceLoader::Impl::createTextures(bool async) {
             entry->texels = stbi_load_from_memory(sourceData, entry->bufferSize,
                     &width, &height, &comp, 4);
         });
-        js->run(decode);
+        js->run(decode, runFlags);
     }
 
     // Kick off jobs that decode texels from URI strings.
@@ -717,7 +720,7 @@ bool ResourceLoader::Impl::createTextures(bool async) {
                 entry->texels = stbi_load_from_memory(sourceData, iter->second.size, &width,
                         &height, &comp, 4);
             });
-            js->run(decode);
+            js->run(decode, runFlags);
             continue;
         }
 
@@ -731,12 +734,12 @@ bool ResourceLoader::Impl::createTextures(bool async) {
                 int width, height, comp;
                 entry->texels = stbi_load(fullpath.c_str(), &width, &height, &comp, 4);
             });
-            js->run(decode);
+            js->run(decode, runFlags);
         #endif
     }
 
     if (async) {
-        mDecoderRootJob = js->runAndRetain(parent);
+        mDecoderRootJob = js->runAndRetain(parent, runFlags);
         return true;
     }
 
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ibl/Cubemap.h>
+#include <ibl/CubemapIBL.h>
+#include <ibl/CubemapSH.h>
+#include <ibl/CubemapUtils.h>
+#include <ibl/Image.h>
+
+#include <utils/JobSystem.h>
+
+#include <math/vec3.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using namespace filament::ibl;
+using namespace filament::math;
+using namespace utils;
+
+static Cubemap createCubemap(Image& image, size_t dim) {
+    Cubemap cm = CubemapUtils::create(image, dim);
+    for (size_t i = 0; i < 6; i++) {
+        const Cubemap::Face f = Cubemap::Face(i);
+        Image& face = cm.getImageForFace(f);
+        for (size_t y = 0; y < dim; y++) {
+            Cubemap::Texel* data = static_cast<Cubemap::Texel*>(face.getPixelRef(0, y));
+            for (size_t x = 0; x < dim; x++, data++) {
+                // a smooth, but not constant, environment
+                const float3 s = cm.getDirectionFor(f, x, y);
+                Cubemap::writeAt(data, Cubemap::Texel(s * 0.5f + 0.5f));
+            }
+        }
+    }
+    return cm;
+}
+
+// range(0) is the face size, range(1) the number of bands
+static void BM_ComputeSH(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const size_t dim = size_t(state.range(0));
+    const size_t numBands = size_t(state.range(1));
+    Image image;
+    Cubemap cm = createCubemap(image, dim);
+
+    for (auto _ : state) {
+        auto sh = CubemapSH::computeSH(js, cm, numBands, false);
+        benchmark::DoNotOptimize(sh);
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 6 * dim * dim);
+
+    js.emancipate();
+}
+
+static void faceSizesAndBands(benchmark::internal::Benchmark* b) {
+    for (int64_t bands : { 3, 9 }) {
+        for (int64_t dim = 256; dim <= 4096; dim *= 4) {
+            b->Args({ dim, bands });
+        }
+    }
+}
+
+BENCHMARK(BM_ComputeSH)->Apply(faceSizesAndBands)->Unit(benchmark::kMillisecond);
+
+// range(0) is the face size of the destination, range(1) is whether the samples are prefiltered
+static void BM_RoughnessFilter(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    // the source is twice as large as the destination, with all its mip levels
+    size_t dim = size_t(state.range(0)) * 2;
+    std::vector<Image> images(1);
+    std::vector<Cubemap> levels;
+    levels.push_back(createCubemap(images[0], dim));
+    levels[0].makeSeamless();
+    while (dim > 1) {
+        dim >>= 1u;
+        Image image;
+        Cubemap level = CubemapUtils::create(image, dim);
+        CubemapUtils::downsampleCubemapLevelBoxFilter(js, level, levels.back());
+        level.makeSeamless();
+        images.push_back(std::move(image));
+        levels.push_back(std::move(level));
+    }
+
+    Image image;
+    Cubemap dst = CubemapUtils::create(image, size_t(state.range(0)));
+    for (auto _ : state) {
+        CubemapIBL::roughnessFilter(js, dst, levels, 0.5f, 64, float3{ 1 }, state.range(1) != 0);
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 6 * state.range(0) * state.range(0));
+
+    js.emancipate();
+}
+
+BENCHMARK(BM_RoughnessFilter)->Ranges({{ 64, 256 }, { 0, 1 }})->Unit(benchmark::kMillisecond);
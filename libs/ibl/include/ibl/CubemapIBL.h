@@ -19,15 +19,13 @@
 
 #include <math/vec3.h>
 
+#include <utils/JobSystem.h>
+
 #include <vector>
 
 #include <stdint.h>
 #include <stddef.h>
 
-namespace utils {
-class JobSystem;
-} // namespace utils
-
 namespace filament {
 namespace ibl {
 
@@ -55,6 +53,13 @@ public:
             float linearRoughness, size_t maxNumSamples, math::float3 mirror, bool prefilter,
             Progress updater = nullptr, void* userdata = nullptr);
 
+    //! Same as above, the jobs used are children of parent
+    static void roughnessFilter(
+            utils::JobSystem& js, utils::JobSystem::Job* parent,
+            Cubemap& dst, const std::vector<Cubemap>& levels,
+            float linearRoughness, size_t maxNumSamples, math::float3 mirror, bool prefilter,
+            Progress updater = nullptr, void* userdata = nullptr);
+
     //! Computes the "DFG" term of the "split-sum" approximation and stores it in a 2D image
     static void DFG(utils::JobSystem& js, Image& dst, bool multiscatter, bool cloth);
 
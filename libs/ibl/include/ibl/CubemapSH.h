@@ -22,6 +22,7 @@
 
 #include <math/mat3.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
 
 #include <memory>
 #include <vector>
@@ -101,6 +102,13 @@ private:
 
     static void computeShBasis(float* SHb, size_t numBands, const math::float3& s);
 
+    // computes the SH basis of 4 directions at once, SHb[i] holds basis i of each direction
+    static void computeShBasis(math::float4* SHb, size_t numBands,
+            const math::float4& x, const math::float4& y, const math::float4& z);
+
+    template<typename T>
+    static void computeShBasisImpl(T* SHb, size_t numBands, T x, T y, T z);
+
     static float Kml(ssize_t m, size_t l);
 
     static std::vector<float> Ki(size_t numBands);
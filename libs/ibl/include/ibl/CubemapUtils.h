@@ -20,11 +20,9 @@
 #include <ibl/Cubemap.h>
 #include <ibl/Image.h>
 
-#include <functional>
+#include <utils/JobSystem.h>
 
-namespace utils {
-class JobSystem;
-} // namespace utils
+#include <functional>
 
 namespace filament {
 namespace ibl {
@@ -57,6 +55,14 @@ public:
             ReduceProc<STATE> reduce = [](STATE&) {},
             const STATE& prototype = STATE());
 
+    //! process the cubemap using multithreading, with jobs that are children of parent
+    template<typename STATE>
+    static void process(Cubemap& cm,
+            utils::JobSystem& js, utils::JobSystem::Job* parent,
+            ScanlineProc<STATE> proc,
+            ReduceProc<STATE> reduce = [](STATE&) {},
+            const STATE& prototype = STATE());
+
     //! process the cubemap
     template<typename STATE>
     static void processSingleThreaded(Cubemap& cm,
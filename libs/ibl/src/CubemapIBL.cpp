@@ -296,6 +296,16 @@ void CubemapIBL::roughnessFilter(
         utils::JobSystem& js, Cubemap& dst, const std::vector<Cubemap>& levels,
         float linearRoughness, size_t maxNumSamples, math::float3 mirror, bool prefilter,
         Progress updater, void* userdata)
+{
+    roughnessFilter(js, nullptr, dst, levels, linearRoughness, maxNumSamples, mirror, prefilter,
+            updater, userdata);
+}
+
+void CubemapIBL::roughnessFilter(
+        utils::JobSystem& js, utils::JobSystem::Job* parent,
+        Cubemap& dst, const std::vector<Cubemap>& levels,
+        float linearRoughness, size_t maxNumSamples, math::float3 mirror, bool prefilter,
+        Progress updater, void* userdata)
 {
     const float numSamples = maxNumSamples;
     const float inumSamples = 1.0f / numSamples;
@@ -327,7 +337,7 @@ void CubemapIBL::roughnessFilter(
             CubemapUtils::processSingleThreaded<CubemapUtils::EmptyState>(
                     dst, js, std::ref(scanline));
         } else {
-            CubemapUtils::process<CubemapUtils::EmptyState>(dst, js, std::ref(scanline));
+            CubemapUtils::process<CubemapUtils::EmptyState>(dst, js, parent, std::ref(scanline));
         }
         return;
     }
@@ -419,6 +429,10 @@ void CubemapIBL::roughnessFilter(
             size_t p = progress.fetch_add(1, std::memory_order_relaxed) + 1;
             updater(0, (float) p / ((float) dim * 6.0f), userdata);
         }
+        // Each chunk of scanlines gets its own copy of the state, seed the generator from the
+        // scanline so the result doesn't depend on how the work is split.
+        state.gen.seed(uint32_t(size_t(f) * dim + y));
+
         mat3 R;
         const size_t numSamples = cache.size();
         for (size_t x = 0; x < dim; ++x, ++data) {
@@ -438,8 +452,9 @@ void CubemapIBL::roughnessFilter(
                 const CacheEntry& e = cache[sample];
                 const float3 L(R * e.L);
                 const Cubemap& cmBase = levels[e.l0];
-                const Cubemap& next = levels[e.l1];
-                const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
+                const float3 c0 = e.lerp > 0 ?
+                        Cubemap::trilinearFilterAt(cmBase, levels[e.l1], e.lerp, L) :
+                        cmBase.filterAt(L);
                 Li += c0 * e.brdf_NoL;
             }
             Cubemap::writeAt(data, Cubemap::Texel(Li));
@@ -451,7 +466,7 @@ void CubemapIBL::roughnessFilter(
     if (dst.getDimensions() * maxNumSamples <= 256) {
         CubemapUtils::processSingleThreaded<State>(dst, js, std::ref(scanline));
     } else {
-        CubemapUtils::process<State>(dst, js, std::ref(scanline));
+        CubemapUtils::process<State>(dst, js, parent, std::ref(scanline));
     }
 }
 
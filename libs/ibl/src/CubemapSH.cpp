@@ -108,24 +108,12 @@ constexpr float CubemapSH::computeTruncatedCosSh(size_t l) {
  *  m < 0, sin(|m|*phi) * P(|m|,l)
  *  m = 0, P(0,l)
  */
-void CubemapSH::computeShBasis(
-        float* UTILS_RESTRICT SHb,
+template<typename T>
+inline void CubemapSH::computeShBasisImpl(
+        T* UTILS_RESTRICT SHb,
         size_t numBands,
-        const float3& s)
+        T sx, T sy, T sz)
 {
-#if 0
-    // Reference implementation
-    float phi = atan2(s.x, s.y);
-    for (size_t l = 0; l < numBands; l++) {
-        SHb[SHindex(0, l)] = Legendre(l, 0, s.z);
-        for (size_t m = 1; m <= l; m++) {
-            float p = Legendre(l, m, s.z);
-            SHb[SHindex(-m, l)] = std::sin(m * phi) * p;
-            SHb[SHindex( m, l)] = std::cos(m * phi) * p;
-        }
-    }
-#endif
-
     /*
      * TODO: all the Legendre computation below is identical for all faces, so it
      * might make sense to pre-compute it once. Also note that there is
@@ -147,11 +135,11 @@ void CubemapSH::computeShBasis(
     // s = (x, y, z) = (sin(theta)*cos(phi), sin(theta)*sin(phi), cos(theta))
 
     // handle m=0 separately, since it produces only one coefficient
-    float Pml_2 = 0;
-    float Pml_1 = 1;
+    T Pml_2 = 0;
+    T Pml_1 = 1;
     SHb[0] =  Pml_1;
     for (size_t l=1; l<numBands; l++) {
-        float Pml = ((2*l-1.0f)*Pml_1*s.z - (l-1.0f)*Pml_2) / l;
+        T Pml = ((2*l-1.0f)*Pml_1*sz - (l-1.0f)*Pml_2) / l;
         Pml_2 = Pml_1;
         Pml_1 = Pml;
         SHb[SHindex(0, l)] = Pml;
@@ -160,7 +148,7 @@ void CubemapSH::computeShBasis(
     for (size_t m=1 ; m<numBands ; m++) {
         Pmm = (1.0f - 2*m) * Pmm;      // See [1], divide by sqrt(1 - s.z*s.z);
         Pml_2 = Pmm;
-        Pml_1 = (2*m + 1.0f)*Pmm*s.z;
+        Pml_1 = (2*m + 1.0f)*Pmm*sz;
         // l == m
         SHb[SHindex(-m, m)] = Pml_2;
         SHb[SHindex( m, m)] = Pml_2;
@@ -169,7 +157,7 @@ void CubemapSH::computeShBasis(
             SHb[SHindex(-m, m+1)] = Pml_1;
             SHb[SHindex( m, m+1)] = Pml_1;
             for (size_t l=m+2 ; l<numBands ; l++) {
-                float Pml = ((2*l - 1.0f)*Pml_1*s.z - (l + m - 1.0f)*Pml_2) / (l-m);
+                T Pml = ((2*l - 1.0f)*Pml_1*sz - (l + m - 1.0f)*Pml_2) / (l-m);
                 Pml_2 = Pml_1;
                 Pml_1 = Pml;
                 SHb[SHindex(-m, l)] = Pml;
@@ -190,21 +178,53 @@ void CubemapSH::computeShBasis(
     // Note that (d.x, d.y) == (cos(phi), sin(phi)) * sin(theta), so the
     // code below actually evaluates:
     //      (cos((m*phi), sin(m*phi)) * sin(theta)^|m|
-    float Cm = s.x;
-    float Sm = s.y;
+    T Cm = sx;
+    T Sm = sy;
     for (size_t m = 1; m <= numBands; m++) {
         for (size_t l = m; l < numBands; l++) {
             SHb[SHindex(-m, l)] *= Sm;
             SHb[SHindex( m, l)] *= Cm;
         }
-        float Cm1 = Cm * s.x - Sm * s.y;
-        float Sm1 = Sm * s.x + Cm * s.y;
+        T Cm1 = Cm * sx - Sm * sy;
+        T Sm1 = Sm * sx + Cm * sy;
         Cm = Cm1;
         Sm = Sm1;
     }
 }
 
 
+/*
+ * Calculates non-normalized SH bases, see computeShBasisImpl() above.
+ */
+void CubemapSH::computeShBasis(
+        float* UTILS_RESTRICT SHb,
+        size_t numBands,
+        const float3& s)
+{
+#if 0
+    // Reference implementation
+    float phi = atan2(s.x, s.y);
+    for (size_t l = 0; l < numBands; l++) {
+        SHb[SHindex(0, l)] = Legendre(l, 0, s.z);
+        for (size_t m = 1; m <= l; m++) {
+            float p = Legendre(l, m, s.z);
+            SHb[SHindex(-m, l)] = std::sin(m * phi) * p;
+            SHb[SHindex( m, l)] = std::cos(m * phi) * p;
+        }
+    }
+#endif
+    computeShBasisImpl(SHb, numBands, s.x, s.y, s.z);
+}
+
+void CubemapSH::computeShBasis(
+        float4* UTILS_RESTRICT SHb,
+        size_t numBands,
+        const float4& x, const float4& y, const float4& z)
+{
+    computeShBasisImpl(SHb, numBands, x, y, z);
+}
+
+
 /*
  * utilities to rotate very low order spherical harmonics (up to 3rd band)
  */
@@ -510,47 +530,60 @@ void CubemapSH::windowSH(std::unique_ptr<float3[]>& sh, size_t numBands, float c
 std::unique_ptr<float3[]> CubemapSH::computeSH(JobSystem& js, const Cubemap& cm, size_t numBands, bool irradiance) {
 
     const size_t numCoefs = numBands * numBands;
-    std::unique_ptr<float3[]> SH(new float3[numCoefs]{});
-
-    struct State {
-        State() = default;
-        explicit State(size_t numCoefs) : numCoefs(numCoefs) { }
-
-        State& operator=(State const & rhs) {
-            SH.reset(new float3[rhs.numCoefs]{}); // NOLINT(modernize-make-unique)
-            SHb.reset(new float[rhs.numCoefs]{}); // NOLINT(modernize-make-unique)
-            return *this;
-        }
-        size_t numCoefs = 0;
-        std::unique_ptr<float3[]> SH;
-        std::unique_ptr<float[]> SHb;
-    } prototype(numCoefs);
-
-    CubemapUtils::process<State>(const_cast<Cubemap&>(cm), js,
-            [&](State& state, size_t y, Cubemap::Face f, Cubemap::Texel const* data, size_t dim) {
-        for (size_t x=0 ; x<dim ; ++x, ++data) {
-
-            float3 s(cm.getDirectionFor(f, x, y));
-
-            // sample a color
-            float3 color(Cubemap::sampleAt(data));
-
-            // take solid angle into account
-            color *= CubemapUtils::solidAngle(dim, x, y);
+    const size_t dim = cm.getDimensions();
+
+    // Each chunk of scanlines (of all 6 faces) accumulates its own coefficients, chunks are
+    // summed in order, so the result doesn't depend on the number of threads.
+    const std::vector<float3> sum = jobs::parallel_reduce(js, 0, uint32_t(6 * dim),
+            std::vector<float3>(numCoefs),
+            [&cm, numBands, numCoefs, dim](uint32_t start, uint32_t count) {
+        // coefficients are accumulated 4 texels at a time, one color channel per vector
+        std::vector<float4> R(numCoefs), G(numCoefs), B(numCoefs);
+        std::vector<float4> SHb(numCoefs);
+        for (uint32_t row = start; row < start + count; row++) {
+            const Cubemap::Face f = Cubemap::Face(row / dim);
+            const size_t y = row % dim;
+            Cubemap::Texel const* data =
+                    static_cast<Cubemap::Texel const*>(cm.getImageForFace(f).getPixelRef(0, y));
+            for (size_t x=0 ; x<dim ; x += 4) {
+                float4 sx, sy, sz, r, g, b;
+                for (size_t k=0 ; k<4 ; k++) {
+                    // lanes past the end of the scanline get a black texel
+                    const size_t xk = std::min(x + k, dim - 1);
+                    const float3 s(cm.getDirectionFor(f, xk, y));
+                    // sample a color and take solid angle into account
+                    const float3 color = x + k < dim ?
+                            float3(Cubemap::sampleAt(data + xk)) *
+                                    CubemapUtils::solidAngle(dim, xk, y) : float3(0);
+                    sx[k] = s.x;  sy[k] = s.y;  sz[k] = s.z;
+                    r[k] = color.r;  g[k] = color.g;  b[k] = color.b;
+                }
 
-            computeShBasis(state.SHb.get(), numBands, s);
+                computeShBasis(SHb.data(), numBands, sx, sy, sz);
 
-            // apply coefficients to the sampled color
-            for (size_t i=0 ; i<numCoefs ; i++) {
-                state.SH[i] += color * state.SHb[i];
+                // apply coefficients to the sampled colors
+                for (size_t i=0 ; i<numCoefs ; i++) {
+                    R[i] += r * SHb[i];
+                    G[i] += g * SHb[i];
+                    B[i] += b * SHb[i];
+                }
             }
         }
+        std::vector<float3> SH(numCoefs);
+        for (size_t i=0 ; i<numCoefs ; i++) {
+            SH[i] = { dot(R[i], float4(1)), dot(G[i], float4(1)), dot(B[i], float4(1)) };
+        }
+        return SH;
     },
-    [&](State& state) {
+    [numCoefs](std::vector<float3> lhs, std::vector<float3> const& rhs) {
         for (size_t i=0 ; i<numCoefs ; i++) {
-            SH[i] += state.SH[i];
+            lhs[i] += rhs[i];
         }
-    }, prototype);
+        return lhs;
+    }, jobs::CountSplitter<16, 10>());
+
+    std::unique_ptr<float3[]> SH(new float3[numCoefs]);
+    std::copy(sum.begin(), sum.end(), SH.get());
 
     // precompute the scaling factor K
     std::vector<float> K = Ki(numBands);
@@ -22,6 +22,9 @@
 #include <utils/compiler.h>
 #include <utils/JobSystem.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace filament {
 namespace ibl {
 
@@ -32,53 +35,57 @@ void CubemapUtils::process(
         CubemapUtils::ScanlineProc<STATE> proc,
         ReduceProc<STATE> reduce,
         const STATE& prototype) {
-    using namespace utils;
-
-    const size_t dim = cm.getDimensions();
-
-    STATE states[6];
-    for (STATE& s : states) {
-        s = prototype;
-    }
+    process<STATE>(cm, js, nullptr, std::move(proc), std::move(reduce), prototype);
+}
 
-    JobSystem::Job* parent = js.createJob();
-    for (size_t faceIndex = 0; faceIndex < 6; faceIndex++) {
+template<typename STATE>
+void CubemapUtils::process(
+        Cubemap& cm,
+        utils::JobSystem& js,
+        utils::JobSystem::Job* parent,
+        CubemapUtils::ScanlineProc<STATE> proc,
+        ReduceProc<STATE> reduce,
+        const STATE& prototype) {
+    using namespace utils;
 
-        auto perFaceJob = [faceIndex, &states, &cm, dim, &proc]
-                (utils::JobSystem& js, utils::JobSystem::Job* parent) {
-            STATE& s = states[faceIndex];
-            Image& image(cm.getImageForFace((Cubemap::Face)faceIndex));
-
-            // here we must limit how much we capture so we can use this closure
-            // by value.
-            auto parallelJobTask = [&s, &image, &proc, dim = uint16_t(dim),
-                                    faceIndex = uint8_t(faceIndex)](size_t y0, size_t c) {
-                for (size_t y = y0; y < y0 + c; y++) {
-                    Cubemap::Texel* data =
-                            static_cast<Cubemap::Texel*>(image.getPixelRef(0, y));
-                    proc(s, y, (Cubemap::Face)faceIndex, data, dim);
-                }
-            };
-
-            constexpr bool isStateLess = std::is_same<STATE, CubemapUtils::EmptyState>::value;
-            if (UTILS_LIKELY(isStateLess)) {
-                // create the job, copying it by value
-                auto job = jobs::parallel_for(js, parent, 0, uint32_t(dim),
-                        parallelJobTask, jobs::CountSplitter<64, 8>());
-                // not need to signal here, since we're just scheduling work
-                js.run(job, JobSystem::DONT_SIGNAL);
-            } else {
-                // if we have a per-thread STATE, we can't parallel_for()
-                parallelJobTask(0, dim);
+    // The scanlines of all 6 faces are cut into chunks, and each chunk gets its own copy of the
+    // state, so that stateful kernels are as parallel as stateless ones. The states are then
+    // reduced in order, so the result doesn't depend on the number of threads.
+    constexpr size_t MAX_SLOTS = 256;
+    const size_t rows = 6 * cm.getDimensions();
+    const size_t rowsPerSlot = std::max(size_t(16), (rows + MAX_SLOTS - 1) / MAX_SLOTS);
+    const size_t slotCount = (rows + rowsPerSlot - 1) / rowsPerSlot;
+
+    std::vector<STATE> states(slotCount, prototype);
+
+    // here we must limit how much we capture so we can use this closure by value.
+    auto parallelJobTask = [&states, &cm, &proc, rowsPerSlot = uint32_t(rowsPerSlot)]
+            (size_t s0, size_t c) {
+        const size_t dim = cm.getDimensions();
+        for (size_t slot = s0; slot < s0 + c; slot++) {
+            STATE& s = states[slot];
+            const size_t end = std::min(6 * dim, (slot + 1) * rowsPerSlot);
+            for (size_t row = slot * rowsPerSlot; row < end; row++) {
+                const Cubemap::Face f = (Cubemap::Face)(row / dim);
+                const size_t y = row % dim;
+                Cubemap::Texel* data =
+                        static_cast<Cubemap::Texel*>(cm.getImageForFace(f).getPixelRef(0, y));
+                proc(s, y, f, data, dim);
             }
-        };
+        }
+    };
 
-        // not need to signal here, since we're just scheduling work
-        js.run(jobs::createJob(js, parent, perFaceJob, std::ref(js), parent), JobSystem::DONT_SIGNAL);
-    }
+    // The chunks are children of their own job, so we only wait for them. That job has the
+    // given parent, or the JobSystem's root job if there is none.
+    JobSystem::Job* chunks = js.createJob(parent);
+
+    // create the job, copying it by value
+    auto job = jobs::parallel_for(js, chunks, 0, uint32_t(slotCount),
+            parallelJobTask, jobs::CountSplitter<1, 8>());
+    js.run(job);
 
     // wait for all our threads to finish
-    js.runAndWait(parent);
+    js.runAndWait(chunks);
 
     for (STATE& s : states) {
         reduce(s);
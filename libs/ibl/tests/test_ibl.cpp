@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ibl/Cubemap.h>
+#include <ibl/CubemapIBL.h>
+#include <ibl/CubemapUtils.h>
+#include <ibl/Image.h>
+
+#include "CubemapUtilsImpl.h"
+
+#include <utils/JobSystem.h>
+
+#include <math/vec3.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include <string.h>
+
+using namespace filament::ibl;
+using namespace filament::math;
+using namespace utils;
+
+static Cubemap createCubemap(Image& image, size_t dim) {
+    Cubemap cm = CubemapUtils::create(image, dim);
+    for (size_t i = 0; i < 6; i++) {
+        const Cubemap::Face f = Cubemap::Face(i);
+        Image& face = cm.getImageForFace(f);
+        for (size_t y = 0; y < dim; y++) {
+            Cubemap::Texel* data = static_cast<Cubemap::Texel*>(face.getPixelRef(0, y));
+            for (size_t x = 0; x < dim; x++, data++) {
+                // a smooth, but not constant, environment
+                const float3 s = cm.getDirectionFor(f, x, y);
+                Cubemap::writeAt(data, Cubemap::Texel(s * 0.5f + 0.5f));
+            }
+        }
+    }
+    return cm;
+}
+
+static bool isEqual(Cubemap const& lhs, Cubemap const& rhs) {
+    const size_t dim = lhs.getDimensions();
+    if (rhs.getDimensions() != dim) {
+        return false;
+    }
+    for (size_t i = 0; i < 6; i++) {
+        const Cubemap::Face f = Cubemap::Face(i);
+        for (size_t y = 0; y < dim; y++) {
+            if (memcmp(lhs.getImageForFace(f).getPixelRef(0, y),
+                    rhs.getImageForFace(f).getPixelRef(0, y), dim * sizeof(Cubemap::Texel))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+TEST(IBL, ProcessMatchesSingleThreaded) {
+    JobSystem js;
+    js.adopt();
+
+    // a stateful kernel that seeds its generator from the scanline, like roughnessFilter()
+    struct State {
+        std::default_random_engine gen;
+        std::uniform_real_distribution<float> distribution{ 0.0f, 1.0f };
+    };
+    auto scanline = [](State& state, size_t y, Cubemap::Face f, Cubemap::Texel* data,
+            size_t dim) {
+        state.gen.seed(uint32_t(size_t(f) * dim + y));
+        for (size_t x = 0; x < dim; ++x, ++data) {
+            Cubemap::writeAt(data, Cubemap::Texel(state.distribution(state.gen)));
+        }
+    };
+
+    const size_t dim = 128;
+    Image multiImage;
+    Cubemap multi = CubemapUtils::create(multiImage, dim);
+    CubemapUtils::process<State>(multi, js, scanline);
+
+    Image singleImage;
+    Cubemap single = CubemapUtils::create(singleImage, dim);
+    CubemapUtils::processSingleThreaded<State>(single, js, scanline);
+
+    EXPECT_TRUE(isEqual(multi, single));
+
+    js.emancipate();
+}
+
+TEST(IBL, RoughnessFilterIsDeterministic) {
+    // enough work per scanline for roughnessFilter() to use the JobSystem
+    const size_t dim = 32;
+    const size_t numSamples = 64;
+
+    Image levelImage;
+    std::vector<Cubemap> levels;
+    levels.push_back(createCubemap(levelImage, dim));
+
+    auto filter = [&](size_t threadCount, Image& image) {
+        JobSystem js(threadCount);
+        js.adopt();
+        Cubemap dst = CubemapUtils::create(image, dim);
+        CubemapIBL::roughnessFilter(js, dst, levels, 0.5f, numSamples, float3{ 1 }, false);
+        js.emancipate();
+        return dst;
+    };
+
+    // the result mustn't depend on how the work is spread over the threads
+    Image image1, image2, image3;
+    Cubemap filtered1 = filter(1, image1);
+    Cubemap filtered2 = filter(4, image2);
+    Cubemap filtered3 = filter(4, image3);
+    EXPECT_TRUE(isEqual(filtered1, filtered2));
+    EXPECT_TRUE(isEqual(filtered2, filtered3));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/ImageOps.h>
+#include <image/ImageSampler.h>
+#include <image/LinearImage.h>
+
+#include <utils/JobSystem.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using namespace image;
+using namespace utils;
+
+static LinearImage createImage(uint32_t size, uint32_t channels) {
+    LinearImage image(size, size, channels);
+    float* data = image.getPixelRef();
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            for (uint32_t c = 0; c < channels; c++) {
+                // a smooth gradient with some high frequencies
+                *data++ = float((x * (c + 1) + y * 7) % 255) / 255.0f;
+            }
+        }
+    }
+    return image;
+}
+
+// range(0) is the source size, range(1) the number of channels, range(2) is 1 for the
+// multi-threaded version. The image is minified by 2 with the default (Lanczos) filter.
+static void BM_ResampleImage(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const uint32_t size = uint32_t(state.range(0));
+    const LinearImage source = createImage(size, uint32_t(state.range(1)));
+    for (auto _ : state) {
+        LinearImage result = state.range(2) ?
+                resampleImage(js, source, size / 2, size / 2) :
+                resampleImage(source, size / 2, size / 2);
+        benchmark::DoNotOptimize(result.getPixelRef());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * size * size);
+
+    js.emancipate();
+}
+
+static void sizesAndChannels(benchmark::internal::Benchmark* b) {
+    for (int64_t size : { 512, 2048 }) {
+        for (int64_t channels : { 1, 3, 4 }) {
+            b->Args({ size, channels, 0 });
+            b->Args({ size, channels, 1 });
+        }
+    }
+}
+
+BENCHMARK(BM_ResampleImage)->Apply(sizesAndChannels)->Unit(benchmark::kMillisecond);
+
+// Same as BM_ResampleImage with a compact image, range(3) is the CompactImage::Format.
+static void BM_ResampleCompactImage(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const uint32_t size = uint32_t(state.range(0));
+    const CompactImage source = toCompactImage(createImage(size, uint32_t(state.range(1))),
+            CompactImage::Format(state.range(3)));
+    for (auto _ : state) {
+        CompactImage result = state.range(2) ?
+                resampleImage(js, source, size / 2, size / 2) :
+                resampleImage(source, size / 2, size / 2);
+        benchmark::DoNotOptimize(result.getPixelRef());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * size * size);
+
+    js.emancipate();
+}
+
+static void sizesChannelsAndFormats(benchmark::internal::Benchmark* b) {
+    for (int64_t size : { 512, 2048 }) {
+        for (int64_t channels : { 3, 4 }) {
+            for (CompactImage::Format format :
+                    { CompactImage::Format::HALF, CompactImage::Format::UNORM8 }) {
+                b->Args({ size, channels, 0, int64_t(format) });
+                b->Args({ size, channels, 1, int64_t(format) });
+            }
+        }
+    }
+}
+
+BENCHMARK(BM_ResampleCompactImage)->Apply(sizesChannelsAndFormats)
+        ->Unit(benchmark::kMillisecond);
+
+// range(0) is the source size, range(1) is 1 for the multi-threaded version.
+static void BM_GenerateMipmaps(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const LinearImage source = createImage(uint32_t(state.range(0)), 4);
+    const uint32_t count = getMipmapCount(source);
+    std::vector<LinearImage> levels(count);
+    for (auto _ : state) {
+        if (state.range(1)) {
+            generateMipmaps(js, source, Filter::BOX, levels.data(), count);
+        } else {
+            generateMipmaps(source, Filter::BOX, levels.data(), count);
+        }
+        benchmark::DoNotOptimize(levels.data());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * state.range(0) * state.range(0));
+
+    js.emancipate();
+}
+
+BENCHMARK(BM_GenerateMipmaps)->Ranges({{ 512, 2048 }, { 0, 1 }})->Unit(benchmark::kMillisecond);
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_COMPACTIMAGE_H
+#define IMAGE_COMPACTIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace image {
+
+/**
+ * CompactImage is a handle to packed pixel data arranged into a row-major grid, like LinearImage,
+ * but with 16-bit (half-float) or 8-bit (unorm) channels instead of 32-bit floats. It uses 2 to 4
+ * times less memory than the equivalent LinearImage, which matters for very large textures.
+ *
+ * Algorithms access pixels as floats, one row at a time, through loadRow() and storeRow(). The
+ * values are converted on the fly: no float copy of the whole image is ever made. UNORM8 is meant
+ * for data that lives in [0, 1], values outside this range are clamped and NaNs are stored as 0.
+ *
+ * Like LinearImage, the pixel data has shared ownership semantics and shared access to pixels is
+ * not thread safe. However, distinct rows can be written concurrently.
+ */
+class CompactImage {
+public:
+    enum class Format : uint8_t {
+        HALF,   // 16-bit floating point
+        UNORM8  // 8-bit normalized integer
+    };
+
+    /**
+     * Allocates a zeroed-out image.
+     */
+    CompactImage(uint32_t width, uint32_t height, uint32_t channels, Format format);
+
+    /**
+     * Creates an empty (invalid) image.
+     */
+    CompactImage() = default;
+    explicit operator bool() const { return mData != nullptr; }
+
+    /**
+     * Gets a pointer to the underlying pixel data, the stride of a row is getBytesPerRow().
+     */
+    void* getPixelRef() { return mData.get(); }
+    void const* getPixelRef() const { return mData.get(); }
+
+    /**
+     * Gets a pointer to the pixel data at the given column and row. (not bounds checked)
+     */
+    void* getPixelRef(uint32_t column, uint32_t row) {
+        return mData.get() + (column + size_t(row) * mWidth) * getBytesPerPixel();
+    }
+
+    void const* getPixelRef(uint32_t column, uint32_t row) const {
+        return mData.get() + (column + size_t(row) * mWidth) * getBytesPerPixel();
+    }
+
+    /**
+     * Converts the given row to floats. dst must hold width * channels floats.
+     */
+    void loadRow(uint32_t row, float* dst) const;
+
+    /**
+     * Converts floats to the given row. src must hold width * channels floats.
+     */
+    void storeRow(uint32_t row, float const* src);
+
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+    uint32_t getChannels() const { return mChannels; }
+    Format getFormat() const { return mFormat; }
+    size_t getBytesPerChannel() const { return mFormat == Format::HALF ? 2 : 1; }
+    size_t getBytesPerPixel() const { return getBytesPerChannel() * mChannels; }
+    size_t getBytesPerRow() const { return getBytesPerPixel() * mWidth; }
+    void reset() { *this = CompactImage(); }
+    bool isValid() const { return mData != nullptr; }
+
+private:
+    std::shared_ptr<uint8_t> mData;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mChannels = 0;
+    Format mFormat = Format::HALF;
+};
+
+} // namespace image
+
+#endif /* IMAGE_COMPACTIMAGE_H */
@@ -17,6 +17,7 @@
 #ifndef IMAGE_IMAGEOPS_H
 #define IMAGE_IMAGEOPS_H
 
+#include <image/CompactImage.h>
 #include <image/LinearImage.h>
 
 #include <cstddef>
@@ -80,6 +81,17 @@ LinearImage voronoiFromCoordField(const LinearImage& coordField, const LinearIma
 // Copies content of a source image into a target image. Requires width/height/channels to match.
 void blitImage(LinearImage& target, const LinearImage& source);
 
+// Converts a linear image to a compact image with the given storage format, and vice versa.
+CompactImage toCompactImage(const LinearImage& image, CompactImage::Format format);
+LinearImage toLinearImage(const CompactImage& image);
+
+// Versions of the above pixel shuffling operations that work on compact images directly, without
+// any conversion to floats.
+CompactImage horizontalFlip(const CompactImage& image);
+CompactImage verticalFlip(const CompactImage& image);
+CompactImage transpose(const CompactImage& image);
+CompactImage cropRegion(const CompactImage& image, uint32_t l, uint32_t t, uint32_t r, uint32_t b);
+
 } // namespace image
 
 
@@ -17,8 +17,13 @@
 #ifndef IMAGE_IMAGESAMPLER_H
 #define IMAGE_IMAGESAMPLER_H
 
+#include <image/CompactImage.h>
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 /**
@@ -110,6 +115,36 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
         Filter filter = Filter::DEFAULT);
 
+/**
+ * Multi-threaded versions of resampleImage, rows are processed in parallel on the given
+ * JobSystem. The results are identical to the single-threaded versions.
+ * This must be called from a thread known to the JobSystem (i.e. one of its own threads, or an
+ * adopted one).
+ */
+LinearImage resampleImage(utils::JobSystem& js, const LinearImage& source, uint32_t width,
+        uint32_t height, const ImageSampler& sampler);
+
+LinearImage resampleImage(utils::JobSystem& js, const LinearImage& source, uint32_t width,
+        uint32_t height, Filter filter = Filter::DEFAULT);
+
+/**
+ * Versions of resampleImage that work on compact images directly. Source rows are converted to
+ * floats as they are needed, and the result has the same format as the source. The memory
+ * overhead is a few rows per thread, rather than the whole image, and the results are the same
+ * as resampling the float version of the source, up to the precision of the format.
+ */
+CompactImage resampleImage(const CompactImage& source, uint32_t width, uint32_t height,
+        const ImageSampler& sampler);
+
+CompactImage resampleImage(const CompactImage& source, uint32_t width, uint32_t height,
+        Filter filter = Filter::DEFAULT);
+
+CompactImage resampleImage(utils::JobSystem& js, const CompactImage& source, uint32_t width,
+        uint32_t height, const ImageSampler& sampler);
+
+CompactImage resampleImage(utils::JobSystem& js, const CompactImage& source, uint32_t width,
+        uint32_t height, Filter filter = Filter::DEFAULT);
+
 /**
  * Computes a single sample for the given texture coordinate and writes the resulting color
  * components into the given output holder.
@@ -139,11 +174,27 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
  */
 void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount);
 
+/**
+ * Multi-threaded version of generateMipmaps, the levels are generated concurrently on the given
+ * JobSystem. This must be called from a thread known to the JobSystem.
+ */
+void generateMipmaps(utils::JobSystem& js, const LinearImage& source, Filter,
+        LinearImage* result, uint32_t mipCount);
+
+/**
+ * Versions of generateMipmaps that work on compact images directly, see resampleImage.
+ */
+void generateMipmaps(const CompactImage& source, Filter, CompactImage* result, uint32_t mipCount);
+
+void generateMipmaps(utils::JobSystem& js, const CompactImage& source, Filter,
+        CompactImage* result, uint32_t mipCount);
+
 /**
  * Returns the number of miplevels it would take to downsample the given image down to 1x1. This
  * number does not include the original image (i.e. mip 0).
  */
 uint32_t getMipmapCount(const LinearImage& source);
+uint32_t getMipmapCount(const CompactImage& source);
 
 /**
  * Given the string name of a filter, converts it to uppercase and returns the corresponding
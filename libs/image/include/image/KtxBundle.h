@@ -22,6 +22,10 @@
 #include <cstdint>
 #include <memory>
 
+namespace utils {
+class MappedFile;
+} // namespace utils
+
 namespace image {
 
 struct KtxInfo {
@@ -64,6 +68,11 @@ struct KtxMetadata;
 class KtxBundle {
 public:
 
+    enum class Storage : uint8_t {
+        COPY,   // the bundle owns a copy of the serialized data
+        VIEW    // the bundle refers to the serialized data, which must outlive it
+    };
+
     ~KtxBundle();
 
     /**
@@ -75,8 +84,21 @@ public:
      * Creates a new bundle by deserializing the given data.
      *
      * Typically, this constructor is used to consume the contents of a KTX file.
+     *
+     * With Storage::VIEW, nothing is copied: blobs point into the given data, and the metadata is
+     * only parsed when it's first needed. The data is never written to, blobs are copied the first
+     * time one of them is modified.
+     */
+    KtxBundle(uint8_t const* bytes, uint32_t nbytes, Storage storage = Storage::COPY);
+
+    /**
+     * Memory-maps the given KTX file and creates a bundle that views it in place, the file is
+     * unmapped when the bundle is destroyed. Returns null if the file can't be mapped.
+     *
+     * Pages are only read when blobs are accessed, so passing the blobs straight to the GPU (see
+     * ktx::createTexture) never holds a second copy of the file in memory.
      */
-    KtxBundle(uint8_t const* bytes, uint32_t nbytes);
+    static KtxBundle* map(const char* path);
 
     /**
      * Serializes the bundle into the given target memory. Returns false if there's not enough
@@ -98,7 +120,8 @@ public:
     KtxInfo& info() { return mInfo; }
 
     /**
-     * Gets or sets key/value metadata.
+     * Gets or sets key/value metadata. The first call may parse the metadata, so it must not be
+     * made concurrently.
      */
     const char* getMetadata(const char* key, size_t* valueSize = nullptr) const;
     void setMetadata(const char* key, const char* value);
@@ -128,7 +151,8 @@ public:
 
     /**
      * Retrieves a weak reference to a given data blob. Returns false if the given blob index is out
-     * of bounds, or if the blob at the given index is empty.
+     * of bounds, or if the blob at the given index is empty. The blobs of a bundle created with
+     * Storage::VIEW must not be written to.
      */
     bool getBlob(KtxBlobIndex index, uint8_t** data, uint32_t* size) const;
 
@@ -270,6 +294,7 @@ private:
     uint32_t mNumCubeFaces;
     std::unique_ptr<KtxBlobList> mBlobs;
     std::unique_ptr<KtxMetadata> mMetadata;
+    std::unique_ptr<utils::MappedFile> mFile;
 };
 
 } // namespace image
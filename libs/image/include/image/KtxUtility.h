@@ -144,6 +144,9 @@ namespace ktx {
      * Creates a Texture object from a KTX bundle, populates all of its faces and miplevels,
      * and automatically destroys the bundle after all the texture data has been uploaded.
      *
+     * With a bundle created by KtxBundle::map(), the miplevels are uploaded straight from the
+     * mapped file, which is unmapped once the upload is done.
+     *
      * @param engine Used to create the Filament Texture
      * @param ktx In-memory representation of a KTX file
      * @param srgb Forces the KTX-specified format into an SRGB format if possible
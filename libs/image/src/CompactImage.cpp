@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/CompactImage.h>
+
+#include <math/half.h>
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+#include <cstring> // for memset
+
+using namespace filament::math;
+
+namespace image {
+
+CompactImage::CompactImage(uint32_t width, uint32_t height, uint32_t channels, Format format) :
+        mWidth(width), mHeight(height), mChannels(channels), mFormat(format) {
+    const size_t size = getBytesPerRow() * height;
+    uint8_t* bytes = new uint8_t[size];
+    memset(bytes, 0, size);
+    mData = std::shared_ptr<uint8_t>(bytes, std::default_delete<uint8_t[]>());
+}
+
+void CompactImage::loadRow(uint32_t row, float* UTILS_RESTRICT dst) const {
+    const size_t n = size_t(mWidth) * mChannels;
+    if (mFormat == Format::HALF) {
+        half const* UTILS_RESTRICT src = static_cast<half const*>(getPixelRef(0, row));
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = float(src[i]);
+        }
+    } else {
+        uint8_t const* UTILS_RESTRICT src = static_cast<uint8_t const*>(getPixelRef(0, row));
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = float(src[i]) * (1.0f / 255.0f);
+        }
+    }
+}
+
+void CompactImage::storeRow(uint32_t row, float const* UTILS_RESTRICT src) {
+    const size_t n = size_t(mWidth) * mChannels;
+    if (mFormat == Format::HALF) {
+        half* UTILS_RESTRICT dst = static_cast<half*>(getPixelRef(0, row));
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = half(src[i]);
+        }
+    } else {
+        uint8_t* UTILS_RESTRICT dst = static_cast<uint8_t*>(getPixelRef(0, row));
+        for (size_t i = 0; i < n; ++i) {
+            // NaNs fail the comparison and become 0, converting them would be undefined
+            const float v = src[i] > 0.0f ? std::min(src[i], 1.0f) : 0.0f;
+            dst[i] = uint8_t(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+} // namespace image
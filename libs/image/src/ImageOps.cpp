@@ -422,4 +422,70 @@ void blitImage(LinearImage& target, const LinearImage& source) {
             sizeof(float) * source.getWidth() * source.getHeight() * source.getChannels());
 }
 
+CompactImage toCompactImage(const LinearImage& image, CompactImage::Format format) {
+    const uint32_t height = image.getHeight();
+    CompactImage result(image.getWidth(), height, image.getChannels(), format);
+    for (uint32_t row = 0; row < height; ++row) {
+        result.storeRow(row, image.getPixelRef(0, row));
+    }
+    return result;
+}
+
+LinearImage toLinearImage(const CompactImage& image) {
+    const uint32_t height = image.getHeight();
+    LinearImage result(image.getWidth(), height, image.getChannels());
+    for (uint32_t row = 0; row < height; ++row) {
+        image.loadRow(row, result.getPixelRef(0, row));
+    }
+    return result;
+}
+
+CompactImage horizontalFlip(const CompactImage& image) {
+    const uint32_t width = image.getWidth();
+    const uint32_t height = image.getHeight();
+    const size_t bpp = image.getBytesPerPixel();
+    CompactImage result(width, height, image.getChannels(), image.getFormat());
+    for (uint32_t row = 0; row < height; ++row) {
+        for (uint32_t col = 0; col < width; ++col) {
+            memcpy(result.getPixelRef(width - 1 - col, row), image.getPixelRef(col, row), bpp);
+        }
+    }
+    return result;
+}
+
+CompactImage verticalFlip(const CompactImage& image) {
+    const uint32_t height = image.getHeight();
+    CompactImage result(image.getWidth(), height, image.getChannels(), image.getFormat());
+    for (uint32_t row = 0; row < height; ++row) {
+        memcpy(result.getPixelRef(0, height - 1 - row), image.getPixelRef(0, row),
+                image.getBytesPerRow());
+    }
+    return result;
+}
+
+CompactImage transpose(const CompactImage& image) {
+    const uint32_t width = image.getWidth();
+    const uint32_t height = image.getHeight();
+    const size_t bpp = image.getBytesPerPixel();
+    CompactImage result(height, width, image.getChannels(), image.getFormat());
+    for (uint32_t row = 0; row < height; ++row) {
+        for (uint32_t col = 0; col < width; ++col) {
+            memcpy(result.getPixelRef(row, col), image.getPixelRef(col, row), bpp);
+        }
+    }
+    return result;
+}
+
+CompactImage cropRegion(const CompactImage& image, uint32_t left, uint32_t top, uint32_t right,
+        uint32_t bottom) {
+    const uint32_t width = right - left;
+    const uint32_t height = bottom - top;
+    CompactImage result(width, height, image.getChannels(), image.getFormat());
+    for (uint32_t row = 0; row < height; ++row) {
+        memcpy(result.getPixelRef(0, row), image.getPixelRef(left, top + row),
+                result.getBytesPerRow());
+    }
+    return result;
+}
+
 } // namespace image
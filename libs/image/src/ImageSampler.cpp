@@ -21,9 +21,13 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/CString.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -132,7 +136,7 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     // the [0,1] domain. If this were a huge number, the filtered results would look the same, but
     // the filter would perform very poorly because it would be iterating over a lot more samples
     // than necessary.
-    const float filterBounds = domainScale * std::abs(filter.boundingRadius);
+    const float filterBounds = std::abs(filter.boundingRadius) / domainScale;
 
     // Iterate through target samples. "xtarget" points to the center of each target pixel.
     float xtarget = dtarget / 2.0f;
@@ -143,9 +147,19 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
         uint32_t count = 0;
         float sum = 0;
 
-        // Iterate through source samples that lie within the bounded region.
-        const auto isource_lower = int32_t((xtarget - filterBounds) * nsource);
-        const auto isource_upper = int32_t(std::ceil((xtarget + filterBounds) * nsource));
+        // Iterate through source samples that lie within the bounded region. The bounds are
+        // mapped to the source range, with a margin of one sample for rounding errors. A filter
+        // without bounds (i.e. NEAREST) only looks at the samples closest to the target center,
+        // mapped to the source range as well.
+        const float center = (left + xtarget * (right - left)) * nsource;
+        int32_t isource_lower = int32_t(std::floor(center));
+        int32_t isource_upper = int32_t(std::ceil(center));
+        if (filterBounds != 0) {
+            const float lower = left + (xtarget - filterBounds) * (right - left);
+            const float upper = left + (xtarget + filterBounds) * (right - left);
+            isource_lower = int32_t(std::floor(lower * nsource - 0.5f)) - 1;
+            isource_upper = int32_t(std::ceil(upper * nsource - 0.5f)) + 1;
+        }
         for (int32_t isource = isource_lower; isource <= isource_upper; ++isource) {
             const float xsource = (((isource + 0.5f) / nsource) - left) / (right - left);
             const bool outside_image = isource < 0 || isource >= int32_t(nsource);
@@ -172,24 +186,6 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     }
 }
 
-// Transforms a MAD program intended for single-channel data into a program intended for
-// multi-channel data.
-void expandMadProgram(uint32_t nchannels, MadProgram* program) {
-    if (nchannels == 1) {
-        return;
-    }
-    MadProgram result;
-    result.reserve(program->size() * nchannels);
-    for (auto mad : *program) {
-        mad.sourceIndex *= nchannels;
-        mad.targetIndex *= nchannels;
-        for (uint32_t j = 0; j < nchannels; ++j, ++mad.sourceIndex, ++mad.targetIndex) {
-            result.push_back(mad);
-        }
-    }
-    program->swap(result);
-}
-
 FilterFunction createFilterFunction(Filter ftype) {
     FilterFunction fn;
     switch (ftype) {
@@ -208,68 +204,195 @@ FilterFunction createFilterFunction(Filter ftype) {
 }
 
 template <class VecT>
-void normalizeImpl(LinearImage& image) {
-    const uint32_t width = image.getWidth(), height = image.getHeight();
-    auto vecs = (VecT*) image.getPixelRef();
-    for (uint32_t n = 0; n < width * height; ++n) {
+void normalizeImpl(float* pixels, size_t count) {
+    auto vecs = (VecT*) pixels;
+    for (size_t n = 0; n < count; ++n) {
         vecs[n] = normalize(vecs[n]);
     }
 }
 
+void normalizePixels(float* pixels, size_t count, uint32_t channels) {
+    ASSERT_PRECONDITION(channels == 3 || channels == 4, "Must be a 3 or 4 channel image");
+    if (channels == 3) {
+      normalizeImpl< filament::math::float3>(pixels, count);
+    } else {
+      normalizeImpl< filament::math::float4>(pixels, count);
+    }
+}
+
 void normalize(LinearImage& image) {
-    ASSERT_PRECONDITION(image.getChannels() == 3 || image.getChannels() == 4,
-                        "Must be a 3 or 4 channel image");
-    if (image.getChannels() == 3) {
-      normalizeImpl< filament::math::float3>(image);
+    normalizePixels(image.getPixelRef(), size_t(image.getWidth()) * image.getHeight(),
+            image.getChannels());
+}
+
+// A MAD program compiled into spans: each target sample is the weighted sum of a contiguous run
+// of source samples. This lets the inner loops run over all the channels of a pixel (horizontal
+// pass) or over all the pixels of a row (vertical pass) at once.
+struct MadSpan {
+    int32_t first;      // index of the first source sample
+    uint32_t count;     // number of source samples
+    uint32_t weights;   // offset of the first weight in MadSpans::weights
+};
+
+struct MadSpans {
+    std::vector<MadSpan> spans;     // one per target sample
+    std::vector<float> weights;     // samples in a span that had no instruction get a weight of 0
+};
+
+// Compiles a single-channel MAD program, which must have been generated by generateMadProgram.
+void compileMadProgram(uint32_t ntarget, MadProgram const& program, MadSpans* result) {
+    result->spans.assign(ntarget, { 0, 0, 0 });
+    result->weights.clear();
+    for (size_t i = 0, n = program.size(); i < n;) {
+        const uint32_t target = program[i].targetIndex;
+        const int32_t first = program[i].sourceIndex;
+        size_t end = i;
+        while (end < n && program[end].targetIndex == target) {
+            ++end;
+        }
+        const int32_t last = program[end - 1].sourceIndex;
+        const uint32_t offset = uint32_t(result->weights.size());
+        result->weights.resize(offset + (last - first + 1), 0.0f);
+        for (; i < end; ++i) {
+            result->weights[offset + (program[i].sourceIndex - first)] = program[i].weight;
+        }
+        result->spans[target] = { first, uint32_t(last - first + 1), offset };
+    }
+}
+
+// Calls fn(start, count) over [0, count), in parallel if we have a JobSystem. Jobs get at least
+// GRAIN rows.
+template<uint32_t GRAIN = 8, typename F>
+void parallelRows(utils::JobSystem* js, uint32_t count, F const& fn) {
+    if (!js || count < 2) {
+        fn(0, count);
+        return;
+    }
+    utils::JobSystem::Job* job = utils::jobs::parallel_for(*js, nullptr, 0, count,
+            [&fn](uint32_t start, uint32_t count) { fn(start, count); },
+            utils::jobs::CountSplitter<GRAIN>());
+    js->runAndWait(job);
+}
+
+// Filters one row with NCHAN channels, or with nchan channels if NCHAN is 0.
+template<uint32_t NCHAN>
+void resampleRow(float const* UTILS_RESTRICT source, float* UTILS_RESTRICT target,
+        MadSpans const& program, uint32_t nchan, bool minimum) {
+    const uint32_t n = NCHAN ? NCHAN : nchan;
+    float const* weights = program.weights.data();
+    for (MadSpan const& span : program.spans) {
+        float const* src = source + span.first * n;
+        float const* w = weights + span.weights;
+        if (NCHAN == 0) {
+            for (uint32_t k = 0; k < span.count; ++k, src += n) {
+                for (uint32_t c = 0; c < n; ++c) {
+                    target[c] = minimum ? (w[k] != 0 ? std::min(src[c], target[c]) : target[c])
+                            : target[c] + src[c] * w[k];
+                }
+            }
+        } else {
+            // the accumulator stays in registers, and the channels are computed together
+            float acc[NCHAN ? NCHAN : 1];
+            for (uint32_t c = 0; c < n; ++c) {
+                acc[c] = target[c];
+            }
+            if (minimum) {
+                for (uint32_t k = 0; k < span.count; ++k, src += n) {
+                    if (w[k] != 0) {
+                        for (uint32_t c = 0; c < n; ++c) {
+                            acc[c] = std::min(src[c], acc[c]);
+                        }
+                    }
+                }
+            } else {
+                for (uint32_t k = 0; k < span.count; ++k, src += n) {
+                    for (uint32_t c = 0; c < n; ++c) {
+                        acc[c] += src[c] * w[k];
+                    }
+                }
+            }
+            for (uint32_t c = 0; c < n; ++c) {
+                target[c] = acc[c];
+            }
+        }
+        target += n;
+    }
+}
+
+void resampleRow(float const* source, float* target, MadSpans const& program, uint32_t nchan,
+        bool minimum) {
+    switch (nchan) {
+        case 1:  resampleRow<1>(source, target, program, nchan, minimum); break;
+        case 2:  resampleRow<2>(source, target, program, nchan, minimum); break;
+        case 3:  resampleRow<3>(source, target, program, nchan, minimum); break;
+        case 4:  resampleRow<4>(source, target, program, nchan, minimum); break;
+        default: resampleRow<0>(source, target, program, nchan, minimum); break;
+    }
+}
+
+// Adds a weighted source row to the target row, or takes the minimum of both.
+void accumulateRow(float* UTILS_RESTRICT target, float const* UTILS_RESTRICT source,
+        size_t size, float weight, bool minimum) {
+    if (minimum) {
+        if (weight != 0) {
+            for (size_t i = 0; i < size; ++i) {
+                target[i] = std::min(source[i], target[i]);
+            }
+        }
     } else {
-      normalizeImpl< filament::math::float4>(image);
+        for (size_t i = 0; i < size; ++i) {
+            target[i] += source[i] * weight;
+        }
+    }
+}
+
+Filter resolveFilter(Filter filter, uint32_t ntarget, uint32_t nsource) {
+    if (filter == Filter::DEFAULT) {
+        filter = ntarget > nsource ? Filter::MITCHELL : Filter::LANCZOS;
     }
+    return filter;
 }
 
-LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
-        uint32_t twidth, Filter filter, float left, float right, float filterRadiusMultiplier) {
+void generateMadSpans(uint32_t ntarget, uint32_t nsource, Filter filter, float left, float right,
+        float filterRadiusMultiplier, MadProgram* program, MadSpans* spans) {
+    const FilterFunction fn = createFilterFunction(filter);
+    program->clear();
+    generateMadProgram(ntarget, nsource, left, right, fn, filterRadiusMultiplier, program);
+    compileMadProgram(ntarget, *program, spans);
+}
+
+// Resizes the image horizontally.
+LinearImage resampleHorizontal(utils::JobSystem* js, const LinearImage& source,
+        MadProgram* program, uint32_t twidth, Filter filter, float left, float right,
+        float filterRadiusMultiplier) {
     const uint32_t swidth = source.getWidth();
     const uint32_t sheight = source.getHeight();
     const uint32_t nchan = source.getChannels();
-    const bool mag = twidth > swidth;
-    if (filter == Filter::DEFAULT) filter = mag ? Filter::MITCHELL : Filter::LANCZOS;
-    const FilterFunction hfn = createFilterFunction(filter);
+    filter = resolveFilter(filter, twidth, swidth);
 
-    // Generate a flat list of multiply-add (MAD) instructions.
-    program->clear();
-    generateMadProgram(twidth, swidth, left, right, hfn, filterRadiusMultiplier, program);
-    expandMadProgram(nchan, program);
+    MadSpans spans;
+    generateMadSpans(twidth, swidth, filter, left, right, filterRadiusMultiplier, program, &spans);
 
     // Allocate the target image.
     LinearImage result(twidth, sheight, nchan);
-    float const* sourceRow = source.getPixelRef();
-    float* targetRow = result.getPixelRef();
 
     // The MIN filter is special because it starts with non-zero values and ignores filter weights.
-    if (filter == Filter::MINIMUM) {
-        for (uint32_t n = 0; n < twidth * sheight * nchan; ++n) {
-            targetRow[n] = std::numeric_limits<float>::max();
-        }
-        for (uint32_t row = 0; row < sheight; ++row) {
-            for (auto mad : *program) {
-                const float a = sourceRow[mad.sourceIndex];
-                const float b = targetRow[mad.targetIndex];
-                targetRow[mad.targetIndex] = std::min(a, b);
-            }
-            targetRow += twidth * nchan;
-            sourceRow += swidth * nchan;
-        }
-        return result;
+    const bool minimum = filter == Filter::MINIMUM;
+    if (minimum) {
+        clearToValue(result, std::numeric_limits<float>::max());
     }
 
-    // Resize the image horizontally by executing the MAD instructions over each row.
-    for (uint32_t row = 0; row < sheight; ++row) {
-        for (auto mad : *program) {
-            targetRow[mad.targetIndex] += sourceRow[mad.sourceIndex] * mad.weight;
+    // Execute the program over each row.
+    auto resampleRows = [&](uint32_t start, uint32_t count) {
+        float const* sourceRow = source.getPixelRef(0, start);
+        float* targetRow = result.getPixelRef(0, start);
+        for (uint32_t row = start; row < start + count; ++row) {
+            resampleRow(sourceRow, targetRow, spans, nchan, minimum);
+            targetRow += twidth * nchan;
+            sourceRow += swidth * nchan;
         }
-        targetRow += twidth * nchan;
-        sourceRow += swidth * nchan;
-    }
+    };
+    parallelRows(js, sheight, resampleRows);
 
     // Perform post processing for the current pass.
     if (filter == Filter::GAUSSIAN_NORMALS) {
@@ -278,16 +401,49 @@ LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
     return result;
 }
 
-} // anonymous namespace
+// Resizes the image vertically. Each target row is a weighted sum of whole source rows, so unlike
+// the horizontal pass, the inner loop runs over every float of the row, which vectorizes well.
+// This produces the same results as transposing and resizing horizontally.
+LinearImage resampleVertical(utils::JobSystem* js, const LinearImage& source,
+        MadProgram* program, uint32_t theight, Filter filter, float top, float bottom,
+        float filterRadiusMultiplier) {
+    const uint32_t width = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t nchan = source.getChannels();
+    filter = resolveFilter(filter, theight, sheight);
 
-namespace image {
+    MadSpans spans;
+    generateMadSpans(theight, sheight, filter, top, bottom, filterRadiusMultiplier, program,
+            &spans);
 
-SingleSample::~SingleSample() {
-    delete[] data;
+    LinearImage result(width, theight, nchan);
+    const bool minimum = filter == Filter::MINIMUM;
+    if (minimum) {
+        clearToValue(result, std::numeric_limits<float>::max());
+    }
+
+    const uint32_t rowSize = width * nchan;
+    auto resampleRows = [&](uint32_t start, uint32_t count) {
+        for (uint32_t row = start; row < start + count; ++row) {
+            MadSpan const& span = spans.spans[row];
+            float const* w = spans.weights.data() + span.weights;
+            float* target = result.getPixelRef(0, row);
+            for (uint32_t k = 0; k < span.count; ++k) {
+                accumulateRow(target, source.getPixelRef(0, span.first + k), rowSize, w[k],
+                        minimum);
+            }
+        }
+    };
+    parallelRows(js, theight, resampleRows);
+
+    if (filter == Filter::GAUSSIAN_NORMALS) {
+        normalize(result);
+    }
+    return result;
 }
 
-LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
-        const ImageSampler& sampler) {
+LinearImage resampleImageImpl(utils::JobSystem* js, const LinearImage& source,
+        uint32_t width, uint32_t height, const ImageSampler& sampler) {
     ASSERT_PRECONDITION(
         sampler.east.mode == Boundary::EXCLUDE &&
         sampler.north.mode == Boundary::EXCLUDE &&
@@ -302,11 +458,144 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
     const float bottom = sampler.sourceRegion.bottom;
     MadProgram program;
     LinearImage result;
-    result = transpose(resampleImage1D(source, &program, width, hfilter, left, right, radius));
-    result = transpose(resampleImage1D(result, &program, height, vfilter, top, bottom, radius));
+    result = resampleHorizontal(js, source, &program, width, hfilter, left, right, radius);
+    result = resampleVertical(js, result, &program, height, vfilter, top, bottom, radius);
     return result;
 }
 
+// Resizes a compact image in a single pass over the target rows. Rather than storing the whole
+// intermediate image, each job filters the source rows it needs horizontally, converting them
+// to floats on the fly, and keeps them in a small window until the next target rows are done with
+// them. The arithmetic is the same as with the LinearImage version.
+CompactImage resampleImageImpl(utils::JobSystem* js, const CompactImage& source,
+        uint32_t width, uint32_t height, const ImageSampler& sampler) {
+    ASSERT_PRECONDITION(
+        sampler.east.mode == Boundary::EXCLUDE &&
+        sampler.north.mode == Boundary::EXCLUDE &&
+        sampler.west.mode == Boundary::EXCLUDE &&
+        sampler.south.mode == Boundary::EXCLUDE, "Not yet implemented.");
+    const uint32_t swidth = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t nchan = source.getChannels();
+    const Filter hfilter = resolveFilter(sampler.horizontalFilter, width, swidth);
+    const Filter vfilter = resolveFilter(sampler.verticalFilter, height, sheight);
+    const float radius = sampler.filterRadiusMultiplier;
+    const Region& region = sampler.sourceRegion;
+
+    MadProgram program;
+    MadSpans hspans;
+    MadSpans vspans;
+    generateMadSpans(width, swidth, hfilter, region.left, region.right, radius, &program,
+            &hspans);
+    generateMadSpans(height, sheight, vfilter, region.top, region.bottom, radius, &program,
+            &vspans);
+
+    // the source rows of a target row are contiguous, so they never collide in the window
+    uint32_t window = 1;
+    for (MadSpan const& span : vspans.spans) {
+        window = std::max(window, span.count);
+    }
+
+    CompactImage result(width, height, nchan, source.getFormat());
+    const bool hminimum = hfilter == Filter::MINIMUM;
+    const bool vminimum = vfilter == Filter::MINIMUM;
+    const size_t sourceSize = size_t(swidth) * nchan;
+    const size_t rowSize = size_t(width) * nchan;
+
+    auto resampleRows = [&](uint32_t start, uint32_t count) {
+        std::vector<float> sourceRow(sourceSize);
+        std::vector<float> target(rowSize);
+        std::vector<float> filtered(rowSize * window);
+        std::vector<int32_t> filteredRows(window, -1);
+        for (uint32_t row = start; row < start + count; ++row) {
+            MadSpan const& span = vspans.spans[row];
+            float const* w = vspans.weights.data() + span.weights;
+            std::fill(target.begin(), target.end(),
+                    vminimum ? std::numeric_limits<float>::max() : 0.0f);
+            for (uint32_t k = 0; k < span.count; ++k) {
+                const int32_t srow = span.first + int32_t(k);
+                const uint32_t slot = uint32_t(srow) % window;
+                float* hrow = filtered.data() + slot * rowSize;
+                if (filteredRows[slot] != srow) {
+                    source.loadRow(uint32_t(srow), sourceRow.data());
+                    std::fill_n(hrow, rowSize,
+                            hminimum ? std::numeric_limits<float>::max() : 0.0f);
+                    resampleRow(sourceRow.data(), hrow, hspans, nchan, hminimum);
+                    if (hfilter == Filter::GAUSSIAN_NORMALS) {
+                        normalizePixels(hrow, width, nchan);
+                    }
+                    filteredRows[slot] = srow;
+                }
+                accumulateRow(target.data(), hrow, rowSize, w[k], vminimum);
+            }
+            if (vfilter == Filter::GAUSSIAN_NORMALS) {
+                normalizePixels(target.data(), width, nchan);
+            }
+            result.storeRow(row, target.data());
+        }
+    };
+    // Neighboring jobs filter some source rows twice, larger jobs keep this overhead low.
+    parallelRows<32>(js, height, resampleRows);
+    return result;
+}
+
+template<typename Image>
+uint32_t getMipmapCountImpl(const Image& source) {
+    uint32_t width = source.getWidth();
+    uint32_t height = source.getHeight();
+    uint32_t count = 0;
+    while (width > 1 || height > 1) {
+        ++count;
+        width = std::max(width >> 1u, 1u);
+        height = std::max(height >> 1u, 1u);
+    }
+    return count;
+}
+
+template<typename Image>
+void generateMipmapsImpl(utils::JobSystem* js, const Image& source, Filter filter,
+        Image* result, uint32_t mips) {
+    mips = std::min(mips, getMipmapCountImpl(source));
+    auto generateLevels = [&](uint32_t start, uint32_t count) {
+        for (uint32_t n = start; n < start + count; ++n) {
+            const uint32_t width = std::max(source.getWidth() >> (n + 1u), 1u);
+            const uint32_t height = std::max(source.getHeight() >> (n + 1u), 1u);
+            result[n] = resampleImageImpl(js, source, width, height, ImageSampler {
+                .horizontalFilter = filter,
+                .verticalFilter = filter
+            });
+        }
+    };
+    if (!js || mips < 2) {
+        generateLevels(0, mips);
+        return;
+    }
+    // The levels don't depend on each other, so they're generated concurrently, and each level
+    // is itself processed in parallel.
+    utils::JobSystem::Job* job = utils::jobs::parallel_for(*js, nullptr, 0, mips,
+            [&generateLevels](uint32_t start, uint32_t count) { generateLevels(start, count); },
+            utils::jobs::CountSplitter<1>());
+    js->runAndWait(job);
+}
+
+} // anonymous namespace
+
+namespace image {
+
+SingleSample::~SingleSample() {
+    delete[] data;
+}
+
+LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
+        const ImageSampler& sampler) {
+    return resampleImageImpl(nullptr, source, width, height, sampler);
+}
+
+LinearImage resampleImage(utils::JobSystem& js, const LinearImage& source, uint32_t width,
+        uint32_t height, const ImageSampler& sampler) {
+    return resampleImageImpl(&js, source, width, height, sampler);
+}
+
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
         Filter filter) {
     return resampleImage(source, width, height, ImageSampler {
@@ -315,6 +604,40 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
     });
 }
 
+LinearImage resampleImage(utils::JobSystem& js, const LinearImage& source, uint32_t width,
+        uint32_t height, Filter filter) {
+    return resampleImage(js, source, width, height, ImageSampler {
+        .horizontalFilter = filter,
+        .verticalFilter = filter
+    });
+}
+
+CompactImage resampleImage(const CompactImage& source, uint32_t width, uint32_t height,
+        const ImageSampler& sampler) {
+    return resampleImageImpl(nullptr, source, width, height, sampler);
+}
+
+CompactImage resampleImage(utils::JobSystem& js, const CompactImage& source, uint32_t width,
+        uint32_t height, const ImageSampler& sampler) {
+    return resampleImageImpl(&js, source, width, height, sampler);
+}
+
+CompactImage resampleImage(const CompactImage& source, uint32_t width, uint32_t height,
+        Filter filter) {
+    return resampleImage(source, width, height, ImageSampler {
+        .horizontalFilter = filter,
+        .verticalFilter = filter
+    });
+}
+
+CompactImage resampleImage(utils::JobSystem& js, const CompactImage& source, uint32_t width,
+        uint32_t height, Filter filter) {
+    return resampleImage(js, source, width, height, ImageSampler {
+        .horizontalFilter = filter,
+        .verticalFilter = filter
+    });
+}
+
 void computeSingleSample(const LinearImage& source, float x, float y, SingleSample* result,
         Filter filter) {
     const float radius = 1.0f;
@@ -323,8 +646,8 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
     const float right = x + radius / source.getWidth();
     const float bottom = y + radius / source.getHeight();
     MadProgram program;
-    LinearImage row = transpose(resampleImage1D(source, &program, 1, filter, left, right, radius));
-    row = resampleImage1D(row, &program, 1, filter, top, bottom, radius);
+    LinearImage row = resampleHorizontal(nullptr, source, &program, 1, filter, left, right, radius);
+    row = resampleVertical(nullptr, row, &program, 1, filter, top, bottom, radius);
     if (!result->data) {
         result->data = new float[source.getChannels()];
     }
@@ -338,26 +661,30 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
 // Unlike traditional mipmap generation, our implementation generates all levels from the original
 // image, under the premise that this produces a higher quality result.
 void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips) {
-    mips = std::min(mips, getMipmapCount(source));
-    uint32_t width = source.getWidth();
-    uint32_t height = source.getHeight();
-    for (uint32_t n = 0; n < mips; ++n) {
-        width = std::max(width >> 1u, 1u);
-        height = std::max(height >> 1u, 1u);
-        result[n] = resampleImage(source, width, height, filter);
-    }
+    generateMipmapsImpl(nullptr, source, filter, result, mips);
+}
+
+void generateMipmaps(utils::JobSystem& js, const LinearImage& source, Filter filter,
+        LinearImage* result, uint32_t mips) {
+    generateMipmapsImpl(&js, source, filter, result, mips);
+}
+
+void generateMipmaps(const CompactImage& source, Filter filter, CompactImage* result,
+        uint32_t mips) {
+    generateMipmapsImpl(nullptr, source, filter, result, mips);
+}
+
+void generateMipmaps(utils::JobSystem& js, const CompactImage& source, Filter filter,
+        CompactImage* result, uint32_t mips) {
+    generateMipmapsImpl(&js, source, filter, result, mips);
 }
 
 uint32_t getMipmapCount(const LinearImage& source) {
-    uint32_t width = source.getWidth();
-    uint32_t height = source.getHeight();
-    uint32_t count = 0;
-    while (width > 1 || height > 1) {
-        ++count;
-        width = std::max(width >> 1u, 1u);
-        height = std::max(height >> 1u, 1u);
-    }
-    return count;
+    return getMipmapCountImpl(source);
+}
+
+uint32_t getMipmapCount(const CompactImage& source) {
+    return getMipmapCountImpl(source);
 }
 
 Filter filterFromString(const char* rawname) {
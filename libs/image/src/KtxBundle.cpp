@@ -16,6 +16,7 @@
 
 #include <image/KtxBundle.h>
 
+#include <utils/MappedFile.h>
 #include <utils/Panic.h>
 
 #include <string>
@@ -51,6 +52,37 @@ namespace image  {
 // This little wrapper lets us avoid having an STL container in the header file.
 struct KtxMetadata {
     std::unordered_map<std::string, std::string> keyvals;
+
+    // serialized key/value data that hasn't been parsed yet
+    uint8_t const* pending = nullptr;
+    uint32_t pendingSize = 0;
+
+    std::unordered_map<std::string, std::string>& get() {
+        if (pending) {
+            parse();
+        }
+        return keyvals;
+    }
+
+    // We use std::string to store both the key and the value. Note that the spec says the value can
+    // be a binary blob that contains null characters.
+    void parse() {
+        uint8_t const* pdata = pending;
+        uint8_t const* end = pdata + pendingSize;
+        while (pdata < end) {
+            const uint32_t keyAndValueByteSize = *((uint32_t const*) pdata);
+            pdata += sizeof(uint32_t);
+            std::string key((const char*) pdata);
+            uint8_t const* pval = pdata + key.size() + 1;
+            pdata += keyAndValueByteSize;
+            std::string val((const char*) pval, (const char*) pdata);
+            keyvals.insert({key, val});
+            const uint32_t paddingSize = 3 - ((keyAndValueByteSize + 3) % 4);
+            pdata += paddingSize;
+        }
+        pending = nullptr;
+        pendingSize = 0;
+    }
 };
 
 // Extremely simple contiguous storage for an array of blobs. Assumes that the total number of blobs
@@ -60,8 +92,15 @@ struct KtxBlobList {
     std::vector<uint8_t> blobs;
     std::vector<uint32_t> sizes;
 
+    // Blobs of a bundle that views its serialized data are spans of it, until they're detached.
+    uint8_t const* view = nullptr;
+    std::vector<uint32_t> offsets;
+
     // Obtains a pointer to the given blob.
     uint8_t* get(uint32_t blobIndex) {
+        if (view) {
+            return const_cast<uint8_t*>(view + offsets[blobIndex]);
+        }
         uint8_t* result = blobs.data();
         for (uint32_t i = 0; i < blobIndex; ++i) {
             result += sizes[i];
@@ -69,6 +108,26 @@ struct KtxBlobList {
         return result;
     }
 
+    // Copies the viewed blobs into contiguous storage, so that they can be modified.
+    void detach() {
+        if (!view) {
+            return;
+        }
+        uint32_t total = 0;
+        for (uint32_t size : sizes) {
+            total += size;
+        }
+        std::vector<uint8_t> newBlobs(total);
+        uint8_t* dst = newBlobs.data();
+        for (uint32_t i = 0; i < sizes.size(); ++i) {
+            memcpy(dst, view + offsets[i], sizes[i]);
+            dst += sizes[i];
+        }
+        blobs.swap(newBlobs);
+        view = nullptr;
+        offsets.clear();
+    }
+
     // Resizes the blob at the given index by building a new contiguous array and swapping.
     void resize(uint32_t blobIndex, uint32_t newSize) {
         uint32_t preSize = 0;
@@ -106,7 +165,7 @@ KtxBundle::KtxBundle(uint32_t numMipLevels, uint32_t arrayLength, bool isCubemap
     mBlobs->sizes.resize(numMipLevels * arrayLength * mNumCubeFaces);
 }
 
-KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
+KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes, Storage storage) :
         mBlobs(new KtxBlobList), mMetadata(new KtxMetadata) {
     ASSERT_PRECONDITION(sizeof(SerializationHeader) <= nbytes, "KTX buffer is too small");
 
@@ -124,21 +183,15 @@ KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
     mNumCubeFaces = header->numberOfFaces ? header->numberOfFaces : 1;
     mBlobs->sizes.resize(mNumMipLevels * mArrayLength * mNumCubeFaces);
 
-    // We use std::string to store both the key and the value. Note that the spec says the value can
-    // be a binary blob that contains null characters.
     uint8_t const* pdata = bytes + sizeof(SerializationHeader);
-    uint8_t const* end = pdata + header->bytesOfKeyValueData;
-    while (pdata < end) {
-        const uint32_t keyAndValueByteSize = *((uint32_t const*) pdata);
-        pdata += sizeof(uint32_t);
-        std::string key((const char*) pdata);
-        uint8_t const* pval = pdata + key.size() + 1;
-        pdata += keyAndValueByteSize;
-        std::string val((const char*) pval, (const char*) pdata);
-        mMetadata->keyvals.insert({key, val});
-        const uint32_t paddingSize = 3 - ((keyAndValueByteSize + 3) % 4);
-        pdata += paddingSize;
+    ASSERT_PRECONDITION(header->bytesOfKeyValueData <= nbytes - sizeof(SerializationHeader),
+            "KTX metadata is truncated");
+    mMetadata->pending = pdata;
+    mMetadata->pendingSize = header->bytesOfKeyValueData;
+    if (storage == Storage::COPY) {
+        mMetadata->parse();
     }
+    pdata += header->bytesOfKeyValueData;
 
     // There is no compressed format that has a block size that is not a multiple of 4, so these
     // two padding constants can be safely hardcoded to 0. They are here for spec consistency.
@@ -149,18 +202,31 @@ KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
     const bool isNonArrayCube = mNumCubeFaces > 1 && mArrayLength == 1;
     const uint32_t facesPerMip = mArrayLength * mNumCubeFaces;
 
-    // Extract blobs from the serialized byte stream.
+    // Extract blobs from the serialized byte stream, or just record where they are.
     const uint32_t totalSize = nbytes - (pdata - bytes);
-    mBlobs->blobs.resize(totalSize);
+    if (storage == Storage::VIEW) {
+        mBlobs->view = bytes;
+        mBlobs->offsets.resize(mBlobs->sizes.size());
+    } else {
+        mBlobs->blobs.resize(totalSize);
+    }
     for (uint32_t mipmap = 0; mipmap < mNumMipLevels; ++mipmap) {
+        ASSERT_PRECONDITION(pdata + sizeof(uint32_t) <= bytes + nbytes, "KTX blobs are truncated");
         const uint32_t imageSize = *((uint32_t const*) pdata);
         const uint32_t faceSize = isNonArrayCube ? imageSize : (imageSize / facesPerMip);
         const uint32_t levelSize = faceSize * mNumCubeFaces * mArrayLength;
         pdata += sizeof(uint32_t);
-        memcpy(mBlobs->get(flatten(this, {mipmap, 0, 0})), pdata, levelSize);
+        ASSERT_PRECONDITION(levelSize <= size_t(bytes + nbytes - pdata), "KTX blobs are truncated");
+        if (storage == Storage::COPY) {
+            memcpy(mBlobs->get(flatten(this, {mipmap, 0, 0})), pdata, levelSize);
+        }
         for (uint32_t layer = 0; layer < mArrayLength; ++layer) {
             for (uint32_t face = 0; face < mNumCubeFaces; ++face) {
-                mBlobs->sizes[flatten(this, {mipmap, layer, face})] = faceSize;
+                const size_t blobIndex = flatten(this, {mipmap, layer, face});
+                mBlobs->sizes[blobIndex] = faceSize;
+                if (storage == Storage::VIEW) {
+                    mBlobs->offsets[blobIndex] = uint32_t(pdata - bytes);
+                }
                 pdata += faceSize;
                 pdata += cubePadding;
             }
@@ -169,6 +235,17 @@ KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
     }
 }
 
+KtxBundle* KtxBundle::map(const char* path) {
+    std::unique_ptr<utils::MappedFile> file(new utils::MappedFile(path));
+    if (!file->isValid() || file->size() < sizeof(SerializationHeader) ||
+            memcmp(file->data(), MAGIC, sizeof(MAGIC)) != 0) {
+        return nullptr;
+    }
+    KtxBundle* bundle = new KtxBundle(file->data(), uint32_t(file->size()), Storage::VIEW);
+    bundle->mFile = std::move(file);
+    return bundle;
+}
+
 bool KtxBundle::serialize(uint8_t* destination, uint32_t numBytes) const {
     uint32_t requiredLength = getSerializedLength();
     if (numBytes < requiredLength) {
@@ -190,7 +267,7 @@ bool KtxBundle::serialize(uint8_t* destination, uint32_t numBytes) const {
     }
 
     // Compute space required for metadata, padding up to 4-byte alignment.
-    for (const auto& iter : mMetadata->keyvals) {
+    for (const auto& iter : mMetadata->get()) {
         const uint32_t kvsize = iter.first.size() + 1 + iter.second.size();
         const uint32_t kvpadding = 3 - ((kvsize + 3) % 4);
         header.bytesOfKeyValueData += sizeof(uint32_t) + kvsize + kvpadding;
@@ -203,7 +280,7 @@ bool KtxBundle::serialize(uint8_t* destination, uint32_t numBytes) const {
     // Write out the metadata. Note that keys are null-terminated strings: they are constructed from
     // C strings, and we obtain their contents with c_str(). Values are binary strings: they are
     // constructed from begin-end pairs, and we obtain their contents with data().
-    for (const auto& iter : mMetadata->keyvals) {
+    for (const auto& iter : mMetadata->get()) {
         const uint32_t kvsize = iter.first.size() + 1 + iter.second.size();
         const uint32_t kvpadding = 3 - ((kvsize + 3) % 4);
         memcpy(pdata, &kvsize, sizeof(uint32_t));
@@ -248,7 +325,7 @@ bool KtxBundle::serialize(uint8_t* destination, uint32_t numBytes) const {
 
 uint32_t KtxBundle::getSerializedLength() const {
     uint32_t total = sizeof(SerializationHeader);
-    for (const auto& iter : mMetadata->keyvals) {
+    for (const auto& iter : mMetadata->get()) {
         const uint32_t kvsize = iter.first.size() + 1 + iter.second.size();
         const uint32_t kvpadding = 3 - ((kvsize + 3) % 4);
         total += sizeof(uint32_t) + kvsize + kvpadding;
@@ -271,8 +348,9 @@ uint32_t KtxBundle::getSerializedLength() const {
 }
 
 const char* KtxBundle::getMetadata(const char* key, size_t* valueSize) const {
-    auto iter = mMetadata->keyvals.find(key);
-    if (iter == mMetadata->keyvals.end()) {
+    auto& keyvals = mMetadata->get();
+    auto iter = keyvals.find(key);
+    if (iter == keyvals.end()) {
         return nullptr;
     }
     if (valueSize) {
@@ -283,7 +361,7 @@ const char* KtxBundle::getMetadata(const char* key, size_t* valueSize) const {
 }
 
 void KtxBundle::setMetadata(const char* key, const char* value) {
-    mMetadata->keyvals.insert({key, value});
+    mMetadata->get().insert({key, value});
 }
 
 bool KtxBundle::getSphericalHarmonics(filament::math::float3* result) {
@@ -325,6 +403,7 @@ bool KtxBundle::setBlob(KtxBlobIndex index, uint8_t const* data, uint32_t size)
         return false;
     }
     uint32_t flatIndex = flatten(this, index);
+    mBlobs->detach();
     uint32_t blobSize = mBlobs->sizes[flatIndex];
     if (blobSize != size) {
         mBlobs->resize(flatIndex, size);
@@ -339,6 +418,7 @@ bool KtxBundle::allocateBlob(KtxBlobIndex index, uint32_t size) {
         return false;
     }
     uint32_t flatIndex = flatten(this, index);
+    mBlobs->detach();
     mBlobs->resize(flatIndex, size);
     return true;
 }
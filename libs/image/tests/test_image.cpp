@@ -15,6 +15,7 @@
  */
 
 #include <image/ColorTransform.h>
+#include <image/CompactImage.h>
 #include <image/KtxBundle.h>
 #include <image/ImageOps.h>
 #include <image/ImageSampler.h>
@@ -26,13 +27,17 @@
 
 #include <gtest/gtest.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Path.h>
 
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -362,6 +367,215 @@ TEST_F(ImageTest, Mipmaps) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, JobSystem) { // NOLINT
+    utils::JobSystem js;
+    js.adopt();
+
+    auto equal = [](const LinearImage& a, const LinearImage& b) {
+        const uint32_t size = a.getWidth() * a.getHeight() * a.getChannels();
+        return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+                a.getChannels() == b.getChannels() &&
+                std::equal(a.getPixelRef(), a.getPixelRef() + size, b.getPixelRef());
+    };
+
+    // The multi-threaded versions must produce exactly the same results.
+    LinearImage src = createNormalMap(100);
+    for (Filter filter : { Filter::DEFAULT, Filter::BOX, Filter::NEAREST, Filter::GAUSSIAN_NORMALS,
+            Filter::MINIMUM }) {
+        EXPECT_TRUE(equal(resampleImage(src, 37, 23, filter),
+                resampleImage(js, src, 37, 23, filter)));
+        EXPECT_TRUE(equal(resampleImage(src, 301, 173, filter),
+                resampleImage(js, src, 301, 173, filter)));
+
+        const uint32_t count = getMipmapCount(src);
+        vector<LinearImage> mips(count), mipsJs(count);
+        generateMipmaps(src, filter, mips.data(), count);
+        generateMipmaps(js, src, filter, mipsJs.data(), count);
+        for (uint32_t index = 0; index < count; ++index) {
+            EXPECT_TRUE(equal(mips[index], mipsJs[index]));
+        }
+    }
+
+    js.emancipate();
+}
+
+TEST_F(ImageTest, ResampleRegion) { // NOLINT
+    // Reference horizontal resampling of a single row: weighs every source sample in the source
+    // region, so that nothing depends on how the filter's support is bounded.
+    auto reference = [](vector<float> const& source, uint32_t ntarget, float left, float right,
+            float radiusMultiplier, float (*fn)(float)) {
+        const uint32_t nsource = uint32_t(source.size());
+        const float domainScale = std::min(float(ntarget), nsource * (right - left)) /
+                radiusMultiplier;
+        vector<float> result(ntarget);
+        for (uint32_t itarget = 0; itarget < ntarget; ++itarget) {
+            const float xtarget = (itarget + 0.5f) / ntarget;
+            float sum = 0, weights = 0;
+            for (uint32_t isource = 0; isource < nsource; ++isource) {
+                const float xsource = ((isource + 0.5f) / nsource - left) / (right - left);
+                if (xsource < 0 || xsource >= 1.0f) {
+                    continue;
+                }
+                const float weight = fn(domainScale * std::abs(xsource - xtarget));
+                sum += source[isource] * weight;
+                weights += weight;
+            }
+            result[itarget] = weights != 0 ? sum / weights : 0;
+        }
+        return result;
+    };
+    auto box = [](float t) { return t <= 0.5f ? 1.0f : 0.0f; };
+    auto gaussian = [](float t) { return t >= 2.0f ? 0.0f : std::exp(-2.0f * t * t); };
+
+    struct Case {
+        Filter filter;
+        float (*fn)(float);
+        uint32_t nsource, ntarget;
+        float left, right, radiusMultiplier;
+    };
+    const Case cases[] = {
+        // minification of a region
+        { Filter::BOX,              box,      64,   8, 0.25f, 0.75f, 1 },
+        { Filter::GAUSSIAN_SCALARS, gaussian, 64,   8, 0.25f, 0.75f, 1 },
+        // magnification of a region, where the filter spans several source samples
+        { Filter::GAUSSIAN_SCALARS, gaussian, 16,  32, 0.25f, 0.5f,  3 },
+        // large radius multipliers, with and without a region
+        { Filter::BOX,              box,      64,  16, 0.0f,  1.0f,  8 },
+        { Filter::GAUSSIAN_SCALARS, gaussian, 64,  16, 0.0f,  1.0f,  8 },
+        { Filter::GAUSSIAN_SCALARS, gaussian, 100, 10, 0.1f,  0.6f,  16 },
+        { Filter::BOX,              box,      64,   4, 0.0f,  1.0f,  32 },
+        { Filter::GAUSSIAN_SCALARS, gaussian, 64,   4, 0.0f,  1.0f,  32 },
+        { Filter::GAUSSIAN_SCALARS, gaussian, 64,   4, 0.5f,  1.0f,  32 },
+    };
+
+    for (Case const& c : cases) {
+        LinearImage source(c.nsource, 1, 1);
+        vector<float> row(c.nsource);
+        for (uint32_t i = 0; i < c.nsource; ++i) {
+            row[i] = source.getPixelRef()[i] = 0.5f + 0.5f * std::sin(i * 0.7f);
+        }
+        LinearImage result = resampleImage(source, c.ntarget, 1, ImageSampler {
+            .horizontalFilter = c.filter,
+            .verticalFilter = Filter::BOX,
+            .sourceRegion = { c.left, 0, c.right, 1 },
+            .filterRadiusMultiplier = c.radiusMultiplier
+        });
+        vector<float> expected = reference(row, c.ntarget, c.left, c.right,
+                c.radiusMultiplier, c.fn);
+        for (uint32_t i = 0; i < c.ntarget; ++i) {
+            EXPECT_NEAR(result.getPixelRef()[i], expected[i], 1e-5f) << "sample " << i
+                    << " of " << c.nsource << " -> " << c.ntarget << " in [" << c.left << ", "
+                    << c.right << "] with a radius multiplier of " << c.radiusMultiplier;
+        }
+    }
+
+    // NEAREST picks the source sample under the center of each target sample, in the region.
+    struct NearestCase {
+        uint32_t nsource, ntarget;
+        float left, right;
+    };
+    const NearestCase nearestCases[] = {
+        { 64, 32, 0.25f, 0.75f },   // same sample size
+        { 64, 64, 0.5f,  0.75f },   // magnification
+        { 64,  8, 0.5f,  1.0f  },   // minification
+    };
+    for (NearestCase const& c : nearestCases) {
+        LinearImage source(c.nsource, 1, 1);
+        for (uint32_t i = 0; i < c.nsource; ++i) {
+            source.getPixelRef()[i] = float(i);
+        }
+        LinearImage result = resampleImage(source, c.ntarget, 1, ImageSampler {
+            .horizontalFilter = Filter::NEAREST,
+            .verticalFilter = Filter::BOX,
+            .sourceRegion = { c.left, 0, c.right, 1 }
+        });
+        for (uint32_t i = 0; i < c.ntarget; ++i) {
+            const float xtarget = (i + 0.5f) / c.ntarget;
+            const float expected = std::floor((c.left + xtarget * (c.right - c.left)) * c.nsource);
+            EXPECT_EQ(result.getPixelRef()[i], expected) << "sample " << i << " of "
+                    << c.nsource << " -> " << c.ntarget << " in [" << c.left << ", " << c.right
+                    << "]";
+        }
+    }
+}
+
+TEST_F(ImageTest, CompactImage) { // NOLINT
+    auto equal = [](const CompactImage& a, const CompactImage& b) {
+        auto pa = static_cast<uint8_t const*>(a.getPixelRef());
+        auto pb = static_cast<uint8_t const*>(b.getPixelRef());
+        return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+                a.getChannels() == b.getChannels() && a.getFormat() == b.getFormat() &&
+                std::equal(pa, pa + a.getBytesPerRow() * a.getHeight(), pb);
+    };
+
+    LinearImage colors = vectorsToColors(createNormalMap(100));
+    for (auto format : { CompactImage::Format::HALF, CompactImage::Format::UNORM8 }) {
+        CompactImage src = toCompactImage(colors, format);
+        ASSERT_EQ(src.getBytesPerPixel(), format == CompactImage::Format::HALF ? 6 : 3);
+
+        // Conversions are exact up to the precision of the format.
+        const float epsilon = format == CompactImage::Format::HALF ? 1.0f / 1024.0f : 0.5f / 255.0f;
+        ASSERT_EQ(compare(toLinearImage(src), colors, epsilon), 0);
+
+        // Pixel shuffling works on the compact data directly.
+        ASSERT_TRUE(equal(horizontalFlip(src), toCompactImage(horizontalFlip(colors), format)));
+        ASSERT_TRUE(equal(verticalFlip(src), toCompactImage(verticalFlip(colors), format)));
+        ASSERT_TRUE(equal(transpose(src), toCompactImage(transpose(colors), format)));
+        ASSERT_TRUE(equal(cropRegion(src, 10, 20, 60, 50),
+                toCompactImage(cropRegion(colors, 10, 20, 60, 50), format)));
+
+        // Resampling gives the same results as resampling the float version of the image.
+        LinearImage linear = toLinearImage(src);
+        for (Filter filter : { Filter::DEFAULT, Filter::BOX, Filter::NEAREST,
+                Filter::GAUSSIAN_NORMALS, Filter::MINIMUM }) {
+            EXPECT_TRUE(equal(resampleImage(src, 37, 23, filter),
+                    toCompactImage(resampleImage(linear, 37, 23, filter), format)));
+            EXPECT_TRUE(equal(resampleImage(src, 301, 173, filter),
+                    toCompactImage(resampleImage(linear, 301, 173, filter), format)));
+        }
+        ImageSampler sampler;
+        sampler.sourceRegion = { 0.25f, 0.1f, 0.75f, 0.6f };
+        sampler.filterRadiusMultiplier = 3;
+        EXPECT_TRUE(equal(resampleImage(src, 40, 50, sampler),
+                toCompactImage(resampleImage(linear, 40, 50, sampler), format)));
+
+        utils::JobSystem js;
+        js.adopt();
+        const uint32_t count = getMipmapCount(src);
+        vector<CompactImage> mips(count), mipsJs(count);
+        vector<LinearImage> expected(count);
+        generateMipmaps(src, Filter::DEFAULT, mips.data(), count);
+        generateMipmaps(js, src, Filter::DEFAULT, mipsJs.data(), count);
+        generateMipmaps(linear, Filter::DEFAULT, expected.data(), count);
+        for (uint32_t index = 0; index < count; ++index) {
+            EXPECT_TRUE(equal(mips[index], toCompactImage(expected[index], format)));
+            EXPECT_TRUE(equal(mips[index], mipsJs[index]));
+        }
+        js.emancipate();
+    }
+}
+
+TEST_F(ImageTest, CompactImageConversions) { // NOLINT
+    const float inf = std::numeric_limits<float>::infinity();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float values[] = { -1.0f, 0.0f, 0.5f / 255.0f, 0.25f, 1.0f, 2.0f, inf, -inf, nan };
+
+    // UNORM8 rounds to the nearest value, clamps to [0, 1] and stores NaNs as 0.
+    const uint8_t unorm8[] = { 0, 0, 1, 64, 255, 255, 255, 0, 0 };
+    const uint32_t count = sizeof(values) / sizeof(values[0]);
+    CompactImage image(count, 1, 1, CompactImage::Format::UNORM8);
+    image.storeRow(0, values);
+    auto pixels = static_cast<uint8_t const*>(image.getPixelRef());
+    for (uint32_t i = 0; i < count; ++i) {
+        EXPECT_EQ(pixels[i], unorm8[i]) << "value " << values[i];
+    }
+    float loaded[count];
+    image.loadRow(0, loaded);
+    for (uint32_t i = 0; i < count; ++i) {
+        EXPECT_FLOAT_EQ(loaded[i], unorm8[i] / 255.0f);
+    }
+}
+
 TEST_F(ImageTest, Ktx) { // NOLINT
     uint8_t foo[] = {1, 2, 3};
     uint8_t* data;
@@ -427,6 +641,66 @@ TEST_F(ImageTest, Ktx) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, KtxView) { // NOLINT
+    // A two-level cubemap whose faces are filled with their index.
+    KtxBundle source(2, 1, true);
+    for (uint32_t level = 0; level < 2; level++) {
+        for (uint32_t face = 0; face < 6; face++) {
+            vector<uint8_t> blob(level ? 16 : 64, uint8_t(level * 6 + face));
+            ASSERT_TRUE(source.setBlob({level, 0, face}, blob.data(), blob.size()));
+        }
+    }
+    source.setMetadata("foo", "bar");
+    vector<uint8_t> serialized(source.getSerializedLength());
+    ASSERT_TRUE(source.serialize(serialized.data(), serialized.size()));
+    const vector<uint8_t> original = serialized;
+
+    // Blobs point into the serialized data, which is never modified.
+    KtxBundle view(serialized.data(), serialized.size(), KtxBundle::Storage::VIEW);
+    ASSERT_EQ(view.getNumMipLevels(), 2);
+    ASSERT_TRUE(view.isCubemap());
+    uint8_t* data;
+    uint32_t size;
+    for (uint32_t level = 0; level < 2; level++) {
+        for (uint32_t face = 0; face < 6; face++) {
+            ASSERT_TRUE(view.getBlob({level, 0, face}, &data, &size));
+            ASSERT_EQ(size, level ? 16 : 64);
+            ASSERT_GE(data, serialized.data());
+            ASSERT_LE(data + size, serialized.data() + serialized.size());
+            ASSERT_EQ(data[0], level * 6 + face);
+        }
+    }
+    ASSERT_EQ(string(view.getMetadata("foo")), "bar");
+    vector<uint8_t> reserialized(view.getSerializedLength());
+    ASSERT_TRUE(view.serialize(reserialized.data(), reserialized.size()));
+    ASSERT_EQ(reserialized, original);
+
+    // Modifying a blob copies them all first.
+    uint8_t foo[] = {1, 2, 3};
+    ASSERT_TRUE(view.setBlob({1, 0, 2}, foo, sizeof(foo)));
+    ASSERT_TRUE(view.getBlob({1, 0, 2}, &data, &size));
+    ASSERT_EQ(size, sizeof(foo));
+    ASSERT_TRUE(view.getBlob({1, 0, 3}, &data, &size));
+    ASSERT_EQ(data[0], 9);
+    ASSERT_EQ(serialized, original);
+
+    // Mapped files are viewed the same way.
+    utils::Path path = utils::Path::getTemporaryDirectory() + "test_image_view.ktx";
+    {
+        std::ofstream out(path.getPath(), std::ios::binary);
+        out.write((const char*) original.data(), original.size());
+    }
+    std::unique_ptr<KtxBundle> mapped(KtxBundle::map(path.c_str()));
+    ASSERT_NE(mapped, nullptr);
+    ASSERT_TRUE(mapped->getBlob({1, 0, 5}, &data, &size));
+    ASSERT_EQ(size, 16);
+    ASSERT_EQ(data[15], 11);
+    ASSERT_EQ(string(mapped->getMetadata("foo")), "bar");
+    mapped.reset();
+    path.unlinkFile();
+    ASSERT_EQ(KtxBundle::map(path.c_str()), nullptr);
+}
+
 TEST_F(ImageTest, getSphericalHarmonics) {
     KtxBundle ktx(2, 1, true);
 
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/BlockCompression.h>
+#include <imageio/ImageDecoder.h>
+#include <imageio/ImageDiffer.h>
+#include <imageio/ImageEncoder.h>
+
+#include <image/ImageOps.h>
+#include <image/LinearImage.h>
+
+#include <utils/JobSystem.h>
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace image;
+using namespace utils;
+
+static LinearImage createImage(uint32_t size, uint32_t channels) {
+    LinearImage image(size, size, channels);
+    float* data = image.getPixelRef();
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            for (uint32_t c = 0; c < channels; c++) {
+                // a smooth gradient with some high frequencies
+                *data++ = float((x * (c + 1) + y * 7) % 255) / 255.0f;
+            }
+        }
+    }
+    return image;
+}
+
+// Compresses a 1024x1024 RGBA image with the given option string, on a JobSystem with
+// range(0) threads, or on the calling thread only if range(0) is 1. The reported rate is in
+// pixels per second.
+static void compress(benchmark::State& state, const char* options) {
+    CompressionConfig config {};
+    parseOptionString(options, &config);
+    config.threadCount = uint32_t(state.range(0));
+
+    const uint32_t size = 1024;
+    const LinearImage source = createImage(size, 4);
+    for (auto _ : state) {
+        CompressedTexture texture = compressTexture(config, source);
+        benchmark::DoNotOptimize(texture.data.get());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * size * size);
+}
+
+static void BM_CompressS3tc(benchmark::State& state) {
+    compress(state, "s3tc_rgba_dxt5");
+}
+
+static void BM_CompressEtc(benchmark::State& state) {
+    compress(state, "etc_rgba8_rgba_40");
+}
+
+static void BM_CompressAstc(benchmark::State& state) {
+    compress(state, "astc_veryfast_ldr_4x4");
+}
+
+BENCHMARK(BM_CompressS3tc)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_CompressEtc)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK(BM_CompressAstc)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// Encodes a 2048x2048 sRGB PNG, the reported rate of decoders is in pixels per second.
+static std::string createPng() {
+    std::stringstream stream;
+    ImageEncoder::encode(stream, ImageEncoder::Format::PNG, createImage(2048, 3), "", "bench.png");
+    return stream.str();
+}
+
+static void BM_DecodePng(benchmark::State& state) {
+    const std::string png = createPng();
+    for (auto _ : state) {
+        std::istringstream stream(png);
+        LinearImage image = ImageDecoder::decode(stream, "bench.png");
+        benchmark::DoNotOptimize(image.getPixelRef());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 2048 * 2048);
+}
+
+// Decodes to RGBA8 in bands of 64 rows, like a texture upload would.
+static void BM_DecodePngRows(benchmark::State& state) {
+    const std::string png = createPng();
+    std::unique_ptr<uint8_t[]> pixels(new uint8_t[2048 * 2048 * 4]);
+    for (auto _ : state) {
+        std::istringstream stream(png);
+        auto rows = ImageDecoder::createRowDecoder(stream, "bench.png");
+        while (rows->getRow() < rows->getHeight()) {
+            uint8_t* dst = pixels.get() + size_t(rows->getRow()) * 2048 * 4;
+            if (!rows->decodeRows(dst, 64, ImageDecoder::PixelDataFormat::RGBA,
+                    ImageDecoder::PixelDataType::UBYTE)) {
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(pixels.get());
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 2048 * 2048);
+}
+
+BENCHMARK(BM_DecodePng)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DecodePngRows)->Unit(benchmark::kMillisecond);
+
+// Compares two 4096x4096 RGB images that match within the tolerance but aren't identical, which is
+// the common case of a passing golden image test. The reported rate is in pixels per second.
+static constexpr uint32_t DIFF_SIZE = 4096;
+
+static LinearImage createDiffImage() {
+    LinearImage image = createImage(DIFF_SIZE, 3);
+    for (uint32_t y = 0; y < DIFF_SIZE; y += 97) {
+        image.getPixelRef(y, y)[1] += 0.25f / 255.0f;
+    }
+    return image;
+}
+
+static void BM_Compare(benchmark::State& state) {
+    const LinearImage a = createImage(DIFF_SIZE, 3);
+    const LinearImage b = createDiffImage();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compare(a, b, 0.5f / 255.0f));
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * DIFF_SIZE * DIFF_SIZE);
+}
+
+// Runs on a JobSystem with range(0) threads, or on the calling thread only if range(0) is 1.
+static void BM_Diff(benchmark::State& state) {
+    const LinearImage a = createImage(DIFF_SIZE, 3);
+    const LinearImage b = createDiffImage();
+    const uint32_t threadCount = uint32_t(state.range(0));
+    JobSystem js(threadCount - 1);
+    js.adopt();
+    DiffOptions options;
+    options.epsilon = 0.5f / 255.0f;
+    DiffStatistics stats;
+    for (auto _ : state) {
+        bool same = threadCount == 1 ? diff(a, b, options, &stats)
+                : diff(js, a, b, options, &stats);
+        benchmark::DoNotOptimize(same);
+    }
+    js.emancipate();
+    state.SetItemsProcessed((int64_t)state.iterations() * DIFF_SIZE * DIFF_SIZE);
+}
+
+BENCHMARK(BM_Compare)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Diff)->RangeMultiplier(2)->Range(1, 8)->Unit(benchmark::kMillisecond)->UseRealTime();
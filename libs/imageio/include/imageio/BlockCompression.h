@@ -28,6 +28,10 @@
 
 #include <stdint.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 enum class CompressedFormat {
@@ -122,6 +126,10 @@ struct AstcConfig {
 // header block that ARM uses in their file format is not included.
 CompressedTexture astcCompress(const LinearImage& source, AstcConfig config);
 
+// Multi-threaded version of astcCompress, the conversion of the source to the encoder's format is
+// done on the JobSystem. Like astcCompress, the ARM encoder uses one thread per core.
+CompressedTexture astcCompress(utils::JobSystem& js, const LinearImage& source, AstcConfig config);
+
 // Parses a simple underscore-delimited string to produce an ASTC compression configuration. This
 // makes it easy to incorporate the compression API into command-line tools. If the string is
 // malformed, this returns a config with a 0x0 blocksize. Example strings: fast_ldr_4x4,
@@ -149,6 +157,10 @@ struct EtcConfig {
 // Uses the CPU to compress a linear image (1 to 4 channels) into an ETC texture.
 CompressedTexture etcCompress(const LinearImage& source, EtcConfig config);
 
+// Multi-threaded version of etcCompress, the conversion of the source to the encoder's format is
+// done on the JobSystem. Like etcCompress, the ETC encoder uses one thread per core.
+CompressedTexture etcCompress(utils::JobSystem& js, const LinearImage& source, EtcConfig config);
+
 // Converts a string into an ETC compression configuration where the string has the form
 // FORMAT_METRIC_EFFORT where:
 // - FORMAT is one of: r11, signed_r11, rg11, signed_rg11, rgb8, srgb8, rgb8_alpha,
@@ -168,6 +180,10 @@ struct S3tcConfig {
 // Uses the CPU to compress a linear image (1 to 4 channels) into an S3TC texture.
 CompressedTexture s3tcCompress(const LinearImage& source, S3tcConfig config);
 
+// Multi-threaded version of s3tcCompress, strips of blocks are compressed concurrently on the
+// JobSystem, directly into the result.
+CompressedTexture s3tcCompress(utils::JobSystem& js, const LinearImage& source, S3tcConfig config);
+
 // Parses an underscore-delimited string to produce an S3TC compression configuration. Currently
 // this only accepts "rgb_dxt1" and "rgba_dxt5". If the string is malformed, this returns a config
 // with an invalid format.
@@ -180,12 +196,24 @@ struct CompressionConfig {
     AstcConfig astc;
     S3tcConfig s3tc;
     EtcConfig etc;
+    uint32_t threadCount = 0; // 0 means one thread per core
 };
 
+// Parses the option string of any of the above formats, prefixed with "astc_", "s3tc_" or "etc_".
+// The string can end with "_tN" to compress with N threads, e.g. s3tc_rgba_dxt5_t4.
 bool parseOptionString(const std::string& options, CompressionConfig* config);
 
+// Compresses the image. The ASTC and ETC encoders run their own config.threadCount threads (one
+// per core by default), S3TC is compressed on the calling thread.
 CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image);
 
+// Compresses the image using the given JobSystem. The ASTC and ETC encoders run their own
+// config.threadCount threads (one per core by default), S3TC runs at most config.threadCount
+// jobs at once (no limit by default), and a threadCount of 1 compresses on the calling thread
+// only. This must be called from a thread known to the JobSystem.
+CompressedTexture compressTexture(utils::JobSystem& js, const CompressionConfig& config,
+        const LinearImage& image);
+
 } // namespace image
 
 #endif /* IMAGEIO_BLOCKCOMPRESSION_H_ */
@@ -18,8 +18,13 @@
 #define IMAGE_IMAGEDECODER_H_
 
 #include <iosfwd>
+#include <memory>
 #include <string>
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <image/CompactImage.h>
 #include <image/LinearImage.h>
 
 namespace image {
@@ -31,13 +36,40 @@ public:
         SRGB
     };
 
+    // Destination formats of RowDecoder, named after their Texture::Format and Texture::Type
+    // equivalents.
+    enum class PixelDataFormat : uint8_t {
+        R,
+        RG,
+        RGB,
+        RGBA
+    };
+
+    enum class PixelDataType : uint8_t {
+        UBYTE,      // normalized and clamped to [0, 1]
+        USHORT,     // normalized and clamped to [0, 1]
+        HALF,
+        FLOAT
+    };
+
+    static size_t getBytesPerPixel(PixelDataFormat format, PixelDataType type) noexcept;
+
     // Returns linear floating-point data, or a non-valid image if an error occured.
     static LinearImage decode(std::istream& stream, const std::string& sourceName,
             ColorSpace sourceSpace = ColorSpace::SRGB);
 
+    // Returns compact data in the given format, or a non-valid image if an error occured.
+    // PNGs are converted a row at a time, without any float copy of the image. The other formats
+    // are decoded to a LinearImage of the whole image first, which is then converted: they need
+    // as much memory as decode() does, plus the compact image.
+    static CompactImage decode(std::istream& stream, const std::string& sourceName,
+            CompactImage::Format format, ColorSpace sourceSpace = ColorSpace::SRGB);
+
     class Decoder {
     public:
         virtual LinearImage decode() = 0;
+        // The default implementation converts the result of decode().
+        virtual CompactImage decodeCompact(CompactImage::Format format);
         virtual ~Decoder() = default;
 
         ColorSpace getColorSpace() const noexcept {
@@ -52,7 +84,52 @@ public:
         ColorSpace mColorSpace = ColorSpace::SRGB;
     };
 
+    /**
+     * Decodes an image a band of rows at a time, straight into a caller-owned buffer in the
+     * requested PixelDataFormat and PixelDataType, for instance the buffer of a
+     * PixelBufferDescriptor given to Texture::setImage(). No float copy of the image is made:
+     * PNG, HDR and PSD files are decoded one row at a time. Interlaced PNGs and EXRs can't be
+     * streamed, they are decoded entirely first.
+     *
+     * Values are converted like decode() does, so PNGs are linearized unless their color space
+     * is LINEAR, which keeps the encoded values, e.g. for an sRGB texture. Channels missing from
+     * the source are set to 0, and alpha to 1.
+     */
+    class RowDecoder {
+    public:
+        virtual ~RowDecoder() = default;
+
+        uint32_t getWidth() const noexcept { return mWidth; }
+        uint32_t getHeight() const noexcept { return mHeight; }
+
+        // Number of channels in the source, 3 or 4.
+        uint32_t getChannels() const noexcept { return mChannels; }
+
+        // Index of the next row to decode.
+        uint32_t getRow() const noexcept { return mRow; }
+
+        // Decodes the next count rows (or what's left of the image) into dst. Rows are stride
+        // bytes apart, or tightly packed if stride is 0. Returns the number of rows decoded,
+        // which is short of what was asked at the end of the image or if an error occurred.
+        virtual uint32_t decodeRows(void* dst, uint32_t count, PixelDataFormat format,
+                PixelDataType type, size_t stride = 0) = 0;
+
+    protected:
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        uint32_t mChannels = 0;
+        uint32_t mRow = 0;
+    };
+
+    // Reads the image header, returns null if the format isn't supported or the header is
+    // invalid.
+    static std::unique_ptr<RowDecoder> createRowDecoder(std::istream& stream,
+            const std::string& sourceName, ColorSpace sourceSpace = ColorSpace::SRGB);
+
 private:
+    static Decoder* createDecoder(std::istream& stream, const std::string& sourceName,
+            ColorSpace sourceSpace);
+
     enum class Format {
         NONE,
         PNG,
@@ -60,6 +137,8 @@ private:
         PSD,
         EXR
     };
+
+    static Format detectFormat(std::istream& stream);
 };
 
 } // namespace image
@@ -14,10 +14,20 @@
  * limitations under the License.
  */
 
+#ifndef IMAGE_IMAGEDIFFER_H_
+#define IMAGE_IMAGEDIFFER_H_
+
 #include <image/LinearImage.h>
 
 #include <utils/Path.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 enum class ComparisonMode {
@@ -31,4 +41,59 @@ enum class ComparisonMode {
 // The passed-in image is the "result image" and the expected image is the "golden image".
 void updateOrCompare(LinearImage result, const utils::Path& golden, ComparisonMode, float epsilon);
 
+struct DiffOptions {
+    // Two channel values match if their absolute difference is at most epsilon. A NaN on either
+    // side never matches.
+    float epsilon = 0.0f;
+
+    // Stops as soon as a tile has a mismatch: the image is processed in tiles of rows, and the
+    // remaining rows of all tiles are skipped. The statistics are then partial, they only cover
+    // the rows compared, and with the multi-threaded diff() they depend on which tiles ran before
+    // the first mismatch was found, so they can change from one run to the next. Only the return
+    // value and DiffStatistics::complete are deterministic.
+    bool earlyOut = false;
+
+    // If not null, receives a single-channel image of the same size as the inputs, set to 1 where
+    // a pixel has at least one channel that doesn't match and 0 elsewhere.
+    LinearImage* mask = nullptr;
+};
+
+struct DiffStatistics {
+    static constexpr size_t MAX_CHANNELS = 4;
+    static constexpr size_t HISTOGRAM_SIZE = 256;
+
+    size_t pixelCount = 0;          // number of pixels compared
+    size_t mismatchCount = 0;       // number of pixels with at least one mismatching channel
+    float maxDiff = 0.0f;           // largest absolute difference, over all channels
+                                    // (NaN if any difference is NaN)
+    float meanDiff = 0.0f;          // mean absolute difference, over all channels
+                                    // (NaN if any difference is NaN)
+    double psnr = 0.0;              // peak signal-to-noise ratio in dB, for a peak value of 1.0
+                                    // (infinite for identical images, NaN if any difference is)
+    bool complete = false;          // false if the comparison stopped early
+    bool sizeMismatch = false;      // true if the dimensions or channel counts differ, in which
+                                    // case nothing was compared
+
+    // Per-channel histogram of absolute differences: bin i counts the values that round to
+    // i / 255 (i.e. a difference of i levels with 8-bit data), the last bin also counts all the
+    // larger differences, infinities and NaNs. Only the first MAX_CHANNELS channels have a
+    // histogram.
+    uint32_t histogram[MAX_CHANNELS][HISTOGRAM_SIZE] = {};
+};
+
+// Compares two images of the same dimensions and returns true if all their channels match.
+// Returns false if the dimensions or channel counts differ, in which case the statistics are reset
+// with sizeMismatch set, and the mask is left untouched. stats can be null.
+bool diff(const LinearImage& a, const LinearImage& b, DiffOptions const& options,
+        DiffStatistics* stats);
+
+// Multi-threaded version of diff(), the tiles are compared in parallel on the given JobSystem.
+// The results are identical to the single-threaded version, except for the statistics of early
+// outs, which depend on the order in which tiles complete (see DiffOptions::earlyOut). This must
+// be called from a thread known to the JobSystem (i.e. one of its own threads, or an adopted one).
+bool diff(utils::JobSystem& js, const LinearImage& a, const LinearImage& b,
+        DiffOptions const& options, DiffStatistics* stats);
+
 }  // namespace image
+
+#endif /* IMAGE_IMAGEDIFFER_H_ */
@@ -20,6 +20,7 @@
 #include <iosfwd>
 #include <string>
 
+#include <image/CompactImage.h>
 #include <image/LinearImage.h>
 
 namespace image {
@@ -47,14 +48,27 @@ public:
     static bool encode(std::ostream& stream, Format format, const LinearImage& image,
             const std::string& compression, const std::string& destName);
 
+    // Consumes compact data, returns false if unable to encode. Only the formats written as PNG
+    // (PNG, PNG_LINEAR, RGBM and RGB_10_11_11_REV) convert the image a few rows at a time. The
+    // other formats convert it to a LinearImage of the whole image first, so they need as much
+    // memory as encoding a LinearImage does.
+    static bool encode(std::ostream& stream, Format format, const CompactImage& image,
+            const std::string& compression, const std::string& destName);
+
     static Format chooseFormat(const std::string& name, bool forceLinear = false);
     static std::string chooseExtension(Format format);
 
     class Encoder {
     public:
         virtual bool encode(const LinearImage& image) = 0;
+        // The default implementation converts the image to a LinearImage and calls encode().
+        virtual bool encodeCompact(const CompactImage& image);
         virtual ~Encoder() = default;
     };
+
+private:
+    static Encoder* createEncoder(std::ostream& stream, Format format,
+            const std::string& compression, const std::string& destName);
 };
 
 } // namespace image
@@ -18,6 +18,8 @@
 
 #include <image/ImageOps.h>
 
+#include <utils/JobSystem.h>
+
 #include <algorithm>
 #include <cmath>
 #include <thread>
@@ -30,19 +32,48 @@
 
 namespace image {
 
-static LinearImage extendToFourChannels(LinearImage source);
+static LinearImage extendToFourChannels(utils::JobSystem* js, const LinearImage& source,
+        uint32_t maxJobs);
 
-CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
+// Calls fn(start, count) over [0, count), in parallel if we have a JobSystem. At most maxJobs
+// calls run concurrently, 0 means no limit.
+template<typename F>
+static void parallelRows(utils::JobSystem* js, uint32_t count, uint32_t maxJobs, F const& fn) {
+    if (!js || count < 2 || maxJobs == 1) {
+        fn(0, count);
+        return;
+    }
+    utils::JobSystem::Job* job;
+    if (maxJobs == 0 || maxJobs >= count) {
+        job = utils::jobs::parallel_for(*js, nullptr, 0, count,
+                [&fn](uint32_t start, uint32_t count) { fn(start, count); },
+                utils::jobs::CountSplitter<4>());
+    } else {
+        // one job per band of rows, so that no more than maxJobs of them can run at once
+        job = utils::jobs::parallel_for(*js, nullptr, 0, maxJobs,
+                [&fn, count, maxJobs](uint32_t start, uint32_t bands) {
+                    for (uint32_t i = start; i < start + bands; i++) {
+                        const uint32_t begin = uint32_t(uint64_t(count) * i / maxJobs);
+                        const uint32_t end = uint32_t(uint64_t(count) * (i + 1) / maxJobs);
+                        fn(begin, end - begin);
+                    }
+                }, utils::jobs::CountSplitter<1>());
+    }
+    js->runAndWait(job);
+}
+
+static CompressedTexture astcCompress(utils::JobSystem* js, const LinearImage& original,
+        AstcConfig config, int threadcount) {
 
     // If this is the first time, initialize the ARM encoder tables.
 
-    static bool first = true;
-    if (first) {
+    static const bool initialized = []() {
         test_inappropriate_extended_precision();
         prepare_angular_tables();
         build_quantization_mode_table();
-        first = false;
-    }
+        return true;
+    }();
+    (void) initialized;
 
     // Check the validity of the given block size.
 
@@ -84,20 +115,22 @@ CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
     // It expects four-channel data, so we extend or curtail the channel count in a reasonable way.
     // The encoder can take half-floats or bytes, but we always give it half-floats.
 
-    LinearImage source = extendToFourChannels(original);
+    LinearImage source = extendToFourChannels(js, original, uint32_t(threadcount));
     const uint32_t width = source.getWidth();
     const uint32_t height = source.getHeight();
     astc_codec_image* input_image = allocate_image(16, width, height, 1, 0);
-    for (int y = 0; y < height; y++) {
-        auto imagedata16 = input_image->imagedata16[0][y];
-        float const* src = source.getPixelRef(0, y);
-        for (int x = 0; x < width; x++) {
-            imagedata16[4 * x] = float_to_sf16(src[4 * x], SF_NEARESTEVEN);
-            imagedata16[4 * x + 1] = float_to_sf16(src[4 * x + 1], SF_NEARESTEVEN);
-            imagedata16[4 * x + 2] = float_to_sf16(src[4 * x + 2], SF_NEARESTEVEN);
-            imagedata16[4 * x + 3] = float_to_sf16(src[4 * x + 3], SF_NEARESTEVEN);
+    parallelRows(js, height, uint32_t(threadcount), [&](uint32_t start, uint32_t count) {
+        for (uint32_t y = start; y < start + count; y++) {
+            auto imagedata16 = input_image->imagedata16[0][y];
+            float const* src = source.getPixelRef(0, y);
+            for (uint32_t x = 0; x < width; x++) {
+                imagedata16[4 * x] = float_to_sf16(src[4 * x], SF_NEARESTEVEN);
+                imagedata16[4 * x + 1] = float_to_sf16(src[4 * x + 1], SF_NEARESTEVEN);
+                imagedata16[4 * x + 2] = float_to_sf16(src[4 * x + 2], SF_NEARESTEVEN);
+                imagedata16[4 * x + 3] = float_to_sf16(src[4 * x + 3], SF_NEARESTEVEN);
+            }
         }
-    }
+    });
 
     // Determine the bitrate based on the specified block size.
 
@@ -289,8 +322,6 @@ CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
             break;
     }
 
-    const int threadcount = std::thread::hardware_concurrency();
-
     const int xsize = input_image->xsize;
     const int ysize = input_image->ysize;
     const int zsize = input_image->zsize;
@@ -313,6 +344,15 @@ CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
     };
 }
 
+CompressedTexture astcCompress(const LinearImage& original, AstcConfig config) {
+    return astcCompress(nullptr, original, config, std::thread::hardware_concurrency());
+}
+
+CompressedTexture astcCompress(utils::JobSystem& js, const LinearImage& original,
+        AstcConfig config) {
+    return astcCompress(&js, original, config, std::thread::hardware_concurrency());
+}
+
 AstcConfig astcParseOptionString(const std::string& configString) {
     const size_t _1 = configString.find('_');
     const size_t _2 = configString.find('_', _1 + 1);
@@ -382,22 +422,37 @@ static void extract4x4RGBA(uint8_t* dst, const LinearImage& source, uint32_t x0,
 //  - DXT5 with alpha (16 input pixels into 128 bits of output, 4:1)
 //
 // TODO: investigate using something more capable than STB (eg AMD Compressenator, bimg, libsquish)
-CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
+static CompressedTexture s3tcCompress(utils::JobSystem* js, const LinearImage& original,
+        S3tcConfig config, uint32_t maxJobs) {
+    // STB initializes its tables on first use, this must not happen concurrently.
+    static const bool initialized = []() {
+        uint8_t block[64] = {};
+        uint8_t result[16];
+        stb_compress_dxt_block(result, block, 1, 0);
+        return true;
+    }();
+    (void) initialized;
+
     const bool dxt5 = config.format == CompressedFormat::RGBA_S3TC_DXT5;
-    LinearImage source = extendToFourChannels(original);
-    uint8_t block[64];
+    const uint32_t blockSize = dxt5 ? 16 : 8;
+    LinearImage source = extendToFourChannels(js, original, maxJobs);
     uint32_t xblocks = (source.getWidth() + 3) / 4;
     uint32_t yblocks = (source.getHeight() + 3) / 4;
-    uint32_t size = xblocks * yblocks * (dxt5 ? 16 : 8);
+    uint32_t size = xblocks * yblocks * blockSize;
     uint8_t* buffer = new uint8_t[size];
-    uint8_t* dst = buffer;
-    for (int y = 0, h = source.getHeight(); y < h; y += 4) {
-        for (int x = 0, w = source.getWidth(); x < w; x += 4) {
-            extract4x4RGBA(block, source, x, y);
-            stb_compress_dxt_block(dst, block, dxt5, 8);
-            dst += dxt5 ? 16 : 8;
+
+    // Each job compresses a strip of rows of blocks, right where they go in the result.
+    parallelRows(js, yblocks, maxJobs, [&](uint32_t start, uint32_t count) {
+        uint8_t block[64];
+        uint8_t* dst = buffer + start * xblocks * blockSize;
+        for (uint32_t y = start * 4, y1 = (start + count) * 4; y < y1; y += 4) {
+            for (uint32_t x = 0, w = source.getWidth(); x < w; x += 4) {
+                extract4x4RGBA(block, source, x, y);
+                stb_compress_dxt_block(dst, block, dxt5, 8);
+                dst += blockSize;
+            }
         }
-    }
+    });
     return {
         .format = config.format,
         .size = size,
@@ -405,6 +460,15 @@ CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
     };
 }
 
+CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
+    return s3tcCompress(nullptr, original, config, 0);
+}
+
+CompressedTexture s3tcCompress(utils::JobSystem& js, const LinearImage& original,
+        S3tcConfig config) {
+    return s3tcCompress(&js, original, config, 0);
+}
+
 S3tcConfig s3tcParseOptionString(const std::string& options) {
     if (options == "rgb_dxt1") {
         return {CompressedFormat::RGB_S3TC_DXT1, false};
@@ -415,9 +479,9 @@ S3tcConfig s3tcParseOptionString(const std::string& options) {
     return {};
 }
 
-CompressedTexture etcCompress(const LinearImage& original, EtcConfig config) {
-    LinearImage source = extendToFourChannels(original);
-    const int threadcount = std::thread::hardware_concurrency();
+static CompressedTexture etcCompress(utils::JobSystem* js, const LinearImage& original,
+        EtcConfig config, int threadcount) {
+    LinearImage source = extendToFourChannels(js, original, uint32_t(threadcount));
     Etc::Image::Format etcformat;
     switch (config.format) {
         case CompressedFormat::R11_EAC: etcformat = Etc::Image::Format::R11; break;
@@ -469,6 +533,15 @@ CompressedTexture etcCompress(const LinearImage& original, EtcConfig config) {
     };
 }
 
+CompressedTexture etcCompress(const LinearImage& original, EtcConfig config) {
+    return etcCompress(nullptr, original, config, std::thread::hardware_concurrency());
+}
+
+CompressedTexture etcCompress(utils::JobSystem& js, const LinearImage& original,
+        EtcConfig config) {
+    return etcCompress(&js, original, config, std::thread::hardware_concurrency());
+}
+
 EtcConfig etcParseOptionString(const std::string& options) {
     EtcConfig result {};
     const size_t _2 = options.rfind('_');
@@ -512,8 +585,19 @@ EtcConfig etcParseOptionString(const std::string& options) {
     return result;
 }
 
-bool parseOptionString(const std::string& options, CompressionConfig* config) {
+bool parseOptionString(const std::string& optionString, CompressionConfig* config) {
     config->type = CompressionConfig::INVALID;
+    config->threadCount = 0;
+
+    // Strip the thread count suffix, if any. No format option ends with "_t" and a number.
+    std::string options = optionString;
+    const size_t _t = options.rfind("_t");
+    if (_t != std::string::npos && _t + 2 < options.size() &&
+            options.find_first_not_of("0123456789", _t + 2) == std::string::npos) {
+        config->threadCount = uint32_t(std::stoul(options.substr(_t + 2)));
+        options = options.substr(0, _t);
+    }
+
     if (options.substr(0, 5) == "astc_") {
         config->astc = astcParseOptionString(options.substr(5));
         if (config->astc.blocksize[0] != 0) {
@@ -533,57 +617,76 @@ bool parseOptionString(const std::string& options, CompressionConfig* config) {
     return config->type != CompressionConfig::INVALID;
 }
 
-CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image) {
+// The ARM encoder and etc2comp have their own worker threads, config.threadCount of them, or one
+// per core by default. S3TC is compressed on the JobSystem with at most config.threadCount jobs
+// at once, or on the calling thread without a JobSystem.
+static CompressedTexture compressTexture(utils::JobSystem* js, const CompressionConfig& config,
+        const LinearImage& image) {
+    const int threadCount = config.threadCount ?
+            int(config.threadCount) : int(std::thread::hardware_concurrency());
     if (config.type == CompressionConfig::ASTC) {
-        return astcCompress(image, config.astc);
+        return astcCompress(js, image, config.astc, threadCount);
     }
     if (config.type == CompressionConfig::S3TC) {
-        return s3tcCompress(image, config.s3tc);
+        return s3tcCompress(js, image, config.s3tc, config.threadCount);
     }
     if (config.type == CompressionConfig::ETC) {
-        return etcCompress(image, config.etc);
+        return etcCompress(js, image, config.etc, threadCount);
     }
     return {};
 }
 
-static LinearImage extendToFourChannels(LinearImage original) {
-    LinearImage source = original;
+CompressedTexture compressTexture(const CompressionConfig& config, const LinearImage& image) {
+    return compressTexture(nullptr, config, image);
+}
+
+CompressedTexture compressTexture(utils::JobSystem& js, const CompressionConfig& config,
+        const LinearImage& image) {
+    return compressTexture(config.threadCount == 1 ? nullptr : &js, config, image);
+}
+
+// Returns a four-channel version of the source: luminance is copied to RGB, and alpha is 1 if
+// the source doesn't have it.
+static LinearImage extendToFourChannels(utils::JobSystem* js, const LinearImage& source,
+        uint32_t maxJobs) {
+    const uint32_t channels = source.getChannels();
+    if (channels == 4) {
+        return source;
+    }
     const uint32_t width = source.getWidth();
     const uint32_t height = source.getHeight();
-    auto createEmptyImage = [width, height](float value) {
-        auto result = LinearImage(width, height, 1);
-        float* pixels = result.getPixelRef(0, 0);
-        std::fill(pixels, pixels + width * height, value);
-        return result;
-    };
-    switch (source.getChannels()) {
-        case 4: break;
-        case 1: {
-            auto l = image::extractChannel(source, 0);
-            auto a = createEmptyImage(1.0f);
-            source = image::combineChannels({l, l, l, a});
-        }
-        case 2: {
-            auto l = image::extractChannel(source, 0);
-            auto a = image::extractChannel(source, 1);
-            source = image::combineChannels({l, l, l, a});
-        }
-        case 3: {
-            auto r = image::extractChannel(source, 0);
-            auto g = image::extractChannel(source, 1);
-            auto b = image::extractChannel(source, 2);
-            auto a = createEmptyImage(1.0f);
-            source = image::combineChannels({r, g, b, a});
-        }
-        default: {
-            auto r = image::extractChannel(source, 0);
-            auto g = image::extractChannel(source, 1);
-            auto b = image::extractChannel(source, 2);
-            auto a = image::extractChannel(source, 3);
-            source = image::combineChannels({r, g, b, a});
+    LinearImage result(width, height, 4);
+    parallelRows(js, height, maxJobs, [&](uint32_t start, uint32_t count) {
+        for (uint32_t y = start; y < start + count; y++) {
+            float const* src = source.getPixelRef(0, y);
+            float* dst = result.getPixelRef(0, y);
+            for (uint32_t x = 0; x < width; x++, src += channels, dst += 4) {
+                switch (channels) {
+                    case 1:
+                        dst[0] = dst[1] = dst[2] = src[0];
+                        dst[3] = 1.0f;
+                        break;
+                    case 2:
+                        dst[0] = dst[1] = dst[2] = src[0];
+                        dst[3] = src[1];
+                        break;
+                    case 3:
+                        dst[0] = src[0];
+                        dst[1] = src[1];
+                        dst[2] = src[2];
+                        dst[3] = 1.0f;
+                        break;
+                    default:
+                        dst[0] = src[0];
+                        dst[1] = src[1];
+                        dst[2] = src[2];
+                        dst[3] = src[3];
+                        break;
+                }
+            }
         }
-    }
-    return source;
+    });
+    return result;
 }
 
 } // namespace image
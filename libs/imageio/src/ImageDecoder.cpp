@@ -18,6 +18,7 @@
 
 #include <imageio/ImageDecoder.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring> // for memcmp
 #include <iostream> // for cerr
@@ -34,9 +35,12 @@
 #    include <arpa/inet.h>
 #endif
 
+#include <math/half.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <utils/compiler.h>
+
 #include <tinyexr.h>
 
 #include <vector>
@@ -55,6 +59,8 @@ public:
     PNGDecoder& operator=(const PNGDecoder&) = delete;
 
 private:
+    friend class PNGRowDecoder;
+
     explicit PNGDecoder(std::istream& stream);
     ~PNGDecoder() override;
 
@@ -62,6 +68,12 @@ private:
 
     // ImageDecoder::Decoder interface
     LinearImage decode() override;
+    CompactImage decodeCompact(CompactImage::Format format) override;
+
+    // Reads the header and sets up the conversion to 16 bits, returns the size of a row.
+    size_t readHeader();
+    LinearImage convertRows(uint32_t width, uint32_t height, size_t rowBytes,
+            uint8_t const* data) const;
 
     static void cb_error(png_structp, png_const_charp);
     static void cb_stream(png_structp png, png_bytep buffer, png_size_t size);
@@ -95,7 +107,6 @@ private:
     static const char sigRadiance[];
     static const char sigRGBE[];
     std::istream& mStream;
-    std::streampos mStreamStartPos;
 };
 
 // -----------------------------------------------------------------------------------------------
@@ -117,7 +128,6 @@ private:
 
     static const char sig[];
     std::istream& mStream;
-    std::streampos mStreamStartPos;
 };
 
 // -----------------------------------------------------------------------------------------------
@@ -145,9 +155,114 @@ private:
 
 // -----------------------------------------------------------------------------------------------
 
+// Row decoders decode one row at a time to floats, which are then packed to the requested format.
+class BaseRowDecoder : public ImageDecoder::RowDecoder {
+public:
+    uint32_t decodeRows(void* dst, uint32_t count, ImageDecoder::PixelDataFormat format,
+            ImageDecoder::PixelDataType type, size_t stride) override;
+
+protected:
+    BaseRowDecoder(std::istream& stream, const char* name);
+
+    // Decodes row mRow, with mChannels floats per pixel. Throws std::runtime_error on errors.
+    virtual void readRow(float* dst) = 0;
+
+    // Decodes row mRow straight into dst, with dstChannels values of the given type per pixel.
+    // Returns false if the decoder can't, the row is then decoded to floats and packed.
+    virtual bool readPackedRow(void* /*dst*/, uint32_t /*dstChannels*/,
+            ImageDecoder::PixelDataType /*type*/) {
+        return false;
+    }
+
+    std::istream& mStream;
+    std::streampos mStreamStartPos;
+
+private:
+    const char* mName;
+    std::unique_ptr<float[]> mFloatRow;
+    bool mFailed = false;
+};
+
+class PNGRowDecoder : public BaseRowDecoder {
+public:
+    static PNGRowDecoder* create(std::istream& stream, ImageDecoder::ColorSpace colorSpace);
+    ~PNGRowDecoder() override;
+
+private:
+    explicit PNGRowDecoder(std::istream& stream);
+
+    void readRow(float* dst) override;
+    bool readPackedRow(void* dst, uint32_t dstChannels, ImageDecoder::PixelDataType type) override;
+
+    // Reads row mRow, in the 16-bit format set up by PNGDecoder::readHeader().
+    uint16_t const* readPNGRow();
+
+    PNGDecoder* mDecoder;
+    std::unique_ptr<uint8_t[]> mImageData; // one row, or the whole image if interlaced
+    size_t mRowBytes = 0;
+    bool mInterlaced = false;
+};
+
+class HDRRowDecoder : public BaseRowDecoder {
+public:
+    static HDRRowDecoder* create(std::istream& stream);
+
+private:
+    explicit HDRRowDecoder(std::istream& stream);
+
+    void readRow(float* dst) override;
+
+    std::unique_ptr<uint8_t[]> mRGBE;
+    bool mRLE = false;
+};
+
+class PSDRowDecoder : public BaseRowDecoder {
+public:
+    static PSDRowDecoder* create(std::istream& stream);
+
+private:
+    explicit PSDRowDecoder(std::istream& stream);
+
+    void readRow(float* dst) override;
+
+    std::unique_ptr<uint8_t[]> mChannelRow;
+    std::streampos mDataStartPos;
+    uint16_t mDepth = 0;
+};
+
+// For the formats that can't be streamed, rows are read from an already decoded image.
+class LinearRowDecoder : public BaseRowDecoder {
+public:
+    static LinearRowDecoder* create(std::istream& stream, const LinearImage& image);
+
+private:
+    LinearRowDecoder(std::istream& stream, const LinearImage& image);
+
+    void readRow(float* dst) override;
+
+    LinearImage mImage;
+};
+
+// -----------------------------------------------------------------------------------------------
+
 LinearImage ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
         ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(createDecoder(stream, sourceName, sourceSpace));
+    return decoder ? decoder->decode() : LinearImage();
+}
+
+CompactImage ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
+        CompactImage::Format format, ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(createDecoder(stream, sourceName, sourceSpace));
+    return decoder ? decoder->decodeCompact(format) : CompactImage();
+}
 
+CompactImage ImageDecoder::Decoder::decodeCompact(CompactImage::Format format) {
+    LinearImage image = decode();
+    return image ? toCompactImage(image, format) : CompactImage();
+}
+
+ImageDecoder::Format ImageDecoder::detectFormat(std::istream& stream) {
     Format format = Format::NONE;
 
     std::streampos pos = stream.tellg();
@@ -165,11 +280,18 @@ LinearImage ImageDecoder::decode(std::istream& stream, const std::string& source
     }
 
     stream.seekg(pos);
+    return format;
+}
+
+ImageDecoder::Decoder* ImageDecoder::createDecoder(std::istream& stream,
+        const std::string& sourceName, ColorSpace sourceSpace) {
+
+    Format format = detectFormat(stream);
 
     std::unique_ptr<Decoder> decoder;
     switch (format) {
         case Format::NONE:
-            return LinearImage();
+            return nullptr;
         case Format::PNG:
             decoder.reset(PNGDecoder::create(stream));
             decoder->setColorSpace(sourceSpace);
@@ -188,22 +310,192 @@ LinearImage ImageDecoder::decode(std::istream& stream, const std::string& source
             break;
     }
 
-    return decoder->decode();
+    return decoder.release();
+}
+
+// R, RG, RGB and RGBA have 1 to 4 channels
+static inline uint32_t getChannelCount(ImageDecoder::PixelDataFormat format) noexcept {
+    return uint32_t(format) + 1;
+}
+
+std::unique_ptr<ImageDecoder::RowDecoder> ImageDecoder::createRowDecoder(std::istream& stream,
+        const std::string& sourceName, ColorSpace sourceSpace) {
+    std::unique_ptr<RowDecoder> decoder;
+    switch (detectFormat(stream)) {
+        case Format::NONE:
+            break;
+        case Format::PNG:
+            decoder.reset(PNGRowDecoder::create(stream, sourceSpace));
+            break;
+        case Format::HDR:
+            decoder.reset(HDRRowDecoder::create(stream));
+            break;
+        case Format::PSD:
+            decoder.reset(PSDRowDecoder::create(stream));
+            break;
+        case Format::EXR: {
+            std::unique_ptr<Decoder> exr(EXRDecoder::create(stream, sourceName));
+            LinearImage image = exr->decode();
+            if (image) {
+                decoder.reset(LinearRowDecoder::create(stream, image));
+            }
+            break;
+        }
+    }
+    return decoder;
+}
+
+size_t ImageDecoder::getBytesPerPixel(PixelDataFormat format, PixelDataType type) noexcept {
+    const size_t channels = getChannelCount(format);
+    switch (type) {
+        case PixelDataType::UBYTE:  return channels;
+        case PixelDataType::USHORT: return channels * 2;
+        case PixelDataType::HALF:   return channels * 2;
+        case PixelDataType::FLOAT:  return channels * 4;
+    }
+    return 0;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-static inline float read32(std::istream& istream) {
-    uint32_t data;
-    istream.read(reinterpret_cast<char*>(&data), sizeof(uint32_t));
-    data = ntohl(data);
-    return *reinterpret_cast<float*>(&data);
+BaseRowDecoder::BaseRowDecoder(std::istream& stream, const char* name)
+        : mStream(stream), mStreamStartPos(stream.tellg()), mName(name) {
+}
+
+template<typename T>
+static inline T convertChannel(float v);
+
+template<>
+inline uint8_t convertChannel(float v) {
+    return uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+template<>
+inline uint16_t convertChannel(float v) {
+    return uint16_t(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+template<>
+inline filament::math::half convertChannel(float v) {
+    return filament::math::half(v);
 }
 
-static inline float read16(std::istream& istream) {
-    uint16_t data;
-    istream.read(reinterpret_cast<char*>(&data), sizeof(uint16_t));
-    return static_cast<float>(ntohs(data)) / std::numeric_limits<uint16_t>::max();
+template<>
+inline float convertChannel(float v) {
+    return v;
+}
+
+template<typename T>
+static void packRow(void* dst, float const* UTILS_RESTRICT src, uint32_t width,
+        uint32_t srcChannels, uint32_t dstChannels) {
+    T* UTILS_RESTRICT d = static_cast<T*>(dst);
+    const T zero = convertChannel<T>(0.0f);
+    const T one = convertChannel<T>(1.0f);
+    for (uint32_t x = 0; x < width; x++, src += srcChannels) {
+        for (uint32_t c = 0; c < dstChannels; c++) {
+            *d++ = c < srcChannels ? convertChannel<T>(src[c]) : (c == 3 ? one : zero);
+        }
+    }
+}
+
+uint32_t BaseRowDecoder::decodeRows(void* dst, uint32_t count,
+        ImageDecoder::PixelDataFormat format, ImageDecoder::PixelDataType type, size_t stride) {
+    using PixelDataType = ImageDecoder::PixelDataType;
+    if (mFailed) {
+        return 0;
+    }
+    const uint32_t channels = getChannelCount(format);
+    stride = stride ? stride : ImageDecoder::getBytesPerPixel(format, type) * mWidth;
+    count = std::min(count, mHeight - mRow);
+
+    // floats with the same layout as the source are decoded in place
+    const bool inPlace = type == PixelDataType::FLOAT && channels == mChannels;
+
+    uint8_t* row = static_cast<uint8_t*>(dst);
+    uint32_t decoded = 0;
+    try {
+        for ( ; decoded < count; decoded++, mRow++, row += stride) {
+            if (readPackedRow(row, channels, type)) {
+                continue;
+            }
+            if (inPlace) {
+                readRow(reinterpret_cast<float*>(row));
+                continue;
+            }
+            if (!mFloatRow) {
+                mFloatRow.reset(new float[size_t(mWidth) * mChannels]);
+            }
+            readRow(mFloatRow.get());
+            switch (type) {
+                case PixelDataType::UBYTE:
+                    packRow<uint8_t>(row, mFloatRow.get(), mWidth, mChannels, channels);
+                    break;
+                case PixelDataType::USHORT:
+                    packRow<uint16_t>(row, mFloatRow.get(), mWidth, mChannels, channels);
+                    break;
+                case PixelDataType::HALF:
+                    packRow<filament::math::half>(row, mFloatRow.get(), mWidth, mChannels,
+                            channels);
+                    break;
+                case PixelDataType::FLOAT:
+                    packRow<float>(row, mFloatRow.get(), mWidth, mChannels, channels);
+                    break;
+            }
+        }
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding " << mName << ": " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+        mFailed = true;
+    }
+    return decoded;
+}
+
+// Returns the result of sRGBToLinear() for every 16-bit value.
+static float const* getSRGBToLinearTable() {
+    static const std::unique_ptr<float[]> table = []() {
+        std::unique_ptr<float[]> linear(new float[65536]);
+        for (uint32_t i = 0; i < 65536; i++) {
+            filament::math::float3 sRGB{ float(i) };
+            sRGB /= std::numeric_limits<uint16_t>::max();
+            linear[i] = sRGBToLinear(sRGB).x;
+        }
+        return linear;
+    }();
+    return table.get();
+}
+
+// Converts a 16-bit PNG value to T, like converting the float that decode() produces would.
+// Color channels of sRGB images are linearized with the given table.
+template<typename T>
+static inline T convertPNGChannel(uint16_t v, float const* linear) {
+    return convertChannel<T>(linear ? linear[v] : float(v) / std::numeric_limits<uint16_t>::max());
+}
+
+template<>
+inline uint8_t convertPNGChannel(uint16_t v, float const* linear) {
+    // v / 257 is never halfway between two integers, so this rounds like the float version
+    return linear ? convertChannel<uint8_t>(linear[v]) : uint8_t((uint32_t(v) + 128) / 257);
+}
+
+template<>
+inline uint16_t convertPNGChannel(uint16_t v, float const* linear) {
+    return linear ? convertChannel<uint16_t>(linear[v]) : v;
+}
+
+// Converts a row of 16-bit PNG data, in network order (big endian), without going through floats.
+template<typename T>
+static void packPNGRow(void* dst, uint16_t const* UTILS_RESTRICT src, uint32_t width,
+        uint32_t srcChannels, uint32_t dstChannels, float const* linear) {
+    T* UTILS_RESTRICT d = static_cast<T*>(dst);
+    const T zero = convertChannel<T>(0.0f);
+    const T one = convertChannel<T>(1.0f);
+    for (uint32_t x = 0; x < width; x++, src += srcChannels) {
+        for (uint32_t c = 0; c < dstChannels; c++) {
+            *d++ = c < srcChannels ? convertPNGChannel<T>(ntohs(src[c]), c < 3 ? linear : nullptr)
+                    : (c == 3 ? one : zero);
+        }
+    }
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -232,44 +524,72 @@ PNGDecoder::~PNGDecoder() {
     png_destroy_read_struct(&mPNG, &mInfo, nullptr);
 }
 
-LinearImage PNGDecoder::decode() {
-    std::unique_ptr<uint8_t[]> imageData;
-    try {
-        mInfo = png_create_info_struct(mPNG);
-        png_read_info(mPNG, mInfo);
+size_t PNGDecoder::readHeader() {
+    mInfo = png_create_info_struct(mPNG);
+    png_read_info(mPNG, mInfo);
 
-        int colorType = png_get_color_type(mPNG, mInfo);
-        int bitDepth = png_get_bit_depth(mPNG, mInfo);
+    int colorType = png_get_color_type(mPNG, mInfo);
+    int bitDepth = png_get_bit_depth(mPNG, mInfo);
 
-        if (colorType == PNG_COLOR_TYPE_PALETTE) {
-            png_set_palette_to_rgb(mPNG);
-        }
-        if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
-            if (bitDepth < 8) {
-                png_set_expand_gray_1_2_4_to_8(mPNG);
-            }
-            png_set_gray_to_rgb(mPNG);
-        }
-        if (png_get_valid(mPNG, mInfo, PNG_INFO_tRNS)) {
-            png_set_tRNS_to_alpha(mPNG);
+    if (colorType == PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(mPNG);
+    }
+    if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+        if (bitDepth < 8) {
+            png_set_expand_gray_1_2_4_to_8(mPNG);
         }
+        png_set_gray_to_rgb(mPNG);
+    }
+    if (png_get_valid(mPNG, mInfo, PNG_INFO_tRNS)) {
+        png_set_tRNS_to_alpha(mPNG);
+    }
+    if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
+        png_set_alpha_mode(mPNG, PNG_ALPHA_PNG, PNG_DEFAULT_sRGB);
+    } else {
+        png_set_alpha_mode(mPNG, PNG_ALPHA_PNG, PNG_GAMMA_LINEAR);
+    }
+    if (bitDepth < 16) {
+        png_set_expand_16(mPNG);
+    }
+
+    png_read_update_info(mPNG, mInfo);
+    return png_get_rowbytes(mPNG, mInfo);
+}
+
+LinearImage PNGDecoder::convertRows(uint32_t width, uint32_t height, size_t rowBytes,
+        uint8_t const* data) const {
+    // Read updated color type since we may have asked for a conversion before
+    const int colorType = png_get_color_type(mPNG, mInfo);
+    if (colorType == PNG_COLOR_TYPE_RGBA) {
         if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-            png_set_alpha_mode(mPNG, PNG_ALPHA_PNG, PNG_DEFAULT_sRGB);
+            return toLinearWithAlpha<uint16_t>(width, height, rowBytes, data,
+                    [](uint16_t v) -> uint16_t { return ntohs(v); },
+                    sRGBToLinear<filament::math::float4>);
         } else {
-            png_set_alpha_mode(mPNG, PNG_ALPHA_PNG, PNG_GAMMA_LINEAR);
+            return toLinearWithAlpha<uint16_t>(width, height, rowBytes, data,
+                    [](uint16_t v) -> uint16_t { return ntohs(v); },
+                    [](const filament::math::float4& color) ->  filament::math::float4 { return color; });
         }
-        if (bitDepth < 16) {
-            png_set_expand_16(mPNG);
+    } else {
+        // Convert to linear float (PNG 16 stores data in network order (big endian).
+        if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
+            return toLinear<uint16_t>(width, height, rowBytes, data,
+                    [](uint16_t v) -> uint16_t { return ntohs(v); },
+                    sRGBToLinear< filament::math::float3>);
+        } else {
+            return toLinear<uint16_t>(width, height, rowBytes, data,
+                    [](uint16_t v) -> uint16_t { return ntohs(v); },
+                    [](const filament::math::float3& color) ->  filament::math::float3 { return color; });
         }
+    }
+}
 
-        png_read_update_info(mPNG, mInfo);
-
-        // Read updated color type since we may have asked for a conversion before
-        colorType = png_get_color_type(mPNG, mInfo);
-
+LinearImage PNGDecoder::decode() {
+    std::unique_ptr<uint8_t[]> imageData;
+    try {
+        size_t rowBytes = readHeader();
         uint32_t width  = png_get_image_width(mPNG, mInfo);
         uint32_t height = png_get_image_height(mPNG, mInfo);
-        size_t rowBytes = png_get_rowbytes(mPNG, mInfo);
 
         imageData = std::make_unique<uint8_t[]>(height * rowBytes);
         std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
@@ -279,35 +599,62 @@ LinearImage PNGDecoder::decode() {
         png_read_image(mPNG, rowPointers.get());
         png_read_end(mPNG, mInfo);
 
-        if (colorType == PNG_COLOR_TYPE_RGBA) {
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<filament::math::float4>);
+        return convertRows(width, height, rowBytes, imageData.get());
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+        imageData.release();
+    }
+    return LinearImage();
+}
+
+// Non-interlaced images are decoded and converted one row at a time, interlaced images must be
+// read at once, but they still don't need a float copy.
+CompactImage PNGDecoder::decodeCompact(CompactImage::Format format) {
+    float const* linear =
+            getColorSpace() == ImageDecoder::ColorSpace::SRGB ? getSRGBToLinearTable() : nullptr;
+    try {
+        size_t rowBytes = readHeader();
+        uint32_t width  = png_get_image_width(mPNG, mInfo);
+        uint32_t height = png_get_image_height(mPNG, mInfo);
+        uint32_t channels = png_get_color_type(mPNG, mInfo) == PNG_COLOR_TYPE_RGBA ? 4 : 3;
+        const bool interlaced = png_get_interlace_type(mPNG, mInfo) != PNG_INTERLACE_NONE;
+
+        std::unique_ptr<uint8_t[]> imageData(new uint8_t[(interlaced ? height : 1) * rowBytes]);
+        if (interlaced) {
+            std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
+            for (size_t y = 0 ; y < height ; y++) {
+                rowPointers[y] = &imageData[y * rowBytes];
+            }
+            png_read_image(mPNG, rowPointers.get());
+        }
+
+        CompactImage result(width, height, channels, format);
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t* row = imageData.get();
+            if (interlaced) {
+                row += y * rowBytes;
             } else {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [](const filament::math::float4& color) ->  filament::math::float4 { return color; });
+                png_read_row(mPNG, row, nullptr);
             }
-        } else {
-            // Convert to linear float (PNG 16 stores data in network order (big endian).
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear< filament::math::float3>);
+            uint16_t const* src = reinterpret_cast<uint16_t const*>(row);
+            if (format == CompactImage::Format::HALF) {
+                packPNGRow<filament::math::half>(result.getPixelRef(0, y), src, width,
+                        channels, channels, linear);
             } else {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [](const filament::math::float3& color) ->  filament::math::float3 { return color; });
+                packPNGRow<uint8_t>(result.getPixelRef(0, y), src, width, channels, channels,
+                        linear);
             }
         }
+        png_read_end(mPNG, mInfo);
+        return result;
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
-        imageData.release();
     }
-    return LinearImage();
+    return CompactImage();
 }
 
 void PNGDecoder::cb_stream(png_structp png, png_bytep buffer, png_size_t size) {
@@ -333,6 +680,90 @@ void PNGDecoder::error() {
 
 // -----------------------------------------------------------------------------------------------
 
+PNGRowDecoder* PNGRowDecoder::create(std::istream& stream, ImageDecoder::ColorSpace colorSpace) {
+    std::unique_ptr<PNGRowDecoder> decoder(new PNGRowDecoder(stream));
+    PNGDecoder* png = decoder->mDecoder;
+    png->setColorSpace(colorSpace);
+    try {
+        decoder->mRowBytes = png->readHeader();
+        decoder->mWidth = png_get_image_width(png->mPNG, png->mInfo);
+        decoder->mHeight = png_get_image_height(png->mPNG, png->mInfo);
+        decoder->mChannels =
+                png_get_color_type(png->mPNG, png->mInfo) == PNG_COLOR_TYPE_RGBA ? 4 : 3;
+        decoder->mInterlaced = png_get_interlace_type(png->mPNG, png->mInfo) != PNG_INTERLACE_NONE;
+        return decoder.release();
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
+        stream.seekg(decoder->mStreamStartPos);
+    }
+    return nullptr;
+}
+
+PNGRowDecoder::PNGRowDecoder(std::istream& stream)
+        : BaseRowDecoder(stream, "PNG"), mDecoder(PNGDecoder::create(stream)) {
+}
+
+PNGRowDecoder::~PNGRowDecoder() {
+    delete mDecoder;
+}
+
+// Non-interlaced images are decoded one row at a time, interlaced images must be read at once.
+uint16_t const* PNGRowDecoder::readPNGRow() {
+    png_structp png = mDecoder->mPNG;
+    uint8_t const* row;
+    if (mInterlaced) {
+        if (!mImageData) {
+            mImageData.reset(new uint8_t[mHeight * mRowBytes]);
+            std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[mHeight]);
+            for (size_t y = 0 ; y < mHeight ; y++) {
+                rowPointers[y] = &mImageData[y * mRowBytes];
+            }
+            png_read_image(png, rowPointers.get());
+        }
+        row = &mImageData[mRow * mRowBytes];
+    } else {
+        if (!mImageData) {
+            mImageData.reset(new uint8_t[mRowBytes]);
+        }
+        png_read_row(png, mImageData.get(), nullptr);
+        row = mImageData.get();
+    }
+    if (mRow + 1 == mHeight) {
+        png_read_end(png, mDecoder->mInfo);
+    }
+    return reinterpret_cast<uint16_t const*>(row);
+}
+
+void PNGRowDecoder::readRow(float* dst) {
+    readPackedRow(dst, mChannels, ImageDecoder::PixelDataType::FLOAT);
+}
+
+bool PNGRowDecoder::readPackedRow(void* dst, uint32_t dstChannels,
+        ImageDecoder::PixelDataType type) {
+    using PixelDataType = ImageDecoder::PixelDataType;
+    float const* linear = mDecoder->getColorSpace() == ImageDecoder::ColorSpace::SRGB ?
+            getSRGBToLinearTable() : nullptr;
+    uint16_t const* src = readPNGRow();
+    switch (type) {
+        case PixelDataType::UBYTE:
+            packPNGRow<uint8_t>(dst, src, mWidth, mChannels, dstChannels, linear);
+            break;
+        case PixelDataType::USHORT:
+            packPNGRow<uint16_t>(dst, src, mWidth, mChannels, dstChannels, linear);
+            break;
+        case PixelDataType::HALF:
+            packPNGRow<filament::math::half>(dst, src, mWidth, mChannels, dstChannels, linear);
+            break;
+        case PixelDataType::FLOAT:
+            packPNGRow<float>(dst, src, mWidth, mChannels, dstChannels, linear);
+            break;
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
 const char HDRDecoder::sigRadiance[] = { '#', '?', 'R', 'A', 'D', 'I', 'A', 'N', 'C', 'E', 0xa };
 const char HDRDecoder::sigRGBE[]     = { '#', '?', 'R', 'G', 'B', 'E', 0xa };
 
@@ -347,124 +778,152 @@ bool HDRDecoder::checkSignature(char const* buf) {
 }
 
 HDRDecoder::HDRDecoder(std::istream& stream)
-    : mStream(stream), mStreamStartPos(stream.tellg()) {
+    : mStream(stream) {
 }
 
 HDRDecoder::~HDRDecoder() = default;
 
+// Decodes all the rows of an image as floats.
+static LinearImage decodeImage(ImageDecoder::RowDecoder* decoder) {
+    std::unique_ptr<ImageDecoder::RowDecoder> rows(decoder);
+    if (!rows) {
+        return LinearImage();
+    }
+    const uint32_t width = rows->getWidth();
+    const uint32_t height = rows->getHeight();
+    const uint32_t channels = rows->getChannels();
+    LinearImage image(width, height, channels);
+    const auto format = channels == 4 ?
+            ImageDecoder::PixelDataFormat::RGBA : ImageDecoder::PixelDataFormat::RGB;
+    const uint32_t decoded = rows->decodeRows(image.getPixelRef(), height, format,
+            ImageDecoder::PixelDataType::FLOAT);
+    return decoded == height ? image : LinearImage();
+}
+
 LinearImage HDRDecoder::decode() {
+    return decodeImage(HDRRowDecoder::create(mStream));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+HDRRowDecoder* HDRRowDecoder::create(std::istream& stream) {
+    std::unique_ptr<HDRRowDecoder> decoder(new HDRRowDecoder(stream));
     try {
-        float gamma;
-        float exposure;
         char sy, sx;
         unsigned int height, width;
 
-        {
-            char buf[1024];
-            do {
-                char format[128];
-                mStream.getline(buf, sizeof(buf), 0xa);
-                if (buf[0] == '#') continue;
-                sscanf(buf, "FORMAT=%127s", format); // NOLINT
-                sscanf(buf, "GAMMA=%f", &gamma); // NOLINT
-                sscanf(buf, "EXPOSURE=%f", &exposure); // NOLINT
-                if ((sscanf(buf, "%cY %u %cX %u", &sy, &height, &sx, &width) == 4)||   // NOLINT
-                    (sscanf(buf, "%cX %u %cY %u", &sx, &width, &sy, &height) == 4)) {  // NOLINT
-                    break;
-                }
-            } while (true);
-        }
-
-        LinearImage image(width, height, 3);
+        char buf[1024];
+        do {
+            stream.getline(buf, sizeof(buf), 0xa);
+            if (!stream.good()) {
+                throw std::runtime_error("invalid header");
+            }
+            if (buf[0] == '#') continue;
+            if ((sscanf(buf, "%cY %u %cX %u", &sy, &height, &sx, &width) == 4)||   // NOLINT
+                (sscanf(buf, "%cX %u %cY %u", &sx, &width, &sy, &height) == 4)) {  // NOLINT
+                break;
+            }
+        } while (true);
 
-        if (sx == '-') image = horizontalFlip(image);
-        if (sy == '+') image = verticalFlip(image);
+        decoder->mWidth = width;
+        decoder->mHeight = height;
+        decoder->mChannels = 3;
 
         // Allocate memory to hold one row of decoded pixel data.
-        std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width * 4]);
+        decoder->mRGBE.reset(new uint8_t[width * 4]);
 
         // First, test for non-RLE images.
-        const auto pos = mStream.tellg();
-        mStream.read((char*) rgbe.get(), 3);
-        mStream.seekg(pos);
-
-        if (rgbe[0] != 0x2 || rgbe[1] != 0x2 || (rgbe[2] & 0x80) || width < 8 || width > 32767) {
-            for (uint32_t y = 0; y < height; y++) {
-                filament::math::float3* dst = reinterpret_cast<filament::math::float3*>(image.getPixelRef(0, y));
-                mStream.read((char*) rgbe.get(), width * 4);
-                // (rgb/256) * 2^(e-128)
-                size_t pixel = 0;
-                for (size_t x = 0; x < width; x++, pixel += 4) {
-                    if (rgbe[pixel + 3] == 0.0f) {
-                        dst[x] = filament::math::float3{0.0f};
-                    } else {
-                        filament::math::float3 v(rgbe[pixel], rgbe[pixel + 1], rgbe[pixel + 2]);
-                        dst[x] = (v + 0.5f) * std::ldexp(1.0f, rgbe[pixel + 3] - (128 + 8));
-                    }
-                }
+        uint8_t const* rgbe = decoder->mRGBE.get();
+        const auto pos = stream.tellg();
+        stream.read((char*) rgbe, 3);
+        stream.seekg(pos);
+        decoder->mRLE = !(rgbe[0] != 0x2 || rgbe[1] != 0x2 || (rgbe[2] & 0x80) ||
+                width < 8 || width > 32767);
+
+        return decoder.release();
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
+        stream.seekg(decoder->mStreamStartPos);
+    }
+    return nullptr;
+}
+
+HDRRowDecoder::HDRRowDecoder(std::istream& stream) : BaseRowDecoder(stream, "HDR") {
+}
+
+void HDRRowDecoder::readRow(float* dst) {
+    const uint32_t width = mWidth;
+    filament::math::float3* pixels = reinterpret_cast<filament::math::float3*>(dst);
+
+    if (!mRLE) {
+        uint8_t const* rgbe = mRGBE.get();
+        mStream.read((char*) rgbe, width * 4);
+        // (rgb/256) * 2^(e-128)
+        size_t pixel = 0;
+        for (size_t x = 0; x < width; x++, pixel += 4) {
+            if (rgbe[pixel + 3] == 0.0f) {
+                pixels[x] = filament::math::float3{0.0f};
+            } else {
+                filament::math::float3 v(rgbe[pixel], rgbe[pixel + 1], rgbe[pixel + 2]);
+                pixels[x] = (v + 0.5f) * std::ldexp(1.0f, rgbe[pixel + 3] - (128 + 8));
             }
-        } else {
-            for (uint32_t y = 0; y < height; y++) {
-                uint16_t magic;
-                mStream.read((char*) &magic, 2);
-                if (magic != 0x0202) {
-                    throw std::runtime_error("invalid scanline (magic)");
-                }
+        }
+        return;
+    }
 
-                uint16_t w;
-                mStream.read((char*) &w, 2);
-                if (ntohs(w) != width) {
-                    throw std::runtime_error("invalid scanline (width)");
-                }
+    uint16_t magic;
+    mStream.read((char*) &magic, 2);
+    if (magic != 0x0202) {
+        throw std::runtime_error("invalid scanline (magic)");
+    }
 
-                char* d = (char*) rgbe.get();
-                for (size_t p = 0; p < 4; p++) {
-                    size_t num_bytes = 0;
-                    while (num_bytes < width) {
-                        uint8_t rle_count;
-                        mStream.read((char*) &rle_count, 1);
-                        if (rle_count > 128) {
-                            char v;
-                            mStream.read(&v, 1);
-                            memset(d, v, size_t(rle_count - 128));
-                            d += rle_count - 128;
-                            num_bytes += rle_count - 128;
-                        } else {
-                            if (rle_count == 0) {
-                                throw std::runtime_error("run length is zero");
-                            }
-                            mStream.read(d, rle_count);
-                            d += rle_count;
-                            num_bytes += rle_count;
-                        }
-                    }
-                }
+    uint16_t w;
+    mStream.read((char*) &w, 2);
+    if (ntohs(w) != width) {
+        throw std::runtime_error("invalid scanline (width)");
+    }
 
-                uint8_t const* r = &rgbe[0];
-                uint8_t const* g = &rgbe[width];
-                uint8_t const* b = &rgbe[2 * width];
-                uint8_t const* e = &rgbe[3 * width];
-                filament::math::float3* dst = reinterpret_cast<filament::math::float3*>(image.getPixelRef(0, y));
-                // (rgb/256) * 2^(e-128)
-                for (size_t x = 0; x < width; x++, r++, g++, b++, e++) {
-                    if (e[0] == 0.0f) {
-                        dst[x] = filament::math::float3{0.0f};
-                    } else {
-                        filament::math::float3 v(r[0], g[0], b[0]);
-                        dst[x] = (v + 0.5f) * std::ldexp(1.0f, e[0] - (128 + 8));
-                    }
+    char* d = (char*) mRGBE.get();
+    for (size_t p = 0; p < 4; p++) {
+        size_t num_bytes = 0;
+        while (num_bytes < width) {
+            uint8_t rle_count;
+            mStream.read((char*) &rle_count, 1);
+            const size_t run = rle_count > 128 ? rle_count - 128 : rle_count;
+            if (num_bytes + run > width) {
+                throw std::runtime_error("invalid scanline (run length)");
+            }
+            if (rle_count > 128) {
+                char v;
+                mStream.read(&v, 1);
+                memset(d, v, size_t(rle_count - 128));
+                d += rle_count - 128;
+                num_bytes += rle_count - 128;
+            } else {
+                if (rle_count == 0) {
+                    throw std::runtime_error("run length is zero");
                 }
+                mStream.read(d, rle_count);
+                d += rle_count;
+                num_bytes += rle_count;
             }
         }
+    }
 
-        return image;
-
-    } catch(std::runtime_error& e) {
-        // reset the stream, like we found it
-        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
-        mStream.seekg(mStreamStartPos);
+    uint8_t const* r = &mRGBE[0];
+    uint8_t const* g = &mRGBE[width];
+    uint8_t const* b = &mRGBE[2 * width];
+    uint8_t const* e = &mRGBE[3 * width];
+    // (rgb/256) * 2^(e-128)
+    for (size_t x = 0; x < width; x++, r++, g++, b++, e++) {
+        if (e[0] == 0.0f) {
+            pixels[x] = filament::math::float3{0.0f};
+        } else {
+            filament::math::float3 v(r[0], g[0], b[0]);
+            pixels[x] = (v + 0.5f) * std::ldexp(1.0f, e[0] - (128 + 8));
+        }
     }
-    return LinearImage();
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -481,12 +940,18 @@ bool PSDDecoder::checkSignature(char const* buf) {
 }
 
 PSDDecoder::PSDDecoder(std::istream& stream)
-        : mStream(stream), mStreamStartPos(stream.tellg()) {
+        : mStream(stream) {
 }
 
 PSDDecoder::~PSDDecoder() = default;
 
 LinearImage PSDDecoder::decode() {
+    return decodeImage(PSDRowDecoder::create(mStream));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+PSDRowDecoder* PSDRowDecoder::create(std::istream& stream) {
     #pragma pack(push, 1)
     // IMPORTANT NOTE: PSD files use big endian storage
     struct Header {
@@ -504,9 +969,10 @@ LinearImage PSDDecoder::decode() {
     static const uint16_t kColorModeRGB = 3;
     static const uint16_t kCompressionRAW = 0;
 
+    std::unique_ptr<PSDRowDecoder> decoder(new PSDRowDecoder(stream));
     try {
         Header h = { };
-        mStream.read(reinterpret_cast<char*>(&h), sizeof(Header));
+        stream.read(reinterpret_cast<char*>(&h), sizeof(Header));
 
         if (ntohs(h.channels) != 3) {
             throw std::runtime_error("the image must have 3 channels only");
@@ -521,62 +987,67 @@ LinearImage PSDDecoder::decode() {
             throw std::runtime_error("the image must be RGB");
         }
 
-        uint32_t width = ntohl(h.width);
-        uint32_t height = ntohl(h.height);
-
         uint32_t length;
 
         // color mode data section
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+        stream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+        stream.seekg(ntohl(length), std::istream::cur);
 
         // image resources
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+        stream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+        stream.seekg(ntohl(length), std::istream::cur);
 
         // layer and mask info section
-        mStream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
-        mStream.seekg(ntohl(length), std::istream::cur);
+        stream.read(reinterpret_cast<char*>(&length), sizeof(uint32_t));
+        stream.seekg(ntohl(length), std::istream::cur);
 
         // compression format
         uint16_t compression;
-        mStream.read(reinterpret_cast<char*>(&compression), sizeof(uint16_t));
+        stream.read(reinterpret_cast<char*>(&compression), sizeof(uint16_t));
         if (ntohs(compression) != kCompressionRAW) {
             throw std::runtime_error("compressed images are not supported");
         }
 
-        LinearImage image(width, height, 3);
+        decoder->mWidth = ntohl(h.width);
+        decoder->mHeight = ntohl(h.height);
+        decoder->mChannels = 3;
+        decoder->mDepth = depth;
+        decoder->mDataStartPos = stream.tellg();
+        decoder->mChannelRow.reset(new uint8_t[decoder->mWidth * (depth / 8)]);
+        return decoder.release();
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding PSD: " << e.what() << std::endl;
+        stream.seekg(decoder->mStreamStartPos);
+    }
+    return nullptr;
+}
 
-        if (depth == 32) {
-            for (size_t i = 0; i < 3; i++) {
-                for (uint32_t y = 0; y < height; y++) {
-                    for (uint32_t x = 0; x < width; x++) {
-                         filament::math::float3& pixel =
-                                *reinterpret_cast< filament::math::float3*>(image.getPixelRef(x, y));
-                        pixel[i] = read32(mStream);
-                    }
-                }
+PSDRowDecoder::PSDRowDecoder(std::istream& stream) : BaseRowDecoder(stream, "PSD") {
+}
+
+// Channels are stored in separate planes, so each row is gathered from three places.
+void PSDRowDecoder::readRow(float* dst) {
+    const size_t bytesPerRow = mWidth * (mDepth / 8);
+    for (size_t c = 0; c < 3; c++) {
+        mStream.seekg(mDataStartPos + std::streamoff((c * mHeight + mRow) * bytesPerRow));
+        mStream.read(reinterpret_cast<char*>(mChannelRow.get()), bytesPerRow);
+        if (!mStream.good()) {
+            throw std::runtime_error("unexpected end of stream");
+        }
+        if (mDepth == 32) {
+            uint32_t const* src = reinterpret_cast<uint32_t const*>(mChannelRow.get());
+            for (size_t x = 0; x < mWidth; x++) {
+                uint32_t data = ntohl(src[x]);
+                memcpy(&dst[x * 3 + c], &data, sizeof(float));
             }
         } else {
-            for (size_t i = 0; i < 3; i++) {
-                for (uint32_t y = 0; y < height; y++) {
-                    for (uint32_t x = 0; x < width; x++) {
-                         filament::math::float3& pixel =
-                                *reinterpret_cast< filament::math::float3*>(image.getPixelRef(x, y));
-                        pixel[i] = read16(mStream);
-                    }
-                }
+            uint16_t const* src = reinterpret_cast<uint16_t const*>(mChannelRow.get());
+            for (size_t x = 0; x < mWidth; x++) {
+                dst[x * 3 + c] = float(ntohs(src[x])) / std::numeric_limits<uint16_t>::max();
             }
         }
-
-        return image;
-    } catch(std::runtime_error& e) {
-        // reset the stream, like we found it
-        std::cerr << "Runtime error while decoding PSD: " << e.what() << std::endl;
-        mStream.seekg(mStreamStartPos);
     }
-
-    return LinearImage();
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -650,4 +1121,21 @@ LinearImage EXRDecoder::decode() {
     return LinearImage();
 }
 
+// -----------------------------------------------------------------------------------------------
+
+LinearRowDecoder* LinearRowDecoder::create(std::istream& stream, const LinearImage& image) {
+    return new LinearRowDecoder(stream, image);
+}
+
+LinearRowDecoder::LinearRowDecoder(std::istream& stream, const LinearImage& image)
+        : BaseRowDecoder(stream, "image"), mImage(image) {
+    mWidth = mImage.getWidth();
+    mHeight = mImage.getHeight();
+    mChannels = mImage.getChannels();
+}
+
+void LinearRowDecoder::readRow(float* dst) {
+    memcpy(dst, mImage.getPixelRef(0, mRow), sizeof(float) * mWidth * mChannels);
+}
+
 } // namespace image
@@ -20,12 +20,227 @@
 #include <image/ImageOps.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
+#include <utils/compiler.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
+#include <limits>
+#include <vector>
+
+#include <string.h>
 
 namespace image {
 
+namespace {
+
+// Number of rows in a tile, tiles are the unit of work and of early-out.
+constexpr uint32_t TILE_ROWS = 16;
+
+constexpr size_t MAX_CHANNELS = DiffStatistics::MAX_CHANNELS;
+constexpr size_t HISTOGRAM_SIZE = DiffStatistics::HISTOGRAM_SIZE;
+
+// Differences below this all land in the first histogram bin.
+constexpr float FIRST_BIN_LIMIT = 0.5f / 255.0f;
+
+// This library is built with -ffast-math, so NaNs can't be detected with float comparisons.
+// Absolute differences are compared through their bits instead: the bits of non-negative floats
+// are ordered like their values, and NaNs (whose sign abs() clears) come after +inf.
+constexpr uint32_t INFINITY_BITS = 0x7f800000;
+
+inline uint32_t orderedBits(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+inline float fromOrderedBits(uint32_t bits) {
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// Maximum of two absolute differences, NaN if either is NaN.
+inline float maxDiffOf(float a, float b) {
+    return fromOrderedBits(std::max(orderedBits(a), orderedBits(b)));
+}
+
+struct TileStatistics {
+    size_t rowCount = 0;
+    size_t mismatchCount = 0;
+    float maxDiff = 0.0f;
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    uint32_t histogram[MAX_CHANNELS][HISTOGRAM_SIZE] = {};
+};
+
+template<typename F>
+void parallelTiles(utils::JobSystem* js, uint32_t count, F const& fn) {
+    if (!js || count < 2) {
+        fn(0, count);
+        return;
+    }
+    utils::JobSystem::Job* job = utils::jobs::parallel_for(*js, nullptr, 0, count,
+            [&fn](uint32_t start, uint32_t count) { fn(start, count); },
+            utils::jobs::CountSplitter<1>());
+    js->runAndWait(job);
+}
+
+// Computes the absolute differences of a row and returns their maximum (NaN if any of them is
+// NaN), sum and sum of squares. This is the hot loop, it is written so that it vectorizes.
+float diffRow(float const* UTILS_RESTRICT a, float const* UTILS_RESTRICT b,
+        float* UTILS_RESTRICT d, size_t n, float& sum, float& sumSquares) {
+    uint32_t m = 0;
+    float s = 0.0f;
+    float s2 = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        const float v = std::abs(a[i] - b[i]);
+        d[i] = v;
+        m = std::max(m, orderedBits(v));
+        s += v;
+        s2 += v * v;
+    }
+    sum = s;
+    sumSquares = s2;
+    return fromOrderedBits(m);
+}
+
+bool diffImages(utils::JobSystem* js, const LinearImage& a, const LinearImage& b,
+        DiffOptions const& options, DiffStatistics* stats) {
+    const uint32_t width = a.getWidth();
+    const uint32_t height = a.getHeight();
+    const uint32_t channels = a.getChannels();
+    if (b.getWidth() != width || b.getHeight() != height || b.getChannels() != channels) {
+        if (stats) {
+            *stats = {};
+            stats->sizeMismatch = true;
+        }
+        return false;
+    }
+
+    LinearImage* mask = options.mask;
+    if (mask) {
+        *mask = LinearImage(width, height, 1);
+    }
+
+    // A difference matches if its bits are at most these, a negative epsilon matches nothing.
+    const int64_t epsilonBits = options.epsilon < 0.0f ? -1 : orderedBits(options.epsilon);
+    const size_t rowSize = size_t(width) * channels;
+    const uint32_t hchannels = std::min(channels, uint32_t(MAX_CHANNELS));
+    const uint32_t tileCount = (height + TILE_ROWS - 1) / TILE_ROWS;
+    std::vector<TileStatistics> tiles(tileCount);
+    std::atomic<bool> stop{ false };
+
+    auto diffTiles = [&](uint32_t start, uint32_t count) {
+        std::vector<float> d(rowSize);
+        for (uint32_t t = start; t < start + count; ++t) {
+            TileStatistics& tile = tiles[t];
+            const uint32_t end = std::min(height, (t + 1) * TILE_ROWS);
+            for (uint32_t row = t * TILE_ROWS; row < end; ++row) {
+                if (options.earlyOut && stop.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                float sum, sumSquares;
+                const float maxDiff = diffRow(a.getPixelRef(0, row), b.getPixelRef(0, row),
+                        d.data(), rowSize, sum, sumSquares);
+                tile.rowCount++;
+                tile.maxDiff = maxDiffOf(tile.maxDiff, maxDiff);
+                tile.sum += sum;
+                tile.sumSquares += sumSquares;
+
+                // Fast path: the row matches and all of its differences are in the first bin.
+                if (orderedBits(maxDiff) <= epsilonBits && maxDiff < FIRST_BIN_LIMIT) {
+                    for (uint32_t c = 0; c < hchannels; ++c) {
+                        tile.histogram[c][0] += width;
+                    }
+                    continue;
+                }
+
+                float* maskRow = mask ? mask->getPixelRef(0, row) : nullptr;
+                float const* p = d.data();
+                for (uint32_t x = 0; x < width; ++x, p += channels) {
+                    bool mismatch = false;
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        mismatch = mismatch || orderedBits(p[c]) > epsilonBits;
+                    }
+                    for (uint32_t c = 0; c < hchannels; ++c) {
+                        // infinities and NaNs go to the last bin
+                        const uint32_t bin = orderedBits(p[c]) >= INFINITY_BITS ?
+                                HISTOGRAM_SIZE - 1 :
+                                uint32_t(std::min(p[c] * 255.0f + 0.5f, HISTOGRAM_SIZE - 1.0f));
+                        tile.histogram[c][bin]++;
+                    }
+                    if (mismatch) {
+                        tile.mismatchCount++;
+                        if (maskRow) {
+                            maskRow[x] = 1.0f;
+                        }
+                    }
+                }
+                if (options.earlyOut && tile.mismatchCount) {
+                    stop.store(true, std::memory_order_relaxed);
+                    return;
+                }
+            }
+        }
+    };
+    parallelTiles(js, tileCount, diffTiles);
+
+    // Merge the tiles in order, so that the results don't depend on the scheduling.
+    size_t rowCount = 0;
+    size_t mismatchCount = 0;
+    float maxDiff = 0.0f;
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for (TileStatistics const& tile : tiles) {
+        rowCount += tile.rowCount;
+        mismatchCount += tile.mismatchCount;
+        maxDiff = maxDiffOf(maxDiff, tile.maxDiff);
+        sum += tile.sum;
+        sumSquares += tile.sumSquares;
+    }
+
+    if (stats) {
+        *stats = {};
+        const double n = double(rowCount) * rowSize;
+        stats->pixelCount = rowCount * width;
+        stats->mismatchCount = mismatchCount;
+        stats->maxDiff = maxDiff;
+        if (orderedBits(maxDiff) > INFINITY_BITS) {
+            stats->meanDiff = std::numeric_limits<float>::quiet_NaN();
+            stats->psnr = std::numeric_limits<double>::quiet_NaN();
+        } else {
+            stats->meanDiff = n > 0 ? float(sum / n) : 0.0f;
+            stats->psnr = sumSquares > 0 ? 10.0 * std::log10(n / sumSquares)
+                    : std::numeric_limits<double>::infinity();
+        }
+        stats->complete = rowCount == height;
+        for (TileStatistics const& tile : tiles) {
+            for (uint32_t c = 0; c < hchannels; ++c) {
+                for (size_t i = 0; i < HISTOGRAM_SIZE; ++i) {
+                    stats->histogram[c][i] += tile.histogram[c][i];
+                }
+            }
+        }
+    }
+    return mismatchCount == 0;
+}
+
+} // anonymous namespace
+
+bool diff(const LinearImage& a, const LinearImage& b, DiffOptions const& options,
+        DiffStatistics* stats) {
+    return diffImages(nullptr, a, b, options, stats);
+}
+
+bool diff(utils::JobSystem& js, const LinearImage& a, const LinearImage& b,
+        DiffOptions const& options, DiffStatistics* stats) {
+    return diffImages(&js, a, b, options, stats);
+}
+
 // TODO: Remove special treatment of 1-channel data.
 void updateOrCompare(LinearImage limgResult, const utils::Path& fnameGolden,
         ComparisonMode mode, float epsilon) {
@@ -42,6 +42,7 @@
 #include <utils/compiler.h>
 
 #include <image/ColorTransform.h>
+#include <image/ImageOps.h>
 
 using namespace filament::math;
 
@@ -69,8 +70,15 @@ private:
 
     // ImageEncoder::Encoder interface
     bool encode(const LinearImage& image) override;
+    bool encodeCompact(const CompactImage& image) override;
 
-    int chooseColorType(const LinearImage& image) const;
+    // Calls writeRows(write) between the header and the end of the file, write(data, start,
+    // count) writes the given rows of a LinearImage to the file.
+    template<typename F>
+    bool encodeImpl(uint32_t width, uint32_t height, uint32_t channels, F const& writeRows);
+    std::unique_ptr<uint8_t[]> convert(const LinearImage& image, uint32_t dstChannels) const;
+
+    int chooseColorType(uint32_t channels) const;
     uint32_t getChannelsCount(int colorType) const;
 
     static void cb_error(png_structp png, png_const_charp error);
@@ -190,6 +198,22 @@ private:
 
 bool ImageEncoder::encode(std::ostream& stream, Format format, const LinearImage& image,
         const std::string& compression, const std::string& destName) {
+    std::unique_ptr<Encoder> encoder(createEncoder(stream, format, compression, destName));
+    return encoder->encode(image);
+}
+
+bool ImageEncoder::encode(std::ostream& stream, Format format, const CompactImage& image,
+        const std::string& compression, const std::string& destName) {
+    std::unique_ptr<Encoder> encoder(createEncoder(stream, format, compression, destName));
+    return encoder->encodeCompact(image);
+}
+
+bool ImageEncoder::Encoder::encodeCompact(const CompactImage& image) {
+    return encode(toLinearImage(image));
+}
+
+ImageEncoder::Encoder* ImageEncoder::createEncoder(std::ostream& stream, Format format,
+        const std::string& compression, const std::string& destName) {
     std::unique_ptr<Encoder> encoder;
     switch(format) {
         case Format::PNG:
@@ -220,7 +244,7 @@ bool ImageEncoder::encode(std::ostream& stream, Format format, const LinearImage
             encoder.reset(DDSEncoder::create(stream, compression, DDSEncoder::PixelFormat::LINEAR_RGB));
             break;
     }
-    return encoder->encode(image);
+    return encoder.release();
 }
 
 ImageEncoder::Format ImageEncoder::chooseFormat(const std::string& name, bool forceLinear) {
@@ -293,8 +317,7 @@ void PNGEncoder::init() {
     png_set_write_fn(mPNG, this, cb_stream, nullptr);
 }
 
-int PNGEncoder::chooseColorType(const LinearImage& image) const {
-    size_t channels = image.getChannels();
+int PNGEncoder::chooseColorType(uint32_t channels) const {
     switch (channels) {
         case 1:
             return PNG_COLOR_TYPE_GRAY;
@@ -330,8 +353,56 @@ uint32_t PNGEncoder::getChannelsCount(int colorType) const {
 }
 
 bool PNGEncoder::encode(const LinearImage& image) {
-    size_t srcChannels = image.getChannels();
+    return encodeImpl(image.getWidth(), image.getHeight(), image.getChannels(),
+            [&image](auto const& write) { write(image, 0, image.getHeight()); });
+}
 
+// Compact images are converted and written in bands of rows, so that we never need a float copy
+// of the whole image.
+bool PNGEncoder::encodeCompact(const CompactImage& image) {
+    const uint32_t width = image.getWidth();
+    const uint32_t height = image.getHeight();
+    const uint32_t channels = image.getChannels();
+    return encodeImpl(width, height, channels, [&](auto const& write) {
+        constexpr uint32_t BAND_HEIGHT = 64;
+        LinearImage band(width, std::min(height, BAND_HEIGHT), channels);
+        for (uint32_t y = 0; y < height; y += BAND_HEIGHT) {
+            const uint32_t count = std::min(height - y, BAND_HEIGHT);
+            for (uint32_t row = 0; row < count; row++) {
+                image.loadRow(y + row, band.getPixelRef(0, row));
+            }
+            write(band, y, count);
+        }
+    });
+}
+
+std::unique_ptr<uint8_t[]> PNGEncoder::convert(const LinearImage& image,
+        uint32_t dstChannels) const {
+    if (image.getChannels() == 1) {
+        return fromLinearToGrayscale<uint8_t>(image);
+    }
+    switch (mFormat) {
+        case PixelFormat::RGBM:
+            return fromLinearToRGBM<uint8_t>(image);
+        case PixelFormat::RGB_10_11_11_REV:
+            return fromLinearToRGB_10_11_11_REV(image);
+        case PixelFormat::sRGB:
+            if (dstChannels == 4) {
+                return fromLinearTosRGB<uint8_t, 4>(image);
+            }
+            return fromLinearTosRGB<uint8_t, 3>(image);
+        case PixelFormat::LINEAR_RGB:
+            if (dstChannels == 4) {
+                return fromLinearToRGB<uint8_t, 4>(image);
+            }
+            return fromLinearToRGB<uint8_t, 3>(image);
+    }
+    return nullptr;
+}
+
+template<typename F>
+bool PNGEncoder::encodeImpl(uint32_t width, uint32_t height, uint32_t srcChannels,
+        F const& writeRows) {
     switch (mFormat) {
         case PixelFormat::RGBM:
         case PixelFormat::RGB_10_11_11_REV:
@@ -352,9 +423,7 @@ bool PNGEncoder::encode(const LinearImage& image) {
         mInfo = png_create_info_struct(mPNG);
 
         // Write header (8 bit colour depth)
-        size_t width = image.getWidth();
-        size_t height = image.getHeight();
-        int colorType = chooseColorType(image);
+        int colorType = chooseColorType(srcChannels);
 
         png_set_IHDR(mPNG, mInfo, width, height,
                      8, colorType, PNG_INTERLACE_NONE,
@@ -368,45 +437,17 @@ bool PNGEncoder::encode(const LinearImage& image) {
 
         png_write_info(mPNG, mInfo);
 
-        std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[height]);
-        std::unique_ptr<uint8_t[]> data;
-
-        uint32_t dstChannels;
-        if (srcChannels == 1) {
-            dstChannels = 1;
-            data = fromLinearToGrayscale<uint8_t>(image);
-        } else {
-            dstChannels = getChannelsCount(colorType);
-            switch (mFormat) {
-                case PixelFormat::RGBM:
-                    data = fromLinearToRGBM<uint8_t>(image);
-                    break;
-                case PixelFormat::RGB_10_11_11_REV:
-                    data = fromLinearToRGB_10_11_11_REV(image);
-                    break;
-                case PixelFormat::sRGB:
-                    if (dstChannels == 4) {
-                        data = fromLinearTosRGB<uint8_t, 4>(image);
-                    } else {
-                        data = fromLinearTosRGB<uint8_t, 3>(image);
-                    }
-                    break;
-                case PixelFormat::LINEAR_RGB:
-                    if (dstChannels == 4) {
-                        data = fromLinearToRGB<uint8_t, 4>(image);
-                    } else {
-                        data = fromLinearToRGB<uint8_t, 3>(image);
-                    }
-                    break;
+        const uint32_t dstChannels = srcChannels == 1 ? 1 : getChannelsCount(colorType);
+        writeRows([&](const LinearImage& image, uint32_t, uint32_t count) {
+            std::unique_ptr<png_bytep[]> row_pointers(new png_bytep[count]);
+            std::unique_ptr<uint8_t[]> data = convert(image, dstChannels);
+            for (size_t y = 0; y < count; y++) {
+                row_pointers[y] = reinterpret_cast<png_bytep>
+                        (&data[y * width * dstChannels * sizeof(uint8_t)]);
             }
-        }
-
-        for (size_t y = 0; y < height; y++) {
-            row_pointers[y] = reinterpret_cast<png_bytep>
-                    (&data[y * width * dstChannels * sizeof(uint8_t)]);
-        }
+            png_write_rows(mPNG, row_pointers.get(), count);
+        });
 
-        png_write_image(mPNG, row_pointers.get());
         png_write_end(mPNG, mInfo);
         mStream.flush();
     } catch (std::runtime_error& e) {
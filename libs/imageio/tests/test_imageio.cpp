@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/ImageDecoder.h>
+#include <imageio/ImageDiffer.h>
+#include <imageio/ImageEncoder.h>
+
+#include <image/CompactImage.h>
+#include <image/ImageOps.h>
+#include <image/LinearImage.h>
+
+#include <gtest/gtest.h>
+
+#include <math/half.h>
+
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+using namespace image;
+
+class ImageIOTest : public testing::Test {};
+
+// Creates an RGB or RGBA image with smooth gradients, and a different color at each pixel.
+static LinearImage createGradient(uint32_t width, uint32_t height, uint32_t channels = 3) {
+    LinearImage image(width, height, channels);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            float* pixel = image.getPixelRef(x, y);
+            pixel[0] = float(x) / float(width - 1);
+            pixel[1] = float(y) / float(height - 1);
+            pixel[2] = 0.25f + 0.5f * pixel[0] * pixel[1];
+            if (channels == 4) {
+                pixel[3] = 1.0f - 0.5f * pixel[0];
+            }
+        }
+    }
+    return image;
+}
+
+static bool isEqual(const CompactImage& a, const CompactImage& b) {
+    auto pa = static_cast<uint8_t const*>(a.getPixelRef());
+    auto pb = static_cast<uint8_t const*>(b.getPixelRef());
+    return a.getWidth() == b.getWidth() && a.getHeight() == b.getHeight() &&
+            a.getChannels() == b.getChannels() && a.getFormat() == b.getFormat() &&
+            std::equal(pa, pa + a.getBytesPerRow() * a.getHeight(), pb);
+}
+
+static string encode(ImageEncoder::Format format, const CompactImage& image) {
+    std::ostringstream stream;
+    EXPECT_TRUE(ImageEncoder::encode(stream, format, image, "", "compact"));
+    return stream.str();
+}
+
+static string encode(ImageEncoder::Format format, const LinearImage& image) {
+    std::ostringstream stream;
+    EXPECT_TRUE(ImageEncoder::encode(stream, format, image, "", "linear"));
+    return stream.str();
+}
+
+TEST_F(ImageIOTest, CompactPng) { // NOLINT
+    // 8-bit linear PNGs round-trip exactly through the row by row compact paths.
+    CompactImage src = toCompactImage(createGradient(100, 150), CompactImage::Format::UNORM8);
+    std::istringstream in(encode(ImageEncoder::Format::PNG_LINEAR, src));
+    CompactImage decoded = ImageDecoder::decode(in, "compact.png",
+            CompactImage::Format::UNORM8, ImageDecoder::ColorSpace::LINEAR);
+    EXPECT_TRUE(isEqual(decoded, src));
+
+    // Images taller than a band of rows are encoded like their float version.
+    for (auto format : { ImageEncoder::Format::PNG, ImageEncoder::Format::RGBM }) {
+        EXPECT_EQ(encode(format, src), encode(format, toLinearImage(src)));
+    }
+
+    // sRGB PNGs are decoded like their float version.
+    const string encoded = encode(ImageEncoder::Format::PNG, src);
+    for (auto format : { CompactImage::Format::HALF, CompactImage::Format::UNORM8 }) {
+        std::istringstream compactIn(encoded);
+        std::istringstream linearIn(encoded);
+        EXPECT_TRUE(isEqual(ImageDecoder::decode(compactIn, "compact.png", format),
+                toCompactImage(ImageDecoder::decode(linearIn, "linear.png"), format)));
+    }
+}
+
+TEST_F(ImageIOTest, CompactOtherFormats) { // NOLINT
+    // The other formats go through a LinearImage, and give the same results.
+    CompactImage src = toCompactImage(createGradient(100, 150), CompactImage::Format::HALF);
+    for (auto format : { ImageEncoder::Format::HDR, ImageEncoder::Format::PSD }) {
+        const string encoded = encode(format, src);
+        EXPECT_EQ(encoded, encode(format, toLinearImage(src)));
+
+        std::istringstream compactIn(encoded);
+        std::istringstream linearIn(encoded);
+        EXPECT_TRUE(isEqual(ImageDecoder::decode(compactIn, "compact", src.getFormat()),
+                toCompactImage(ImageDecoder::decode(linearIn, "linear"), src.getFormat())));
+    }
+}
+
+// Converts a float like RowDecoder is documented to.
+template<typename T>
+static T toChannel(float v) {
+    return T(v);
+}
+
+template<>
+uint8_t toChannel(float v) {
+    return uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+template<>
+uint16_t toChannel(float v) {
+    return uint16_t(std::clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+// Decodes the image with a RowDecoder, in bands of 7 rows, and checks that the result is the
+// output of decode() converted to the given format and type.
+template<typename T>
+static void checkRowDecoder(const string& encoded, ImageDecoder::ColorSpace colorSpace,
+        ImageDecoder::PixelDataFormat format, ImageDecoder::PixelDataType type) {
+    std::istringstream in(encoded);
+    LinearImage expected = ImageDecoder::decode(in, "rows", colorSpace);
+    ASSERT_TRUE(expected.isValid());
+    const uint32_t width = expected.getWidth();
+    const uint32_t height = expected.getHeight();
+    const uint32_t srcChannels = expected.getChannels();
+    const uint32_t dstChannels = uint32_t(format) + 1;
+    ASSERT_EQ(ImageDecoder::getBytesPerPixel(format, type), dstChannels * sizeof(T));
+
+    std::istringstream rowsIn(encoded);
+    auto rows = ImageDecoder::createRowDecoder(rowsIn, "rows", colorSpace);
+    ASSERT_NE(rows, nullptr);
+    ASSERT_EQ(rows->getWidth(), width);
+    ASSERT_EQ(rows->getHeight(), height);
+    ASSERT_EQ(rows->getChannels(), srcChannels);
+    vector<T> decoded(size_t(width) * height * dstChannels);
+    while (rows->getRow() < height) {
+        ASSERT_GT(rows->decodeRows(&decoded[size_t(rows->getRow()) * width * dstChannels], 7,
+                format, type), 0u);
+    }
+    ASSERT_EQ(rows->decodeRows(decoded.data(), 1, format, type), 0u);
+
+    size_t mismatches = 0;
+    T const* pixel = decoded.data();
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x, pixel += dstChannels) {
+            float const* src = expected.getPixelRef(x, y);
+            for (uint32_t c = 0; c < dstChannels; ++c) {
+                const float v = c < srcChannels ? src[c] : (c == 3 ? 1.0f : 0.0f);
+                mismatches += toChannel<T>(v) != pixel[c];
+            }
+        }
+    }
+    EXPECT_EQ(mismatches, 0u) << "format " << int(format) << ", type " << int(type);
+}
+
+TEST_F(ImageIOTest, RowDecoderPng) { // NOLINT
+    using PixelDataFormat = ImageDecoder::PixelDataFormat;
+    using PixelDataType = ImageDecoder::PixelDataType;
+    using ColorSpace = ImageDecoder::ColorSpace;
+
+    // PNG rows are converted from their 16-bit values directly into each format and type, with
+    // the same results as converting the floats of decode().
+    for (uint32_t channels : { 3, 4 }) {
+        const string encoded = encode(ImageEncoder::Format::PNG,
+                createGradient(100, 150, channels));
+        for (auto colorSpace : { ColorSpace::SRGB, ColorSpace::LINEAR }) {
+            for (auto format : { PixelDataFormat::R, PixelDataFormat::RG, PixelDataFormat::RGB,
+                    PixelDataFormat::RGBA }) {
+                checkRowDecoder<uint8_t>(encoded, colorSpace, format, PixelDataType::UBYTE);
+                checkRowDecoder<uint16_t>(encoded, colorSpace, format, PixelDataType::USHORT);
+                checkRowDecoder<filament::math::half>(encoded, colorSpace, format,
+                        PixelDataType::HALF);
+                checkRowDecoder<float>(encoded, colorSpace, format, PixelDataType::FLOAT);
+            }
+        }
+    }
+
+    // 8-bit linear PNGs round-trip exactly, rows can be padded.
+    CompactImage src = toCompactImage(createGradient(100, 150), CompactImage::Format::UNORM8);
+    std::istringstream in(encode(ImageEncoder::Format::PNG_LINEAR, src));
+    auto rows = ImageDecoder::createRowDecoder(in, "rows.png", ColorSpace::LINEAR);
+    ASSERT_NE(rows, nullptr);
+    const uint32_t width = src.getWidth();
+    const uint32_t height = src.getHeight();
+    const size_t stride = width * 4 + 8;
+    vector<uint8_t> decoded(stride * height);
+    ASSERT_EQ(rows->decodeRows(decoded.data(), height, PixelDataFormat::RGBA,
+            PixelDataType::UBYTE, stride), height);
+    bool equal = true;
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t const* expected = static_cast<uint8_t const*>(src.getPixelRef(0, y));
+        for (uint32_t x = 0; x < width; x++) {
+            uint8_t const* pixel = &decoded[y * stride + x * 4];
+            equal = equal && std::equal(pixel, pixel + 3, expected + x * 3) && pixel[3] == 255;
+        }
+    }
+    EXPECT_TRUE(equal);
+}
+
+TEST_F(ImageIOTest, RowDecoderOtherFormats) { // NOLINT
+    using PixelDataFormat = ImageDecoder::PixelDataFormat;
+    using PixelDataType = ImageDecoder::PixelDataType;
+
+    // The other formats are decoded to floats a row at a time, then packed.
+    for (auto format : { ImageEncoder::Format::HDR, ImageEncoder::Format::PSD }) {
+        const string encoded = encode(format, createGradient(100, 150));
+        checkRowDecoder<float>(encoded, ImageDecoder::ColorSpace::SRGB, PixelDataFormat::RGB,
+                PixelDataType::FLOAT);
+        checkRowDecoder<filament::math::half>(encoded, ImageDecoder::ColorSpace::SRGB,
+                PixelDataFormat::RGBA, PixelDataType::HALF);
+        checkRowDecoder<uint8_t>(encoded, ImageDecoder::ColorSpace::SRGB, PixelDataFormat::RG,
+                PixelDataType::UBYTE);
+    }
+}
+
+TEST_F(ImageIOTest, ImageDiffer) { // NOLINT
+    // LinearImage copies share their pixels, so build two distinct images.
+    LinearImage a = createGradient(100, 100);
+    LinearImage b = createGradient(100, 100);
+    DiffStatistics stats;
+
+    EXPECT_TRUE(diff(a, b, {}, &stats));
+    EXPECT_TRUE(stats.complete);
+    EXPECT_FALSE(stats.sizeMismatch);
+    EXPECT_EQ(stats.pixelCount, 100u * 100u);
+    EXPECT_EQ(stats.mismatchCount, 0u);
+    EXPECT_EQ(stats.maxDiff, 0.0f);
+    EXPECT_GT(stats.psnr, 1000.0);
+    EXPECT_EQ(stats.histogram[0][0], 100u * 100u);
+
+    // Mismatching dimensions reset the statistics.
+    EXPECT_FALSE(diff(a, LinearImage(100, 99, a.getChannels()), {}, nullptr));
+    EXPECT_FALSE(diff(a, LinearImage(100, 100, 1), {}, &stats));
+    EXPECT_TRUE(stats.sizeMismatch);
+    EXPECT_FALSE(stats.complete);
+    EXPECT_EQ(stats.pixelCount, 0u);
+    EXPECT_EQ(stats.histogram[0][0], 0u);
+
+    // Differences in both directions are detected, and reported in the mask.
+    b.getPixelRef(10, 20)[0] += 2.0f / 255.0f;
+    b.getPixelRef(90, 80)[2] -= 0.5f;
+    LinearImage mask;
+    DiffOptions options;
+    options.epsilon = 1.0f / 255.0f;
+    options.mask = &mask;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_EQ(stats.mismatchCount, 2u);
+    EXPECT_FLOAT_EQ(stats.maxDiff, 0.5f);
+    EXPECT_EQ(stats.histogram[0][2], 1u);
+    EXPECT_EQ(stats.histogram[2][128], 1u);
+    EXPECT_EQ(stats.histogram[1][0], 100u * 100u);
+    EXPECT_NEAR(stats.psnr, 10.0 * std::log10(3.0 * 100 * 100 / (0.25 + 4.0 / 65025.0)), 1e-3);
+    ASSERT_EQ(mask.getChannels(), 1u);
+    EXPECT_EQ(*mask.getPixelRef(10, 20), 1.0f);
+    EXPECT_EQ(*mask.getPixelRef(90, 80), 1.0f);
+    EXPECT_EQ(std::count(mask.getPixelRef(), mask.getPixelRef() + 100 * 100, 1.0f), 2);
+
+    options.epsilon = 3.0f / 255.0f;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_EQ(stats.mismatchCount, 1u);
+
+    // The multi-threaded version must produce the same results.
+    utils::JobSystem js;
+    js.adopt();
+    DiffStatistics statsJs;
+    LinearImage maskJs;
+    options.mask = &maskJs;
+    EXPECT_FALSE(diff(js, a, b, options, &statsJs));
+    EXPECT_EQ(stats.mismatchCount, statsJs.mismatchCount);
+    EXPECT_EQ(stats.maxDiff, statsJs.maxDiff);
+    EXPECT_EQ(stats.meanDiff, statsJs.meanDiff);
+    EXPECT_EQ(stats.psnr, statsJs.psnr);
+    EXPECT_EQ(memcmp(stats.histogram, statsJs.histogram, sizeof(stats.histogram)), 0);
+    EXPECT_TRUE(std::equal(mask.getPixelRef(), mask.getPixelRef() + 100 * 100,
+            maskJs.getPixelRef()));
+
+    // An early out stops at the first tile with a mismatch, the statistics are partial.
+    options.earlyOut = true;
+    options.mask = nullptr;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_FALSE(stats.complete);
+    EXPECT_EQ(stats.mismatchCount, 1u);
+    EXPECT_LT(stats.pixelCount, 100u * 100u);
+    EXPECT_FALSE(diff(js, a, b, options, &statsJs));
+    EXPECT_FALSE(statsJs.complete);
+    EXPECT_GE(statsJs.mismatchCount, 1u);
+    js.emancipate();
+}
+
+TEST_F(ImageIOTest, ImageDifferNaN) { // NOLINT
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+
+    // An image full of NaNs never matches, even with a large epsilon.
+    LinearImage a(4, 4, 3);
+    LinearImage b(4, 4, 3);
+    std::fill_n(a.getPixelRef(), 4 * 4 * 3, 0.5f);
+    std::fill_n(b.getPixelRef(), 4 * 4 * 3, nan);
+    DiffOptions options;
+    options.epsilon = 1.0f;
+    DiffStatistics stats;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_EQ(stats.mismatchCount, 4u * 4u);
+    EXPECT_TRUE(std::isnan(stats.maxDiff));
+    EXPECT_TRUE(std::isnan(stats.meanDiff));
+    EXPECT_TRUE(std::isnan(stats.psnr));
+    EXPECT_EQ(stats.histogram[0][DiffStatistics::HISTOGRAM_SIZE - 1], 4u * 4u);
+
+    // A single NaN or infinity is found, and binned last.
+    std::fill_n(b.getPixelRef(), 4 * 4 * 3, 0.5f);
+    b.getPixelRef(1, 2)[1] = nan;
+    b.getPixelRef(3, 3)[2] = inf;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_EQ(stats.mismatchCount, 2u);
+    EXPECT_TRUE(std::isnan(stats.maxDiff));
+    EXPECT_EQ(stats.histogram[0][0], 4u * 4u);
+    EXPECT_EQ(stats.histogram[1][DiffStatistics::HISTOGRAM_SIZE - 1], 1u);
+    EXPECT_EQ(stats.histogram[2][DiffStatistics::HISTOGRAM_SIZE - 1], 1u);
+
+    b.getPixelRef(1, 2)[1] = 0.5f;
+    EXPECT_FALSE(diff(a, b, options, &stats));
+    EXPECT_EQ(stats.mismatchCount, 1u);
+    EXPECT_EQ(stats.maxDiff, inf);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MATH_MAT34_H_
+#define MATH_MAT34_H_
+
+#include <math/compiler.h>
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace filament {
+namespace math {
+// -------------------------------------------------------------------------------------
+namespace details {
+
+/**
+ * A 3x4 row-major matrix class, representing an affine transform.
+ *
+ * This is a 4x4 matrix whose last row is implicitly (0, 0, 0, 1), only the first
+ * three rows are stored:
+ *
+ * mat34 m =
+ *      \f$
+ *      \left(
+ *      \begin{array}{c}
+ *      m[0] \\
+ *      m[1] \\
+ *      m[2] \\
+ *      \end{array}
+ *      \right)
+ *      \f$
+ *      =
+ *      \f$
+ *      \left(
+ *      \begin{array}{cccc}
+ *      m[0][0] & m[0][1] & m[0][2] & m[0][3] \\
+ *      m[1][0] & m[1][1] & m[1][2] & m[1][3] \\
+ *      m[2][0] & m[2][1] & m[2][2] & m[2][3] \\
+ *      0 & 0 & 0 & 1 \\
+ *      \end{array}
+ *      \right)
+ *      \f$
+ *
+ * m[n] is the \f$ n^{th} \f$ *row* of the matrix and is a vec4, unlike TMat44 where m[n]
+ * is a column. m[n][3] is the translation.
+ *
+ * Storing rows rather than columns allows all operations to be expressed as 4-wide vector
+ * operations, which the compiler maps directly to SIMD instructions. TMat34 takes 3/4 of the
+ * space of a TMat44, which matters when large arrays of transforms are processed.
+ */
+template<typename T>
+class MATH_EMPTY_BASES TMat34 {
+public:
+    typedef T value_type;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef size_t size_type;
+    typedef TVec4<T> row_type;
+    typedef TVec3<T> col_type;
+
+    static constexpr size_t NUM_ROWS = 3;
+    static constexpr size_t NUM_COLS = row_type::SIZE;
+
+private:
+    row_type m_value[NUM_ROWS];
+
+public:
+    // array access, note that this returns a row
+    inline constexpr row_type const& operator[](size_t row) const noexcept {
+        assert(row < NUM_ROWS);
+        return m_value[row];
+    }
+
+    inline constexpr row_type& operator[](size_t row) noexcept {
+        assert(row < NUM_ROWS);
+        return m_value[row];
+    }
+
+    inline constexpr T const& operator()(size_t row, size_t col) const noexcept {
+        return m_value[row][col];
+    }
+
+    /**
+     * Default constructor, initializes to identity
+     */
+    constexpr TMat34() noexcept
+            : m_value{ row_type(1, 0, 0, 0), row_type(0, 1, 0, 0), row_type(0, 0, 1, 0) } {
+    }
+
+    /**
+     * Construct from the three rows of the matrix
+     */
+    template<typename A, typename B, typename C>
+    constexpr TMat34(const TVec4<A>& r0, const TVec4<B>& r1, const TVec4<C>& r2) noexcept
+            : m_value{ row_type(r0), row_type(r1), row_type(r2) } {
+    }
+
+    /**
+     * Construct from a linear transform and a translation
+     */
+    template<typename A, typename B>
+    constexpr TMat34(const TMat33<A>& m, const TVec3<B>& t) noexcept
+            : m_value{
+                row_type(m[0][0], m[1][0], m[2][0], t[0]),
+                row_type(m[0][1], m[1][1], m[2][1], t[1]),
+                row_type(m[0][2], m[1][2], m[2][2], t[2]) } {
+    }
+
+    /**
+     * Construct from a 4x4 matrix, whose last row is assumed to be (0, 0, 0, 1).
+     */
+    template<typename A>
+    constexpr explicit TMat34(const TMat44<A>& m) noexcept
+            : m_value{
+                row_type(m[0][0], m[1][0], m[2][0], m[3][0]),
+                row_type(m[0][1], m[1][1], m[2][1], m[3][1]),
+                row_type(m[0][2], m[1][2], m[2][2], m[3][2]) } {
+    }
+
+    /**
+     * Returns the equivalent 4x4 matrix
+     */
+    constexpr TMat44<T> toMat4() const noexcept {
+        return TMat44<T>(
+                TVec4<T>(m_value[0][0], m_value[1][0], m_value[2][0], 0),
+                TVec4<T>(m_value[0][1], m_value[1][1], m_value[2][1], 0),
+                TVec4<T>(m_value[0][2], m_value[1][2], m_value[2][2], 0),
+                TVec4<T>(m_value[0][3], m_value[1][3], m_value[2][3], 1));
+    }
+
+    /**
+     * Returns the linear part of the transform as a 3x3 matrix
+     */
+    inline constexpr TMat33<T> upperLeft() const noexcept {
+        return TMat33<T>(
+                TVec3<T>(m_value[0][0], m_value[1][0], m_value[2][0]),
+                TVec3<T>(m_value[0][1], m_value[1][1], m_value[2][1]),
+                TVec3<T>(m_value[0][2], m_value[1][2], m_value[2][2]));
+    }
+
+    /**
+     * Returns the translation part of the transform
+     */
+    inline constexpr TVec3<T> translation() const noexcept {
+        return { m_value[0][3], m_value[1][3], m_value[2][3] };
+    }
+
+    /**
+     * Returns the determinant of the linear part of the transform
+     */
+    friend inline constexpr T MATH_PURE det(const TMat34& m) noexcept {
+        return dot(m[0].xyz, cross(m[1].xyz, m[2].xyz));
+    }
+
+    /**
+     * Multiplies two affine transforms, i.e. (lhs * rhs).
+     * Each row of the result is a linear combination of the rows of rhs.
+     */
+    friend inline constexpr TMat34 MATH_PURE operator*(
+            const TMat34& lhs, const TMat34& rhs) noexcept {
+        TMat34 r{};
+        for (size_t i = 0; i < NUM_ROWS; i++) {
+            const row_type a = lhs[i];
+            r[i] = rhs[0] * a[0] + rhs[1] * a[1] + rhs[2] * a[2] + row_type{ 0, 0, 0, a[3] };
+        }
+        return r;
+    }
+
+    /**
+     * Transforms a vector, v.w is passed through unchanged
+     */
+    template<typename U>
+    friend inline constexpr TVec4<U> MATH_PURE operator*(
+            const TMat34& lhs, const TVec4<U>& v) noexcept {
+        return { dot(lhs[0], v), dot(lhs[1], v), dot(lhs[2], v), v[3] };
+    }
+
+    /**
+     * Transforms a point, result is (m * {v, 1}).xyz
+     */
+    template<typename U>
+    friend inline constexpr TVec3<U> MATH_PURE operator*(
+            const TMat34& lhs, const TVec3<U>& v) noexcept {
+        return (lhs * TVec4<U>{ v, 1 }).xyz;
+    }
+
+    /**
+     * Inverse of an affine transform. The linear part must be invertible.
+     * The rows of the inverse of the linear part are the cross products of its columns,
+     * scaled by 1/det. The translation of the inverse is -(inverse(linear) * t).
+     */
+    friend inline constexpr TMat34 MATH_PURE inverse(const TMat34& m) noexcept {
+        const TVec3<T> c0 = { m[0][0], m[1][0], m[2][0] };
+        const TVec3<T> c1 = { m[0][1], m[1][1], m[2][1] };
+        const TVec3<T> c2 = { m[0][2], m[1][2], m[2][2] };
+        const TVec3<T> t  = { m[0][3], m[1][3], m[2][3] };
+        const TVec3<T> r0 = cross(c1, c2);
+        const TVec3<T> r1 = cross(c2, c0);
+        const TVec3<T> r2 = cross(c0, c1);
+        const T invDet = T(1) / dot(c0, r0);
+        return TMat34(
+                row_type{ r0, -dot(r0, t) } * invDet,
+                row_type{ r1, -dot(r1, t) } * invDet,
+                row_type{ r2, -dot(r2, t) } * invDet);
+    }
+
+    friend inline constexpr bool operator==(const TMat34& lhs, const TMat34& rhs) noexcept {
+        return all(equal(lhs[0], rhs[0])) && all(equal(lhs[1], rhs[1])) &&
+               all(equal(lhs[2], rhs[2]));
+    }
+
+    friend inline constexpr bool operator!=(const TMat34& lhs, const TMat34& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+}  // namespace details
+
+// ----------------------------------------------------------------------------------------
+
+typedef details::TMat34<double> mat34;
+typedef details::TMat34<float> mat34f;
+
+// ----------------------------------------------------------------------------------------
+}  // namespace math
+}  // namespace filament
+
+#endif  // MATH_MAT34_H_
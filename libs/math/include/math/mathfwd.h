@@ -28,6 +28,7 @@
 #include <math/mat2.h>
 #include <math/mat3.h>
 #include <math/mat4.h>
+#include <math/mat34.h>
 
 #else
 
@@ -44,6 +45,7 @@ template<typename T> class TVec4;
 template<typename T> class TMat22;
 template<typename T> class TMat33;
 template<typename T> class TMat44;
+template<typename T> class TMat34;
 
 }  // namespace details
 
@@ -86,6 +88,9 @@ using mat3f     = details::TMat33<float>;
 using mat4      = details::TMat44<double>;
 using mat4f     = details::TMat44<float>;
 
+using mat34     = details::TMat34<double>;
+using mat34f    = details::TMat34<float>;
+
 }  // namespace math
 }  // namespace filament
 
@@ -23,6 +23,7 @@
 #include <math/mat2.h>
 #include <math/mat4.h>
 #include <math/mat3.h>
+#include <math/mat34.h>
 #include <math/quat.h>
 #include <math/scalar.h>
 
@@ -429,6 +430,71 @@ TEST_F(Mat2Test, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+//------------------------------------------------------------------------------
+// MAT 3x4
+//------------------------------------------------------------------------------
+
+class Mat34Test : public testing::Test {
+protected:
+};
+
+TEST_F(Mat34Test, Basics) {
+    EXPECT_EQ(sizeof(mat34f), sizeof(float)*12);
+    EXPECT_EQ(mat4f(), mat34f().toMat4());
+}
+
+TEST_F(Mat34Test, Conversions) {
+    const mat4 m = mat4::translation(double3{ 1, 2, 3 }) *
+                   mat4::rotation(0.5, double3{ 0, 1, 0 }) *
+                   mat4::scaling(double3{ 2, 3, 4 });
+    const mat34 a(m);
+    EXPECT_EQ(m, a.toMat4());
+    EXPECT_EQ(m.upperLeft(), a.upperLeft());
+    EXPECT_EQ(double3(1, 2, 3), a.translation());
+    EXPECT_EQ(a, mat34(m.upperLeft(), double3(1, 2, 3)));
+    EXPECT_EQ(m[0][1], a(1, 0));
+    EXPECT_FLOAT_EQ(det(m), det(a));
+}
+
+TEST_F(Mat34Test, MiscOps) {
+    const mat4 m0 = mat4::translation(double3{ 1, 2, 3 }) *
+                    mat4::rotation(0.5, double3{ 0, 1, 0 }) *
+                    mat4::scaling(double3{ 2, 3, 4 });
+    const mat4 m1 = mat4::translation(double3{ -4, 5, 0.5 }) *
+                    mat4::rotation(-1.2, normalize(double3{ 1, 1, 0 }));
+    const mat34 a0(m0);
+    const mat34 a1(m1);
+
+    const mat4 p = m0 * m1;
+    const mat4 q = (a0 * a1).toMat4();
+    for (size_t c = 0; c < 4; c++) {
+        for (size_t r = 0; r < 4; r++) {
+            EXPECT_NEAR(p[c][r], q[c][r], 1e-12);
+        }
+    }
+
+    const double4 v{ 3, -2, 7, 1 };
+    const double4 pv = m0 * v;
+    const double4 qv = a0 * v;
+    const double3 qp = a0 * v.xyz;
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_NEAR(pv[i], qv[i], 1e-12);
+    }
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_NEAR(pv[i], qp[i], 1e-12);
+    }
+
+    const mat4 pi = inverse(m0);
+    const mat4 qi = inverse(a0).toMat4();
+    const mat4 identity = (a0 * inverse(a0)).toMat4();
+    for (size_t c = 0; c < 4; c++) {
+        for (size_t r = 0; r < 4; r++) {
+            EXPECT_NEAR(pi[c][r], qi[c][r], 1e-12);
+            EXPECT_NEAR(mat4()[c][r], identity[c][r], 1e-12);
+        }
+    }
+}
+
 //------------------------------------------------------------------------------
 // MORE MATRIX TESTS
 //------------------------------------------------------------------------------
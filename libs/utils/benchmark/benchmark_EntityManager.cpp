@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <utils/Entity.h>
+#include <utils/EntityManager.h>
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+using namespace utils;
+
+// each thread creates and destroys batches of state.range(0) entities
+static void BM_EntityManager_CreateDestroy(benchmark::State& state) {
+    EntityManager& em = EntityManager::get();
+    std::vector<Entity> entities(state.range(0));
+    PerformanceCounters pc(state);
+    for (auto _ : state) {
+        em.create(entities.size(), entities.data());
+        em.destroy(entities.size(), entities.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * entities.size());
+}
+
+// each thread creates and destroys entities one at a time
+static void BM_EntityManager_CreateDestroySingle(benchmark::State& state) {
+    EntityManager& em = EntityManager::get();
+    std::vector<Entity> entities(state.range(0));
+    PerformanceCounters pc(state);
+    for (auto _ : state) {
+        for (Entity& e : entities) {
+            e = em.create();
+        }
+        for (Entity e : entities) {
+            em.destroy(e);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * entities.size());
+}
+
+BENCHMARK(BM_EntityManager_CreateDestroy)
+    ->Arg(1)
+    ->Arg(64)
+    ->Arg(1024)
+    ->Threads(1)
+    ->Threads(2)
+    ->Threads(8)
+    ->ThreadPerCpu();
+
+BENCHMARK(BM_EntityManager_CreateDestroySingle)
+    ->Arg(64)
+    ->Threads(1)
+    ->Threads(2)
+    ->Threads(8)
+    ->ThreadPerCpu();
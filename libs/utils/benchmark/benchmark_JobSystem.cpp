@@ -21,6 +21,15 @@
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
 using namespace utils;
 
 
@@ -78,7 +87,240 @@ static void BM_JobSystemParallelFor(benchmark::State& state) {
     js.emancipate();
 }
 
+// The benchmarks below take the number of threads in the pool as argument
+
+static void BM_JobSystemAsChildren16k(benchmark::State& state) {
+    JobSystem js(state.range(0));
+    js.adopt();
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            // this needs more jobs than a single job pool can hold
+            auto root = js.create(nullptr, &emptyJob);
+            for (size_t i = 0; i < 16383; i++) {
+                js.run(js.create(root, &emptyJob), JobSystem::DONT_SIGNAL);
+            }
+            js.runAndWait(root);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * 16384);
+
+    js.emancipate();
+}
+
+static void BM_JobSystemParallelForScaling(benchmark::State& state) {
+    JobSystem js(state.range(0));
+    js.adopt();
+
+    std::vector<float> data(1024 * 1024);
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto job = jobs::parallel_for(js, nullptr, data.data(), uint32_t(data.size()),
+                    [](float* p, uint32_t count) {
+                        for (uint32_t i = 0; i < count; i++) {
+                            p[i] = std::sqrt(p[i] * 0.5f + 1.0f);
+                        }
+                    }, jobs::CountSplitter<256, 16>());
+            js.runAndWait(job);
+            benchmark::DoNotOptimize(data.data());
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * data.size());
+
+    js.emancipate();
+}
+
+// Latency of a frame-critical parallel_for while other jobs saturate the JobSystem.
+// Argument 0: no other jobs, 1: other jobs at normal priority, 2: BACKGROUND jobs
+
+struct BackgroundLoad {
+    std::atomic_bool stop = { false };
+    uint32_t flags = 0;
+    JobSystem::Job* root = nullptr;
+
+    void work(JobSystem& js, JobSystem::Job*) {
+        // simulates a texture decode, then queue another one
+        float v = 1.0f;
+        for (size_t i = 0; i < 20000; i++) {
+            v = std::sqrt(v + 1.0f);
+        }
+        benchmark::DoNotOptimize(v);
+        if (!stop.load(std::memory_order_relaxed)) {
+            js.run(js.createJob<BackgroundLoad, &BackgroundLoad::work>(root, this), flags);
+        }
+    }
+};
+
+static void BM_JobSystemFrameLatency(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    BackgroundLoad load;
+    load.flags = state.range(0) == 2 ? JobSystem::BACKGROUND : 0;
+    load.root = js.createJob();
+    if (state.range(0)) {
+        for (size_t i = 0; i < 64; i++) {
+            js.run(js.createJob<BackgroundLoad, &BackgroundLoad::work>(load.root, &load),
+                    load.flags);
+        }
+    }
+
+    std::vector<float> data(64 * 1024);
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto job = jobs::parallel_for(js, nullptr, data.data(), uint32_t(data.size()),
+                    [](float* p, uint32_t count) {
+                        for (uint32_t i = 0; i < count; i++) {
+                            p[i] = std::sqrt(p[i] * 0.5f + 1.0f);
+                        }
+                    }, jobs::CountSplitter<256>());
+            js.runAndWait(job);
+            benchmark::DoNotOptimize(data.data());
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * data.size());
+
+    load.stop = true;
+    JobSystem::Job* root = js.runAndRetain(load.root, load.flags);
+    js.waitAndRelease(root);
+
+    js.emancipate();
+}
+
+// range(0) is 0 for the serial std:: equivalent, 1 for the JobSystem primitive
+static void BM_JobSystemParallelReduce(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    std::vector<float> data(1024 * 1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = float(i % 1024) * 0.25f;
+    }
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            float sum;
+            if (state.range(0)) {
+                sum = jobs::parallel_reduce(js, 0, uint32_t(data.size()), 0.0f,
+                        [&data](uint32_t s, uint32_t c) {
+                            return std::accumulate(data.data() + s, data.data() + s + c, 0.0f);
+                        }, std::plus<float>(), jobs::CountSplitter<4096>());
+            } else {
+                sum = std::accumulate(data.begin(), data.end(), 0.0f);
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * data.size());
+
+    js.emancipate();
+}
+
+static void BM_JobSystemParallelScan(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    std::vector<uint32_t> in(1024 * 1024);
+    std::vector<uint32_t> out(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = uint32_t(i & 1u);
+    }
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (state.range(0)) {
+                jobs::parallel_exclusive_scan(js, in.data(), out.data(), uint32_t(in.size()), 0u,
+                        std::plus<uint32_t>(), jobs::CountSplitter<4096>());
+            } else {
+                uint32_t sum = 0;
+                for (size_t i = 0; i < in.size(); i++) {
+                    out[i] = sum;
+                    sum += in[i];
+                }
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * in.size());
+
+    js.emancipate();
+}
+
+static void BM_JobSystemParallelSort(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    std::vector<uint64_t> source(256 * 1024);
+    std::mt19937_64 gen;
+    for (auto& v : source) {
+        v = gen();
+    }
+    std::vector<uint64_t> data(source.size());
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            data = source;
+            state.ResumeTiming();
+            if (state.range(0)) {
+                jobs::parallel_sort(js, data.begin(), uint32_t(data.size()),
+                        std::less<uint64_t>(), jobs::CountSplitter<8192>());
+            } else {
+                std::sort(data.begin(), data.end());
+            }
+            benchmark::DoNotOptimize(data.data());
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * data.size());
+
+    js.emancipate();
+}
+
+// A short job is handed to the worker threads, the adopted thread spins until it has run.
+// range(0) is how long (in microseconds) the workers are left idle between two round-trips,
+// i.e. whether they're still spinning or already asleep when the job arrives.
+static void BM_JobSystemRoundTripLatency(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    std::atomic<uint32_t> done = { 0 };
+    auto ping = [&done](JobSystem&, JobSystem::Job*) {
+        done.fetch_add(1, std::memory_order_release);
+    };
+    const auto idle = std::chrono::microseconds(state.range(0));
+
+    uint32_t expected = 0;
+    for (auto _ : state) {
+        auto start = std::chrono::steady_clock::now();
+        js.run(js.createJob(nullptr, ping));
+        expected++;
+        // don't help: the job must be picked up by a worker thread
+        while (done.load(std::memory_order_acquire) != expected) {
+            std::this_thread::yield();
+        }
+        auto end = std::chrono::steady_clock::now();
+        state.SetIterationTime(std::chrono::duration<double>(end - start).count());
+        std::this_thread::sleep_for(idle);
+    }
+
+    js.emancipate();
+}
 
 BENCHMARK(BM_JobSystem);
 BENCHMARK(BM_JobSystemAsChildren4k);
 BENCHMARK(BM_JobSystemParallelFor);
+BENCHMARK(BM_JobSystemAsChildren16k)->RangeMultiplier(2)->Range(8, 128)->UseRealTime();
+BENCHMARK(BM_JobSystemParallelForScaling)->RangeMultiplier(2)->Range(8, 128)->UseRealTime();
+BENCHMARK(BM_JobSystemFrameLatency)->DenseRange(0, 2)->UseRealTime();
+BENCHMARK(BM_JobSystemParallelReduce)->Arg(0)->Arg(1)->UseRealTime();
+BENCHMARK(BM_JobSystemParallelScan)->Arg(0)->Arg(1)->UseRealTime();
+BENCHMARK(BM_JobSystemParallelSort)->Arg(0)->Arg(1)->UseRealTime();
+BENCHMARK(BM_JobSystemRoundTripLatency)->Arg(0)->Arg(50)->Arg(1000)->UseManualTime();
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <utils/JobSystem.h>
+#include <utils/JobTask.h>
+
+#include <benchmark/benchmark.h>
+
+using namespace utils;
+
+#if UTILS_HAS_COROUTINES
+
+static constexpr uint32_t SPAWN_COUNT = 1024;
+
+static jobs::Task<uint32_t> child(uint32_t i) {
+    co_return i;
+}
+
+static jobs::Task<uint32_t> scheduledChild(JobSystem& js, uint32_t i) {
+    co_await jobs::schedule(js);
+    co_return i;
+}
+
+static jobs::Task<uint32_t> spawn() {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < SPAWN_COUNT; i++) {
+        sum += co_await child(i);
+    }
+    co_return sum;
+}
+
+static jobs::Task<uint32_t> spawnScheduled(JobSystem& js) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < SPAWN_COUNT; i++) {
+        sum += co_await scheduledChild(js, i);
+    }
+    co_return sum;
+}
+
+// range(0) is 0 for tasks that complete synchronously, 1 for tasks that hop to a job, and
+// 2 for plain jobs, for reference.
+static void BM_JobTaskSpawn(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (state.range(0) == 2) {
+                for (uint32_t i = 0; i < SPAWN_COUNT; i++) {
+                    js.runAndWait(js.createJob());
+                }
+            } else {
+                uint32_t sum = jobs::runAndWait(js, state.range(0) ? spawnScheduled(js) : spawn());
+                benchmark::DoNotOptimize(sum);
+            }
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * SPAWN_COUNT);
+
+    js.emancipate();
+}
+
+BENCHMARK(BM_JobTaskSpawn)->DenseRange(0, 2);
+
+#endif // UTILS_HAS_COROUTINES
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <utils/TraceRecorder.h>
+
+#include <benchmark/benchmark.h>
+
+using namespace utils;
+
+// cost of a trace scope, with the recorder disabled (0) or enabled (1)
+static void BM_TraceRecorderScope(benchmark::State& state) {
+    if (state.thread_index == 0) {
+        TraceRecorder::setEnabled(state.range(0) != 0);
+    }
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            TraceRecorder::Scope scope("BM_TraceRecorderScope");
+            benchmark::ClobberMemory();
+        }
+    }
+    if (state.thread_index == 0) {
+        TraceRecorder::setEnabled(false);
+    }
+}
+
+BENCHMARK(BM_TraceRecorderScope)
+    ->Arg(0)
+    ->Arg(1)
+    ->Threads(1)
+    ->ThreadPerCpu();
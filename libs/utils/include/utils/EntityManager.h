@@ -23,6 +23,8 @@
 #include <utils/Entity.h>
 #include <utils/compiler.h>
 
+#include <atomic>
+
 #ifndef FILAMENT_UTILS_TRACK_ENTITIES
 #define FILAMENT_UTILS_TRACK_ENTITIES false
 #endif
@@ -77,7 +79,7 @@ public:
     // Thread safe.
     bool isAlive(Entity e) const noexcept {
         assert(getIndex(e) < RAW_INDEX_COUNT);
-        return (!e.isNull()) && (getGeneration(e) == mGens[getIndex(e)]);
+        return (!e.isNull()) && (getGeneration(e) == getGenerationForIndex(getIndex(e)));
     }
 
     // registers a listener to be called when an entity is destroyed. thread safe.
@@ -87,12 +89,24 @@ public:
     // unregisters a listener.
     void unregisterListener(Listener* l) noexcept;
 
+    // By default, listeners are called synchronously by destroy(). When deferred notifications
+    // are enabled, destroyed entities are queued instead and listeners are called in a single
+    // batch by notifyListeners(), or by destroy() once a few thousand entities are pending.
+    // Disabling deferred notifications flushes the queue. filament::Engine enables them for as
+    // long as an engine exists. Thread safe.
+    void setDeferredListenerNotifications(bool enable) noexcept;
+
+    // Notifies the listeners of all the entities queued since the last call, if deferred
+    // notifications are enabled. filament::Engine calls this from its garbage collection.
+    // Thread safe.
+    void notifyListeners() noexcept;
+
 
     /* no user serviceable parts below */
 
     // current generation of the given index. Use for debugging and testing.
     uint8_t getGenerationForIndex(size_t index) const noexcept {
-        return mGens[index];
+        return mGens[index].load(std::memory_order_relaxed);
     }
     // singleton, can't be copied
     EntityManager(const EntityManager& rhs) = delete;
@@ -125,7 +139,7 @@ private:
     }
 
     // stores the generation of each index.
-    uint8_t * const mGens;
+    std::atomic<uint8_t> * const mGens;
 };
 
 } // namespace utils
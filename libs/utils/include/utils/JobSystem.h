@@ -19,8 +19,10 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <vector>
 
@@ -39,9 +41,18 @@
 namespace utils {
 
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
-    static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
-    using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
+    // Jobs are allocated from pools of JOB_POOL_SIZE jobs, new pools are added as needed.
+    // Jobs are referred to by a 15-bits index everywhere, which also bounds the reference and
+    // children counts of a job to 16 bits.
+    static constexpr size_t JOB_POOL_SIZE = 4096;
+    static constexpr size_t MAX_JOB_POOL_COUNT = 8;
+    static constexpr size_t MAX_JOB_COUNT = JOB_POOL_SIZE * MAX_JOB_POOL_COUNT - 1;
+    static_assert(MAX_JOB_COUNT <= 0x7FFF, "MAX_JOB_COUNT must be <= 0x7FFF");
+
+    // A work queue doesn't need to hold all jobs, if it's full, run() helps with the queued
+    // jobs until there is room (BACKGROUND jobs only with a background slot, otherwise it waits).
+    static constexpr size_t MAX_QUEUE_SIZE = 4096;
+    using WorkQueue = WorkStealingDequeue<uint16_t, MAX_QUEUE_SIZE>;
 
 public:
     class Job;
@@ -69,10 +80,13 @@ public:
                                                                 // v7 | v8
         void* storage[JOB_STORAGE_SIZE_WORDS];                  // 48 | 48
         JobFunc function;                                       //  4 |  8
-        uint16_t parent;                                        //  2 |  2
+        uint16_t parent : 15;                                   //  2 |  2
+        uint16_t hasContinuation : 1;                           //    |
         std::atomic<uint16_t> runningJobCount = { 1 };          //  2 |  2
         mutable std::atomic<uint16_t> refCount = { 1 };         //  2 |  2
-                                                                //  6 |  2 (padding)
+        uint16_t id : 15;                                       //  2 |  2
+        uint16_t background : 1;                                //    |
+                                                                //  4 |  0 (padding)
                                                                 // 64 | 64
     };
 
@@ -225,6 +239,15 @@ public:
      */
     void cancel(Job*& job) noexcept;
 
+    /*
+     * Sets a job to be run once 'job' and all its children have completed, with the same
+     * priority as 'job'. This is how a job can be awaited without blocking a thread.
+     *
+     * 'job' can have only one continuation, which must be set before 'job' is run.
+     * The continuation must not be run otherwise.
+     */
+    void setContinuation(Job* job, Job* continuation) noexcept;
+
     /*
      * Adds a reference to a Job.
      *
@@ -250,13 +273,18 @@ public:
      * Add job to this thread's execution queue. It's reference will drop automatically.
      * Current thread must be owned by JobSystem's thread pool. See adopt().
      *
+     * BACKGROUND jobs are only executed when no other jobs are waiting, and by at most
+     * getMaxBackgroundThreadCount() threads at a time. Use this for work that doesn't need to
+     * finish within a frame (e.g. texture decoding). Jobs run from a BACKGROUND job are
+     * BACKGROUND jobs too.
+     *
      * The job can't be used after this call.
      */
-    enum runFlags { DONT_SIGNAL = 0x1 };
+    enum runFlags { DONT_SIGNAL = 0x1, BACKGROUND = 0x2 };
     void run(Job*& job, uint32_t flags = 0) noexcept;
     void run(Job*&& job, uint32_t flags = 0) noexcept { // allows run(createJob(...));
         Job* p = job;
-        run(p);
+        run(p, flags);
     }
 
     void signal() noexcept;
@@ -272,6 +300,8 @@ public:
     /*
      * Wait on a job and destroys it.
      * Current thread must be owned by JobSystem's thread pool. See adopt().
+     * While waiting, the current thread only helps with BACKGROUND jobs if the job it's waiting
+     * on is a BACKGROUND job itself, or if it's called from a BACKGROUND job.
      *
      * The job must first be obtained from runAndRetain() or retain().
      * The job can't be used after this call.
@@ -313,6 +343,21 @@ public:
         return mParallelSplitCount;
     }
 
+    // number of threads in the pool, not including adopted threads
+    size_t getThreadCount() const noexcept {
+        return mThreadCount;
+    }
+
+    /*
+     * Limits the number of threads that can run BACKGROUND jobs at the same time, so that
+     * some threads are always available for frame-critical work. By default, all threads can.
+     */
+    void setMaxBackgroundThreadCount(size_t count) noexcept;
+
+    size_t getMaxBackgroundThreadCount() const noexcept {
+        return mMaxBackgroundThreads.load(std::memory_order_relaxed);
+    }
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -327,9 +372,18 @@ private:
         }
     };
 
+    // states of ThreadState::parkState, see park() and unpark()
+    enum : uint32_t {
+        PARK_PARKED,    // the thread is (or is about to be) sleeping on the futex
+        PARK_EMPTY,     // the thread is not sleeping
+        PARK_NOTIFIED   // unpark() was called, the next park() returns immediately
+    };
+
     struct alignas(CACHELINE_SIZE) ThreadState {    // this causes 40-bytes padding
         // make sure storage is cache-line aligned
         WorkQueue workQueue;
+        alignas(CACHELINE_SIZE)
+        WorkQueue backgroundQueue;
 
         // these are not accessed by the worker threads
         alignas(CACHELINE_SIZE)     // this causes 56-bytes padding
@@ -337,6 +391,19 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t id;
+        int32_t cpu;                // cpu this thread is pinned to, or -1
+        uint16_t domainBegin;       // threads [domainBegin, domainBegin + domainSize) share
+        uint16_t domainSize;        // the same last level cache (or package) as this one
+        bool background;            // the job currently running on this thread is BACKGROUND
+        bool hasBackgroundSlot;     // this thread is accounted for in mBackgroundThreads
+        uint16_t spinCount;         // how long to spin before sleeping, adapted in idle()
+
+        // these are written by other threads to wake this one up, see idle()
+        alignas(CACHELINE_SIZE)
+        std::atomic<Job const*> waitingFor = { nullptr };   // the job this thread waits on
+        std::atomic<uint32_t> parkState = { PARK_EMPTY };   // futex word, see park()
+        std::atomic<bool> parked = { false };               // this thread is sleeping
+        std::atomic<bool> parkedForBackground = { false };  // ...and can run BACKGROUND jobs
     };
 
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
@@ -348,46 +415,75 @@ private:
     void decRef(Job const* job) noexcept;
 
     Job* allocateJob() noexcept;
+    size_t addJobPool(size_t poolCount) noexcept;
     JobSystem::ThreadState* getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
 
     void requestExit() noexcept;
     bool exitRequested() const noexcept;
     bool hasActiveJobs() const noexcept;
+    bool hasActiveBackgroundJobs() const noexcept;
+    bool hasWork(JobSystem::ThreadState const& state, bool allowBackground) const noexcept;
+    bool acquireBackgroundSlot() noexcept;
+    void releaseBackgroundSlot() noexcept;
 
     void loop(ThreadState* state) noexcept;
-    bool execute(JobSystem::ThreadState& state) noexcept;
-    Job* steal(JobSystem::ThreadState& state) noexcept;
+    bool execute(JobSystem::ThreadState& state, bool allowBackground) noexcept;
+    bool executeBackground(JobSystem::ThreadState& state, bool allowSteal) noexcept;
+    Job* steal(JobSystem::ThreadState& state, bool background) noexcept;
+    void call(JobSystem::ThreadState& state, Job* job, bool background) noexcept;
     void finish(Job* job) noexcept;
 
+    Job* getJob(size_t index) const noexcept {
+        assert(index < MAX_JOB_COUNT);
+        return mJobStorage[index / JOB_POOL_SIZE] + (index % JOB_POOL_SIZE);
+    }
+
+    uint16_t& getContinuation(Job const* job) const noexcept {
+        return mContinuations[job->id / JOB_POOL_SIZE][job->id % JOB_POOL_SIZE];
+    }
+
     void put(WorkQueue& workQueue, Job* job) noexcept {
-        size_t index = job - mJobStorageBase;
-        assert(index >= 0 && index < MAX_JOB_COUNT);
+        size_t index = job->id;
+        assert(index < MAX_JOB_COUNT);
         workQueue.push(uint16_t(index + 1));
     }
 
     Job* pop(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.pop();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : &mJobStorageBase[index - 1];
+        return !index ? nullptr : getJob(index - 1);
     }
 
     Job* steal(WorkQueue& workQueue) noexcept {
         size_t index = workQueue.steal();
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : &mJobStorageBase[index - 1];
+        return !index ? nullptr : getJob(index - 1);
     }
 
-    void wait(std::unique_lock<Mutex>& lock) noexcept;
-    void wake() noexcept;
+    bool idle(ThreadState& state, Job const* job, bool allowBackground) noexcept;
+    void park(ThreadState& state) noexcept;
+    void unpark(ThreadState& state) noexcept;
+    void wake(ThreadState const* from, size_t count, bool background) noexcept;
+    void wakeWaiters(Job const* job) noexcept;
 
     // these have thread contention, keep them together
+    std::atomic<uint32_t> mParkedThreads = { 0 };   // threads sleeping in idle()
+#if !defined(__linux__)
+    // without futexes, sleeping threads share a condition
     utils::Mutex mWaiterLock;
     utils::Condition mWaiterCondition;
-    uint32_t mWaiterCount = 0;
+#endif
 
     std::atomic<uint32_t> mActiveJobs = { 0 };
-    utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock> mJobPool;
+    std::atomic<uint32_t> mActiveBackgroundJobs = { 0 };
+    std::atomic<uint32_t> mBackgroundThreads = { 0 };   // threads currently running BACKGROUND jobs
+
+    using JobPool = utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock>;
+    std::atomic<uint32_t> mJobPoolCount = { 0 };
+    std::unique_ptr<JobPool> mJobPools[MAX_JOB_POOL_COUNT];
+    std::unique_ptr<uint16_t[]> mContinuations[MAX_JOB_POOL_COUNT];    // id of each continuation
+    utils::Mutex mJobPoolLock;  // only taken when adding a pool
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -402,9 +498,11 @@ private:
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { false };       // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
-    Job* const mJobStorageBase;                         // Base for conversion to indices
+    std::atomic<uint32_t> mMaxBackgroundThreads = { 0 }; // this one is almost never written
+    Job* mJobStorage[MAX_JOB_POOL_COUNT] = {};          // Bases for conversion to indices
     uint16_t mThreadCount = 0;                          // total # of threads in the pool
     uint8_t mParallelSplitCount = 0;                    // # of split allowable in parallel_for
+    uint16_t mMaxSpinCount = 0;                         // max # of spins before sleeping
     Job* mRootJob = nullptr;
 
     utils::SpinLock mThreadMapLock; // this should have very little contention
@@ -597,6 +695,191 @@ public:
     }
 };
 
+namespace details {
+
+// size of the chunks a range of count items is cut into, once split as much as splitter allows
+template<typename S>
+uint32_t getChunkSize(uint32_t count, const S& splitter) noexcept {
+    uint32_t c = count;
+    uint8_t s = 0;
+    while (splitter.split(s, c)) {
+        c /= 2u;
+        ++s;
+    }
+    return std::max(c, 1u);
+}
+
+// calls chunk(index, start, count) for each chunk of [start, start + count) in parallel, and
+// waits for all of them.
+template<typename F>
+void parallel_chunks(JobSystem& js, uint32_t start, uint32_t count, uint32_t chunkSize,
+        const F& chunk) {
+    const uint32_t chunkCount = (count + chunkSize - 1u) / chunkSize;
+    auto task = [&chunk, start, count, chunkSize](uint32_t first, uint32_t n) {
+        for (uint32_t i = first; i < first + n; i++) {
+            const uint32_t s = i * chunkSize;
+            chunk(i, start + s, std::min(chunkSize, count - s));
+        }
+    };
+    JobSystem::Job* job = nullptr;
+    if (chunkCount > 1u) {
+        job = parallel_for(js, nullptr, 0, chunkCount, task, CountSplitter<1, 16>());
+    }
+    if (UTILS_LIKELY(job)) {
+        js.runAndWait(job);
+    } else {
+        // a single chunk, or we couldn't create a job
+        task(0, chunkCount);
+    }
+}
+
+} // namespace details
+
+/*
+ * The primitives below run their jobs and wait for them, so unlike parallel_for(), they must be
+ * called from a thread known to the JobSystem (i.e. one of its own threads, or an adopted one).
+ *
+ * The range is cut into chunks of the size the splitter allows, chunks are then distributed
+ * to the threads by work-stealing. A range that doesn't split is processed on the calling
+ * thread, without creating any job.
+ *
+ * They allocate their temporaries and call the given functions, so they aren't noexcept.
+ * Exceptions can only propagate from the calling thread though: one thrown from a job terminates.
+ */
+
+/*
+ * Reduces [start, start + count) in parallel: map(start, count) returns the value of a chunk,
+ * and these values are combined in order with reduce(T, T). reduce must be associative, but
+ * doesn't need to be commutative, and the result doesn't depend on the number of threads.
+ * Returns identity if count is 0. T must be default-constructible.
+ */
+template<typename T, typename S, typename M, typename R>
+T parallel_reduce(JobSystem& js, uint32_t start, uint32_t count, T identity,
+        M map, R reduce, const S& splitter) {
+    const uint32_t chunkSize = details::getChunkSize(count, splitter);
+    if (count <= chunkSize) {
+        return count ? reduce(std::move(identity), map(start, count)) : identity;
+    }
+    std::vector<T> partials((count + chunkSize - 1u) / chunkSize);
+    details::parallel_chunks(js, start, count, chunkSize,
+            [&partials, &map](uint32_t i, uint32_t s, uint32_t c) {
+                partials[i] = map(s, c);
+            });
+    T result = std::move(identity);
+    for (T& partial : partials) {
+        result = reduce(std::move(result), std::move(partial));
+    }
+    return result;
+}
+
+/*
+ * Prefix scan of [start, start + count) in parallel, e.g. for stream compaction.
+ *
+ * map(start, count) returns the total of a chunk; these totals are then scanned in order with
+ * reduce(T, T), starting from init, which gives each chunk the total of everything before it.
+ * Finally, scan(start, count, prefix) is called for each chunk with that prefix, and must
+ * return prefix combined with the chunk's total. reduce must be associative.
+ *
+ * Returns the total of the whole range, combined with init.
+ * T must be default-constructible.
+ */
+template<typename T, typename S, typename M, typename R, typename F>
+T parallel_scan(JobSystem& js, uint32_t start, uint32_t count, T init,
+        M map, R reduce, F scan, const S& splitter) {
+    const uint32_t chunkSize = details::getChunkSize(count, splitter);
+    if (count <= chunkSize) {
+        return count ? scan(start, count, std::move(init)) : init;
+    }
+    std::vector<T> prefixes((count + chunkSize - 1u) / chunkSize);
+    details::parallel_chunks(js, start, count, chunkSize,
+            [&prefixes, &map](uint32_t i, uint32_t s, uint32_t c) {
+                prefixes[i] = map(s, c);
+            });
+    T total = std::move(init);
+    for (T& prefix : prefixes) {
+        T chunkTotal = std::move(prefix);
+        prefix = total;
+        total = reduce(std::move(total), std::move(chunkTotal));
+    }
+    details::parallel_chunks(js, start, count, chunkSize,
+            [&prefixes, &scan](uint32_t i, uint32_t s, uint32_t c) {
+                scan(s, c, prefixes[i]);
+            });
+    return total;
+}
+
+// out[i] = init op in[0] op ... op in[i - 1], returns the total. in and out can be the same.
+template<typename T, typename S, typename R>
+T parallel_exclusive_scan(JobSystem& js, T const* in, T* out, uint32_t count, T init,
+        R op, const S& splitter) {
+    return parallel_scan(js, 0, count, std::move(init),
+            [in, &op](uint32_t s, uint32_t c) {
+                T sum = in[s];
+                for (uint32_t i = s + 1; i < s + c; i++) {
+                    sum = op(sum, in[i]);
+                }
+                return sum;
+            },
+            op,
+            [in, out, &op](uint32_t s, uint32_t c, T sum) {
+                for (uint32_t i = s; i < s + c; i++) {
+                    T const v = in[i];
+                    out[i] = sum;
+                    sum = op(sum, v);
+                }
+                return sum;
+            }, splitter);
+}
+
+// out[i] = init op in[0] op ... op in[i], returns the total. in and out can be the same.
+template<typename T, typename S, typename R>
+T parallel_inclusive_scan(JobSystem& js, T const* in, T* out, uint32_t count, T init,
+        R op, const S& splitter) {
+    return parallel_scan(js, 0, count, std::move(init),
+            [in, &op](uint32_t s, uint32_t c) {
+                T sum = in[s];
+                for (uint32_t i = s + 1; i < s + c; i++) {
+                    sum = op(sum, in[i]);
+                }
+                return sum;
+            },
+            op,
+            [in, out, &op](uint32_t s, uint32_t c, T sum) {
+                for (uint32_t i = s; i < s + c; i++) {
+                    sum = op(sum, in[i]);
+                    out[i] = sum;
+                }
+                return sum;
+            }, splitter);
+}
+
+/*
+ * Sorts [first, first + count) in parallel. The chunks are sorted with std::sort, then merged
+ * pairwise with std::inplace_merge, each round of merges running in parallel.
+ * Like std::sort, this is not a stable sort. std::inplace_merge may allocate a temporary
+ * buffer, and the comparator may throw, so this is not noexcept.
+ */
+template<typename I, typename S, typename C>
+void parallel_sort(JobSystem& js, I first, uint32_t count, C comp, const S& splitter) {
+    const uint32_t chunkSize = details::getChunkSize(count, splitter);
+    details::parallel_chunks(js, 0, count, chunkSize,
+            [first, &comp](uint32_t, uint32_t s, uint32_t c) {
+                std::sort(first + s, first + (s + c), comp);
+            });
+    for (uint64_t width = chunkSize; width < count; width *= 2u) {
+        const uint32_t pairCount = uint32_t((count + 2u * width - 1u) / (2u * width));
+        details::parallel_chunks(js, 0, pairCount, 1,
+                [first, count, width, &comp](uint32_t, uint32_t i, uint32_t) {
+                    const uint64_t s = uint64_t(i) * 2u * width;
+                    const uint64_t m = std::min<uint64_t>(s + width, count);
+                    const uint64_t e = std::min<uint64_t>(s + 2u * width, count);
+                    if (m < e) {
+                        std::inplace_merge(first + s, first + m, first + e, comp);
+                    }
+                });
+    }
+}
+
 } // namespace jobs
 } // namespace utils
 
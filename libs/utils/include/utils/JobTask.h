@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_JOBTASK_H
+#define TNT_UTILS_JOBTASK_H
+
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
+
+#include <stddef.h>
+
+// Tasks need C++20 coroutines, the rest of this header is available regardless.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#   if __has_include(<coroutine>)
+#       define UTILS_HAS_COROUTINES 1
+#   endif
+#endif
+#ifndef UTILS_HAS_COROUTINES
+#   define UTILS_HAS_COROUTINES 0
+#endif
+
+#if UTILS_HAS_COROUTINES
+#   include <atomic>
+#   include <coroutine>
+#   include <exception>
+#   include <optional>
+#   include <utility>
+#endif
+
+namespace utils {
+namespace jobs {
+
+namespace details {
+
+// Coroutine frames are allocated from lock-free pools, one per size class, so that starting a
+// task doesn't normally allocate. A frame can be freed on any thread.
+UTILS_PUBLIC void* allocateTaskFrame(size_t size) noexcept;
+UTILS_PUBLIC void freeTaskFrame(void* p, size_t size) noexcept;
+
+} // namespace details
+
+#if UTILS_HAS_COROUTINES
+
+/*
+ * Task<T> is a coroutine that runs on a JobSystem.
+ *
+ * A task doesn't start until it is co_await'ed by another task, or passed to runAndWait().
+ * It then runs on the thread that started it, until it suspends on one of:
+ *
+ *   co_await task;                     // another task, which runs until it suspends
+ *   co_await jobs::schedule(js);       // resumes in a job, i.e. on any JobSystem thread
+ *   co_await jobs::run(js, job);       // runs the job, resumes when it and its children are done
+ *   co_await event;                    // resumes when the jobs::Event is signaled
+ *
+ * A suspended task doesn't hold a thread: the thread that started it moves on, and later the
+ * task is resumed by whichever thread completes what it waited for.
+ *
+ *   jobs::Task<Asset*> load(JobSystem& js, const char* path) {
+ *       Data data = co_await read(js, path);
+ *       co_await jobs::run(js, jobs::parallel_for(js, nullptr, ...decode data...));
+ *       co_return upload(data);
+ *   }
+ *
+ *   Asset* asset = jobs::runAndWait(js, load(js, "asset.glb"));
+ *
+ * Tasks are move-only, destroying a Task destroys its coroutine, which must not be running.
+ */
+template<typename T = void>
+class Task;
+
+namespace details {
+
+struct TaskPromiseBase {
+    // resumed when the task completes...
+    std::coroutine_handle<> continuation;
+    // ...otherwise this job is run when the task completes, see runAndWait()
+    JobSystem* js = nullptr;
+    JobSystem::Job* completion = nullptr;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            TaskPromiseBase& promise = handle.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            if (promise.completion) {
+                // the task can be destroyed as soon as this job runs, don't touch it after
+                JobSystem::Job* completion = promise.completion;
+                promise.js->run(completion);
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() const noexcept { std::terminate(); }
+
+    static void* operator new(size_t size) {
+        return allocateTaskFrame(size);
+    }
+
+    static void operator delete(void* p, size_t size) noexcept {
+        freeTaskFrame(p, size);
+    }
+};
+
+template<typename T>
+struct TaskPromise : public TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+        return std::move(*value);
+    }
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+    void result() const noexcept {}
+};
+
+} // namespace details
+
+template<typename T>
+class Task {
+public:
+    using promise_type = details::TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+
+    Task(Task&& rhs) noexcept : mHandle(std::exchange(rhs.mHandle, {})) {
+    }
+
+    Task& operator=(Task&& rhs) noexcept {
+        std::swap(mHandle, rhs.mHandle);
+        return *this;
+    }
+
+    ~Task() noexcept {
+        if (mHandle) {
+            mHandle.destroy();
+        }
+    }
+
+    bool done() const noexcept {
+        return !mHandle || mHandle.done();
+    }
+
+    struct Awaiter {
+        handle_type handle;
+
+        bool await_ready() const noexcept {
+            return !handle || handle.done();
+        }
+
+        // start the task right away, it resumes us when it completes
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() {
+            return handle.promise().result();
+        }
+    };
+
+    Awaiter operator co_await() noexcept {
+        return { mHandle };
+    }
+
+private:
+    friend promise_type;
+
+    template<typename U>
+    friend U runAndWait(JobSystem& js, Task<U> task);
+
+    explicit Task(handle_type handle) noexcept : mHandle(handle) {
+    }
+
+    handle_type mHandle;
+};
+
+template<typename T>
+Task<T> details::TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> details::TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+/*
+ * Starts a task and waits for it to complete, running jobs in the meantime.
+ * Current thread must be owned by JobSystem's thread pool. See JobSystem::adopt().
+ */
+template<typename T>
+T runAndWait(JobSystem& js, Task<T> task) {
+    JobSystem::Job* done = js.createJob();
+    // 'done' can't complete before this child, which runs when the task completes
+    task.mHandle.promise().js = &js;
+    task.mHandle.promise().completion = js.createJob(done);
+    task.mHandle.resume();
+    js.runAndWait(done);
+    return task.mHandle.promise().result();
+}
+
+namespace details {
+
+struct ScheduleAwaiter {
+    JobSystem& js;
+    uint32_t flags;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        // this awaiter lives in the coroutine frame, which can be gone when run() returns
+        js.run(js.createJob(nullptr, [handle](JobSystem&, JobSystem::Job*) {
+            handle.resume();
+        }), flags);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct JobAwaiter {
+    JobSystem& js;
+    JobSystem::Job* job;
+    uint32_t flags;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept {
+        // No thread waits for the job, the task is resumed by its continuation, which runs
+        // once the job and its children are done.
+        js.setContinuation(job, js.createJob(nullptr, [handle](JobSystem&, JobSystem::Job*) {
+            handle.resume();
+        }));
+        js.run(job, flags);
+    }
+
+    void await_resume() const noexcept {}
+};
+
+} // namespace details
+
+// co_await schedule(js) resumes the task in a new job, i.e. on one of the JobSystem's threads.
+inline details::ScheduleAwaiter schedule(JobSystem& js, uint32_t flags = 0) noexcept {
+    return { js, flags };
+}
+
+// co_await run(js, job) runs the job and resumes the task once the job and its children are done.
+[[nodiscard]]
+inline details::JobAwaiter run(JobSystem& js, JobSystem::Job* job, uint32_t flags = 0) noexcept {
+    return { js, job, flags };
+}
+
+/*
+ * An Event resumes the tasks waiting on it when it is signaled, e.g. when a resource becomes
+ * available. Tasks co_await'ing a signaled Event don't suspend. Each waiting task is resumed
+ * in its own job, so signal() must be called from a thread owned by the JobSystem.
+ */
+class Event {
+    struct Awaiter {
+        Event const& event;
+        std::coroutine_handle<> handle;
+        Awaiter* next = nullptr;
+
+        bool await_ready() const noexcept {
+            return event.isSignaled();
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) noexcept {
+            handle = h;
+            void* state = event.mState.load(std::memory_order_acquire);
+            do {
+                if (state == &event) {
+                    // signaled in the meantime, don't suspend
+                    return false;
+                }
+                next = static_cast<Awaiter*>(state);
+            } while (!event.mState.compare_exchange_weak(state, this,
+                    std::memory_order_release, std::memory_order_acquire));
+            return true;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+public:
+    explicit Event(JobSystem& js, bool signaled = false) noexcept
+            : mJobSystem(js), mState(signaled ? this : nullptr) {
+    }
+
+    Event(Event const&) = delete;
+    Event& operator=(Event const&) = delete;
+
+    bool isSignaled() const noexcept {
+        return mState.load(std::memory_order_acquire) == this;
+    }
+
+    void signal() noexcept {
+        void* state = mState.exchange(this, std::memory_order_acq_rel);
+        if (state == this) {
+            return;
+        }
+        JobSystem& js = mJobSystem;
+        for (Awaiter* awaiter = static_cast<Awaiter*>(state); awaiter;) {
+            // the awaiter lives in its coroutine frame, which can be gone once it's resumed
+            Awaiter* const next = awaiter->next;
+            std::coroutine_handle<> handle = awaiter->handle;
+            js.run(js.createJob(nullptr, [handle](JobSystem&, JobSystem::Job*) {
+                handle.resume();
+            }));
+            awaiter = next;
+        }
+    }
+
+    // only allowed when no task is waiting
+    void reset() noexcept {
+        void* state = this;
+        mState.compare_exchange_strong(state, nullptr, std::memory_order_relaxed);
+    }
+
+    Awaiter operator co_await() const noexcept {
+        return { *this };
+    }
+
+private:
+    JobSystem& mJobSystem;
+    // 'this' when signaled, otherwise the list of waiting Awaiters
+    mutable std::atomic<void*> mState;
+};
+
+#endif // UTILS_HAS_COROUTINES
+
+} // namespace jobs
+} // namespace utils
+
+#endif // TNT_UTILS_JOBTASK_H
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_MAPPEDFILE_H
+#define TNT_UTILS_MAPPEDFILE_H
+
+#include <utils/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+
+/**
+ * A read-only memory mapping of a whole file. Pages are read from the file when they're first
+ * accessed, and the file is unmapped when the MappedFile is destroyed.
+ */
+class UTILS_PUBLIC MappedFile {
+public:
+    MappedFile() noexcept = default;
+
+    // Maps the given file, isValid() returns false if it can't be mapped (e.g. it's empty).
+    explicit MappedFile(const char* path) noexcept;
+
+    ~MappedFile() noexcept;
+
+    MappedFile(const MappedFile& rhs) = delete;
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+
+    MappedFile(MappedFile&& rhs) noexcept;
+    MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+    bool isValid() const noexcept { return mData != nullptr; }
+
+    uint8_t const* data() const noexcept { return static_cast<uint8_t const*>(mData); }
+
+    size_t size() const noexcept { return mSize; }
+
+private:
+    void unmap() noexcept;
+
+    void* mData = nullptr;
+    size_t mSize = 0;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_MAPPEDFILE_H
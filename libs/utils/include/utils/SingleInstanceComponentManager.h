@@ -104,6 +104,12 @@ public:
         return getComponentCount() == 0;
     }
 
+    // incremented each time components are added, removed or swapped, i.e. whenever an
+    // existing Instance might stop referring to the same Entity.
+    uint32_t getVersion() const noexcept {
+        return mVersion;
+    }
+
     // returns a pointer to the Entity array. This is basically the list
     // of entities this component manager handles.
     // The pointer becomes invalid when adding or removing a component.
@@ -221,6 +227,7 @@ protected:
             Entity& ei = elementAt<ENTITY_INDEX>(i);
             Entity& ej = elementAt<ENTITY_INDEX>(j);
             std::swap(ei, ej);
+            mVersion++;
             if (ei) {
                 map[ei] = i;
             }
@@ -258,6 +265,7 @@ private:
     // maps an entity to an instance index
     tsl::robin_map<Entity, Instance> mInstanceMap;
     default_random_engine mRng;
+    uint32_t mVersion = 0;
 };
 
 // Keep these outside of the class because CLion has trouble parsing them
@@ -272,6 +280,7 @@ SingleInstanceComponentManager<Elements ...>::addComponent(Entity e) {
             // index 0 is used when the component doesn't exist
             ci = Instance(mData.size() - 1);
             mInstanceMap[e] = ci;
+            mVersion++;
         } else {
             // if the entity already has this component, just return its instance
             ci = mInstanceMap[e];
@@ -303,6 +312,7 @@ SingleInstanceComponentManager<Elements ... >::removeComponent(Entity e) {
         }
         mData.pop_back();
         map.erase(pos);
+        mVersion++;
         return last;
     }
     return 0;
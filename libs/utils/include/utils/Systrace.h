@@ -228,17 +228,63 @@ private:
 #else // !ANDROID
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * Without atrace, the SYSTRACE_ macros record into utils::TraceRecorder, which is a no-op
+ * until it's enabled at runtime. Like on Android, nothing is recorded when SYSTRACE_TAG is
+ * SYSTRACE_TAG_NEVER.
+ */
+
+#include <utils/TraceRecorder.h>
+
+#ifndef SYSTRACE_TAG
+#define SYSTRACE_TAG (SYSTRACE_TAG_ALWAYS)
+#endif
+
 #define SYSTRACE_ENABLE()
 #define SYSTRACE_DISABLE()
 #define SYSTRACE_CONTEXT()
-#define SYSTRACE_NAME(name)
-#define SYSTRACE_NAME_BEGIN(name)
-#define SYSTRACE_NAME_END()
-#define SYSTRACE_CALL()
-#define SYSTRACE_ASYNC_BEGIN(name, cookie)
-#define SYSTRACE_ASYNC_END(name, cookie)
-#define SYSTRACE_VALUE32(name, val)
-#define SYSTRACE_VALUE64(name, val)
+
+#define SYSTRACE_NAME(name) \
+        ::utils::TraceRecorder::Scope ___tracer(name, (SYSTRACE_TAG) != 0)
+
+#define SYSTRACE_CALL() SYSTRACE_NAME(__FUNCTION__)
+
+#define SYSTRACE_NAME_BEGIN(name) \
+        do { if (SYSTRACE_TAG) ::utils::TraceRecorder::begin(name); } while (0)
+
+#define SYSTRACE_NAME_END() \
+        do { if (SYSTRACE_TAG) ::utils::TraceRecorder::end(); } while (0)
+
+#define SYSTRACE_ASYNC_BEGIN(name, cookie) \
+        do { if (SYSTRACE_TAG) ::utils::TraceRecorder::asyncBegin(name, cookie); } while (0)
+
+#define SYSTRACE_ASYNC_END(name, cookie) \
+        do { if (SYSTRACE_TAG) ::utils::TraceRecorder::asyncEnd(name, cookie); } while (0)
+
+// Values are only evaluated when they're recorded, they can be expensive to compute or only
+// valid when tracing.
+#if (SYSTRACE_TAG) == SYSTRACE_TAG_NEVER
+
+#define SYSTRACE_VALUE32(name, val) do { } while (0)
+#define SYSTRACE_VALUE64(name, val) do { } while (0)
+
+#else
+
+#define SYSTRACE_VALUE32(name, val) \
+        do { \
+            if (UTILS_UNLIKELY(::utils::TraceRecorder::isEnabled())) { \
+                ::utils::TraceRecorder::counter(name, int32_t(val)); \
+            } \
+        } while (0)
+
+#define SYSTRACE_VALUE64(name, val) \
+        do { \
+            if (UTILS_UNLIKELY(::utils::TraceRecorder::isEnabled())) { \
+                ::utils::TraceRecorder::counter(name, int64_t(val)); \
+            } \
+        } while (0)
+
+#endif
 
 #endif // ANDROID
 
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_TRACERECORDER_H
+#define TNT_UTILS_TRACERECORDER_H
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/compiler.h>
+
+namespace utils {
+
+namespace io {
+class ostream;
+} // namespace io
+
+/*
+ * TraceRecorder is an in-process recorder for timestamped trace events. Events are recorded
+ * in per-thread ring buffers without taking any lock, and can be written out at any time as
+ * Chrome trace-event JSON, which can be loaded in chrome://tracing or ui.perfetto.dev.
+ *
+ * Recording is disabled by default, in which case recording an event only costs a relaxed
+ * atomic load, so the recorder can stay compiled in.
+ *
+ * Each thread keeps its last EVENTS_PER_THREAD - 1 events, older events are overwritten.
+ * Names are copied and truncated to MAX_NAME_LENGTH characters.
+ */
+class UTILS_PUBLIC TraceRecorder {
+public:
+    static constexpr size_t EVENTS_PER_THREAD = 4096;  // must be a power of two
+    static constexpr size_t MAX_NAME_LENGTH = 39;
+
+    static void setEnabled(bool enabled) noexcept;
+
+    static bool isEnabled() noexcept {
+        return sEnabled.load(std::memory_order_relaxed);
+    }
+
+    // beginning of a duration event, must be matched by an end() on the same thread
+    static void begin(const char* name) noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::BEGIN, name, 0);
+        }
+    }
+
+    // end of the last duration event started on this thread
+    static void end() noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::END, nullptr, 0);
+        }
+    }
+
+    // an event without duration
+    static void instant(const char* name, int64_t value = 0) noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::INSTANT, name, value);
+        }
+    }
+
+    // the new value of a counter
+    static void counter(const char* name, int64_t value) noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::COUNTER, name, value);
+        }
+    }
+
+    // asynchronous events don't need to nest, and can begin and end on different threads
+    static void asyncBegin(const char* name, int64_t cookie) noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::ASYNC_BEGIN, name, cookie);
+        }
+    }
+
+    static void asyncEnd(const char* name, int64_t cookie) noexcept {
+        if (UTILS_UNLIKELY(isEnabled())) {
+            record(Type::ASYNC_END, name, cookie);
+        }
+    }
+
+    /*
+     * Writes the events currently held by all threads as a Chrome trace-event JSON object.
+     * This can be called while other threads are recording, events overwritten during the
+     * dump are dropped.
+     */
+    static void dump(io::ostream& out) noexcept;
+
+    // discards all recorded events
+    static void clear() noexcept;
+
+    /*
+     * Scope records a duration event for its lifetime. The end event is only recorded if the
+     * begin event was, so that toggling the recorder doesn't produce unbalanced events.
+     */
+    class Scope {
+    public:
+        explicit Scope(const char* name, bool active = true) noexcept
+                : mActive(active && isEnabled()) {
+            if (UTILS_UNLIKELY(mActive)) {
+                record(Type::BEGIN, name, 0);
+            }
+        }
+
+        ~Scope() noexcept {
+            if (UTILS_UNLIKELY(mActive)) {
+                record(Type::END, nullptr, 0);
+            }
+        }
+
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+
+    private:
+        const bool mActive;
+    };
+
+private:
+    enum class Type : uint8_t {
+        BEGIN, END, INSTANT, COUNTER, ASYNC_BEGIN, ASYNC_END
+    };
+
+    static void record(Type type, const char* name, int64_t value) noexcept;
+
+    static std::atomic<bool> sEnabled;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_TRACERECORDER_H
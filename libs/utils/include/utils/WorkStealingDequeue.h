@@ -65,7 +65,8 @@ public:
 
     size_t getSize() const noexcept { return COUNT; }
 
-    // for debugging only...
+    // When called from the main thread, this can only over-estimate the number of items
+    // (because of concurrent steal()), so it can be used to check the queue is not full.
     size_t getCount() const noexcept {
         index_t bottom = mBottom.load(std::memory_order_relaxed);
         index_t top = mTop.load(std::memory_order_relaxed);
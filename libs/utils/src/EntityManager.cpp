@@ -21,9 +21,11 @@
 namespace utils {
 
 EntityManager::EntityManager()
-        : mGens(new uint8_t[RAW_INDEX_COUNT]) {
+        : mGens(new std::atomic<uint8_t>[RAW_INDEX_COUNT]) {
     // initialize all the generations to 0
-    std::fill_n(mGens, RAW_INDEX_COUNT, 0);
+    for (size_t i = 0; i < RAW_INDEX_COUNT; i++) {
+        mGens[i].store(0, std::memory_order_relaxed);
+    }
 }
 
 EntityManager::~EntityManager() {
@@ -32,6 +34,51 @@ EntityManager::~EntityManager() {
 
 EntityManager::Listener::~Listener() noexcept = default;
 
+UTILS_DEFINE_TLS(EntityManagerImpl::ThreadCache) EntityManagerImpl::sThreadCache;
+
+std::atomic<uint32_t> EntityManagerImpl::sNextId = { 0 };
+
+EntityManagerImpl::EntityManagerImpl() noexcept
+        : mId(++sNextId),
+          mFreeList(new Entity::Type[FREE_LIST_SIZE]) {
+    Registry& registry = getRegistry();
+    std::lock_guard<Mutex> lock(registry.lock);
+    registry.instances.push_back(this);
+}
+
+EntityManagerImpl::~EntityManagerImpl() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<Mutex> lock(registry.lock);
+    auto& instances = registry.instances;
+    instances.erase(std::find(instances.begin(), instances.end(), this));
+}
+
+EntityManagerImpl::Registry& EntityManagerImpl::getRegistry() noexcept {
+    // leaked for the same reason as the EntityManager, it's used when threads terminate
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+void EntityManagerImpl::flushToOwner(ThreadCache& cache) noexcept {
+    if (!cache.owner || cache.isEmpty()) {
+        return;
+    }
+    // holding the lock guarantees the owner can't be destroyed while we're using it
+    Registry& registry = getRegistry();
+    std::lock_guard<Mutex> lock(registry.lock);
+    for (EntityManagerImpl* em : registry.instances) {
+        if (em->mId == cache.owner) {
+            em->flushThreadCache(cache);
+            break;
+        }
+    }
+}
+
+EntityManagerImpl::ThreadCache::~ThreadCache() noexcept {
+    // when a thread terminates, return its unused indices to their EntityManager
+    flushToOwner(*this);
+}
+
 EntityManager& EntityManager::get() noexcept {
     // note: we leak the EntityManager because it's more important that it survives everything else
     // the leak is really not a problem because the process is terminating anyways.
@@ -47,6 +94,14 @@ void EntityManager::destroy(size_t n, Entity* entities) noexcept {
     static_cast<EntityManagerImpl *>(this)->destroy(n, entities);
 }
 
+void EntityManager::setDeferredListenerNotifications(bool enable) noexcept {
+    static_cast<EntityManagerImpl *>(this)->setDeferredListenerNotifications(enable);
+}
+
+void EntityManager::notifyListeners() noexcept {
+    static_cast<EntityManagerImpl *>(this)->notifyListeners();
+}
+
 void EntityManager::registerListener(EntityManager::Listener* l) noexcept {
     static_cast<EntityManagerImpl *>(this)->registerListener(l);
 }
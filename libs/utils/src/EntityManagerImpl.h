@@ -23,6 +23,7 @@
 #include <utils/Entity.h>
 #include <utils/Mutex.h>
 #include <utils/CallStack.h>
+#include <utils/ThreadLocal.h>
 
 #include <tsl/robin_set.h>
 
@@ -30,7 +31,9 @@
 #include <tsl/robin_map.h>
 #endif
 
-#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex> // for std::lock_guard
 #include <vector>
 
@@ -47,49 +50,26 @@ public:
     using EntityManager::create;
     using EntityManager::destroy;
 
-    void create(size_t n, Entity* entities) {
-        Entity::Type index{};
-        auto& freeList = mFreeList;
-        uint8_t* const gens = mGens;
+    EntityManagerImpl() noexcept;
+    ~EntityManagerImpl() noexcept;
 
-        // this must be thread-safe, acquire the free-list mutex
-        std::lock_guard<Mutex> lock(mFreeListLock);
-        Entity::Type currentIndex = mCurrentIndex;
+    void create(size_t n, Entity* entities) {
+        ThreadCache& cache = getThreadCache();
         for (size_t i = 0; i < n; i++) {
-            // If we have more than a certain number of freed indices, get one from the list.
-            // this is a trade-off between how often we recycle indices and how large the free list
-            // can grow.
-            if (UTILS_UNLIKELY(currentIndex >= RAW_INDEX_COUNT || freeList.size() >= MIN_FREE_INDICES)) {
-
-                // this could only happen if we had gone through all the indices at least once
-                if (UTILS_UNLIKELY(freeList.empty())) {
-                    // return the null entity
-                    entities[i] = {};
-                    continue;
-                }
-
-                index = freeList.front();
-                freeList.pop_front();
-            } else {
-                // In the common case, we just grab the next index.
-                // This works only until all indices have been used once, at which point
-                // we're always in the slower case above. The idea is that we have enough indices
-                // that it doesn't happen in practice.
-                index = currentIndex++;
+            Entity::Type index = allocateIndex(cache);
+            if (UTILS_UNLIKELY(!index)) {
+                // return the null entity
+                entities[i] = {};
+                continue;
             }
-            entities[i] = Entity{ makeIdentity(gens[index], index) };
-#if FILAMENT_UTILS_TRACK_ENTITIES
-            mDebugActiveEntities.emplace(entities[i], CallStack::unwind(5));
-#endif
+            entities[i] = Entity{ makeIdentity(getGenerationForIndex(index), index) };
+            trackEntity(entities[i]);
         }
-        mCurrentIndex = currentIndex;
     }
 
     void destroy(size_t n, Entity* entities) noexcept {
-        auto& freeList = mFreeList;
-        uint8_t* const gens = mGens;
-
-        std::unique_lock<Mutex> lock(mFreeListLock);
+        std::atomic<uint8_t>* const gens = mGens;
+        ThreadCache& cache = getThreadCache();
         for (size_t i = 0; i < n; i++) {
             if (!entities[i]) {
                 // behave like free(), ok to free null Entity.
@@ -102,25 +82,47 @@ public:
             // ... deleting a dead Entity will corrupt the internal state, so we protect ourselves
             // against it. We don't guarantee anything about external state -- e.g. the listeners
             // will be called.
-            if (isAlive(entities[i])) {
-                Entity::Type index = getIndex(entities[i]);
-                freeList.push_back(index);
+            // The generation is checked and bumped in a single step, so that when two threads
+            // destroy the same Entity, only one of them recycles its index.
+            // This doesn't require a lock because the generation is only used for isAlive()
+            // and entities work as weak references -- it just means that isAlive() could return
+            // true a little longer than expected in some other threads.
+            // We do need a memory fence before the index is recycled by another thread though,
+            // it is provided by mFreeListLock when the index is added to the free-list.
+            Entity::Type index = getIndex(entities[i]);
+            uint8_t generation = uint8_t(getGeneration(entities[i]));
+            if (gens[index].compare_exchange_strong(generation, uint8_t(generation + 1),
+                    std::memory_order_relaxed)) {
+                // freed indices are added to the free-list in batches
+                cache.freed[cache.freedCount++] = index;
+                if (UTILS_UNLIKELY(cache.freedCount == BATCH_SIZE)) {
+                    pushFreeList(cache.freed, cache.freedCount);
+                    cache.freedCount = 0;
+                }
+                untrackEntity(entities[i]);
+            }
+        }
 
-                // The generation update doesn't require the lock because it's only used for isAlive()
-                // and entities work as weak references -- it just means that isAlive() could return
-                // true a little longer than expected in some other threads.
-                // We do need a memory fence though, it is provided by the mFreeListLock.unlock() below.
-                gens[index]++;
+        if (!mHasListeners.load(std::memory_order_relaxed)) {
+            return;
+        }
 
-#if FILAMENT_UTILS_TRACK_ENTITIES
-                mDebugActiveEntities.erase(entities[i]);
-#endif
+        std::unique_lock<Mutex> lock(mListenerLock);
+        if (mDeferNotifications) {
+            // our listeners are notified later, in batches, by notifyListeners(), unless
+            // too many entities are pending, so this list can't grow without bounds.
+            mDestroyedEntities.insert(mDestroyedEntities.end(), entities, entities + n);
+            const bool flush = mDestroyedEntities.size() >= MAX_DEFERRED_ENTITIES;
+            lock.unlock();
+            if (UTILS_UNLIKELY(flush)) {
+                notifyListeners();
             }
+            return;
         }
-        lock.unlock();
 
         // notify our listeners that some entities are being destroyed
         auto listeners = getListeners();
+        lock.unlock();
         for (auto const& l : listeners) {
             l->onEntitiesDestroyed(n, entities);
         }
@@ -129,26 +131,44 @@ public:
     void registerListener(EntityManager::Listener* l) noexcept {
         std::lock_guard<Mutex> lock(mListenerLock);
         mListeners.insert(l);
+        mHasListeners.store(true, std::memory_order_relaxed);
     }
 
     void unregisterListener(EntityManager::Listener* l) noexcept {
         std::lock_guard<Mutex> lock(mListenerLock);
         mListeners.erase(l);
+        mHasListeners.store(!mListeners.empty(), std::memory_order_relaxed);
     }
 
-    std::vector<EntityManager::Listener*> getListeners() const noexcept {
+    void setDeferredListenerNotifications(bool enable) noexcept {
         std::unique_lock<Mutex> lock(mListenerLock);
-        tsl::robin_set<Listener*> const& listeners = mListeners;
-        std::vector<EntityManager::Listener*> result(listeners.size()); // unfortunately this memset()
-        auto d = result.begin();
-        for (Listener* listener : listeners) {
-            *d++ = listener;
+        mDeferNotifications = enable;
+        lock.unlock();
+        if (!enable) {
+            // don't leave pending entities behind
+            notifyListeners();
+        }
+    }
+
+    void notifyListeners() noexcept {
+        std::unique_lock<Mutex> lock(mListenerLock);
+        if (mDestroyedEntities.empty()) {
+            return;
+        }
+        std::vector<Entity> destroyed;
+        destroyed.swap(mDestroyedEntities);
+        auto listeners = getListeners();
+        lock.unlock();
+
+        // notify our listeners that some entities have been destroyed
+        for (auto const& l : listeners) {
+            l->onEntitiesDestroyed(destroyed.size(), destroyed.data());
         }
-        return result; // the c++ standard guarantees a move
     }
 
 #if FILAMENT_UTILS_TRACK_ENTITIES
     std::vector<Entity> getActiveEntities() const {
+        std::lock_guard<Mutex> lock(mDebugActiveEntitiesLock);
         std::vector<Entity> result(mDebugActiveEntities.size());
         auto p = result.begin();
         for (auto i : mDebugActiveEntities) {
@@ -158,6 +178,7 @@ public:
     }
 
     void dumpActiveEntities(utils::io::ostream& out) const {
+        std::lock_guard<Mutex> lock(mDebugActiveEntitiesLock);
         for (auto i : mDebugActiveEntities) {
             out << "*** Entity " << i.first.getId() << " was allocated at:\n";
             out << i.second;
@@ -167,16 +188,211 @@ public:
 #endif
 
 private:
-    uint32_t mCurrentIndex = 1;
+    // number of never-used indices a thread grabs at once
+    static constexpr const Entity::Type FRESH_BATCH_SIZE = 32;
+
+    // number of indices moved to or from the free-list at once
+    static constexpr const uint32_t BATCH_SIZE = 64;
+
+    // number of destroyed entities after which deferred listeners are notified by destroy()
+    static constexpr const size_t MAX_DEFERRED_ENTITIES = 4096;
+
+    // the free-list can hold all the indices, so it never overflows
+    static constexpr const uint32_t FREE_LIST_SIZE = RAW_INDEX_COUNT;
+    static constexpr const uint32_t FREE_LIST_MASK = FREE_LIST_SIZE - 1u;
+
+    // Per-thread cache of indices for a given EntityManagerImpl. This is what allows most
+    // create() and destroy() calls to complete without touching any shared state.
+    struct ThreadCache {
+        uint32_t owner = 0;
+        // range of never-used indices
+        Entity::Type next = 0;
+        Entity::Type end = 0;
+        // indices taken from the free-list, not handed out yet
+        uint32_t recycledNext = 0;
+        uint32_t recycledCount = 0;
+        Entity::Type recycled[BATCH_SIZE];
+        // indices destroyed by this thread, not added to the free-list yet
+        uint32_t freedCount = 0;
+        Entity::Type freed[BATCH_SIZE];
+        bool isEmpty() const noexcept {
+            return next == end && recycledNext == recycledCount && !freedCount;
+        }
+        ~ThreadCache() noexcept;
+    };
+
+    // all the live EntityManagerImpl, so that a ThreadCache can be returned to its owner
+    struct Registry {
+        Mutex lock;
+        std::vector<EntityManagerImpl*> instances;
+    };
+    static Registry& getRegistry() noexcept;
+
+    // returns the indices of a ThreadCache to its owner, if it's still alive
+    static void flushToOwner(ThreadCache& cache) noexcept;
+
+    // caller must hold mListenerLock
+    std::vector<EntityManager::Listener*> getListeners() const noexcept {
+        tsl::robin_set<Listener*> const& listeners = mListeners;
+        std::vector<EntityManager::Listener*> result(listeners.size()); // unfortunately this memset()
+        auto d = result.begin();
+        for (Listener* listener : listeners) {
+            *d++ = listener;
+        }
+        return result; // the c++ standard guarantees a move
+    }
+
+    ThreadCache& getThreadCache() noexcept {
+        ThreadCache& cache = sThreadCache;
+        if (UTILS_UNLIKELY(cache.owner != mId)) {
+            // This thread's cache belongs to another EntityManagerImpl, give its indices back
+            // before reusing it. In practice only the global EntityManager exists, so this
+            // doesn't happen.
+            flushToOwner(cache);
+            cache.owner = mId;
+            cache.next = cache.end = 0;
+            cache.recycledNext = cache.recycledCount = 0;
+            cache.freedCount = 0;
+        }
+        return cache;
+    }
+
+    Entity::Type allocateIndex(ThreadCache& cache) noexcept {
+        // indices we already took from the free-list come first
+        if (cache.recycledNext != cache.recycledCount) {
+            return cache.recycled[cache.recycledNext++];
+        }
+
+        // If we have more than a certain number of freed indices, get them from the free-list.
+        // this is a trade-off between how often we recycle indices and how large the free list
+        // can grow.
+        if (UTILS_LIKELY(mFreeListSize.load(std::memory_order_relaxed) < MIN_FREE_INDICES)) {
+            // In the common case, we just grab the next never-used index.
+            // This works only until all indices have been used once, at which point we're always
+            // in the slower case below. The idea is that we have enough indices that it doesn't
+            // happen in practice.
+            if (UTILS_LIKELY(cache.next != cache.end) || refillFreshIndices(cache)) {
+                return cache.next++;
+            }
+        }
+
+        cache.recycledNext = 0;
+        cache.recycledCount = popFreeList(cache.recycled, BATCH_SIZE);
+        if (UTILS_LIKELY(cache.recycledCount)) {
+            return cache.recycled[cache.recycledNext++];
+        }
+
+        // this could only happen if we had gone through all the indices at least once,
+        // our last chance is to use the indices we freed ourselves.
+        if (cache.freedCount) {
+            return cache.freed[--cache.freedCount];
+        }
+        return 0;
+    }
+
+    bool refillFreshIndices(ThreadCache& cache) noexcept {
+        if (mCurrentIndex.load(std::memory_order_relaxed) >= RAW_INDEX_COUNT) {
+            return false;
+        }
+        const Entity::Type first = mCurrentIndex.fetch_add(FRESH_BATCH_SIZE,
+                std::memory_order_relaxed);
+        if (first >= RAW_INDEX_COUNT) {
+            return false;
+        }
+        cache.next = first;
+        cache.end = std::min(first + FRESH_BATCH_SIZE, Entity::Type(RAW_INDEX_COUNT));
+        return true;
+    }
+
+    // returns all the indices of a cache to the free-list
+    void flushThreadCache(ThreadCache& cache) noexcept {
+        pushFreeList(cache.recycled + cache.recycledNext, cache.recycledCount - cache.recycledNext);
+        pushFreeList(cache.freed, cache.freedCount);
+        while (cache.next != cache.end) {
+            Entity::Type batch[FRESH_BATCH_SIZE];
+            uint32_t count = 0;
+            while (cache.next != cache.end && count < FRESH_BATCH_SIZE) {
+                batch[count++] = cache.next++;
+            }
+            pushFreeList(batch, count);
+        }
+        cache.recycledNext = cache.recycledCount = 0;
+        cache.freedCount = 0;
+    }
+
+    // The free-list is a ring buffer, which is only accessed in batches so that mFreeListLock
+    // is taken once for many indices.
+
+    void pushFreeList(Entity::Type const* indices, uint32_t count) noexcept {
+        if (!count) {
+            return;
+        }
+        std::lock_guard<Mutex> lock(mFreeListLock);
+        Entity::Type* const UTILS_RESTRICT freeList = mFreeList.get();
+        const uint32_t size = mFreeListSize.load(std::memory_order_relaxed);
+        assert(size + count <= FREE_LIST_SIZE);
+        const uint32_t tail = mFreeListHead + size;
+        for (uint32_t i = 0; i < count; i++) {
+            freeList[(tail + i) & FREE_LIST_MASK] = indices[i];
+        }
+        mFreeListSize.store(size + count, std::memory_order_relaxed);
+    }
+
+    uint32_t popFreeList(Entity::Type* indices, uint32_t count) noexcept {
+        if (!mFreeListSize.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        std::lock_guard<Mutex> lock(mFreeListLock);
+        Entity::Type const* const UTILS_RESTRICT freeList = mFreeList.get();
+        const uint32_t size = mFreeListSize.load(std::memory_order_relaxed);
+        const uint32_t head = mFreeListHead;
+        count = std::min(count, size);
+        for (uint32_t i = 0; i < count; i++) {
+            indices[i] = freeList[(head + i) & FREE_LIST_MASK];
+        }
+        mFreeListHead = (head + count) & FREE_LIST_MASK;
+        mFreeListSize.store(size - count, std::memory_order_relaxed);
+        return count;
+    }
+
+    void trackEntity(Entity e) noexcept {
+#if FILAMENT_UTILS_TRACK_ENTITIES
+        std::lock_guard<Mutex> lock(mDebugActiveEntitiesLock);
+        mDebugActiveEntities.emplace(e, CallStack::unwind(5));
+#endif
+    }
+
+    void untrackEntity(Entity e) noexcept {
+#if FILAMENT_UTILS_TRACK_ENTITIES
+        std::lock_guard<Mutex> lock(mDebugActiveEntitiesLock);
+        mDebugActiveEntities.erase(e);
+#endif
+    }
+
+    static UTILS_DECLARE_TLS(ThreadCache) sThreadCache;
+    static std::atomic<uint32_t> sNextId;
+
+    // identifies this EntityManagerImpl in the per-thread caches
+    const uint32_t mId;
+
+    // next never-used index
+    std::atomic<Entity::Type> mCurrentIndex = { 1 };
 
-    // stores indices that got freed
+    // stores indices that got freed, in a ring buffer
     mutable Mutex mFreeListLock;
-    std::deque<Entity::Type> mFreeList;
+    std::unique_ptr<Entity::Type[]> mFreeList;
+    uint32_t mFreeListHead = 0;
+    // only modified with mFreeListLock held, but can be read without it
+    std::atomic<uint32_t> mFreeListSize = { 0 };
 
     mutable Mutex mListenerLock;
     tsl::robin_set<Listener*> mListeners;
+    std::vector<Entity> mDestroyedEntities;
+    bool mDeferNotifications = false;
+    std::atomic<bool> mHasListeners = { false };
 
 #if FILAMENT_UTILS_TRACK_ENTITIES
+    mutable Mutex mDebugActiveEntitiesLock;
     tsl::robin_map<Entity, CallStack> mDebugActiveEntities;
 #endif
 };
@@ -23,18 +23,26 @@
 
 #include <utils/JobSystem.h>
 
+#include <algorithm>
 #include <cmath>
 #include <random>
 
+#include <stdio.h>
+
 #include <utils/compiler.h>
 #include <utils/memalign.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
+#include <utils/TraceRecorder.h>
 
 #if !defined(WIN32)
 #    include <pthread.h>
 #endif
 
+#if defined(__linux__)
+#    include "linux/futex.h"
+#endif
+
 #ifdef ANDROID
 #    include <sys/time.h>
 #    include <sys/resource.h>
@@ -66,6 +74,12 @@
 
 namespace utils {
 
+// Idle threads spin (with a pause) between MIN_SPIN_COUNT and MAX_SPIN_COUNT times before
+// going to sleep, then yield YIELD_COUNT times. There is no point spinning with a single CPU.
+static constexpr uint32_t MIN_SPIN_COUNT = 16;
+static constexpr uint32_t MAX_SPIN_COUNT = 2048;
+static constexpr uint32_t YIELD_COUNT = 2;
+
 void JobSystem::setThreadName(const char* name) noexcept {
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), name);
@@ -103,37 +117,131 @@ void JobSystem::setThreadAffinityById(size_t id) noexcept {
 #endif
 }
 
+// A CPU the JobSystem's threads can run on
+struct Cpu {
+    int id;         // as used by sched_setaffinity()
+    int domain;     // CPUs sharing a last level cache (or a package) have the same domain
+    int sibling;    // 0 for the first hardware thread of a physical core, 1 for the next, etc...
+};
+
+// The topology is only read on desktop Linux. Android devices don't expose it reliably to
+// applications and keep the historical behavior of pinning thread i to cpu i.
+#if defined(__linux__) && !defined(__ANDROID__)
+#   define UTILS_HAS_CPU_TOPOLOGY 1
+#else
+#   define UTILS_HAS_CPU_TOPOLOGY 0
+#endif
+
+#if UTILS_HAS_CPU_TOPOLOGY
+static int readCpuTopology(int cpu, const char* name) noexcept {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, name);
+    int value = -1;
+    FILE* file = fopen(path, "r");
+    if (file) {
+        if (fscanf(file, "%d", &value) != 1) {
+            value = -1;
+        }
+        fclose(file);
+    }
+    return value;
+}
+#endif
+
+// Returns the CPUs we're allowed to run on, in the order threads should be assigned to them:
+// first hardware thread of each core first, grouped by domain. Returns an empty list if the
+// topology is not known.
+static std::vector<Cpu> getCpuTopology() noexcept {
+    std::vector<Cpu> cpus;
+#if UTILS_HAS_CPU_TOPOLOGY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return cpus;
+    }
+    std::vector<std::pair<int, int>> cores; // (package, core) of each cpu
+    for (int id = 0; id < CPU_SETSIZE; id++) {
+        if (!CPU_ISSET(id, &set)) {
+            continue;
+        }
+        const int package = std::max(0, readCpuTopology(id, "topology/physical_package_id"));
+        const int core = readCpuTopology(id, "topology/core_id");
+        int domain = package;
+        if (readCpuTopology(id, "cache/index3/level") == 3) {
+            // L3 ids are unique system-wide
+            const int l3 = readCpuTopology(id, "cache/index3/id");
+            domain = l3 >= 0 ? l3 : package;
+        }
+        int sibling = 0;
+        if (core >= 0) {
+            sibling = (int)std::count(cores.begin(), cores.end(), std::make_pair(package, core));
+        }
+        cores.emplace_back(package, core);
+        cpus.push_back({ id, domain, sibling });
+    }
+    std::stable_sort(cpus.begin(), cpus.end(), [](Cpu const& lhs, Cpu const& rhs) {
+        return lhs.sibling != rhs.sibling ? lhs.sibling < rhs.sibling : lhs.domain < rhs.domain;
+    });
+#endif
+    return cpus;
+}
+
 JobSystem::JobSystem(const size_t userThreadCount, const size_t adoptableThreadsCount) noexcept
-    : mJobPool("JobSystem Job pool", MAX_JOB_COUNT * sizeof(Job)),
-      mJobStorageBase(static_cast<Job *>(mJobPool.getAllocator().getCurrent()))
 {
     SYSTRACE_ENABLE();
 
+    std::vector<Cpu> cpus = getCpuTopology();
+
     int threadPoolCount = userThreadCount;
     if (threadPoolCount == 0) {
         // default value, system dependant
-        int hwThreads = std::thread::hardware_concurrency();
-        if (UTILS_HAS_HYPER_THREADING) {
-            // For now we avoid using HT, this simplifies profiling.
-            // TODO: figure-out what to do with Hyper-threading
-            // since we assumed HT, always round-up to an even number of cores (to play it safe)
-            hwThreads = (hwThreads + 1) / 2;
+        int hwThreads;
+        if (!cpus.empty()) {
+            // For now we avoid using HT, this simplifies profiling: one thread per physical core.
+            hwThreads = (int)std::count_if(cpus.begin(), cpus.end(),
+                    [](Cpu const& cpu) { return cpu.sibling == 0; });
+        } else {
+            hwThreads = std::thread::hardware_concurrency();
+            if (UTILS_HAS_HYPER_THREADING) {
+                // we don't know the topology, assume HT and
+                // always round-up to an even number of cores (to play it safe)
+                hwThreads = (hwThreads + 1) / 2;
+            }
         }
         // make sure we have at least one thread in the thread pool
         hwThreads = std::max(2, hwThreads);
         // one of the thread will be the user thread
         threadPoolCount = hwThreads - 1;
     }
-    threadPoolCount = std::min(UTILS_HAS_THREADING ? 32 : 0, threadPoolCount);
+    // thread indices must fit in 16 bits
+    threadPoolCount = std::min(UTILS_HAS_THREADING ? int(0xFFFF - adoptableThreadsCount) : 0,
+            threadPoolCount);
 
     mThreadStates = aligned_vector<ThreadState>(threadPoolCount + adoptableThreadsCount);
     mThreadCount = uint16_t(threadPoolCount);
+    mMaxBackgroundThreads = uint32_t(mThreadStates.size());
     mParallelSplitCount = (uint8_t)std::ceil((std::log2f(threadPoolCount + adoptableThreadsCount)));
+    mMaxSpinCount = uint16_t(std::thread::hardware_concurrency() > 1 ? MAX_SPIN_COUNT : 0);
 
     // this is a pity these are not compile-time checks (C++17 supports it apparently)
     assert(mExitRequested.is_lock_free());
     assert(Job().runningJobCount.is_lock_free());
 
+    // the first job pool is always there
+    addJobPool(0);
+
+    if (cpus.empty()) {
+        // we don't know the topology, thread i runs on cpu i and all threads are in one domain
+        for (int i = 0; i < threadPoolCount; i++) {
+            cpus.push_back({ i, 0, 0 });
+        }
+    }
+    // pinned threads are grouped by domain, so that each domain is a contiguous range of threads.
+    cpus.resize(std::min(cpus.size(), size_t(threadPoolCount)));
+    std::stable_sort(cpus.begin(), cpus.end(), [](Cpu const& lhs, Cpu const& rhs) {
+        return lhs.domain < rhs.domain;
+    });
+
     std::random_device rd;
     const size_t hardwareThreadCount = mThreadCount;
     auto& states = mThreadStates;
@@ -144,6 +252,26 @@ JobSystem::JobSystem(const size_t userThreadCount, const size_t adoptableThreads
         state.rndGen = default_random_engine(rd());
         state.id = (uint32_t)i;
         state.js = this;
+        state.background = false;
+        state.hasBackgroundSlot = false;
+        state.spinCount = uint16_t(std::min(MIN_SPIN_COUNT, uint32_t(mMaxSpinCount)));
+        // threads that are not pinned (including adopted threads) steal from everyone
+        state.cpu = -1;
+        state.domainBegin = 0;
+        state.domainSize = uint16_t(hardwareThreadCount);
+        if (i < cpus.size()) {
+            size_t begin = i;
+            while (begin > 0 && cpus[begin - 1].domain == cpus[i].domain) {
+                begin--;
+            }
+            size_t end = i + 1;
+            while (end < cpus.size() && cpus[end].domain == cpus[i].domain) {
+                end++;
+            }
+            state.cpu = cpus[i].id;
+            state.domainBegin = uint16_t(begin);
+            state.domainSize = uint16_t(end - begin);
+        }
         if (i < hardwareThreadCount) {
             // don't start a thread of adoptable thread slots
             state.thread = std::thread(&JobSystem::loop, this, &state);
@@ -166,7 +294,9 @@ JobSystem::~JobSystem() {
 inline void JobSystem::incRef(Job const* job) noexcept {
     // no action is taken when incrementing the reference counter, therefore we can safely use
     // memory_order_relaxed.
-    job->refCount.fetch_add(1, std::memory_order_relaxed);
+    UTILS_UNUSED_IN_RELEASE
+    auto c = job->refCount.fetch_add(1, std::memory_order_relaxed);
+    assert(c < 0xFFFF);
 }
 
 UTILS_NOINLINE
@@ -184,15 +314,13 @@ void JobSystem::decRef(Job const* job) noexcept {
     assert(c > 0);
     if (c == 1) {
         // This was the last reference, it's safe to destroy the job.
-        mJobPool.destroy(job);
+        mJobPools[job->id / JOB_POOL_SIZE]->destroy(job);
     }
 }
 
 void JobSystem::requestExit() noexcept {
     mExitRequested.store(true);
-    { std::lock_guard<Mutex> lock(mWaiterLock); }
-    mWaiterCondition.notify_all();
-
+    wake(nullptr, mThreadStates.size(), false);
 }
 
 inline bool JobSystem::exitRequested() const noexcept {
@@ -204,22 +332,166 @@ inline bool JobSystem::hasActiveJobs() const noexcept {
     return mActiveJobs.load(std::memory_order_relaxed) > 0;
 }
 
+inline bool JobSystem::hasActiveBackgroundJobs() const noexcept {
+    return mActiveBackgroundJobs.load(std::memory_order_relaxed) > 0;
+}
+
+inline bool JobSystem::hasWork(ThreadState const& state, bool allowBackground) const noexcept {
+    return hasActiveJobs() || (allowBackground && hasActiveBackgroundJobs() &&
+            (state.hasBackgroundSlot || mBackgroundThreads.load(std::memory_order_relaxed) <
+                    mMaxBackgroundThreads.load(std::memory_order_relaxed)));
+}
+
+bool JobSystem::acquireBackgroundSlot() noexcept {
+    // memory_order_relaxed is safe because this counter doesn't guard any data
+    uint32_t const max = mMaxBackgroundThreads.load(std::memory_order_relaxed);
+    uint32_t count = mBackgroundThreads.load(std::memory_order_relaxed);
+    do {
+        if (count >= max) {
+            return false;
+        }
+    } while (!mBackgroundThreads.compare_exchange_weak(count, count + 1,
+            std::memory_order_relaxed, std::memory_order_relaxed));
+    return true;
+}
+
+void JobSystem::releaseBackgroundSlot() noexcept {
+    mBackgroundThreads.fetch_sub(1, std::memory_order_relaxed);
+    if (hasActiveBackgroundJobs()) {
+        // some threads could be waiting for a slot
+        wake(nullptr, 1, true);
+    }
+}
+
 inline bool JobSystem::hasJobCompleted(JobSystem::Job const* job) noexcept {
     return job->runningJobCount.load(std::memory_order_relaxed) <= 0;
 }
 
-void JobSystem::wait(std::unique_lock<Mutex>& lock) noexcept {
-    ++mWaiterCount;
-    mWaiterCondition.wait(lock);
-    --mWaiterCount;
+// Called when this thread has no job it can run. New jobs often show up shortly, so we first
+// spin for a while, then sleep until wake() or wakeWaiters() picks this thread.
+// Returns true if the thread went to sleep.
+bool JobSystem::idle(ThreadState& state, Job const* job, bool allowBackground) noexcept {
+    auto ready = [&]() {
+        return hasWork(state, allowBackground) || (job && hasJobCompleted(job)) ||
+                exitRequested();
+    };
+
+    // The spin count doubles each time spinning spares us a sleep, and is halved otherwise.
+    // We yield last, in case the thread we're waiting for is sharing our CPU.
+    uint32_t const spinCount = state.spinCount;
+    uint32_t const maxSpinCount = mMaxSpinCount;
+    for (uint32_t i = 0; i < spinCount + YIELD_COUNT; i++) {
+        if (ready()) {
+            state.spinCount = uint16_t(std::min(maxSpinCount, spinCount * 2));
+            return false;
+        }
+        if (i < spinCount) {
+            UTILS_PAUSE();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    state.spinCount = uint16_t(std::max(std::min(MIN_SPIN_COUNT, maxSpinCount), spinCount / 2));
+
+    // Let wake() and wakeWaiters() know we're going to sleep, then check for work one last time.
+    // The fence pairs with theirs: either they see this thread parked, or we see their update.
+    state.waitingFor.store(job, std::memory_order_relaxed);
+    state.parkedForBackground.store(allowBackground, std::memory_order_relaxed);
+    state.parked.store(true, std::memory_order_relaxed);
+    mParkedThreads.fetch_add(1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool const sleep = !ready();
+    if (sleep) {
+        TraceRecorder::Scope trace("JobSystem::wait");
+        park(state);
+    }
+
+    // whoever wakes us up takes us off the parked list, unless we didn't wait for them
+    if (state.parked.exchange(false, std::memory_order_relaxed)) {
+        mParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+    }
+    state.waitingFor.store(nullptr, std::memory_order_relaxed);
+    return sleep;
+}
+
+// Sleeps until unpark() is called, or returns immediately if it was called since the last park().
+// Only the thread owning the state can park, and spurious returns are possible.
+void JobSystem::park(ThreadState& state) noexcept {
+    std::atomic<uint32_t>& word = state.parkState;
+    // PARK_NOTIFIED -> PARK_EMPTY, or PARK_EMPTY -> PARK_PARKED
+    if (word.fetch_sub(1, std::memory_order_acquire) == PARK_NOTIFIED) {
+        return;
+    }
+    uint32_t expected;
+    do {
+#if defined(__linux__)
+        linuxutil::futex_wait_ex(&word, false, PARK_PARKED, false, nullptr);
+#else
+        std::unique_lock<Mutex> lock(mWaiterLock);
+        while (word.load(std::memory_order_relaxed) == PARK_PARKED) {
+            mWaiterCondition.wait(lock);
+        }
+#endif
+        expected = PARK_NOTIFIED;
+    } while (!word.compare_exchange_strong(expected, PARK_EMPTY,
+            std::memory_order_acquire, std::memory_order_relaxed));
 }
 
-void JobSystem::wake() noexcept {
-    Mutex& lock = mWaiterLock;
-    lock.lock();
-    const uint32_t waiterCount = mWaiterCount;
-    lock.unlock();
-    mWaiterCondition.notify_n(waiterCount);
+void JobSystem::unpark(ThreadState& state) noexcept {
+    std::atomic<uint32_t>& word = state.parkState;
+    if (word.exchange(PARK_NOTIFIED, std::memory_order_release) == PARK_PARKED) {
+#if defined(__linux__)
+        linuxutil::futex_wake_ex(&word, false, 1);
+#else
+        { std::lock_guard<Mutex> lock(mWaiterLock); }
+        mWaiterCondition.notify_all();
+#endif
+    }
+}
+
+// Wakes-up at most count sleeping threads, only threads that can run BACKGROUND jobs if
+// background is set. Threads in the domain of 'from' are picked first.
+void JobSystem::wake(ThreadState const* from, size_t count, bool background) noexcept {
+    // see idle()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mParkedThreads.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    auto& states = mThreadStates;
+    size_t const n = states.size();
+    size_t const first = from ? from->domainBegin : 0;
+    for (size_t i = 0; i < n && count; i++) {
+        ThreadState& state = states[(first + i) % n];
+        if (!state.parked.load(std::memory_order_acquire)) {
+            continue;
+        }
+        if (background && !state.parkedForBackground.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        // we're racing with other wakers, and with the thread itself
+        if (state.parked.exchange(false, std::memory_order_acquire)) {
+            mParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+            unpark(state);
+            count--;
+        }
+    }
+}
+
+// Wakes-up the threads sleeping in waitAndRelease() on this job.
+void JobSystem::wakeWaiters(Job const* job) noexcept {
+    // see idle()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mParkedThreads.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    for (auto& state : mThreadStates) {
+        if (state.waitingFor.load(std::memory_order_relaxed) == job &&
+                state.parked.exchange(false, std::memory_order_acquire)) {
+            mParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+            unpark(state);
+        }
+    }
 }
 
 inline JobSystem::ThreadState& JobSystem::getState() noexcept {
@@ -230,7 +502,41 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
 }
 
 JobSystem::Job* JobSystem::allocateJob() noexcept {
-    return mJobPool.make<Job>();
+    // pools are tried in order, so we only use the newer ones when the first ones are exhausted
+    size_t poolCount = mJobPoolCount.load(std::memory_order_acquire);
+    size_t i = 0;
+    do {
+        for (; i < poolCount; i++) {
+            Job* const job = mJobPools[i]->make<Job>();
+            if (UTILS_LIKELY(job)) {
+                job->id = uint16_t(i * JOB_POOL_SIZE + (job - mJobStorage[i]));
+                return job;
+            }
+        }
+        // all pools are exhausted, add a new one (unless another thread just did)
+        poolCount = addJobPool(poolCount);
+    } while (i < poolCount);
+    // we're really out of jobs
+    return nullptr;
+}
+
+UTILS_NOINLINE
+size_t JobSystem::addJobPool(size_t poolCount) noexcept {
+    SYSTRACE_CALL();
+    std::lock_guard<Mutex> lock(mJobPoolLock);
+    size_t const currentPoolCount = mJobPoolCount.load(std::memory_order_relaxed);
+    if (currentPoolCount == poolCount && poolCount < MAX_JOB_POOL_COUNT) {
+        // the last pool is one job short, so that job indices never reach 0x7FFF.
+        size_t const size = poolCount == MAX_JOB_POOL_COUNT - 1 ? JOB_POOL_SIZE - 1 : JOB_POOL_SIZE;
+        JobPool* const pool = new JobPool("JobSystem Job pool", size * sizeof(Job));
+        mJobPools[poolCount].reset(pool);
+        mContinuations[poolCount].reset(new uint16_t[size]);
+        mJobStorage[poolCount] = static_cast<Job*>(pool->getAllocator().getCurrent());
+        // publish the new pool, after this, jobs can be allocated from it concurrently
+        mJobPoolCount.store(uint32_t(poolCount + 1), std::memory_order_release);
+        return poolCount + 1;
+    }
+    return currentPoolCount;
 }
 
 inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -246,7 +552,19 @@ inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadS
     if (threadCount >= 2) {
         do {
             // this is biased, but frankly, we don't care. it's fast.
-            uint16_t index = uint16_t(state.rndGen() % threadCount);
+            // the two low bits choose between local and global, so they can't be used for the
+            // index (e.g. with 4 threads, r % 4 would always be 0 when r & 3 is 0).
+            uint32_t const r = state.rndGen();
+            uint16_t index = uint16_t((r >> 2u) % threadCount);
+            uint16_t const localCount = state.domainSize + adopted;
+            if (state.domainSize < mThreadCount && localCount > 1 && (r & 0x3u)) {
+                // three times out of four, steal from a thread in our domain (so the job's
+                // data is more likely to be in a shared cache), or from an adopted thread,
+                // these are usually the ones producing the work.
+                uint16_t const i = uint16_t((r >> 2u) % localCount);
+                index = i < state.domainSize ?
+                        state.domainBegin + i : mThreadCount + (i - state.domainSize);
+            }
             assert(index < threadStates.size());
             stateToStealFrom = &threadStates[index];
             // don't steal from our own queue
@@ -255,27 +573,35 @@ inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadS
     return stateToStealFrom;
 }
 
-JobSystem::Job* JobSystem::steal(JobSystem::ThreadState& state) noexcept {
+JobSystem::Job* JobSystem::steal(JobSystem::ThreadState& state, bool background) noexcept {
     HEAVY_SYSTRACE_CALL();
     Job* job = nullptr;
     do {
         ThreadState* const stateToStealFrom = getStateToStealFrom(state);
         if (UTILS_LIKELY(stateToStealFrom)) {
-            job = steal(stateToStealFrom->workQueue);
+            job = steal(background ?
+                    stateToStealFrom->backgroundQueue : stateToStealFrom->workQueue);
+            if (job) {
+                // the value is the index of the thread we stole from
+                TraceRecorder::instant("JobSystem::steal",
+                        stateToStealFrom - mThreadStates.data());
+            }
         }
         // nullptr -> nothing to steal in that queue either, if there are active jobs,
-        // continue to try stealing one.
-    } while (!job && hasActiveJobs());
+        // continue to try stealing one. Stop looking for BACKGROUND jobs as soon as there
+        // are other jobs.
+    } while (!job && (background ?
+            (hasActiveBackgroundJobs() && !hasActiveJobs()) : hasActiveJobs()));
     return job;
 }
 
-bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
+bool JobSystem::execute(JobSystem::ThreadState& state, bool allowBackground) noexcept {
     HEAVY_SYSTRACE_CALL();
 
     Job* job = pop(state.workQueue);
     if (UTILS_UNLIKELY(job == nullptr)) {
         // our queue is empty, try to steal a job
-        job = steal(state);
+        job = steal(state, false);
     }
 
     if (job) {
@@ -283,23 +609,74 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
         uint32_t activeJobs = mActiveJobs.fetch_sub(1, std::memory_order_relaxed);
         assert(activeJobs); // whoops, we were already at 0
         HEAVY_SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs - 1);
+        call(state, job, false);
+        finish(job);
+        return true;
+    }
 
-        if (UTILS_LIKELY(job->function)) {
-            HEAVY_SYSTRACE_NAME("job->function");
-            job->function(job->storage, *this, job);
-        }
+    // there is no other job, look for a BACKGROUND job if we can
+    if (!allowBackground || !hasActiveBackgroundJobs()) {
+        return false;
+    }
+    return executeBackground(state, true);
+}
+
+// Runs a BACKGROUND job from our queue, or stolen if allowSteal is set. This takes a background
+// slot for the duration of the job, unless this thread already has one; returns false if there
+// was no slot or no job.
+bool JobSystem::executeBackground(JobSystem::ThreadState& state, bool allowSteal) noexcept {
+    bool const hadBackgroundSlot = state.hasBackgroundSlot;
+    if (!hadBackgroundSlot && !acquireBackgroundSlot()) {
+        return false;
+    }
+
+    Job* job = pop(state.backgroundQueue);
+    if (job == nullptr && allowSteal) {
+        job = steal(state, true);
+    }
+
+    if (job) {
+        UTILS_UNUSED_IN_RELEASE
+        uint32_t activeJobs = mActiveBackgroundJobs.fetch_sub(1, std::memory_order_relaxed);
+        assert(activeJobs); // whoops, we were already at 0
+        state.hasBackgroundSlot = true;
+        call(state, job, true);
+        state.hasBackgroundSlot = hadBackgroundSlot;
+    }
+
+    // give our slot back before finishing the job, which can wake-up threads waiting for one
+    if (!hadBackgroundSlot) {
+        releaseBackgroundSlot();
+    }
+
+    if (job) {
         finish(job);
     }
     return job != nullptr;
 }
 
+inline void JobSystem::call(JobSystem::ThreadState& state, Job* job, bool background) noexcept {
+    if (UTILS_LIKELY(job->function)) {
+        HEAVY_SYSTRACE_NAME("job->function");
+        // recorded regardless of SYSTRACE_TAG, TraceRecorder is off unless enabled at runtime
+        TraceRecorder::Scope trace(background ? "JobSystem::backgroundJob" : "JobSystem::job");
+        // jobs run from this job inherit its priority
+        bool const wasBackground = state.background;
+        state.background = background;
+        job->function(job->storage, *this, job);
+        state.background = wasBackground;
+    }
+}
+
 void JobSystem::loop(ThreadState* state) noexcept {
     setThreadName("JobSystem::loop");
     setThreadPriority(Priority::DISPLAY);
 
     // set a CPU affinity on each of our JobSystem thread to prevent them from jumping from core
     // to core. On Android, it looks like the affinity needs to be reset from time to time.
-    setThreadAffinityById(state->id);
+    if (state->cpu >= 0) {
+        setThreadAffinityById(state->cpu);
+    }
 
     // record our work queue
     mThreadMapLock.lock();
@@ -309,11 +686,9 @@ void JobSystem::loop(ThreadState* state) noexcept {
 
     // run our main loop...
     do {
-        if (!execute(*state)) {
-            std::unique_lock<Mutex> lock(mWaiterLock);
-            while (!exitRequested() && !hasActiveJobs()) {
-                wait(lock);
-                setThreadAffinityById(state->id);
+        if (!execute(*state, true)) {
+            if (idle(*state, nullptr, true) && state->cpu >= 0) {
+                setThreadAffinityById(state->cpu);
             }
         }
     } while (!exitRequested());
@@ -323,10 +698,7 @@ UTILS_NOINLINE
 void JobSystem::finish(Job* job) noexcept {
     HEAVY_SYSTRACE_CALL();
 
-    bool notify = false;
-
     // terminate this job and notify its parent
-    Job* const storage = mJobStorageBase;
     do {
         // std::memory_order_release here is needed to synchronize with JobSystem::wait()
         // which needs to "see" all changes that happened before the job terminated.
@@ -334,20 +706,26 @@ void JobSystem::finish(Job* job) noexcept {
         assert(runningJobCount > 0);
         if (runningJobCount == 1) {
             // no more work, destroy this job and notify its parent
-            notify = true;
-            Job* const parent = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+            if (job->refCount.load(std::memory_order_relaxed) > 1) {
+                // someone else holds a reference, it could be waiting on this job
+                wakeWaiters(job);
+            }
+            Job* const parent = job->parent == 0x7FFF ? nullptr : getJob(job->parent);
+            Job* continuation = nullptr;
+            if (UTILS_UNLIKELY(job->hasContinuation)) {
+                continuation = getJob(getContinuation(job));
+            }
+            uint32_t const flags = job->background ? BACKGROUND : 0;
             decRef(job);
+            if (continuation) {
+                run(continuation, flags);
+            }
             job = parent;
         } else {
             // there is still work (e.g.: children), we're done.
             break;
         }
     } while (job);
-
-    // wake-up all threads that could potentially be waiting on this job finishing
-    if (notify) {
-        wake();
-    }
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -368,15 +746,25 @@ JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept
             // can't create a child job of a terminated parent
             assert(parentJobCount > 0);
 
-            index = parent - mJobStorageBase;
+            index = parent->id;
             assert(index < MAX_JOB_COUNT);
         }
         job->function = func;
         job->parent = uint16_t(index);
+        job->hasContinuation = false;
+        job->background = false;
     }
     return job;
 }
 
+void JobSystem::setContinuation(Job* job, Job* continuation) noexcept {
+    assert(job && continuation);
+    assert(!job->hasContinuation);
+    // 'job' hasn't run yet, so it can't complete concurrently with this
+    getContinuation(job) = uint16_t(continuation->id);
+    job->hasContinuation = true;
+}
+
 void JobSystem::cancel(Job*& job) noexcept {
     finish(job);
     job = nullptr;
@@ -394,7 +782,21 @@ void JobSystem::release(JobSystem::Job*& job) noexcept {
 }
 
 void JobSystem::signal() noexcept {
-    wake();
+    // wake-up as many threads as there are jobs, they could have been queued with DONT_SIGNAL
+    uint32_t const activeJobs = mActiveJobs.load(std::memory_order_relaxed);
+    uint32_t const activeBackgroundJobs = mActiveBackgroundJobs.load(std::memory_order_relaxed);
+    if (activeJobs) {
+        wake(nullptr, activeJobs, false);
+    }
+    if (activeBackgroundJobs) {
+        wake(nullptr, activeBackgroundJobs, true);
+    }
+}
+
+void JobSystem::setMaxBackgroundThreadCount(size_t count) noexcept {
+    // at least one thread must be able to run BACKGROUND jobs
+    mMaxBackgroundThreads.store(uint32_t(std::max(size_t(1), count)), std::memory_order_relaxed);
+    wake(nullptr, mThreadStates.size(), true);
 }
 
 void JobSystem::run(JobSystem::Job*& job, uint32_t flags) noexcept {
@@ -402,20 +804,47 @@ void JobSystem::run(JobSystem::Job*& job, uint32_t flags) noexcept {
 
     ThreadState& state(getState());
 
+    const bool background = (flags & BACKGROUND) || state.background;
+    job->background = background;
+    WorkQueue& workQueue = background ? state.backgroundQueue : state.workQueue;
+
+    while (UTILS_UNLIKELY(workQueue.getCount() >= workQueue.getSize())) {
+        // Our queue is full, this can happen because there are more jobs than queue entries.
+        // Help with the queued jobs until there is room for this one, queued jobs are always
+        // safe to run from here, as they would be from runAndWait().
+        if (background) {
+            // BACKGROUND jobs need a slot like anywhere else, so that they don't exceed
+            // setMaxBackgroundThreadCount(). Without one, wait for the threads that have one to
+            // steal from our queue.
+            if (!executeBackground(state, false)) {
+                wake(&state, 1, true);
+                std::this_thread::yield();
+            }
+            continue;
+        }
+        Job* const queued = pop(workQueue);
+        if (queued) {
+            UTILS_UNUSED_IN_RELEASE
+            uint32_t activeJobs = mActiveJobs.fetch_sub(1, std::memory_order_relaxed);
+            assert(activeJobs);
+            call(state, queued, false);
+            finish(queued);
+        }
+    }
+
     // increase the active job count before we add the job to the queue, because otherwise
     // the job could run and finish before the counter is incremented, which would trigger
     // an assert() in execute(). Either way, it's not "wrong", but the assert() is useful.
-    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_relaxed);
+    uint32_t activeJobs = (background ? mActiveBackgroundJobs : mActiveJobs).fetch_add(1,
+            std::memory_order_relaxed);
 
-    put(state.workQueue, job);
+    put(workQueue, job);
 
     HEAVY_SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs + 1);
 
-    // wake-up a thread if needed...
+    // wake-up a thread to run this job, preferably one that shares a cache with us
     if (!(flags & DONT_SIGNAL)) {
-        // wake-up multiple queues because there could be multiple jobs queued
-        // especially if DONT_SIGNAL was used
-        wake();
+        wake(&state, 1, background);
     }
 
     // after run() returns, the job is virtually invalid (it'll die on its own)
@@ -435,8 +864,12 @@ void JobSystem::waitAndRelease(Job*& job) noexcept {
     assert(job->refCount.load(std::memory_order_relaxed) >= 1);
 
     ThreadState& state(getState());
+
+    // don't get stuck in a BACKGROUND job while the job we're waiting on is done
+    const bool allowBackground = job->background || state.background;
+
     do {
-        if (!execute(state)) {
+        if (!execute(state, allowBackground)) {
             // test if job has completed first, to possibly avoid taking the lock
             if (hasJobCompleted(job)) {
                 break;
@@ -448,13 +881,9 @@ void JobSystem::waitAndRelease(Job*& job) noexcept {
             //    - yet our job hasn't completed yet
             //    ergo, it's being run in another thread
             //
-            // this could take time however, so we will wait with a condition, and
-            // continue to handle more jobs, as they get added.
-
-            std::unique_lock<Mutex> lock(mWaiterLock);
-            if (!hasJobCompleted(job) && !hasActiveJobs() && !exitRequested()) {
-                wait(lock);
-            }
+            // this could take time however, so we will spin and then sleep until the job
+            // completes, and continue to handle more jobs, as they get added.
+            idle(state, job, allowBackground);
         }
     } while (!hasJobCompleted(job) && !exitRequested());
 
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/JobTask.h>
+
+#include <utils/Allocator.h>
+#include <utils/Panic.h>
+
+#include <cstddef>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace utils {
+namespace jobs {
+namespace details {
+
+namespace {
+
+constexpr size_t MIN_FRAME_SIZE = 64;
+constexpr size_t SIZE_CLASS_COUNT = 6;      // 64 to 2048 bytes
+constexpr size_t FRAME_POOL_SIZE = 64 * 1024;
+
+template<size_t SIZE>
+using FramePool = Arena<
+        PoolAllocator<SIZE, alignof(std::max_align_t), 0, AtomicFreeList>,
+        LockingPolicy::NoLock>;
+
+// Pools are created the first time a frame of their size class is needed. Like the
+// EntityManager, they're leaked, so that frames can be freed until the process terminates.
+template<size_t C>
+FramePool<(MIN_FRAME_SIZE << C)>& getFramePool() noexcept {
+    static auto* const pool = new FramePool<(MIN_FRAME_SIZE << C)>(
+            "JobTask frame pool", FRAME_POOL_SIZE);
+    return *pool;
+}
+
+template<typename F>
+inline auto withFramePool(size_t c, F&& f) noexcept {
+    switch (c) {
+        case 0:  return f(getFramePool<0>());
+        case 1:  return f(getFramePool<1>());
+        case 2:  return f(getFramePool<2>());
+        case 3:  return f(getFramePool<3>());
+        case 4:  return f(getFramePool<4>());
+        default: return f(getFramePool<5>());
+    }
+}
+static_assert(SIZE_CLASS_COUNT == 6, "withFramePool() must handle all size classes");
+
+// returns SIZE_CLASS_COUNT for frames too large to be pooled
+inline size_t getSizeClass(size_t size) noexcept {
+    size_t c = 0;
+    while (c < SIZE_CLASS_COUNT && (MIN_FRAME_SIZE << c) < size) {
+        c++;
+    }
+    return c;
+}
+
+} // anonymous namespace
+
+void* allocateTaskFrame(size_t size) noexcept {
+    size_t const c = getSizeClass(size);
+    if (c < SIZE_CLASS_COUNT) {
+        void* const p = withFramePool(c, [](auto& pool) {
+            return pool.alloc(pool.getAllocator().getSize());
+        });
+        if (UTILS_LIKELY(p)) {
+            return p;
+        }
+        // the pool is exhausted
+    }
+    void* const p = ::malloc(size);
+    ASSERT_POSTCONDITION(p, "Out of memory allocating a %zu bytes task frame", size);
+    return p;
+}
+
+void freeTaskFrame(void* p, size_t size) noexcept {
+    size_t const c = getSizeClass(size);
+    if (c < SIZE_CLASS_COUNT) {
+        bool const pooled = withFramePool(c, [p](auto& pool) {
+            HeapArea const& area = pool.getArea();
+            uintptr_t const addr = uintptr_t(p);
+            if (addr >= uintptr_t(area.begin()) && addr < uintptr_t(area.end())) {
+                pool.free(p);
+                return true;
+            }
+            return false;
+        });
+        if (pooled) {
+            return;
+        }
+    }
+    ::free(p);
+}
+
+} // namespace details
+} // namespace jobs
+} // namespace utils
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/TraceRecorder.h>
+
+#include <utils/Mutex.h>
+#include <utils/ostream.h>
+#include <utils/ThreadLocal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#   include <pthread.h>
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#elif defined(__APPLE__)
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
+
+namespace utils {
+
+std::atomic<bool> TraceRecorder::sEnabled = { false };
+
+namespace {
+
+constexpr size_t EVENT_MASK = TraceRecorder::EVENTS_PER_THREAD - 1;
+static_assert((TraceRecorder::EVENTS_PER_THREAD & EVENT_MASK) == 0,
+        "EVENTS_PER_THREAD must be a power of two");
+
+constexpr size_t NAME_WORDS = (TraceRecorder::MAX_NAME_LENGTH + 1) / sizeof(uint64_t);
+static_assert(NAME_WORDS * sizeof(uint64_t) == TraceRecorder::MAX_NAME_LENGTH + 1,
+        "MAX_NAME_LENGTH + 1 must be a multiple of 8");
+
+// An event takes exactly one cache line. All fields are atomic so that dump() can read them
+// while they're being overwritten, such torn events are detected and dropped.
+struct Event {
+    std::atomic<uint64_t> time;
+    std::atomic<int64_t> value;
+    std::atomic<uint64_t> type;
+    std::atomic<uint64_t> name[NAME_WORDS];
+};
+
+struct ThreadBuffer {
+    // number of events recorded so far, only written by the owner thread
+    std::atomic<uint64_t> head = { 0 };
+    // the fields below are protected by the Registry lock
+    uint64_t tail = 0;      // events before tail have been cleared
+    uint32_t tid = 0;
+    bool inUse = true;      // false when the owner thread has terminated
+    char name[16] = {};
+    Event events[TraceRecorder::EVENTS_PER_THREAD];
+};
+
+struct Registry {
+    Mutex lock;
+    std::vector<ThreadBuffer*> buffers;
+};
+
+Registry& getRegistry() noexcept {
+    // never destroyed, because threads can terminate after static destructors have run
+    static Registry* const registry = new Registry;
+    return *registry;
+}
+
+struct ThreadSlot {
+    ThreadBuffer* buffer = nullptr;
+    ~ThreadSlot() noexcept {
+        // this thread is terminating, its buffer (and events) can be reused by a new thread
+        if (buffer) {
+            Registry& registry = getRegistry();
+            std::lock_guard<Mutex> guard(registry.lock);
+            buffer->inUse = false;
+        }
+    }
+};
+
+UTILS_DEFINE_TLS(ThreadSlot) sThreadSlot;
+
+uint32_t getThreadId() noexcept {
+#if defined(__linux__)
+    return uint32_t(syscall(SYS_gettid));
+#else
+    static std::atomic<uint32_t> sNextThreadId = { 1 };
+    return sNextThreadId.fetch_add(1, std::memory_order_relaxed);
+#endif
+}
+
+uint32_t getProcessId() noexcept {
+#if defined(__linux__) || defined(__APPLE__)
+    return uint32_t(getpid());
+#else
+    return 1;
+#endif
+}
+
+UTILS_NOINLINE
+ThreadBuffer* acquireBuffer() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<Mutex> guard(registry.lock);
+    auto pos = std::find_if(registry.buffers.begin(), registry.buffers.end(),
+            [](ThreadBuffer const* buffer) { return !buffer->inUse; });
+    ThreadBuffer* buffer;
+    if (pos != registry.buffers.end()) {
+        buffer = *pos;
+        buffer->head.store(0, std::memory_order_relaxed);
+        buffer->tail = 0;
+        buffer->inUse = true;
+    } else {
+        buffer = new ThreadBuffer;
+        registry.buffers.push_back(buffer);
+    }
+    buffer->tid = getThreadId();
+    memset(buffer->name, 0, sizeof(buffer->name));
+#if (defined(__linux__) && !defined(ANDROID)) || defined(__APPLE__)
+    pthread_getname_np(pthread_self(), buffer->name, sizeof(buffer->name));
+#endif
+    return buffer;
+}
+
+// writes s as a JSON string, without the quotes
+void writeString(io::ostream& out, const char* s) noexcept {
+    char buf[2 * TraceRecorder::MAX_NAME_LENGTH + 1];
+    char* p = buf;
+    for (size_t i = 0; s[i] && i < TraceRecorder::MAX_NAME_LENGTH; i++) {
+        const char c = s[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else {
+            *p++ = uint8_t(c) < 0x20 ? ' ' : c;
+        }
+    }
+    *p = 0;
+    out << buf;
+}
+
+} // anonymous namespace
+
+void TraceRecorder::setEnabled(bool enabled) noexcept {
+    sEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void TraceRecorder::record(Type type, const char* name, int64_t value) noexcept {
+    using namespace std::chrono;
+    const uint64_t now = uint64_t(duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count());
+
+    ThreadSlot& slot = sThreadSlot;
+    if (UTILS_UNLIKELY(!slot.buffer)) {
+        slot.buffer = acquireBuffer();
+    }
+    ThreadBuffer* const buffer = slot.buffer;
+
+    uint64_t words[NAME_WORDS] = {};
+    if (name) {
+        memcpy(words, name, strnlen(name, MAX_NAME_LENGTH));
+    }
+
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+
+    // Makes our previous update of head visible to a dump() that sees any of the stores below,
+    // this is how it detects that an event was overwritten while it was reading it.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Event& event = buffer->events[head & EVENT_MASK];
+    event.time.store(now, std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    event.type.store(uint64_t(type), std::memory_order_relaxed);
+    for (size_t i = 0; i < NAME_WORDS; i++) {
+        event.name[i].store(words[i], std::memory_order_relaxed);
+    }
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::clear() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<Mutex> guard(registry.lock);
+    for (ThreadBuffer* buffer : registry.buffers) {
+        buffer->tail = buffer->head.load(std::memory_order_relaxed);
+    }
+}
+
+void TraceRecorder::dump(io::ostream& out) noexcept {
+    struct RawEvent {
+        uint64_t time;
+        int64_t value;
+        Type type;
+        char name[MAX_NAME_LENGTH + 1];
+    };
+
+    struct Thread {
+        uint32_t tid;
+        char name[16];
+        std::vector<RawEvent> events;
+    };
+
+    // take a snapshot of all the events under the lock, so that buffers can't be reused
+    // while we're reading them, but format them outside of it.
+    std::vector<Thread> threads;
+    Registry& registry = getRegistry();
+    registry.lock.lock();
+    threads.resize(registry.buffers.size());
+    for (size_t t = 0, c = registry.buffers.size(); t < c; t++) {
+        ThreadBuffer const* const buffer = registry.buffers[t];
+        Thread& thread = threads[t];
+        thread.tid = buffer->tid;
+        memcpy(thread.name, buffer->name, sizeof(thread.name));
+
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        // the slot of the oldest event is also the one the next event goes to, so we don't
+        // read it, see below.
+        uint64_t first = head >= EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD + 1 : 0;
+        first = std::max(first, buffer->tail);
+        if (first >= head) {
+            continue;
+        }
+
+        thread.events.resize(head - first);
+        for (uint64_t i = first; i < head; i++) {
+            Event const& event = buffer->events[i & EVENT_MASK];
+            RawEvent& raw = thread.events[i - first];
+            uint64_t words[NAME_WORDS];
+            raw.time = event.time.load(std::memory_order_relaxed);
+            raw.value = event.value.load(std::memory_order_relaxed);
+            raw.type = Type(event.type.load(std::memory_order_relaxed));
+            for (size_t w = 0; w < NAME_WORDS; w++) {
+                words[w] = event.name[w].load(std::memory_order_relaxed);
+            }
+            memcpy(raw.name, words, sizeof(raw.name));
+            raw.name[MAX_NAME_LENGTH] = 0;
+        }
+
+        // If the owner thread overwrote an event we just read, it had already published a head
+        // past that event's slot, see record(). The event at the current head could be in the
+        // process of being written, so its slot is dropped as well.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t newHead = buffer->head.load(std::memory_order_relaxed);
+        const uint64_t valid = newHead + 1 > EVENTS_PER_THREAD ?
+                newHead + 1 - EVENTS_PER_THREAD : 0;
+        if (valid > first) {
+            const size_t dropped = size_t(std::min(valid - first, head - first));
+            thread.events.erase(thread.events.begin(), thread.events.begin() + dropped);
+        }
+    }
+    registry.lock.unlock();
+
+    const uint32_t pid = getProcessId();
+    char buf[128];
+    const char* separator = "\n";
+
+    out << "{\"traceEvents\":[";
+    for (Thread const& thread : threads) {
+        snprintf(buf, sizeof(buf),
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+                "\"args\":{\"name\":\"", separator, pid, thread.tid);
+        out << buf;
+        if (thread.name[0]) {
+            writeString(out, thread.name);
+        } else {
+            out << "thread " << thread.tid;
+        }
+        out << "\"}}";
+        separator = ",\n";
+
+        for (RawEvent const& event : thread.events) {
+            out << separator << "{";
+            if (event.type != Type::END) {
+                out << "\"name\":\"";
+                writeString(out, event.name);
+                out << "\",";
+            }
+            const char* ph = "B";
+            switch (event.type) {
+                case Type::BEGIN:       ph = "B"; break;
+                case Type::END:         ph = "E"; break;
+                case Type::INSTANT:     ph = "i\",\"s\":\"t"; break;
+                case Type::COUNTER:     ph = "C"; break;
+                case Type::ASYNC_BEGIN: ph = "b\",\"cat\":\"async"; break;
+                case Type::ASYNC_END:   ph = "e\",\"cat\":\"async"; break;
+            }
+            // timestamps are in microseconds, we keep the nanoseconds as decimals
+            snprintf(buf, sizeof(buf),
+                    "\"ph\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%" PRIu64 ".%03u",
+                    ph, pid, thread.tid, event.time / 1000u, unsigned(event.time % 1000u));
+            out << buf;
+            switch (event.type) {
+                case Type::INSTANT:
+                case Type::COUNTER:
+                    snprintf(buf, sizeof(buf), ",\"args\":{\"value\":%" PRId64 "}", event.value);
+                    out << buf;
+                    break;
+                case Type::ASYNC_BEGIN:
+                case Type::ASYNC_END:
+                    snprintf(buf, sizeof(buf), ",\"id\":%" PRId64, event.value);
+                    out << buf;
+                    break;
+                default:
+                    break;
+            }
+            out << "}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+} // namespace utils
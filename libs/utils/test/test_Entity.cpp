@@ -16,7 +16,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "../src/EntityManagerImpl.h"
 #include <utils/NameComponentManager.h>
@@ -128,6 +131,119 @@ TEST(EntityTest, Lots) {
     // at this point, we should be getting indices from the free-list exclusively
 }
 
+TEST(EntityTest, Listener) {
+    struct Listener : public EntityManager::Listener {
+        void onEntitiesDestroyed(size_t n, Entity const* entities) noexcept override {
+            destroyed.insert(destroyed.end(), entities, entities + n);
+        }
+        std::vector<Entity> destroyed;
+    } listener;
+
+    EntityManagerImpl em;
+    em.registerListener(&listener);
+
+    Entity entities[4];
+    em.create(4, entities);
+
+    // by default, listeners are called by destroy()
+    em.destroy(entities[0]);
+    ASSERT_EQ(1, listener.destroyed.size());
+    EXPECT_EQ(entities[0], listener.destroyed[0]);
+    listener.destroyed.clear();
+
+    // deferred listeners are only called from notifyListeners(), in one batch
+    em.setDeferredListenerNotifications(true);
+    em.destroy(1, entities + 1);
+    em.destroy(entities[3]);
+    EXPECT_TRUE(listener.destroyed.empty());
+    em.notifyListeners();
+    ASSERT_EQ(2, listener.destroyed.size());
+    EXPECT_EQ(entities[1], listener.destroyed[0]);
+    EXPECT_EQ(entities[3], listener.destroyed[1]);
+
+    listener.destroyed.clear();
+    em.notifyListeners();
+    EXPECT_TRUE(listener.destroyed.empty());
+
+    // the pending list is flushed when it gets too large
+    std::vector<Entity> many(8192);
+    em.create(many.size(), many.data());
+    em.destroy(many.size(), many.data());
+    EXPECT_EQ(many.size(), listener.destroyed.size());
+    listener.destroyed.clear();
+
+    // and when deferred notifications are disabled
+    em.destroy(entities[2]);
+    EXPECT_TRUE(listener.destroyed.empty());
+    em.setDeferredListenerNotifications(false);
+    ASSERT_EQ(1, listener.destroyed.size());
+    EXPECT_EQ(entities[2], listener.destroyed[0]);
+    listener.destroyed.clear();
+
+    em.unregisterListener(&listener);
+    em.create(1, entities);
+    em.destroy(entities[0]);
+    em.notifyListeners();
+    EXPECT_TRUE(listener.destroyed.empty());
+}
+
+TEST(EntityTest, MultiThreaded) {
+    EntityManagerImpl em;
+    constexpr size_t THREAD_COUNT = 4;
+    constexpr size_t COUNT = 8192;
+    std::vector<std::vector<Entity>> results(THREAD_COUNT);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        threads.emplace_back([&em, &result = results[t]]() {
+            std::vector<Entity> entities(256);
+            for (size_t i = 0; i < COUNT; i += entities.size()) {
+                em.create(entities.size(), entities.data());
+                // keep every other batch alive
+                if ((i / entities.size()) & 1u) {
+                    em.destroy(entities.size(), entities.data());
+                } else {
+                    result.insert(result.end(), entities.begin(), entities.end());
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // all the entities still alive must be distinct
+    std::vector<Entity> all;
+    for (auto const& result : results) {
+        all.insert(all.end(), result.begin(), result.end());
+    }
+    for (Entity e : all) {
+        EXPECT_TRUE(em.isAlive(e));
+    }
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(all.end(), std::adjacent_find(all.begin(), all.end()));
+    EXPECT_EQ(THREAD_COUNT * COUNT / 2, all.size());
+}
+
+TEST(EntityTest, ThreadCache) {
+    EntityManagerImpl em;
+    EntityManagerImpl other;
+    size_t n = EntityManager::getMaxEntityCount();
+    std::unique_ptr<Entity[]> entities(new Entity[n]);
+
+    // indices cached by a thread that terminates must be given back...
+    std::thread([&em]() {
+        em.destroy(em.create());
+    }).join();
+
+    // ... and so must the ones cached by a thread that starts using another EntityManager
+    em.destroy(em.create());
+    other.create();
+
+    em.create(n, entities.get());
+    EXPECT_TRUE(std::none_of(entities.get(), entities.get() + n,
+            [](Entity e) { return e.isNull(); }));
+}
+
 
 TEST(EntityTest, NameComponent) {
 
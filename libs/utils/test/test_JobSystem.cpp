@@ -23,6 +23,9 @@
 #include <math/mat3.h>
 
 #include <array>
+#include <chrono>
+#include <numeric>
+#include <random>
 #include <thread>
 #include <utils/Allocator.h>
 
@@ -218,6 +221,107 @@ TEST(JobSystem, JobSystemParallelChildren) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemManyThreadsAndChildren) {
+    v = 0;
+
+    // more threads than we used to support, and more jobs than a single job pool can hold
+    JobSystem js(48);
+    js.adopt();
+
+    struct User {
+        std::atomic_int calls = {0};
+        void func(JobSystem&, JobSystem::Job*) {
+            v++;
+            calls++;
+        };
+    } j;
+
+    JobSystem::Job* root = js.createJob<User, &User::func>(nullptr, &j);
+    for (int i=0 ; i<20000 ; i++) {
+        JobSystem::Job* job = js.createJob<User, &User::func>(root, &j);
+        ASSERT_NE(nullptr, job);
+        js.run(job, JobSystem::DONT_SIGNAL);
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(20001, v.load());
+    EXPECT_EQ(20001, j.calls);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemBackgroundJobs) {
+    JobSystem js(4);
+    js.adopt();
+    js.setMaxBackgroundThreadCount(2);
+
+    struct User {
+        std::atomic_int calls = {0};
+        std::atomic_int running = {0};
+        std::atomic_int maxRunning = {0};
+        void func(JobSystem& js, JobSystem::Job* job) {
+            int r = ++running;
+            int m = maxRunning;
+            while (r > m && !maxRunning.compare_exchange_weak(m, r)) { }
+            // jobs run from a BACKGROUND job are BACKGROUND jobs too
+            js.run(js.createJob(job), JobSystem::DONT_SIGNAL);
+            std::this_thread::yield();
+            calls++;
+            running--;
+        };
+    } j;
+
+    JobSystem::Job* root = js.createJob();
+    for (int i=0 ; i<256 ; i++) {
+        js.run(js.createJob<User, &User::func>(root, &j), JobSystem::BACKGROUND);
+    }
+    root = js.runAndRetain(root, JobSystem::BACKGROUND);
+
+    // a job that is not BACKGROUND can still run
+    int result = 0;
+    js.runAndWait(jobs::createJob(js, nullptr, [&result]() { result = 42; }));
+    EXPECT_EQ(42, result);
+
+    js.waitAndRelease(root);
+
+    EXPECT_EQ(256, j.calls);
+    EXPECT_LE(j.maxRunning, 2);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemBackgroundQueueFull) {
+    JobSystem js;
+    js.adopt();
+    js.setMaxBackgroundThreadCount(1);
+
+    struct User {
+        std::atomic_int calls = {0};
+        std::atomic_int running = {0};
+        std::atomic_int maxRunning = {0};
+        void func(JobSystem&, JobSystem::Job*) {
+            int r = ++running;
+            int m = maxRunning;
+            while (r > m && !maxRunning.compare_exchange_weak(m, r)) { }
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            calls++;
+            running--;
+        };
+    } j;
+
+    // more jobs than a queue can hold, the cap holds while run() makes room for them
+    JobSystem::Job* root = js.createJob();
+    for (int i=0 ; i<6000 ; i++) {
+        js.run(js.createJob<User, &User::func>(root, &j), JobSystem::BACKGROUND);
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(6000, j.calls);
+    EXPECT_EQ(1, j.maxRunning);
+
+    js.emancipate();
+}
+
 
 TEST(JobSystem, JobSystemSequentialChildren) {
     JobSystem js;
@@ -253,6 +357,33 @@ TEST(JobSystem, JobSystemSequentialChildren) {
 }
 
 
+TEST(JobSystem, JobSystemContinuation) {
+    JobSystem js;
+    js.adopt();
+
+    std::atomic<int> children = { 0 };
+    std::atomic<int> seen = { -1 };
+
+    JobSystem::Job* done = js.createJob();
+    JobSystem::Job* job = js.createJob();
+    for (size_t i = 0; i < 64; i++) {
+        js.run(js.createJob(job, [&children](JobSystem&, JobSystem::Job*) {
+            children.fetch_add(1, std::memory_order_relaxed);
+        }));
+    }
+
+    // the continuation runs after the job and all its children are done
+    js.setContinuation(job, jobs::createJob(js, done, [&children, &seen]() {
+        seen = children.load(std::memory_order_relaxed);
+    }));
+    js.run(job);
+    js.runAndWait(done);
+
+    EXPECT_EQ(64, seen);
+
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemParallelFor) {
     JobSystem js;
     js.adopt();
@@ -284,6 +415,118 @@ TEST(JobSystem, JobSystemParallelFor) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemParallelReduce) {
+    JobSystem js(4);
+    js.adopt();
+
+    std::vector<uint32_t> values(100000);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = uint32_t(i);
+    }
+
+    uint64_t sum = parallel_reduce(js, 0, uint32_t(values.size()), uint64_t(0),
+            [&values](uint32_t s, uint32_t c) {
+                uint64_t r = 0;
+                for (uint32_t i = s; i < s + c; i++) {
+                    r += values[i];
+                }
+                return r;
+            }, std::plus<uint64_t>(), CountSplitter<64>());
+    EXPECT_EQ(uint64_t(values.size()) * (values.size() - 1) / 2, sum);
+
+    // reduce is not commutative, chunks must be combined in order
+    std::vector<uint32_t> order = parallel_reduce(js, 0, 1000, std::vector<uint32_t>(),
+            [](uint32_t s, uint32_t c) {
+                std::vector<uint32_t> r(c);
+                std::iota(r.begin(), r.end(), s);
+                return r;
+            },
+            [](std::vector<uint32_t> lhs, std::vector<uint32_t> const& rhs) {
+                lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+                return lhs;
+            }, CountSplitter<8>());
+    ASSERT_EQ(1000, order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        EXPECT_EQ(i, order[i]);
+    }
+
+    EXPECT_EQ(7, parallel_reduce(js, 0, 0, 7, [](uint32_t, uint32_t) { return 1; },
+            std::plus<int>(), CountSplitter<64>()));
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemParallelScan) {
+    JobSystem js(4);
+    js.adopt();
+
+    const uint32_t count = 10007;
+    std::vector<uint32_t> in(count);
+    for (uint32_t i = 0; i < count; i++) {
+        in[i] = i % 3u;
+    }
+
+    std::vector<uint32_t> exclusive(count);
+    std::vector<uint32_t> inclusive(count);
+    uint32_t e = parallel_exclusive_scan(js, in.data(), exclusive.data(), count, 5u,
+            std::plus<uint32_t>(), CountSplitter<32>());
+    uint32_t i = parallel_inclusive_scan(js, in.data(), inclusive.data(), count, 5u,
+            std::plus<uint32_t>(), CountSplitter<32>());
+
+    uint32_t sum = 5;
+    for (uint32_t k = 0; k < count; k++) {
+        EXPECT_EQ(sum, exclusive[k]);
+        sum += in[k];
+        EXPECT_EQ(sum, inclusive[k]);
+    }
+    EXPECT_EQ(sum, e);
+    EXPECT_EQ(sum, i);
+
+    // in-place stream compaction: keep the multiples of 3
+    std::vector<uint32_t> values(count);
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<uint32_t> compacted(count);
+    uint32_t kept = parallel_scan(js, 0, count, 0u,
+            [&values](uint32_t s, uint32_t c) {
+                return uint32_t(std::count_if(values.begin() + s, values.begin() + s + c,
+                        [](uint32_t v) { return v % 3u == 0; }));
+            },
+            std::plus<uint32_t>(),
+            [&values, &compacted](uint32_t s, uint32_t c, uint32_t index) {
+                for (uint32_t k = s; k < s + c; k++) {
+                    if (values[k] % 3u == 0) {
+                        compacted[index++] = values[k];
+                    }
+                }
+                return index;
+            }, CountSplitter<16>());
+    EXPECT_EQ((count + 2) / 3, kept);
+    for (uint32_t k = 0; k < kept; k++) {
+        EXPECT_EQ(k * 3, compacted[k]);
+    }
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemParallelSort) {
+    JobSystem js(4);
+    js.adopt();
+
+    for (uint32_t count : { 0u, 1u, 100u, 4099u, 100000u }) {
+        std::vector<uint32_t> values(count);
+        std::mt19937 gen(count);
+        for (auto& v : values) {
+            v = gen() % 1000u;
+        }
+        std::vector<uint32_t> expected(values);
+        std::sort(expected.begin(), expected.end());
+        parallel_sort(js, values.begin(), count, std::less<uint32_t>(), CountSplitter<256>());
+        EXPECT_EQ(expected, values);
+    }
+
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemDelegates) {
     JobSystem js;
     js.adopt();
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/JobSystem.h>
+#include <utils/JobTask.h>
+
+#include <atomic>
+
+#include <string.h>
+
+using namespace utils;
+using namespace jobs;
+
+TEST(JobTask, FrameAllocator) {
+    void* p = jobs::details::allocateTaskFrame(100);
+    jobs::details::freeTaskFrame(p, 100);
+    // frames of the same size class are recycled
+    void* q = jobs::details::allocateTaskFrame(120);
+    EXPECT_EQ(p, q);
+    jobs::details::freeTaskFrame(q, 120);
+
+    // large frames aren't pooled, but still work
+    void* large = jobs::details::allocateTaskFrame(64 * 1024);
+    memset(large, 0, 64 * 1024);
+    jobs::details::freeTaskFrame(large, 64 * 1024);
+}
+
+#if UTILS_HAS_COROUTINES
+
+static Task<int> answer() {
+    co_return 42;
+}
+
+static Task<int> sum(int n) {
+    if (n == 0) {
+        co_return 0;
+    }
+    co_return n + co_await sum(n - 1);
+}
+
+static Task<int> hop(JobSystem& js, int count) {
+    int hops = 0;
+    for (int i = 0; i < count; i++) {
+        co_await schedule(js);
+        hops++;
+    }
+    co_return hops;
+}
+
+static Task<uint32_t> children(JobSystem& js, std::atomic<uint32_t>& counter) {
+    JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < 64; i++) {
+        js.run(js.createJob(parent, [&counter](JobSystem&, JobSystem::Job*) {
+            counter.fetch_add(1, std::memory_order_relaxed);
+        }));
+    }
+    co_await run(js, parent);
+    co_return counter.load(std::memory_order_relaxed);
+}
+
+static Task<int> waitFor(Event& event) {
+    co_await event;
+    co_return 1;
+}
+
+static Task<int> signalAndWait(JobSystem& js, Event& event) {
+    // by the time this job runs, we're most likely suspended on the event
+    js.run(js.createJob(nullptr, [&event](JobSystem&, JobSystem::Job*) {
+        event.signal();
+    }));
+    co_return co_await waitFor(event);
+}
+
+TEST(JobTask, Value) {
+    JobSystem js;
+    js.adopt();
+    EXPECT_EQ(42, runAndWait(js, answer()));
+    js.emancipate();
+}
+
+TEST(JobTask, Nested) {
+    JobSystem js;
+    js.adopt();
+    EXPECT_EQ(500500, runAndWait(js, sum(1000)));
+    js.emancipate();
+}
+
+TEST(JobTask, Schedule) {
+    JobSystem js(4);
+    js.adopt();
+    EXPECT_EQ(1000, runAndWait(js, hop(js, 1000)));
+    js.emancipate();
+}
+
+TEST(JobTask, Jobs) {
+    JobSystem js(4);
+    js.adopt();
+    std::atomic<uint32_t> counter = { 0 };
+    EXPECT_EQ(64, runAndWait(js, children(js, counter)));
+    js.emancipate();
+}
+
+TEST(JobTask, Event) {
+    JobSystem js(4);
+    js.adopt();
+
+    Event event(js);
+    EXPECT_FALSE(event.isSignaled());
+    EXPECT_EQ(1, runAndWait(js, signalAndWait(js, event)));
+    EXPECT_TRUE(event.isSignaled());
+
+    // a signaled event doesn't suspend
+    EXPECT_EQ(1, runAndWait(js, waitFor(event)));
+
+    event.reset();
+    EXPECT_FALSE(event.isSignaled());
+
+    js.emancipate();
+}
+
+TEST(JobTask, ManyWaiters) {
+    JobSystem js(4);
+    js.adopt();
+
+    Event event(js);
+    std::atomic<int> resumed = { 0 };
+    JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < 16; i++) {
+        js.run(js.createJob(parent, [&event, &resumed](JobSystem& js, JobSystem::Job*) {
+            resumed.fetch_add(runAndWait(js, waitFor(event)), std::memory_order_relaxed);
+        }));
+    }
+    parent = js.runAndRetain(parent);
+    event.signal();
+    js.waitAndRelease(parent);
+    EXPECT_EQ(16, resumed.load());
+
+    js.emancipate();
+}
+
+#endif // UTILS_HAS_COROUTINES
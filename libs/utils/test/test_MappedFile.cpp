@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/MappedFile.h>
+#include <utils/Path.h>
+
+#include <fstream>
+#include <string>
+#include <utility>
+
+using namespace utils;
+
+TEST(MappedFile, MapAndMove) {
+    Path path = Path::getTemporaryDirectory() + "test_utils_mapped_file.bin";
+    const std::string content = "Hello mapped world!";
+    {
+        std::ofstream out(path.getPath(), std::ios::binary);
+        out << content;
+    }
+
+    MappedFile file(path.c_str());
+    ASSERT_TRUE(file.isValid());
+    ASSERT_EQ(file.size(), content.size());
+    EXPECT_EQ(std::string((const char*) file.data(), file.size()), content);
+
+    MappedFile moved(std::move(file));
+    EXPECT_FALSE(file.isValid());
+    EXPECT_TRUE(moved.isValid());
+    EXPECT_EQ(moved.data()[0], 'H');
+
+    file = std::move(moved);
+    EXPECT_TRUE(file.isValid());
+    EXPECT_FALSE(moved.isValid());
+
+    path.unlinkFile();
+}
+
+TEST(MappedFile, Invalid) {
+    MappedFile missing((Path::getTemporaryDirectory() + "test_utils_missing_file").c_str());
+    EXPECT_FALSE(missing.isValid());
+    EXPECT_EQ(missing.data(), nullptr);
+    EXPECT_EQ(missing.size(), 0);
+
+    // empty files can't be mapped
+    Path path = Path::getTemporaryDirectory() + "test_utils_empty_file.bin";
+    std::ofstream(path.getPath(), std::ios::binary).close();
+    EXPECT_FALSE(MappedFile(path.c_str()).isValid());
+    path.unlinkFile();
+}
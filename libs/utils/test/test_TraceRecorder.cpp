@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/JobSystem.h>
+#include <utils/sstream.h>
+#include <utils/Systrace.h>
+#include <utils/TraceRecorder.h>
+
+#include <string>
+#include <thread>
+
+using namespace utils;
+
+static size_t count(std::string const& s, const char* what) {
+    size_t n = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+static std::string dump() {
+    io::sstream ss;
+    TraceRecorder::dump(ss);
+    return ss.c_str();
+}
+
+TEST(TraceRecorder, Disabled) {
+    TraceRecorder::setEnabled(false);
+    TraceRecorder::clear();
+    {
+        TraceRecorder::Scope scope("disabled");
+        TraceRecorder::instant("disabled");
+    }
+    std::string json = dump();
+    EXPECT_EQ(0, count(json, "disabled"));
+    EXPECT_EQ(0, json.find("{\"traceEvents\":["));
+}
+
+TEST(TraceRecorder, ValuesNotEvaluatedWhenDisabled) {
+    int evaluated = 0;
+    auto value = [&evaluated]() { return ++evaluated; };
+
+    TraceRecorder::setEnabled(false);
+    SYSTRACE_VALUE32("systraceValue", value());
+    SYSTRACE_VALUE64("systraceValue", value());
+    EXPECT_EQ(0, evaluated);
+
+    TraceRecorder::setEnabled(true);
+    TraceRecorder::clear();
+    SYSTRACE_VALUE32("systraceValue", value());
+    SYSTRACE_VALUE64("systraceValue", value());
+    TraceRecorder::setEnabled(false);
+    EXPECT_EQ(2, evaluated);
+    EXPECT_EQ(2, count(dump(), "systraceValue"));
+}
+
+TEST(TraceRecorder, Events) {
+    TraceRecorder::setEnabled(true);
+    TraceRecorder::clear();
+    {
+        TraceRecorder::Scope scope("outer");
+        TraceRecorder::instant("instant", 42);
+        TraceRecorder::counter("counter", -7);
+        TraceRecorder::asyncBegin("async", 3);
+        TraceRecorder::asyncEnd("async", 3);
+        TraceRecorder::Scope inner("quote\" and \\backslash");
+    }
+    std::thread([] { TraceRecorder::Scope scope("other thread"); }).join();
+    TraceRecorder::setEnabled(false);
+
+    std::string json = dump();
+    EXPECT_EQ(1, count(json, "\"name\":\"outer\",\"ph\":\"B\""));
+    EXPECT_EQ(1, count(json, "\"name\":\"other thread\",\"ph\":\"B\""));
+    EXPECT_EQ(3, count(json, "\"ph\":\"B\""));
+    EXPECT_EQ(3, count(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1, count(json, "\"name\":\"instant\",\"ph\":\"i\""));
+    EXPECT_EQ(1, count(json, "\"args\":{\"value\":42}"));
+    EXPECT_EQ(1, count(json, "\"args\":{\"value\":-7}"));
+    EXPECT_EQ(1, count(json, "\"ph\":\"b\""));
+    EXPECT_EQ(1, count(json, "\"ph\":\"e\""));
+    EXPECT_EQ(1, count(json, "quote\\\" and \\\\backslash"));
+    EXPECT_LE(2, count(json, "\"thread_name\""));
+    EXPECT_EQ(json.size() - 2, json.rfind("}"));
+}
+
+TEST(TraceRecorder, ScopeToggledWhileActive) {
+    TraceRecorder::setEnabled(false);
+    TraceRecorder::clear();
+    {
+        TraceRecorder::Scope scope("unbalanced");
+        TraceRecorder::setEnabled(true);
+    }
+    TraceRecorder::setEnabled(false);
+    std::string json = dump();
+    EXPECT_EQ(0, count(json, "\"ph\":\"B\""));
+    EXPECT_EQ(0, count(json, "\"ph\":\"E\""));
+}
+
+TEST(TraceRecorder, Overflow) {
+    TraceRecorder::setEnabled(true);
+    TraceRecorder::clear();
+    for (size_t i = 0; i < TraceRecorder::EVENTS_PER_THREAD + 100; i++) {
+        TraceRecorder::instant("overflow", int64_t(i));
+    }
+    TraceRecorder::setEnabled(false);
+    std::string json = dump();
+    EXPECT_EQ(TraceRecorder::EVENTS_PER_THREAD - 1, count(json, "\"name\":\"overflow\""));
+    EXPECT_EQ(0, count(json, "\"args\":{\"value\":100}"));
+    EXPECT_EQ(1, count(json, "\"args\":{\"value\":101}"));
+}
+
+TEST(TraceRecorder, JobSystem) {
+    JobSystem js(4);
+    js.adopt();
+
+    TraceRecorder::setEnabled(true);
+    TraceRecorder::clear();
+    auto* root = js.createJob();
+    for (size_t i = 0; i < 64; i++) {
+        js.run(js.createJob(root, [](JobSystem&, JobSystem::Job*) {
+            std::this_thread::yield();
+        }));
+    }
+    js.runAndWait(root);
+    TraceRecorder::setEnabled(false);
+
+    std::string json = dump();
+    EXPECT_EQ(64, count(json, "\"name\":\"JobSystem::job\",\"ph\":\"B\""));
+
+    js.emancipate();
+}
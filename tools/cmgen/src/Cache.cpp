@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Cache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <string.h>
+
+#if defined(WIN32)
+#   include <process.h>
+#   define getpid _getpid
+#else
+#   include <unistd.h>
+#endif
+
+using namespace filament::ibl;
+
+static constexpr uint32_t IMAGE_MAGIC = 0x434d4731; // 'CMG1'
+
+Cache::Hasher& Cache::Hasher::add(void const* data, size_t size) noexcept {
+    uint8_t const* p = static_cast<uint8_t const*>(data);
+    uint64_t h = mValue;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    mValue = h;
+    return *this;
+}
+
+bool Cache::Hasher::addFile(utils::Path const& path) {
+    std::ifstream in(path.getPath(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    char buffer[64 * 1024];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        add(buffer, size_t(in.gcount()));
+    }
+    return true;
+}
+
+Cache::Cache(utils::Path dir) : mDir(std::move(dir)) {
+    if (isEnabled()) {
+        mDir.mkdirRecursive();
+    }
+}
+
+utils::Path Cache::getPath(uint64_t key, const char* kind) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.", (unsigned long long) key);
+    return mDir + (name + std::string(kind));
+}
+
+bool Cache::contains(uint64_t key, const char* kind) const {
+    return isEnabled() && getPath(key, kind).exists();
+}
+
+bool Cache::load(uint64_t key, const char* kind, std::string& data) const {
+    if (!isEnabled()) {
+        return false;
+    }
+    std::ifstream in(getPath(key, kind).getPath(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+void Cache::store(uint64_t key, const char* kind, void const* data, size_t size) const {
+    if (!isEnabled()) {
+        return;
+    }
+    // write to a temporary file first, so that readers never see a partial entry. Its name must
+    // be unique among all the threads of all the processes sharing the cache.
+    const utils::Path path = getPath(key, kind);
+    std::ostringstream tmp;
+    tmp << path.getPath() << ".tmp" << getpid() << "_"
+        << std::hash<std::thread::id>()(std::this_thread::get_id());
+    {
+        std::ofstream out(tmp.str(), std::ios::binary | std::ios::trunc);
+        out.write(static_cast<char const*>(data), std::streamsize(size));
+        if (!out) {
+            std::remove(tmp.str().c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp.str().c_str(), path.c_str()) != 0) {
+        std::remove(tmp.str().c_str());
+    }
+}
+
+bool Cache::loadImage(uint64_t key, const char* kind, Image& image) const {
+    std::string data;
+    if (!load(key, kind, data)) {
+        return false;
+    }
+    uint32_t header[3];
+    const size_t rowSize = image.getWidth() * image.getBytesPerPixel();
+    if (data.size() != sizeof(header) + rowSize * image.getHeight()) {
+        return false;
+    }
+    memcpy(header, data.data(), sizeof(header));
+    if (header[0] != IMAGE_MAGIC || header[1] != image.getWidth() ||
+        header[2] != image.getHeight()) {
+        return false;
+    }
+    char const* src = data.data() + sizeof(header);
+    for (size_t y = 0; y < image.getHeight(); y++, src += rowSize) {
+        memcpy(image.getPixelRef(0, y), src, rowSize);
+    }
+    return true;
+}
+
+void Cache::storeImage(uint64_t key, const char* kind, Image const& image) const {
+    if (!isEnabled()) {
+        return;
+    }
+    const uint32_t header[3] = {
+            IMAGE_MAGIC, uint32_t(image.getWidth()), uint32_t(image.getHeight()) };
+    const size_t rowSize = image.getWidth() * image.getBytesPerPixel();
+    std::string data(reinterpret_cast<char const*>(header), sizeof(header));
+    data.reserve(sizeof(header) + rowSize * image.getHeight());
+    for (size_t y = 0; y < image.getHeight(); y++) {
+        data.append(static_cast<char const*>(image.getPixelRef(0, y)), rowSize);
+    }
+    store(key, kind, data.data(), data.size());
+}
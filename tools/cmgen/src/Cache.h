@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_CACHE_H
+#define SRC_CACHE_H
+
+#include <ibl/Image.h>
+
+#include <utils/Path.h>
+
+#include <string>
+#include <type_traits>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Content-addressed on-disk cache for cmgen's intermediate results.
+ *
+ * Entries are stored in <dir>/<key>.<kind>, where the key is a hash of everything the result
+ * depends on (see Hasher). Entries are written atomically, so the cache can be shared by
+ * concurrent jobs and concurrent cmgen processes.
+ */
+class Cache {
+public:
+    /**
+     * Part of every key. Bump it whenever a change to cmgen or libibl changes their results, so
+     * that entries written by older versions are never used.
+     */
+    static constexpr uint32_t VERSION = 1;
+
+    /**
+     * 64-bit FNV-1a hash, used to build keys.
+     */
+    class Hasher {
+    public:
+        Hasher() noexcept { add(VERSION); }
+
+        Hasher& add(void const* data, size_t size) noexcept;
+
+        Hasher& add(std::string const& s) noexcept {
+            return add(s.data(), s.size() + 1);
+        }
+
+        template<typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+        Hasher& add(T value) noexcept {
+            return add(&value, sizeof(value));
+        }
+
+        /**
+         * Adds the content of a file, returns false if it can't be read.
+         */
+        bool addFile(utils::Path const& path);
+
+        uint64_t getValue() const noexcept { return mValue; }
+
+    private:
+        uint64_t mValue = 0xcbf29ce484222325ull;
+    };
+
+    /**
+     * An empty directory disables the cache: lookups always miss and nothing is stored.
+     */
+    explicit Cache(utils::Path dir);
+
+    bool isEnabled() const noexcept { return !mDir.isEmpty(); }
+
+    bool contains(uint64_t key, const char* kind) const;
+
+    bool load(uint64_t key, const char* kind, std::string& data) const;
+    void store(uint64_t key, const char* kind, void const* data, size_t size) const;
+
+    /**
+     * Loads the pixels of an image, which must already be allocated with the same dimensions
+     * as the one stored.
+     */
+    bool loadImage(uint64_t key, const char* kind, filament::ibl::Image& image) const;
+    void storeImage(uint64_t key, const char* kind, filament::ibl::Image const& image) const;
+
+private:
+    utils::Path getPath(uint64_t key, const char* kind) const;
+
+    utils::Path mDir;
+};
+
+#endif // SRC_CACHE_H
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include "Cache.h"
 #include "ProgressUpdater.h"
 
 #include <ibl/Cubemap.h>
@@ -40,11 +41,17 @@
 #include <math/scalar.h>
 #include <math/vec4.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <getopt/getopt.h>
 
@@ -67,75 +74,81 @@ enum class OutputType {
     FACES, KTX, EQUIRECT, OCTAHEDRON
 };
 
-static image::ImageEncoder::Format g_format = image::ImageEncoder::Format::PNG;
-static OutputType g_type = OutputType::FACES;
-static std::string g_compression;
-static bool g_extract_faces = false;
-static float g_extract_blur = 0.0;
-static utils::Path g_extract_dir;
-
-static size_t g_output_size = 0;
-static size_t g_min_lod_size = 0;
-
-static bool g_quiet = false;
-static bool g_debug = false;
-
-static size_t g_sh_compute = 0;
-static bool g_sh_output = false;
-static bool g_sh_shader = false;
-static bool g_sh_irradiance = false;
-static float g_sh_window = 0.0f; // <0 none, 0=auto, or cutoff
-static bool g_noclamp = true;
-static ShFile g_sh_file = ShFile::SH_NONE;
-static utils::Path g_sh_filename;
-static std::unique_ptr<filament::math::float3[]> g_sh_coefficients;
-
-static bool g_is_mipmap = false;
-static utils::Path g_is_mipmap_dir;
-static bool g_prefilter = false;
-static utils::Path g_prefilter_dir;
-static bool g_dfg = false;
-static utils::Path g_dfg_filename;
-static bool g_dfg_multiscatter = false;
-static bool g_dfg_cloth = false;
-
-static bool g_ibl_irradiance = false;
-static bool g_ibl_no_prefilter = false;
-static utils::Path g_ibl_irradiance_dir;
-
-static bool g_deploy = false;
-static utils::Path g_deploy_dir;
-
-static size_t g_num_samples = 1024;
-
-static bool g_mirror = false;
+// Options of one cmgen invocation, or of one environment of a batch
+struct Config {
+    image::ImageEncoder::Format format = image::ImageEncoder::Format::PNG;
+    OutputType type = OutputType::FACES;
+    std::string compression;
+    bool extract_faces = false;
+    float extract_blur = 0.0;
+    utils::Path extract_dir;
+
+    size_t output_size = 0;
+    size_t min_lod_size = 0;
+
+    bool quiet = false;
+    bool debug = false;
+
+    size_t sh_compute = 0;
+    bool sh_output = false;
+    bool sh_shader = false;
+    bool sh_irradiance = false;
+    float sh_window = 0.0f; // <0 none, 0=auto, or cutoff
+    bool noclamp = true;
+    ShFile sh_file = ShFile::SH_NONE;
+    utils::Path sh_filename;
+
+    bool is_mipmap = false;
+    utils::Path is_mipmap_dir;
+    bool prefilter = false;
+    utils::Path prefilter_dir;
+    bool dfg = false;
+    utils::Path dfg_filename;
+    bool dfg_multiscatter = false;
+    bool dfg_cloth = false;
+
+    bool ibl_irradiance = false;
+    bool ibl_no_prefilter = false;
+    utils::Path ibl_irradiance_dir;
+
+    bool deploy = false;
+    utils::Path deploy_dir;
+
+    size_t num_samples = 1024;
+
+    bool mirror = true;
+
+    utils::Path batch;
+    utils::Path cache_dir;
+};
 
 // -----------------------------------------------------------------------------------------------
 
 static void generateMipmaps(utils::JobSystem& js, std::vector<Cubemap>& levels,
         std::vector<Image>& images);
-static void sphericalHarmonics(utils::JobSystem& js, const utils::Path& iname,
-        const Cubemap& inputCubemap);
-static void iblRoughnessPrefilter(
-        utils::JobSystem& js, const utils::Path& iname, const std::vector<Cubemap>& levels,
-        bool prefilter, const utils::Path& dir);
-static void iblDiffuseIrradiance(utils::JobSystem& js, const utils::Path& iname,
+static std::unique_ptr<float3[]> sphericalHarmonics(utils::JobSystem& js, const Config& config,
+        const Cache& cache, uint64_t key, const utils::Path& iname, const Cubemap& inputCubemap);
+static void iblRoughnessPrefilter(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Cubemap>& levels,
+        const std::unique_ptr<float3[]>& sh, bool prefilter, const utils::Path& dir);
+static void iblDiffuseIrradiance(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Cubemap>& levels, const utils::Path& dir);
+static void iblMipmapPrefilter(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Image>& images,
         const std::vector<Cubemap>& levels, const utils::Path& dir);
-static void iblMipmapPrefilter(utils::JobSystem& js, const utils::Path& iname,
-        const std::vector<Image>& images, const std::vector<Cubemap>& levels,
-        const utils::Path& dir);
-static void iblLutDfg(utils::JobSystem& js, const utils::Path& filename, size_t size,
-        bool multiscatter,
-        bool cloth);
-static void extractCubemapFaces(utils::JobSystem& js, const utils::Path& iname, const Cubemap& cm,
-        const utils::Path& dir);
-static void outputSh(std::ostream& out, const std::unique_ptr<filament::math::float3[]>& sh, size_t numBands);
+static void iblLutDfg(utils::JobSystem& js, const Config& config, const Cache& cache,
+        const utils::Path& filename, size_t size, bool multiscatter, bool cloth);
+static void extractCubemapFaces(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const Cubemap& cm, const utils::Path& dir);
+static void outputSh(const Config& config, std::ostream& out,
+        const std::unique_ptr<filament::math::float3[]>& sh, size_t numBands);
 static void UTILS_UNUSED outputSpectrum(std::ostream& out,
         const std::unique_ptr<filament::math::float3[]>& sh, size_t numBands);
 static void saveImage(const std::string& path, ImageEncoder::Format format, const Image& image,
         const std::string& compression);
 static LinearImage toLinearImage(const Image& image);
-static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubemap& cm);
+static void exportKtxFaces(utils::JobSystem& js, const Config& config, KtxBundle& container,
+        uint32_t miplevel, const Cubemap& cm);
 
 // -----------------------------------------------------------------------------------------------
 
@@ -149,6 +162,7 @@ static void printUsage(char* name) {
             "Usages:\n"
             "    CMGEN [options] <input-file>\n"
             "    CMGEN [options] <uv[N]>\n"
+            "    CMGEN [options] --batch=<manifest>\n"
             "\n"
             "Supported input formats:\n"
             "    PNG, 8 and 16 bits\n"
@@ -178,6 +192,7 @@ static void printUsage(char* name) {
             "               FORMAT is rgb8_alpha, srgb8_alpha, rgba8, or srgb8_alpha8\n"
             "               METRIC is rgba, rgbx, rec709, numeric, or normalxyz\n"
             "               EFFORT is an integer between 0 and 100\n"
+            "             append _tN to compress with N threads, e.g. s3tc_rgba_dxt5_t4\n"
 #endif
             "           PNG: Ignored\n"
             "           PNG RGBM: Ignored\n"
@@ -204,6 +219,14 @@ static void printUsage(char* name) {
             "       Roughness pre-filter into <dir>\n\n"
             "   --sh-shader\n"
             "       Generate irradiance SH for shader code\n\n"
+            "   --batch=manifest\n"
+            "       Process all the environments listed in <manifest> concurrently. Each line\n"
+            "       holds the options and the input of one environment, the options given on the\n"
+            "       command line apply to all of them. Progress output is disabled\n\n"
+            "   --cache=dir\n"
+            "       Cache intermediate results (base cubemap, SH, DFG LUT) into <dir>, keyed by\n"
+            "       the content of the input and the options. Environments that are unchanged\n"
+            "       since they were last processed are skipped; remove <dir> to force them\n\n"
             "\n"
             "Private use only:\n"
             "   --ibl-dfg=filename.[exr|hdr|psd|png|rgbm|rgb32f|dds|h|hpp|c|cpp|inc|txt]\n"
@@ -249,7 +272,7 @@ static void license() {
         std::cout << *p++ << std::endl;
 }
 
-static int handleCommandLineArgments(int argc, char* argv[]) {
+static int handleCommandLineArgments(int argc, char* argv[], Config& config) {
     static constexpr const char* OPTSTR = "hqidt:f:c:s:x:w:S:";
     static const struct option OPTIONS[] = {
             { "help",                       no_argument, nullptr, 'h' },
@@ -279,6 +302,8 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             { "deploy",               required_argument, nullptr, 'x' },
             { "no-mirror",                  no_argument, nullptr, 'm' },
             { "debug",                      no_argument, nullptr, 'd' },
+            { "batch",                required_argument, nullptr, 'B' },
+            { "cache",                required_argument, nullptr, 'X' },
             { nullptr, 0, nullptr, 0 }  // termination of the option list
     };
     int opt;
@@ -287,6 +312,9 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
     bool format_specified = false;
     bool type_specified = false;
     bool ktx_format_requested = false;
+    // we can be called several times in batch mode
+    optind = 1;
+    optreset = 1;
     while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &option_index)) >= 0) {
         std::string arg(optarg ? optarg : "");
         switch (opt) {
@@ -300,53 +328,53 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                 exit(0);
                 break; // NOLINT
             case 'q':
-                g_quiet = true;
+                config.quiet = true;
                 break;
             case 't':
                 if (arg == "cubemap") {
-                    g_type = OutputType::FACES;
+                    config.type = OutputType::FACES;
                     type_specified = true;
                 }
                 if (arg == "ktx") {
-                    g_type = OutputType::KTX;
+                    config.type = OutputType::KTX;
                     type_specified = true;
                 }
                 if ((arg == "equirect") || (arg == "equirectangular")) {
-                    g_type = OutputType::EQUIRECT;
+                    config.type = OutputType::EQUIRECT;
                     type_specified = true;
                 }
                 if (arg == "octahedron") {
-                    g_type = OutputType::OCTAHEDRON;
+                    config.type = OutputType::OCTAHEDRON;
                     type_specified = true;
                 }
                 break;
             case 'f':
                 if (arg == "png") {
-                    g_format = ImageEncoder::Format::PNG;
+                    config.format = ImageEncoder::Format::PNG;
                     format_specified = true;
                 }
                 if (arg == "hdr") {
-                    g_format = ImageEncoder::Format::HDR;
+                    config.format = ImageEncoder::Format::HDR;
                     format_specified = true;
                 }
                 if (arg == "rgbm") {
-                    g_format = ImageEncoder::Format::RGBM;
+                    config.format = ImageEncoder::Format::RGBM;
                     format_specified = true;
                 }
                 if (arg == "rgb32f") {
-                    g_format = ImageEncoder::Format::RGB_10_11_11_REV;
+                    config.format = ImageEncoder::Format::RGB_10_11_11_REV;
                     format_specified = true;
                 }
                 if (arg == "exr") {
-                    g_format = ImageEncoder::Format::EXR;
+                    config.format = ImageEncoder::Format::EXR;
                     format_specified = true;
                 }
                 if (arg == "psd") {
-                    g_format = ImageEncoder::Format::PSD;
+                    config.format = ImageEncoder::Format::PSD;
                     format_specified = true;
                 }
                 if (arg == "dds") {
-                    g_format = ImageEncoder::Format::DDS_LINEAR;
+                    config.format = ImageEncoder::Format::DDS_LINEAR;
                     format_specified = true;
                 }
                 if (arg == "ktx") {
@@ -355,25 +383,25 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                 }
                 break;
             case 'c':
-                g_compression = arg;
+                config.compression = arg;
                 break;
             case 's':
-                g_output_size = std::stoul(arg);
-                if (!isPOT(g_output_size)) {
+                config.output_size = std::stoul(arg);
+                if (!isPOT(config.output_size)) {
                     std::cerr << "output size must be a power of two" << std::endl;
                     exit(0);
                 }
                 break;
             case 'S':
-                g_min_lod_size = std::stoul(arg);
-                if (!isPOT(g_min_lod_size)) {
+                config.min_lod_size = std::stoul(arg);
+                if (!isPOT(config.min_lod_size)) {
                     std::cerr << "min LOD size must be a power of two" << std::endl;
                     exit(0);
                 }
                 break;
             case 'z':
-                g_sh_compute = 1;
-                g_sh_output = true;
+                config.sh_compute = 1;
+                config.sh_output = true;
                 try {
                     num_sh_bands = std::stoi(arg);
                 } catch (std::invalid_argument &e) {
@@ -381,159 +409,115 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                 }
                 break;
             case 'o':
-                g_sh_compute = 1;
-                g_sh_output = true;
-                g_sh_file = ShFile::SH_FILE;
-                g_sh_filename = arg;
-                if (g_sh_filename.getExtension() == "txt") {
-                    g_sh_file = ShFile::SH_TEXT;
+                config.sh_compute = 1;
+                config.sh_output = true;
+                config.sh_file = ShFile::SH_FILE;
+                config.sh_filename = arg;
+                if (config.sh_filename.getExtension() == "txt") {
+                    config.sh_file = ShFile::SH_TEXT;
                 }
                 break;
             case 'w':
-                if (arg == "auto") { g_sh_window = 0.0f; }
-                else if (arg == "no") { g_sh_window = -1.0f; }
-                else { g_sh_window = std::stof(arg); }
+                if (arg == "auto") { config.sh_window = 0.0f; }
+                else if (arg == "no") { config.sh_window = -1.0f; }
+                else { config.sh_window = std::stof(arg); }
                 break;
             case 'K':
-                g_noclamp = false;
+                config.noclamp = false;
                 break;
             case 'i':
-                g_sh_compute = 1;
-                g_sh_irradiance = true;
+                config.sh_compute = 1;
+                config.sh_irradiance = true;
                 break;
             case 'b':
-                g_sh_compute = 1;
-                g_sh_irradiance = true;
-                g_sh_shader = true;
+                config.sh_compute = 1;
+                config.sh_irradiance = true;
+                config.sh_shader = true;
                 break;
             case 'e':
-                g_extract_dir = arg;
-                g_extract_faces = true;
+                config.extract_dir = arg;
+                config.extract_faces = true;
                 break;
             case 'r':
-                g_extract_blur = std::stod(arg);
-                if (g_extract_blur < 0 || g_extract_blur > 1) {
+                config.extract_blur = std::stod(arg);
+                if (config.extract_blur < 0 || config.extract_blur > 1) {
                     std::cerr << "roughness (blur) parameter must be between 0.0 and 1.0" <<
                     std::endl;
                     exit(0);
                 }
                 break;
             case 'y':
-                g_is_mipmap = true;
-                g_is_mipmap_dir = arg;
+                config.is_mipmap = true;
+                config.is_mipmap_dir = arg;
                 break;
             case 'p':
-                g_prefilter = true;
-                g_prefilter_dir = arg;
+                config.prefilter = true;
+                config.prefilter_dir = arg;
                 break;
             case 'P':
-                g_ibl_irradiance = true;
-                g_ibl_irradiance_dir = arg;
+                config.ibl_irradiance = true;
+                config.ibl_irradiance_dir = arg;
                 break;
             case 'n':
-                g_ibl_no_prefilter = true;
+                config.ibl_no_prefilter = true;
                 break;
             case 'a':
-                g_dfg = true;
-                g_dfg_filename = arg;
+                config.dfg = true;
+                config.dfg_filename = arg;
                 break;
             case 'u':
-                g_dfg_multiscatter = true;
+                config.dfg_multiscatter = true;
                 break;
             case 'C':
-                g_dfg_cloth = true;
+                config.dfg_cloth = true;
                 break;
             case 'k':
-                g_num_samples = (size_t)std::stoi(arg);
+                config.num_samples = (size_t)std::stoi(arg);
                 break;
             case 'x':
-                g_deploy = true;
-                g_deploy_dir = arg;
+                config.deploy = true;
+                config.deploy_dir = arg;
                 break;
             case 'd':
-                g_debug = true;
+                config.debug = true;
                 break;
             case 'm':
-                g_mirror = true;
+                config.mirror = false;
+                break;
+            case 'B':
+                config.batch = arg;
+                break;
+            case 'X':
+                config.cache_dir = arg;
                 break;
         }
     }
 
     if (ktx_format_requested) {
-        g_type = OutputType::KTX;
+        config.type = OutputType::KTX;
         type_specified = true;
     }
 
-    if (g_deploy && !type_specified) {
-        g_type = OutputType::FACES;
+    if (config.deploy && !type_specified) {
+        config.type = OutputType::FACES;
     }
 
-    if (g_deploy && !format_specified) {
-        g_format = ImageEncoder::Format::RGB_10_11_11_REV;
+    if (config.deploy && !format_specified) {
+        config.format = ImageEncoder::Format::RGB_10_11_11_REV;
     }
 
-    if (num_sh_bands && g_sh_compute) {
-        g_sh_compute = (size_t) num_sh_bands;
+    if (num_sh_bands && config.sh_compute) {
+        config.sh_compute = (size_t) num_sh_bands;
     }
     return optind;
 }
 
-int main(int argc, char* argv[]) {
-    utils::JobSystem js;
-    js.adopt();
-
-    int option_index = handleCommandLineArgments(argc, argv);
-    int num_args = argc - option_index;
-    if (!g_dfg && num_args < 1) {
-        printUsage(argv[0]);
-        return 1;
-    }
-
-    if (g_dfg) {
-        if (!g_quiet) {
-            std::cout << "Generating IBL DFG LUT..." << std::endl;
-        }
-        size_t size = g_output_size ? g_output_size : DFG_LUT_DEFAULT_SIZE;
-        iblLutDfg(js, g_dfg_filename, size, g_dfg_multiscatter, g_dfg_cloth);
-        if (num_args < 1) return 0;
-    }
-
-    std::string command(argv[option_index]);
-    utils::Path iname(command);
-
-    if (g_deploy) {
-        utils::Path sh_dir = g_deploy_dir;
-
-        // KTX files are self-contained and do not need to live in a subfolder.
-        if (g_type != OutputType::KTX) {
-            sh_dir += iname.getNameWithoutExtension();
-        }
-
-        // generate pre-scaled irradiance sh to text file
-        g_sh_compute = 3;
-        g_sh_shader = true;
-        g_sh_irradiance = true;
-        g_sh_filename = sh_dir + "sh.txt";
-        g_sh_file = ShFile::SH_TEXT;
-        g_sh_output = true;
-
-        // faces
-        g_extract_dir = g_deploy_dir;
-        g_extract_faces = true;
-
-        // prefilter
-        g_prefilter = true;
-        g_prefilter_dir = g_deploy_dir;
-    }
-
-    // Images store the actual data
-    std::vector<Image> images;
-
-    // Cubemaps are just views on Images
-    std::vector<Cubemap> levels;
-
+// Decodes the input (or generates a test pattern), converts it to a seamless cubemap and
+// mirrors it. The result is stored in images[0] and levels[0].
+static void loadBaseCubemap(utils::JobSystem& js, const Config& config, const utils::Path& iname,
+        std::vector<Image>& images, std::vector<Cubemap>& levels) {
     if (iname.exists()) {
-        if (!g_quiet) {
+        if (!config.quiet) {
             std::cout << "Decoding image..." << std::endl;
         }
         std::ifstream input_stream(iname.getPath(), std::ios::binary);
@@ -553,15 +537,15 @@ int main(int argc, char* argv[]) {
         Image inputImage(width, height);
         memcpy(inputImage.getData(), linputImage.getPixelRef(), height * inputImage.getBytesPerRow());
 
-        if (!g_noclamp) {
+        if (!config.noclamp) {
             CubemapUtils::clamp(inputImage);
         }
 
         if ((isPOT(width) && (width * 3 == height * 4)) ||
             (isPOT(height) && (height * 3 == width * 4))) {
             // This is cross cubemap
-            size_t dim = g_output_size ? g_output_size : IBL_DEFAULT_SIZE;
-            if (!g_quiet) {
+            size_t dim = config.output_size ? config.output_size : IBL_DEFAULT_SIZE;
+            if (!config.quiet) {
                 std::cout << "Loading cross... " << std::endl;
             }
 
@@ -572,8 +556,8 @@ int main(int argc, char* argv[]) {
             levels.push_back(std::move(cml));
         } else if (width == 2 * height) {
             // we assume a spherical (equirectangular) image, which we will convert to a cross image
-            size_t dim = g_output_size ? g_output_size : IBL_DEFAULT_SIZE;
-            if (!g_quiet) {
+            size_t dim = config.output_size ? config.output_size : IBL_DEFAULT_SIZE;
+            if (!config.quiet) {
                 std::cout << "Converting equirectangular image... " << std::endl;
             }
             Image temp;
@@ -590,11 +574,11 @@ int main(int argc, char* argv[]) {
             exit(0);
         }
     } else {
-        if (!g_quiet) {
+        if (!config.quiet) {
             std::cout << iname << " does not exist; generating UV grid..." << std::endl;
         }
 
-        size_t dim = g_output_size ? g_output_size : IBL_DEFAULT_SIZE;
+        size_t dim = config.output_size ? config.output_size : IBL_DEFAULT_SIZE;
         Image temp;
         Cubemap cml = CubemapUtils::create(temp, dim);
 
@@ -617,10 +601,9 @@ int main(int argc, char* argv[]) {
         levels.push_back(std::move(cml));
     }
 
-    // we mirror by default -- the mirror option in fact un-mirrors.
-    g_mirror = !g_mirror;
-    if (g_mirror) {
-        if (!g_quiet) {
+    // we mirror by default -- the --no-mirror option turns it off.
+    if (config.mirror) {
+        if (!config.quiet) {
             std::cout << "Mirroring..." << std::endl;
         }
         Image temp;
@@ -629,77 +612,351 @@ int main(int argc, char* argv[]) {
         std::swap(levels[0], cml);
         std::swap(images[0], temp);
     } else {
-        if (!g_quiet) {
+        if (!config.quiet) {
             std::cout << "Skipped mirroring." << std::endl;
         }
     }
 
     // make the cubemap seamless
     levels[0].makeSeamless();
+}
+
+static void generateDfg(utils::JobSystem& js, const Config& config, const Cache& cache) {
+    if (!config.quiet) {
+        std::cout << "Generating IBL DFG LUT..." << std::endl;
+    }
+    size_t size = config.output_size ? config.output_size : DFG_LUT_DEFAULT_SIZE;
+    iblLutDfg(js, config, cache, config.dfg_filename, size, config.dfg_multiscatter,
+            config.dfg_cloth);
+}
+
+// Files written for the environment processed by this thread, see processEnvironment().
+// Outputs are only ever written by the thread running processEnvironment(), but it can start
+// processing another environment of a batch while it waits for its own jobs.
+static thread_local std::vector<std::string>* gOutputs = nullptr;
+
+static void recordOutput(const std::string& path) {
+    if (gOutputs) {
+        gOutputs->push_back(path);
+    }
+}
+
+// Returns true if every output listed in a stamp, one "<hash> <path>" per line, still exists
+// and is unmodified.
+static bool checkOutputs(const std::string& stamp) {
+    std::istringstream in(stamp);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t separator = line.find(' ');
+        if (separator == std::string::npos) {
+            return false;
+        }
+        Cache::Hasher output;
+        if (!output.addFile(line.substr(separator + 1)) ||
+                output.getValue() != std::stoull(line.substr(0, separator), nullptr, 16)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Runs all the requested stages on one environment. commandLine holds the options the
+// environment was processed with, if it's unchanged since the last run with the same input
+// and all the files written by that run are still there, nothing is done and false is returned.
+static bool processEnvironment(utils::JobSystem& js, Config config, const Cache& cache,
+        const utils::Path& iname, const std::string& commandLine) {
+    Cache::Hasher input;
+    if (!iname.exists() || !input.addFile(iname)) {
+        input.add(iname.getPath());
+    }
+
+    const uint64_t stamp = Cache::Hasher(input).add(commandLine)
+            .add(utils::Path::getCurrentDirectory().getPath()).getValue();
+    std::string outputs;
+    if (cache.load(stamp, "stamp", outputs) && checkOutputs(outputs)) {
+        if (!config.quiet) {
+            std::cout << iname << " is up to date" << std::endl;
+        }
+        return false;
+    }
+
+    std::vector<std::string> written;
+    std::vector<std::string>* const previous = gOutputs;
+    gOutputs = &written;
+
+    if (config.deploy) {
+        utils::Path sh_dir = config.deploy_dir;
+
+        // KTX files are self-contained and do not need to live in a subfolder.
+        if (config.type != OutputType::KTX) {
+            sh_dir += iname.getNameWithoutExtension();
+        }
+
+        // generate pre-scaled irradiance sh to text file
+        config.sh_compute = 3;
+        config.sh_shader = true;
+        config.sh_irradiance = true;
+        config.sh_filename = sh_dir + "sh.txt";
+        config.sh_file = ShFile::SH_TEXT;
+        config.sh_output = true;
+
+        // faces
+        config.extract_dir = config.deploy_dir;
+        config.extract_faces = true;
+
+        // prefilter
+        config.prefilter = true;
+        config.prefilter_dir = config.deploy_dir;
+    }
+
+    // Images store the actual data
+    std::vector<Image> images;
+
+    // Cubemaps are just views on Images
+    std::vector<Cubemap> levels;
+
+    const size_t dim = config.output_size ? config.output_size : IBL_DEFAULT_SIZE;
+    const uint64_t baseKey = Cache::Hasher(input)
+            .add(dim).add(config.noclamp).add(config.mirror).getValue();
+    if (cache.contains(baseKey, "base")) {
+        Image image;
+        Cubemap cm = CubemapUtils::create(image, dim);
+        if (cache.loadImage(baseKey, "base", image)) {
+            if (!config.quiet) {
+                std::cout << "Loaded cached cubemap for " << iname << std::endl;
+            }
+            images.push_back(std::move(image));
+            levels.push_back(std::move(cm));
+        }
+    }
+    if (levels.empty()) {
+        loadBaseCubemap(js, config, iname, images, levels);
+        cache.storeImage(baseKey, "base", images[0]);
+    }
 
     // Now generate all the mipmap levels
     generateMipmaps(js, levels, images);
 
-    if (g_sh_compute) {
-        if (!g_quiet) {
+    std::unique_ptr<float3[]> sh;
+    if (config.sh_compute) {
+        if (!config.quiet) {
             std::cout << "Spherical harmonics..." << std::endl;
         }
         Cubemap const& cm(levels[0]);
-        sphericalHarmonics(js, iname, cm);
+        sh = sphericalHarmonics(js, config, cache, baseKey, iname, cm);
     }
 
-    if (g_is_mipmap) {
-        if (!g_quiet) {
+    if (config.is_mipmap) {
+        if (!config.quiet) {
             std::cout << "IBL mipmaps for prefiltered importance sampling..." << std::endl;
         }
-        iblMipmapPrefilter(js, iname, images, levels, g_is_mipmap_dir);
+        iblMipmapPrefilter(js, config, iname, images, levels, config.is_mipmap_dir);
     }
 
-    if (g_prefilter) {
-        if (!g_quiet) {
+    if (config.prefilter) {
+        if (!config.quiet) {
             std::cout << "IBL prefiltering..." << std::endl;
         }
-        iblRoughnessPrefilter(js, iname, levels, !g_ibl_no_prefilter, g_prefilter_dir);
+        iblRoughnessPrefilter(js, config, iname, levels, sh, !config.ibl_no_prefilter, config.prefilter_dir);
     }
 
-    if (g_ibl_irradiance) {
-        if (!g_quiet) {
+    if (config.ibl_irradiance) {
+        if (!config.quiet) {
             std::cout << "IBL diffuse irradiance..." << std::endl;
         }
-        iblDiffuseIrradiance(js, iname, levels, g_ibl_irradiance_dir);
+        iblDiffuseIrradiance(js, config, iname, levels, config.ibl_irradiance_dir);
     }
 
-    if (g_extract_faces) {
+    if (config.extract_faces) {
         Cubemap const& cm(levels[0]);
-        if (g_extract_blur != 0) {
+        if (config.extract_blur != 0) {
             ProgressUpdater updater(1);
-            if (!g_quiet) {
+            if (!config.quiet) {
                 std::cout << "Blurring..." << std::endl;
                 updater.start();
             }
-            const float linear_roughness = g_extract_blur * g_extract_blur;
-            const size_t dim = g_output_size ? g_output_size : cm.getDimensions();
+            const float linear_roughness = config.extract_blur * config.extract_blur;
+            const size_t dim = config.output_size ? config.output_size : cm.getDimensions();
             Image image;
             Cubemap blurred = CubemapUtils::create(image, dim);
-            CubemapIBL::roughnessFilter(js, blurred, levels, linear_roughness, g_num_samples,
-                    float3{ 1, 1, 1 }, !g_ibl_no_prefilter,
+            CubemapIBL::roughnessFilter(js, blurred, levels, linear_roughness, config.num_samples,
+                    float3{ 1, 1, 1 }, !config.ibl_no_prefilter,
                     [](size_t index, float v, void* userdata) {
-                        if (!g_quiet) {
+                        if (userdata) {
                             ((ProgressUpdater*) userdata)->update(index, v);
                         }
-                    }, &updater);
-            if (!g_quiet) {
+                    }, config.quiet ? nullptr : &updater);
+            if (!config.quiet) {
                 updater.stop();
                 std::cout << "Extract faces..." << std::endl;
             }
-            extractCubemapFaces(js, iname, blurred, g_extract_dir);
+            extractCubemapFaces(js, config, iname, blurred, config.extract_dir);
         } else {
-            if (!g_quiet) {
+            if (!config.quiet) {
                 std::cout << "Extract faces..." << std::endl;
             }
-            extractCubemapFaces(js, iname, cm, g_extract_dir);
+            extractCubemapFaces(js, config, iname, cm, config.extract_dir);
+        }
+    }
+
+    gOutputs = previous;
+
+    std::ostringstream manifest;
+    for (const std::string& path : written) {
+        Cache::Hasher output;
+        if (output.addFile(path)) {
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) output.getValue());
+            manifest << hash << " " << path << "\n";
+        }
+    }
+    outputs = manifest.str();
+    cache.store(stamp, "stamp", outputs.data(), outputs.size());
+    return true;
+}
+
+// One environment of a batch manifest
+struct Environment {
+    Config config;
+    utils::Path input;
+    std::string commandLine;
+};
+
+static std::string joinArguments(std::vector<std::string> const& args) {
+    std::string result;
+    for (size_t i = 1; i < args.size(); i++) {
+        result += (i > 1 ? " " : "") + args[i];
+    }
+    return result;
+}
+
+// Each non-empty line of the manifest holds the options and the input of one environment,
+// lines starting with # are comments. Options given on the command line apply to all
+// environments and come first, so that each line can override them.
+static std::vector<Environment> parseManifest(int argc, char* argv[],
+        const utils::Path& manifest) {
+    std::vector<std::string> base;
+    for (int i = 0; i < argc; i++) {
+        const std::string arg(argv[i]);
+        if (arg == "--batch") {
+            i++;
+        } else if (arg.compare(0, 8, "--batch=") != 0) {
+            base.push_back(arg);
+        }
+    }
+
+    std::ifstream in(manifest.getPath());
+    if (!in) {
+        std::cerr << "Unable to open batch manifest: " << manifest << std::endl;
+        exit(1);
+    }
+
+    std::vector<Environment> environments;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(in, line); lineNumber++) {
+        std::istringstream tokens(line);
+        std::vector<std::string> args(base);
+        for (std::string token; tokens >> token && token[0] != '#'; ) {
+            args.push_back(token);
         }
+        if (args.size() == base.size()) {
+            continue;
+        }
+
+        std::vector<char*> lineArgv;
+        for (std::string& arg : args) {
+            lineArgv.push_back(&arg[0]);
+        }
+        lineArgv.push_back(nullptr);
+
+        Environment environment;
+        int index = handleCommandLineArgments(int(args.size()), lineArgv.data(),
+                environment.config);
+        if (int(args.size()) - index != 1) {
+            std::cerr << manifest << ":" << lineNumber << ": expected exactly one input"
+                      << std::endl;
+            exit(1);
+        }
+        // progress output of concurrent environments would be interleaved
+        environment.config.quiet = true;
+        environment.input = args[index];
+        environment.commandLine = joinArguments(args);
+        environments.push_back(std::move(environment));
     }
+    return environments;
+}
+
+// Returns the number of environments that were up to date.
+static size_t processBatch(utils::JobSystem& js, std::vector<Environment> const& environments,
+        const Cache& cache) {
+    // Generate each distinct DFG LUT once, up front.
+    std::vector<utils::Path> dfgs;
+    for (Environment const& environment : environments) {
+        Config const& config = environment.config;
+        if (config.dfg && std::find(dfgs.begin(), dfgs.end(), config.dfg_filename) == dfgs.end()) {
+            dfgs.push_back(config.dfg_filename);
+            generateDfg(js, config, cache);
+        }
+    }
+
+    // Environments are processed concurrently, a few at a time so that memory usage stays
+    // bounded. Each environment also uses the JobSystem for its own work.
+    const size_t count = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> upToDate{ 0 };
+    for (size_t first = 0; first < environments.size(); first += count) {
+        utils::JobSystem::Job* parent = js.createJob();
+        const size_t last = std::min(first + count, environments.size());
+        for (size_t i = first; i < last; i++) {
+            Environment const* environment = &environments[i];
+            js.run(js.createJob(parent,
+                    [environment, &cache, &upToDate](utils::JobSystem& js,
+                            utils::JobSystem::Job*) {
+                        if (!processEnvironment(js, environment->config, cache,
+                                environment->input, environment->commandLine)) {
+                            upToDate++;
+                        }
+                    }));
+        }
+        js.runAndWait(parent);
+    }
+    return upToDate;
+}
+
+int main(int argc, char* argv[]) {
+    utils::JobSystem js;
+    js.adopt();
+
+    Config config;
+    int option_index = handleCommandLineArgments(argc, argv, config);
+    int num_args = argc - option_index;
+    const Cache cache(config.cache_dir);
+
+    if (!config.batch.isEmpty()) {
+        std::vector<Environment> environments = parseManifest(argc, argv, config.batch);
+        if (!config.quiet) {
+            std::cout << "Processing " << environments.size() << " environments..." << std::endl;
+        }
+        const size_t upToDate = processBatch(js, environments, cache);
+        if (!config.quiet) {
+            std::cout << upToDate << " of " << environments.size()
+                      << " environments were up to date" << std::endl;
+        }
+        return 0;
+    }
+
+    if (!config.dfg && num_args < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (config.dfg) {
+        generateDfg(js, config, cache);
+        if (num_args < 1) return 0;
+    }
+
+    utils::Path iname(argv[option_index]);
+    processEnvironment(js, config, cache, iname,
+            joinArguments(std::vector<std::string>(argv, argv + argc)));
 
     return 0;
 }
@@ -721,70 +978,86 @@ void generateMipmaps(utils::JobSystem& js, std::vector<Cubemap>& levels,
     }
 }
 
-void sphericalHarmonics(utils::JobSystem& js, const utils::Path& iname, const Cubemap& inputCubemap) {
+std::unique_ptr<float3[]> sphericalHarmonics(utils::JobSystem& js, const Config& config,
+        const Cache& cache, uint64_t key, const utils::Path& iname, const Cubemap& inputCubemap) {
+    const size_t numBands = config.sh_shader ? 3 : config.sh_compute;
+    const size_t size = numBands * numBands * sizeof(float3);
+    const uint64_t shKey = Cache::Hasher().add(key).add(config.sh_compute)
+            .add(config.sh_shader).add(config.sh_irradiance).add(config.sh_window).getValue();
+
     std::unique_ptr<filament::math::float3[]> sh;
-    if (g_sh_shader) {
-        sh = CubemapSH::computeSH(js, inputCubemap, 3, true);
+    std::string cached;
+    if (cache.load(shKey, "sh", cached) && cached.size() == size) {
+        sh.reset(new float3[numBands * numBands]);
+        memcpy(sh.get(), cached.data(), size);
     } else {
-        sh = CubemapSH::computeSH(js, inputCubemap, g_sh_compute, g_sh_irradiance);
-    }
+        if (config.sh_shader) {
+            sh = CubemapSH::computeSH(js, inputCubemap, 3, true);
+        } else {
+            sh = CubemapSH::computeSH(js, inputCubemap, config.sh_compute, config.sh_irradiance);
+        }
 
-    if (g_sh_window >= 0) {
-        CubemapSH::windowSH(sh, g_sh_compute, g_sh_window);
-    }
+        if (config.sh_window >= 0) {
+            CubemapSH::windowSH(sh, config.sh_compute, config.sh_window);
+        }
+
+        if (config.sh_shader) {
+            CubemapSH::preprocessSHForShader(sh);
+        }
 
-    if (g_sh_shader) {
-        CubemapSH::preprocessSHForShader(sh);
+        cache.store(shKey, "sh", sh.get(), size);
     }
 
-    if (!g_quiet && g_sh_output) {
-        outputSh(std::cout, sh, g_sh_compute);
+    if (!config.quiet && config.sh_output) {
+        outputSh(config, std::cout, sh, config.sh_compute);
     }
 
-    if (g_sh_file != ShFile::SH_NONE || g_debug) {
+    if (config.sh_file != ShFile::SH_NONE || config.debug) {
         Image image;
-        const size_t dim = g_output_size ? g_output_size : inputCubemap.getDimensions();
+        const size_t dim = config.output_size ? config.output_size : inputCubemap.getDimensions();
         Cubemap cm = CubemapUtils::create(image, dim);
 
-        if (g_sh_file != ShFile::SH_NONE) {
-            utils::Path outputDir(g_sh_filename.getAbsolutePath().getParent());
+        if (config.sh_file != ShFile::SH_NONE) {
+            utils::Path outputDir(config.sh_filename.getAbsolutePath().getParent());
             if (!outputDir.exists()) {
                 outputDir.mkdirRecursive();
             }
 
-            if (g_sh_shader) {
+            if (config.sh_shader) {
                 CubemapSH::renderPreScaledSH3Bands(js, cm, sh);
             } else {
-                CubemapSH::renderSH(js, cm, sh, g_sh_compute);
+                CubemapSH::renderSH(js, cm, sh, config.sh_compute);
             }
 
             cm.makeSeamless();
 
-            if (g_sh_file == ShFile::SH_FILE) {
+            if (config.sh_file == ShFile::SH_FILE) {
                 Image image;
-                if (g_type == OutputType::EQUIRECT) {
+                if (config.type == OutputType::EQUIRECT) {
                     size_t dim = cm.getDimensions();
                     image = Image(dim * 2, dim);
                     CubemapUtils::cubemapToEquirectangular(js, image, cm);
                 }
 
-                if (g_type == OutputType::OCTAHEDRON) {
+                if (config.type == OutputType::OCTAHEDRON) {
                     size_t dim = cm.getDimensions();
                     image = Image(dim, dim);
                     CubemapUtils::cubemapToOctahedron(js, image, cm);
                 }
 
-                saveImage(g_sh_filename, ImageEncoder::chooseFormat(g_sh_filename.getName()),
-                        image, g_compression);
+                saveImage(config.sh_filename, ImageEncoder::chooseFormat(config.sh_filename.getName()),
+                        image, config.compression);
             }
-            if (g_sh_file == ShFile::SH_TEXT) {
-                std::ofstream outputStream(g_sh_filename, std::ios::trunc);
-                outputSh(outputStream, sh, g_sh_compute);
+            if (config.sh_file == ShFile::SH_TEXT) {
+                std::ofstream outputStream(config.sh_filename, std::ios::trunc);
+                outputSh(config, outputStream, sh, config.sh_compute);
+                outputStream.close();
+                recordOutput(config.sh_filename.getPath());
             }
         }
 
-        if (g_debug) {
-            utils::Path outputDir(g_sh_filename.getAbsolutePath().getParent());
+        if (config.debug) {
+            utils::Path outputDir(config.sh_filename.getAbsolutePath().getParent());
             if (!outputDir.exists()) {
                 outputDir.mkdirRecursive();
             }
@@ -792,37 +1065,37 @@ void sphericalHarmonics(utils::JobSystem& js, const utils::Path& iname, const Cu
             { // save a file with what we just calculated (radiance or irradiance)
                 std::string basename = iname.getNameWithoutExtension();
                 utils::Path filePath =
-                        outputDir + (basename + "_sh" + (g_sh_irradiance ? "_i" : "_r") + ".hdr");
+                        outputDir + (basename + "_sh" + (config.sh_irradiance ? "_i" : "_r") + ".hdr");
                 CubemapUtils::highlight(image);
                 saveImage(filePath, ImageEncoder::Format::HDR, image, "");
             }
 
             { // save a file with the "other one" (irradiance or radiance)
                 std::unique_ptr<filament::math::float3[]> sh
-                    = CubemapSH::computeSH(js, inputCubemap, g_sh_compute, !g_sh_irradiance);
-                CubemapSH::renderSH(js, cm, sh, g_sh_compute);
+                    = CubemapSH::computeSH(js, inputCubemap, config.sh_compute, !config.sh_irradiance);
+                CubemapSH::renderSH(js, cm, sh, config.sh_compute);
                 std::string basename = iname.getNameWithoutExtension();
                 utils::Path filePath =
-                        outputDir + (basename + "_sh" + (!g_sh_irradiance ? "_i" : "_r") + ".hdr");
+                        outputDir + (basename + "_sh" + (!config.sh_irradiance ? "_i" : "_r") + ".hdr");
                 CubemapUtils::highlight(image);
                 saveImage(filePath, ImageEncoder::Format::HDR, image, "");
             }
         }
     }
-    // Stash the computed coefficients in case we need to use them at a later stage (e.g. KTX gen)
-    g_sh_coefficients = std::move(sh);
+    // Return the computed coefficients in case we need to use them at a later stage (e.g. KTX gen)
+    return sh;
 }
 
-void outputSh(std::ostream& out,
+void outputSh(const Config& config, std::ostream& out,
         const std::unique_ptr<filament::math::float3[]>& sh, size_t numBands) {
     for (ssize_t l = 0; l < numBands; l++) {
         for (ssize_t m = -l; m <= l; m++) {
             size_t i = CubemapSH::getShIndex(m, (size_t) l);
             std::string name = "L" + std::to_string(l) + std::to_string(m);
-            if (g_sh_irradiance) {
+            if (config.sh_irradiance) {
                 name.append(", irradiance");
             }
-            if (g_sh_shader) {
+            if (config.sh_shader) {
                 name.append(", pre-scaled base");
             }
             out << "("
@@ -845,9 +1118,9 @@ void UTILS_UNUSED outputSpectrum(std::ostream& out,
     }
 }
 
-void iblMipmapPrefilter(utils::JobSystem& js, const utils::Path& iname,
-        const std::vector<Image>& images, const std::vector<Cubemap>& levels,
-        const utils::Path& dir) {
+void iblMipmapPrefilter(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Image>& images,
+        const std::vector<Cubemap>& levels, const utils::Path& dir) {
     utils::Path outputDir(dir.getAbsolutePath() + iname.getNameWithoutExtension());
     if (!outputDir.exists()) {
         outputDir.mkdirRecursive();
@@ -857,31 +1130,31 @@ void iblMipmapPrefilter(utils::JobSystem& js, const utils::Path& iname,
     for (size_t level=0 ; level<numLevels ; level++) {
         Cubemap const& dst(levels[level]);
         Image const& img(images[level]);
-        if (g_debug) {
+        if (config.debug) {
             ImageEncoder::Format debug_format = ImageEncoder::Format::HDR;
             std::string ext = ImageEncoder::chooseExtension(debug_format);
             std::string basename = iname.getNameWithoutExtension();
             utils::Path filePath = outputDir + (basename + "_is_m" + (std::to_string(level) + ext));
-            saveImage(filePath, debug_format, img, g_compression);
+            saveImage(filePath, debug_format, img, config.compression);
         }
 
-        std::string ext = ImageEncoder::chooseExtension(g_format);
+        std::string ext = ImageEncoder::chooseExtension(config.format);
 
-        if (g_type == OutputType::EQUIRECT) {
+        if (config.type == OutputType::EQUIRECT) {
             size_t dim = dst.getDimensions();
             Image image(dim * 2, dim);
             CubemapUtils::cubemapToEquirectangular(js, image, dst);
             std::string filename = outputDir + ("is_m" + std::to_string(level) + ext);
-            saveImage(filename, g_format, image, g_compression);
+            saveImage(filename, config.format, image, config.compression);
             continue;
         }
 
-        if (g_type == OutputType::OCTAHEDRON) {
+        if (config.type == OutputType::OCTAHEDRON) {
             size_t dim = dst.getDimensions();
             Image image(dim, dim);
             CubemapUtils::cubemapToOctahedron(js, image, dst);
             std::string filename = outputDir + ("is_m" + std::to_string(level) + ext);
-            saveImage(filename, g_format, image, g_compression);
+            saveImage(filename, config.format, image, config.compression);
             continue;
         }
 
@@ -889,7 +1162,7 @@ void iblMipmapPrefilter(utils::JobSystem& js, const utils::Path& iname,
             Cubemap::Face face = (Cubemap::Face)i;
             std::string filename = outputDir
                     + ("is_m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
+            saveImage(filename, config.format, dst.getImageForFace(face), config.compression);
         }
     }
 }
@@ -907,11 +1180,11 @@ static float lodToPerceptualRoughness(float lod) noexcept {
             : 0.0f;
 }
 
-void iblRoughnessPrefilter(
-        utils::JobSystem& js, const utils::Path& iname, const std::vector<Cubemap>& levels,
-        bool prefilter, const utils::Path& dir) {
+void iblRoughnessPrefilter(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Cubemap>& levels,
+        const std::unique_ptr<float3[]>& sh, bool prefilter, const utils::Path& dir) {
     utils::Path outputDir = dir.getAbsolutePath();
-    if (g_type != OutputType::KTX) {
+    if (config.type != OutputType::KTX) {
         outputDir += iname.getNameWithoutExtension();
     }
     if (!outputDir.exists()) {
@@ -923,13 +1196,13 @@ void iblRoughnessPrefilter(
     // This is useful for debugging.
     const bool DEBUG_FULL_RESOLUTION = false;
 
-    const size_t baseExp = utils::ctz(g_output_size ? g_output_size : IBL_DEFAULT_SIZE);
-    size_t minLod = utils::ctz(g_min_lod_size ? g_min_lod_size : IBL_DEFAULT_MIN_LOD_SIZE);
+    const size_t baseExp = utils::ctz(config.output_size ? config.output_size : IBL_DEFAULT_SIZE);
+    size_t minLod = utils::ctz(config.min_lod_size ? config.min_lod_size : IBL_DEFAULT_MIN_LOD_SIZE);
     if (minLod >= baseExp) {
         minLod = 0;
     }
 
-    size_t numSamples = g_num_samples;
+    size_t numSamples = config.num_samples;
     const size_t numLevels = (baseExp + 1) - minLod;
 
     // It's convenient to create an empty KTX bundle on the stack in this scope, regardless of
@@ -963,7 +1236,7 @@ void iblRoughnessPrefilter(
         // map the lod to a perceptualRoughness
         const float perceptualRoughness = lodToPerceptualRoughness(lod);
         const float roughness = perceptualRoughness * perceptualRoughness;
-        if (!g_quiet) {
+        if (!config.quiet) {
             std::cout << "Level " << level << std::setprecision(3)
                       << ", roughness = " << roughness
                       << ", roughness (perceptual) = " << perceptualRoughness
@@ -973,50 +1246,50 @@ void iblRoughnessPrefilter(
         Cubemap dst = CubemapUtils::create(image, dim);
 
         ProgressUpdater updater(1);
-        if (!g_quiet) {
+        if (!config.quiet) {
             updater.start();
         }
         CubemapIBL::roughnessFilter(js, dst, levels, roughness, numSamples,
                 float3{ 1, 1, 1 }, prefilter,
                 [](size_t index, float v, void* userdata) {
-                    if (!g_quiet) {
+                    if (userdata) {
                         ((ProgressUpdater*) userdata)->update(index, v);
                     }
-                }, &updater);
-        if (!g_quiet) {
+                }, config.quiet ? nullptr : &updater);
+        if (!config.quiet) {
             updater.stop();
         }
 
         dst.makeSeamless();
 
-        if (g_debug) {
+        if (config.debug) {
             ImageEncoder::Format debug_format = ImageEncoder::Format::HDR;
             std::string ext = ImageEncoder::chooseExtension(debug_format);
             std::string basename = iname.getNameWithoutExtension();
             utils::Path filePath = outputDir + (basename + "_roughness_m" + (std::to_string(level) + ext));
-            saveImage(filePath, debug_format, image, g_compression);
+            saveImage(filePath, debug_format, image, config.compression);
         }
 
-        std::string ext = ImageEncoder::chooseExtension(g_format);
+        std::string ext = ImageEncoder::chooseExtension(config.format);
 
-        if (g_type == OutputType::KTX) {
-            exportKtxFaces(container, (uint32_t) level, dst);
+        if (config.type == OutputType::KTX) {
+            exportKtxFaces(js, config, container, (uint32_t) level, dst);
             continue;
         }
 
-        if (g_type == OutputType::EQUIRECT) {
+        if (config.type == OutputType::EQUIRECT) {
             Image outImage(dim * 2, dim);
             CubemapUtils::cubemapToEquirectangular(js, outImage, dst);
             std::string filename = outputDir + ("m" + std::to_string(level) + ext);
-            saveImage(filename, g_format, outImage, g_compression);
+            saveImage(filename, config.format, outImage, config.compression);
             continue;
         }
 
-        if (g_type == OutputType::OCTAHEDRON) {
+        if (config.type == OutputType::OCTAHEDRON) {
             Image outImage(dim, dim);
             CubemapUtils::cubemapToOctahedron(js, outImage, dst);
             std::string filename = outputDir + ("m" + std::to_string(level) + ext);
-            saveImage(filename, g_format, outImage, g_compression);
+            saveImage(filename, config.format, outImage, config.compression);
             continue;
         }
 
@@ -1024,16 +1297,16 @@ void iblRoughnessPrefilter(
             Cubemap::Face face = (Cubemap::Face) j;
             std::string filename = outputDir
                     + ("m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
+            saveImage(filename, config.format, dst.getImageForFace(face), config.compression);
         }
     }
 
-    if (g_type == OutputType::KTX) {
-        if (g_sh_coefficients) {
+    if (config.type == OutputType::KTX) {
+        if (sh) {
             std::ostringstream sstr;
-            for (ssize_t l = 0; l < g_sh_compute; l++) {
+            for (ssize_t l = 0; l < config.sh_compute; l++) {
                 for (ssize_t m = -l; m <= l; m++) {
-                    auto v = g_sh_coefficients[CubemapSH::getShIndex(m, (size_t) l)];
+                    auto v = sh[CubemapSH::getShIndex(m, (size_t) l)];
                     sstr << v.r << " " << v.g << " " << v.b << "\n";
                 }
             }
@@ -1046,66 +1319,67 @@ void iblRoughnessPrefilter(
         std::ofstream outputStream(fullpath.c_str(), std::ios::out | std::ios::binary);
         outputStream.write((const char*) fileContents.data(), fileContents.size());
         outputStream.close();
+        recordOutput(fullpath.getPath());
     }
 }
 
-void iblDiffuseIrradiance(utils::JobSystem& js, const utils::Path& iname,
-        const std::vector<Cubemap>& levels, const utils::Path& dir) {
+void iblDiffuseIrradiance(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const std::vector<Cubemap>& levels, const utils::Path& dir) {
     utils::Path outputDir(dir.getAbsolutePath() + iname.getNameWithoutExtension());
     if (!outputDir.exists()) {
         outputDir.mkdirRecursive();
     }
 
-    const size_t baseExp = utils::ctz(g_output_size ? g_output_size : IBL_DEFAULT_SIZE);
-    size_t numSamples = g_num_samples;
+    const size_t baseExp = utils::ctz(config.output_size ? config.output_size : IBL_DEFAULT_SIZE);
+    size_t numSamples = config.num_samples;
     const size_t dim = 1U << baseExp;
     Image image;
     Cubemap dst = CubemapUtils::create(image, dim);
 
     ProgressUpdater updater(1);
-    if (!g_quiet) {
+    if (!config.quiet) {
         updater.start();
     }
     CubemapIBL::diffuseIrradiance(js, dst, levels, numSamples,
             [](size_t index, float v, void* userdata) {
-                if (!g_quiet) {
+                if (userdata) {
                     ((ProgressUpdater*) userdata)->update(index, v);
                 }
-            }, &updater);
-    if (!g_quiet) {
+            }, config.quiet ? nullptr : &updater);
+    if (!config.quiet) {
         updater.stop();
     }
 
     dst.makeSeamless();
 
-    std::string ext = ImageEncoder::chooseExtension(g_format);
+    std::string ext = ImageEncoder::chooseExtension(config.format);
 
-    if (g_type == OutputType::EQUIRECT) {
+    if (config.type == OutputType::EQUIRECT) {
         size_t dim = dst.getDimensions();
         Image image(dim * 2, dim);
         CubemapUtils::cubemapToEquirectangular(js, image, dst);
         std::string filename = outputDir + ("irradiance" + ext);
-        saveImage(filename, g_format, image, g_compression);
+        saveImage(filename, config.format, image, config.compression);
     }
 
-    if (g_type == OutputType::OCTAHEDRON) {
+    if (config.type == OutputType::OCTAHEDRON) {
         size_t dim = dst.getDimensions();
         Image image(dim, dim);
         CubemapUtils::cubemapToOctahedron(js, image, dst);
         std::string filename = outputDir + ("irradiance" + ext);
-        saveImage(filename, g_format, image, g_compression);
+        saveImage(filename, config.format, image, config.compression);
     }
 
-    if (g_type == OutputType::FACES) {
+    if (config.type == OutputType::FACES) {
         for (size_t j = 0; j < 6; j++) {
             Cubemap::Face face = (Cubemap::Face)j;
             std::string filename =
                     outputDir + ("i_" + std::string(CubemapUtils::getFaceName(face)) + ext);
-            saveImage(filename, g_format, dst.getImageForFace(face), g_compression);
+            saveImage(filename, config.format, dst.getImageForFace(face), config.compression);
         }
     }
 
-    if (g_debug) {
+    if (config.debug) {
         ImageEncoder::Format debug_format = ImageEncoder::Format::HDR;
         std::string basename = iname.getNameWithoutExtension();
         std::string fileExt = ImageEncoder::chooseExtension(debug_format);
@@ -1116,8 +1390,8 @@ void iblDiffuseIrradiance(utils::JobSystem& js, const utils::Path& iname,
         // to compare the resuts and see if the later is better.
         Image outImage;
         Cubemap cm = CubemapUtils::create(outImage, dim);
-        auto sh = CubemapSH::computeSH(js, dst, g_sh_compute, false);
-        CubemapSH::renderSH(js, cm, sh, g_sh_compute);
+        auto sh = CubemapSH::computeSH(js, dst, config.sh_compute, false);
+        CubemapSH::renderSH(js, cm, sh, config.sh_compute);
         filePath = outputDir + (basename + "_diffuse_irradiance_sh" + fileExt);
         saveImage(filePath, debug_format, outImage, "");
     }
@@ -1135,10 +1409,16 @@ static bool isIncludeFile(const utils::Path& filename) {
     return extension == "inc";
 }
 
-void iblLutDfg(utils::JobSystem& js, const utils::Path& filename, size_t size, bool multiscatter,
-        bool cloth) {
+void iblLutDfg(utils::JobSystem& js, const Config& config, const Cache& cache,
+        const utils::Path& filename, size_t size, bool multiscatter, bool cloth) {
+    // the LUT doesn't depend on the environment, so it only needs to be computed once
+    const uint64_t key = Cache::Hasher().add(std::string("dfg"))
+            .add(size).add(multiscatter).add(cloth).getValue();
     Image image(size, size);
-    CubemapIBL::DFG(js, image, multiscatter, cloth);
+    if (!cache.loadImage(key, "dfg", image)) {
+        CubemapIBL::DFG(js, image, multiscatter, cloth);
+        cache.storeImage(key, "dfg", image);
+    }
 
     utils::Path outputDir(filename.getAbsolutePath().getParent());
     if (!outputDir.exists()) {
@@ -1163,7 +1443,7 @@ void iblLutDfg(utils::JobSystem& js, const utils::Path& filename, size_t size, b
                 const uint16_t b = *reinterpret_cast<const uint16_t*>(&d.b);
                 outputStream << "0x" << std::setfill('0') << std::setw(4) << std::hex << r << ", ";
                 outputStream << "0x" << std::setfill('0') << std::setw(4) << std::hex << g << ", ";
-                if (g_dfg_cloth) {
+                if (cloth) {
                     outputStream << "0x" << std::setfill('0') << std::setw(4) << std::hex << b << ", ";
                 }
             }
@@ -1177,21 +1457,21 @@ void iblLutDfg(utils::JobSystem& js, const utils::Path& filename, size_t size, b
         outputStream.close();
     } else {
         ImageEncoder::Format format = ImageEncoder::chooseFormat(filename.getName(), true);
-        saveImage(filename, format, image, g_compression);
+        saveImage(filename, format, image, config.compression);
     }
 }
 
-void extractCubemapFaces(utils::JobSystem& js, const utils::Path& iname, const Cubemap& cm,
-        const utils::Path& dir) {
+void extractCubemapFaces(utils::JobSystem& js, const Config& config,
+        const utils::Path& iname, const Cubemap& cm, const utils::Path& dir) {
     utils::Path outputDir(dir.getAbsolutePath());
-    if (g_type != OutputType::KTX) {
+    if (config.type != OutputType::KTX) {
         outputDir += iname.getNameWithoutExtension();
     }
     if (!outputDir.exists()) {
         outputDir.mkdirRecursive();
     }
 
-    if (g_type == OutputType::KTX) {
+    if (config.type == OutputType::KTX) {
         const uint32_t dim = (const uint32_t) cm.getDimensions();
         KtxBundle container(1, 1, true);
         container.info() = {
@@ -1205,7 +1485,7 @@ void extractCubemapFaces(utils::JobSystem& js, const utils::Path& iname, const C
             .pixelHeight = dim,
             .pixelDepth = 0,
         };
-        exportKtxFaces(container, 0, cm);
+        exportKtxFaces(js, config, container, 0, cm);
         std::string filename = dir.getNameWithoutExtension() + "_skybox.ktx";
         auto fullpath = outputDir + filename;
         std::vector<uint8_t> fileContents(container.getSerializedLength());
@@ -1213,33 +1493,34 @@ void extractCubemapFaces(utils::JobSystem& js, const utils::Path& iname, const C
         std::ofstream outputStream(fullpath.c_str(), std::ios::out | std::ios::binary);
         outputStream.write((const char*) fileContents.data(), fileContents.size());
         outputStream.close();
+        recordOutput(fullpath.getPath());
         return;
     }
 
-    std::string ext = ImageEncoder::chooseExtension(g_format);
+    std::string ext = ImageEncoder::chooseExtension(config.format);
 
-    if (g_type == OutputType::EQUIRECT) {
+    if (config.type == OutputType::EQUIRECT) {
         size_t dim = cm.getDimensions();
         Image image(dim * 2, dim);
         CubemapUtils::cubemapToEquirectangular(js, image, cm);
         std::string filename = outputDir + ("skybox" + ext);
-        saveImage(filename, g_format, image, g_compression);
+        saveImage(filename, config.format, image, config.compression);
         return;
     }
 
-    if (g_type == OutputType::OCTAHEDRON) {
+    if (config.type == OutputType::OCTAHEDRON) {
         size_t dim = cm.getDimensions();
         Image image(dim, dim);
         CubemapUtils::cubemapToOctahedron(js, image, cm);
         std::string filename = outputDir + ("skybox" + ext);
-        saveImage(filename, g_format, image, g_compression);
+        saveImage(filename, config.format, image, config.compression);
         return;
     }
 
     for (size_t i = 0; i < 6; i++) {
         Cubemap::Face face = (Cubemap::Face) i;
         std::string filename(outputDir + (CubemapUtils::getFaceName(face) + ext));
-        saveImage(filename, g_format, cm.getImageForFace(face), g_compression);
+        saveImage(filename, config.format, cm.getImageForFace(face), config.compression);
     }
 }
 
@@ -1264,17 +1545,20 @@ static void saveImage(const std::string& path, ImageEncoder::Format format, cons
     if (!ImageEncoder::encode(outputStream, format, toLinearImage(image), compression, path)) {
         exit(1);
     }
+    outputStream.close();
+    recordOutput(path);
 }
 
-static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubemap& cm) {
+static void exportKtxFaces(utils::JobSystem& js, const Config& config, KtxBundle& container,
+        uint32_t miplevel, const Cubemap& cm) {
     auto& info = container.info();
 
 #ifdef IMAGEIO_SUPPORTS_BLOCK_COMPRESSION
     CompressionConfig compression {};
-    if (!g_compression.empty()) {
-        bool valid = parseOptionString(g_compression, &compression);
+    if (!config.compression.empty()) {
+        bool valid = parseOptionString(config.compression, &compression);
         if (!valid) {
-            std::cerr << "Unrecognized compression: " << g_compression << std::endl;
+            std::cerr << "Unrecognized compression: " << config.compression << std::endl;
             exit(1);
         }
         // The KTX spec says the following for compressed textures: glTypeSize should 1,
@@ -1287,7 +1571,7 @@ static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubema
         info.glInternalFormat = KtxBundle::RGB;
     }
 #else
-    if (!g_compression.empty()) {
+    if (!config.compression.empty()) {
         std::cerr << "Block compression is not supported in this build." << std::endl;
         exit(1);
     }
@@ -1310,7 +1594,7 @@ static void exportKtxFaces(KtxBundle& container, uint32_t miplevel, const Cubema
 
 #ifdef IMAGEIO_SUPPORTS_BLOCK_COMPRESSION
         if (compression.type != CompressionConfig::INVALID) {
-            CompressedTexture tex = compressTexture(compression, image);
+            CompressedTexture tex = compressTexture(js, compression, image);
             container.setBlob(blobIndex, tex.data.get(), tex.size);
             info.glInternalFormat = (uint32_t) tex.format;
             continue;
@@ -153,6 +153,71 @@ TEST_F(CmgenTest, LdrCrossCube) { // NOLINT
     processEnvMap(inputPath, resultPath, goldenPath);
 }
 
+// Returns the number of environments a batch skipped, given its output
+static int countUpToDate(const string& logPath) {
+    std::smatch match;
+    const string log = readFile(logPath);
+    const std::regex summary(R"((\d+) of \d+ environments were up to date)");
+    if (!std::regex_search(log, match, summary)) {
+        return -1;
+    }
+    return std::stoi(match[1]);
+}
+
+TEST_F(CmgenTest, Batch) { // NOLINT
+    // the same environment twice, with different options, must match the single-run results
+    const string executableFolder = Path::getCurrentExecutable().getParent();
+    const string inputPath = Path::getCurrentDirectory() +
+            "assets/environments/white_furnace/white_furnace.exr";
+    const string manifestPath = executableFolder + "batch.txt";
+    const string cachePath = executableFolder + "batch_cache";
+    const string logPath = executableFolder + "batch_log.txt";
+    // start from an empty cache
+    for (Path entry : Path(cachePath).listContents()) {
+        entry.unlinkFile();
+    }
+    {
+        std::ofstream manifest(manifestPath.c_str(), std::ios::trunc);
+        manifest << "# options and input of each environment" << std::endl;
+        manifest << "-x " << executableFolder << "batch_a " << inputPath << std::endl;
+        manifest << "-x " << executableFolder << "batch_b -s 128 " << inputPath << std::endl;
+    }
+    const string cmdline = executableFolder + "cmgen -f rgbm --cache=" + cachePath +
+            " --batch=" + manifestPath + " > " + logPath;
+    ASSERT_EQ(std::system(cmdline.c_str()), 0);
+    ASSERT_EQ(countUpToDate(logPath), 0);
+
+    // nothing changed, both environments are skipped
+    ASSERT_EQ(std::system(cmdline.c_str()), 0);
+    ASSERT_EQ(countUpToDate(logPath), 2);
+
+    // an output is missing, only its environment is processed again
+    const string resultPath = executableFolder + "batch_a/white_furnace/nx.rgbm";
+    ASSERT_TRUE(Path(resultPath).unlinkFile());
+    ASSERT_EQ(std::system(cmdline.c_str()), 0);
+    ASSERT_EQ(countUpToDate(logPath), 1);
+
+    checkFileExistence(resultPath);
+    std::ifstream resultStream(resultPath.c_str(), std::ios::binary);
+    LinearImage resultImage = ImageDecoder::decode(resultStream, resultPath);
+    ASSERT_EQ(resultImage.isValid(), true);
+    LinearImage resultLImage = toLinearFromRGBM(
+            reinterpret_cast<filament::math::float4 const*>(resultImage.getPixelRef()),
+            resultImage.getWidth(), resultImage.getHeight());
+    updateOrCompare(resultLImage, Path::getCurrentDirectory() +
+            "tools/cmgen/tests/white_furnace_nx.rgbm", ComparisonMode::COMPARE, 0.01f);
+
+    // the second environment must match the same options run on their own
+    launchTool("assets/environments/white_furnace/white_furnace.exr",
+            "--quiet -f rgbm -s 128 -x " + executableFolder + "single_b");
+    for (const char* face : { "nx", "ny", "nz", "px", "py", "pz" }) {
+        const string name = "white_furnace/" + string(face) + ".rgbm";
+        checkFileExistence(executableFolder + "batch_b/" + name);
+        EXPECT_EQ(readFile(executableFolder + "batch_b/" + name),
+                readFile(executableFolder + "single_b/" + name)) << name;
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     if (argc != 2) {
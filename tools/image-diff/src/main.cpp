@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/ImageOps.h>
+#include <image/LinearImage.h>
+
+#include <imageio/ImageDecoder.h>
+#include <imageio/ImageDiffer.h>
+#include <imageio/ImageEncoder.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Path.h>
+
+#include <getopt/getopt.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace image;
+using namespace std;
+using namespace utils;
+
+static float g_epsilon = 0.0f;
+static bool g_earlyOut = false;
+static bool g_histogram = false;
+static bool g_quietMode = false;
+static uint32_t g_threadCount = 0;
+static Path g_maskDir;
+
+static const char* USAGE = R"TXT(
+IMAGEDIFF compares images, or directories of images, and reports their differences.
+
+When given two directories, IMAGEDIFF compares every image of <golden> (including the ones
+in sub-directories) with the image of the same name in <candidate>. Images are processed in
+parallel. The exit code is 0 if all the images match, 1 otherwise.
+
+Pixel values are compared as stored in the files, without color space conversions, so a
+difference of 1/255 is a difference of one level with 8-bit images.
+
+Usage:
+    IMAGEDIFF [options] <golden> <candidate>
+
+Supported input formats:
+    PNG, 8 and 16 bits
+    Radiance (.hdr)
+    Photoshop (.psd), 16 and 32 bits
+    OpenEXR (.exr)
+
+Options:
+   --help, -h
+       print this message
+   --license, -L
+       print copyright and license information
+   --epsilon=E, -e E
+       largest difference between two channel values that are considered equal (default 0)
+       append "/255" to express it in 8-bit levels, e.g. --epsilon=2/255 accepts differences
+       of up to 2 levels
+   --early-out, -x
+       stop comparing an image at its first mismatch, the statistics are then partial
+   --mask=DIR, -m DIR
+       write a mask of the mismatching pixels of each image that doesn't match to DIR
+   --histogram, -g
+       print the histogram of differences of each channel, in 8-bit levels
+   --jobs=N, -j N
+       number of threads to use, by default all the cores are used
+   --quiet, -q
+       only report the images that don't match
+
+Examples:
+    IMAGEDIFF --epsilon=1/255 golden/ out/
+    IMAGEDIFF --mask=masks/ golden.png out.png
+)TXT";
+
+static void printUsage(const char* name) {
+    std::string execName(Path(name).getName());
+    const std::string from("IMAGEDIFF");
+    std::string usage(USAGE);
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    puts(usage.c_str());
+}
+
+static void license() {
+    static const char *license[] = {
+        #include "licenses/licenses.inc"
+        nullptr
+    };
+
+    const char **p = &license[0];
+    while (*p)
+        std::cout << *p++ << std::endl;
+}
+
+static int handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hLe:xm:gj:q";
+    static const struct option OPTIONS[] = {
+            { "help",                 no_argument, 0, 'h' },
+            { "license",              no_argument, 0, 'L' },
+            { "epsilon",        required_argument, 0, 'e' },
+            { "early-out",            no_argument, 0, 'x' },
+            { "mask",           required_argument, 0, 'm' },
+            { "histogram",            no_argument, 0, 'g' },
+            { "jobs",           required_argument, 0, 'j' },
+            { "quiet",                no_argument, 0, 'q' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'L':
+                license();
+                exit(0);
+            case 'e':
+                try {
+                    g_epsilon = std::stof(arg);
+                    if (arg.size() > 4 && arg.compare(arg.size() - 4, 4, "/255") == 0) {
+                        // 8-bit values decoded to floats aren't exact multiples of 1/255, so
+                        // accept anything that rounds to the requested number of levels
+                        g_epsilon = (g_epsilon + 0.5f) / 255.0f;
+                    }
+                } catch (std::invalid_argument &e) {
+                    cerr << "Warning: invalid epsilon, falling back to 0." << endl;
+                }
+                break;
+            case 'x':
+                g_earlyOut = true;
+                break;
+            case 'm':
+                g_maskDir = arg;
+                break;
+            case 'g':
+                g_histogram = true;
+                break;
+            case 'j':
+                try {
+                    g_threadCount = uint32_t(std::stoul(arg));
+                } catch (std::invalid_argument &e) {
+                    // keep default value
+                }
+                break;
+            case 'q':
+                g_quietMode = true;
+                break;
+        }
+    }
+
+    return optind;
+}
+
+static bool isImage(const Path& path) {
+    const std::string ext = path.getExtension();
+    return ext == "png" || ext == "hdr" || ext == "psd" || ext == "exr";
+}
+
+// Collects the images of a directory and of its sub-directories, relative to root.
+static void listImages(const Path& root, const std::string& prefix, vector<std::string>& names) {
+    for (const Path& path : (root + prefix).listContents()) {
+        const std::string name = prefix.empty() ? path.getName() : prefix + "/" + path.getName();
+        if (path.isDirectory()) {
+            listImages(root, name, names);
+        } else if (isImage(path)) {
+            names.push_back(name);
+        }
+    }
+}
+
+static LinearImage loadImage(const Path& path) {
+    std::ifstream in(path.getPath(), std::ios::binary);
+    if (!in) {
+        return {};
+    }
+    return ImageDecoder::decode(in, path.getPath(), ImageDecoder::ColorSpace::LINEAR);
+}
+
+struct Result {
+    enum class Status { MATCH, MISMATCH, MISSING, UNREADABLE, INCOMPATIBLE };
+    Status status = Status::MATCH;
+    DiffStatistics stats;
+};
+
+static void writeMask(const LinearImage& mask, const std::string& name) {
+    Path path = g_maskDir + (name.substr(0, name.rfind('.')) + "_mask.png");
+    path.getParent().mkdirRecursive();
+    std::ofstream out(path.getPath(), std::ios::binary | std::ios::trunc);
+    LinearImage rgb = combineChannels({ mask, mask, mask });
+    if (!ImageEncoder::encode(out, ImageEncoder::Format::PNG_LINEAR, rgb, "", path.getPath())) {
+        cerr << "Unable to write " << path << endl;
+    }
+}
+
+// Compares two images, on the JobSystem if one is given.
+static Result compareImages(JobSystem* js, const Path& golden, const Path& candidate,
+        const std::string& name) {
+    Result result;
+    if (!candidate.exists()) {
+        result.status = Result::Status::MISSING;
+        return result;
+    }
+    LinearImage a = loadImage(golden);
+    LinearImage b = loadImage(candidate);
+    if (!a.isValid() || !b.isValid()) {
+        result.status = Result::Status::UNREADABLE;
+        return result;
+    }
+
+    LinearImage mask;
+    DiffOptions options;
+    options.epsilon = g_epsilon;
+    options.earlyOut = g_earlyOut;
+    options.mask = g_maskDir.isEmpty() ? nullptr : &mask;
+    const bool match = js ? diff(*js, a, b, options, &result.stats)
+            : diff(a, b, options, &result.stats);
+    if (result.stats.sizeMismatch) {
+        result.status = Result::Status::INCOMPATIBLE;
+    } else if (!match) {
+        result.status = Result::Status::MISMATCH;
+        if (options.mask) {
+            writeMask(mask, name);
+        }
+    }
+    return result;
+}
+
+static void printResult(const std::string& name, const Result& result) {
+    const DiffStatistics& stats = result.stats;
+    switch (result.status) {
+        case Result::Status::MISSING:
+            printf("%s: missing\n", name.c_str());
+            return;
+        case Result::Status::UNREADABLE:
+            printf("%s: unreadable\n", name.c_str());
+            return;
+        case Result::Status::INCOMPATIBLE:
+            printf("%s: dimensions or channel counts differ\n", name.c_str());
+            return;
+        case Result::Status::MATCH:
+            if (g_quietMode) {
+                return;
+            }
+            printf("%s: match", name.c_str());
+            break;
+        case Result::Status::MISMATCH:
+            printf("%s: %zu pixels differ (%.3f%%)", name.c_str(), stats.mismatchCount,
+                    100.0 * stats.mismatchCount / std::max(stats.pixelCount, size_t(1)));
+            break;
+    }
+    printf(", max %g (%.1f levels), mean %g, PSNR %.2f dB%s\n", stats.maxDiff,
+            stats.maxDiff * 255.0f, stats.meanDiff, stats.psnr,
+            stats.complete ? "" : " (partial)");
+
+    if (g_histogram) {
+        for (size_t c = 0; c < DiffStatistics::MAX_CHANNELS; ++c) {
+            const uint32_t* histogram = stats.histogram[c];
+            if (std::all_of(histogram, histogram + DiffStatistics::HISTOGRAM_SIZE,
+                    [](uint32_t count) { return count == 0; })) {
+                break;
+            }
+            printf("    channel %zu:", c);
+            for (size_t i = 0; i < DiffStatistics::HISTOGRAM_SIZE; ++i) {
+                if (histogram[i]) {
+                    printf(" %zu:%u", i, histogram[i]);
+                }
+            }
+            printf("\n");
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+    int numArgs = argc - optionIndex;
+    if (numArgs < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    Path golden(argv[optionIndex++]);
+    Path candidate(argv[optionIndex]);
+    if (!golden.exists()) {
+        cerr << "The input " << golden << " does not exist." << endl;
+        return 1;
+    }
+    if (!g_maskDir.isEmpty()) {
+        g_maskDir.mkdirRecursive();
+    }
+
+    // A single thread compares on the main thread, without a JobSystem. Otherwise the main thread
+    // is adopted and counts as one of the threads.
+    std::unique_ptr<JobSystem> js;
+    if (g_threadCount != 1) {
+        js.reset(new JobSystem(g_threadCount ? g_threadCount - 1 : 0));
+        js->adopt();
+    }
+
+    vector<std::string> names;
+    vector<Result> results;
+    if (golden.isDirectory()) {
+        listImages(golden, "", names);
+        std::sort(names.begin(), names.end());
+        if (names.empty()) {
+            cerr << "No images found in " << golden << "." << endl;
+            if (js) {
+                js->emancipate();
+            }
+            return 1;
+        }
+        results.resize(names.size());
+
+        // Images are compared concurrently, each one on a single thread.
+        auto compareRange = [&](uint32_t start, uint32_t count) {
+            for (uint32_t i = start; i < start + count; ++i) {
+                results[i] = compareImages(nullptr, golden + names[i], candidate + names[i],
+                        names[i]);
+            }
+        };
+        if (js) {
+            JobSystem::Job* job = jobs::parallel_for(*js, nullptr, 0, uint32_t(names.size()),
+                    [&compareRange](uint32_t start, uint32_t count) {
+                        compareRange(start, count);
+                    }, jobs::CountSplitter<1>());
+            js->runAndWait(job);
+        } else {
+            compareRange(0, uint32_t(names.size()));
+        }
+    } else {
+        // A single image is split in tiles that are compared concurrently.
+        names.push_back(golden.getName());
+        results.push_back(compareImages(js.get(), golden, candidate, golden.getName()));
+    }
+
+    if (js) {
+        js->emancipate();
+    }
+
+    size_t failures = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        printResult(names[i], results[i]);
+        failures += results[i].status != Result::Status::MATCH;
+    }
+    if (names.size() > 1) {
+        printf("%zu of %zu images differ\n", failures, names.size());
+    }
+    return failures ? 1 : 0;
+}
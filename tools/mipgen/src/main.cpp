@@ -27,6 +27,7 @@
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
@@ -103,6 +104,7 @@ R"TXT(
                          srgb8_alpha, rgba8, or srgb8_alpha8
                METRIC is rgba, rgbx, rec709, numeric, or normalxyz
                EFFORT is an integer between 0 and 100
+             append _tN to compress with N threads, e.g. s3tc_rgba_dxt5_t4
 )TXT"
 #endif
 R"TXT(
@@ -316,7 +318,9 @@ int main(int argc, char* argv[]) {
     uint32_t count = getMipmapCount(sourceImage);
     count = g_mipLevelCount == 0 ? count : min(g_mipLevelCount - 1, count);
     vector<LinearImage> miplevels(count);
-    generateMipmaps(sourceImage, g_filter, miplevels.data(), count);
+    utils::JobSystem js;
+    js.adopt();
+    generateMipmaps(js, sourceImage, g_filter, miplevels.data(), count);
 
     if (g_ktxContainer) {
         if (!g_quietMode) {
@@ -381,7 +385,7 @@ int main(int argc, char* argv[]) {
                     printf("Starting compression for %s (%dx%d)\n", inputPath.getName().c_str(),
                             image.getWidth(), image.getHeight());
                 }
-                CompressedTexture tex = compressTexture(config, image);
+                CompressedTexture tex = compressTexture(js, config, image);
                 container.setBlob({mip++}, tex.data.get(), tex.size);
                 info.glInternalFormat = (uint32_t) tex.format;
                 return;